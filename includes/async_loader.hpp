@@ -0,0 +1,497 @@
+#pragma once
+#include "mapped_dataset.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <linux/io_uring.h>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <vector>
+
+// =================== CARGA ASÍNCRONA CON IO_URING ===================
+//
+// Lee archivos en bloques grandes con varias lecturas en vuelo a la vez
+// (io_uring, opcionalmente con O_DIRECT sobre buffers alineados) y avisa
+// al llamador a medida que se completa el prefijo del archivo, para que
+// normalice o inserte lo ya leído mientras el dispositivo sigue leyendo.
+// Si io_uring no está disponible (kernel antiguo, seccomp, sysctl
+// io_uring_disabled) se usa pread() bloque a bloque con la misma interfaz.
+// No depende de liburing: el anillo se maneja con las llamadas al sistema.
+
+namespace async_io {
+
+enum class Backend { Auto, Uring, Pread };
+
+inline const char *backend_name(Backend b) {
+    switch (b) {
+    case Backend::Uring: return "io_uring";
+    case Backend::Pread: return "pread";
+    default: return "auto";
+    }
+}
+
+inline Backend parse_backend(const std::string &s) {
+    if (s == "auto") return Backend::Auto;
+    if (s == "uring" || s == "io_uring") return Backend::Uring;
+    if (s == "pread") return Backend::Pread;
+    throw std::invalid_argument("Backend de lectura desconocido: " + s + " (auto|uring|pread)");
+}
+
+struct LoadOptions {
+    Backend backend = Backend::Auto;  // uring cae a pread si el kernel no lo permite
+    bool direct = false;              // O_DIRECT (cae a lectura normal si el FS no lo admite)
+    size_t block_bytes = 4u << 20;    // tamaño de cada lectura
+    unsigned depth = 8;               // lecturas en vuelo
+};
+
+struct LoadReport {
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+    Backend backend = Backend::Pread;  // el que se usó realmente
+    bool direct = false;
+    unsigned depth = 1;
+    uint64_t fallbacks = 0;            // bloques completados con pread tras un fallo/lectura corta
+
+    double gb_per_s() const { return seconds > 0 ? bytes / 1e9 / seconds : 0.0; }
+
+    void add(const LoadReport &o) {
+        if (bytes == 0) {
+            backend = o.backend;
+            direct = o.direct;
+            depth = o.depth;
+        }
+        bytes += o.bytes;
+        seconds += o.seconds;
+        fallbacks += o.fallbacks;
+    }
+
+    std::string describe() const {
+        std::ostringstream ss;
+        ss << backend_name(backend);
+        if (backend == Backend::Uring) ss << " (" << depth << " en vuelo)";
+        if (direct) ss << ", O_DIRECT";
+        ss << ": " << (bytes / 1048576.0) << " MB en " << seconds << " s (" << gb_per_s() << " GB/s)";
+        return ss.str();
+    }
+
+    void write_csv(std::ostream &out, const std::string &prefix) const {
+        out << prefix << "backend," << backend_name(backend) << "\n";
+        out << prefix << "direct," << (direct ? 1 : 0) << "\n";
+        out << prefix << "bytes," << bytes << "\n";
+        out << prefix << "s," << seconds << "\n";
+        out << prefix << "gb_s," << gb_per_s() << "\n";
+    }
+};
+
+// Se llama en orden con el número de bytes ya leídos desde el inicio del rango
+using ProgressFn = std::function<void(size_t done_bytes)>;
+
+namespace detail {
+
+constexpr size_t DIRECT_ALIGN = 4096;
+
+inline uint64_t align_down(uint64_t v) { return v / DIRECT_ALIGN * DIRECT_ALIGN; }
+inline uint64_t align_up(uint64_t v) { return align_down(v + DIRECT_ALIGN - 1); }
+
+inline void pread_full(int fd, char *p, size_t n, uint64_t off) {
+    while (n > 0) {
+        ssize_t r = ::pread(fd, p, n, off);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("pread: ") + std::strerror(errno));
+        }
+        if (r == 0) throw std::runtime_error("Archivo truncado durante la lectura");
+        p += r;
+        n -= size_t(r);
+        off += uint64_t(r);
+    }
+}
+
+struct AlignedFree {
+    void operator()(char *p) const { std::free(p); }
+};
+
+// Anillo io_uring mínimo: solo lecturas (IORING_OP_READV) y espera de
+// completados. Un único hilo envía y recoge, así que basta con ordenar
+// las colas con acquire/release frente al kernel.
+class Ring {
+private:
+    int fd = -1;
+    void *sq_ptr = nullptr;
+    void *cq_ptr = nullptr;
+    size_t sq_len = 0, cq_len = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqes_len = 0;
+    unsigned *sq_tail = nullptr, *sq_mask = nullptr, *sq_array = nullptr;
+    unsigned *cq_head = nullptr, *cq_tail = nullptr, *cq_mask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    unsigned entries = 0;
+
+public:
+    Ring() = default;
+    Ring(const Ring &) = delete;
+    Ring &operator=(const Ring &) = delete;
+    ~Ring() { release(); }
+
+    // false si el kernel no ofrece io_uring o no da 'depth' entradas
+    bool init(unsigned depth) {
+        io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        int r = int(::syscall(__NR_io_uring_setup, depth, &p));
+        if (r < 0) return false;
+        fd = r;
+        entries = p.sq_entries;
+
+        sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sq_len = cq_len = std::max(sq_len, cq_len);
+
+        sq_ptr = ::mmap(nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                        IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            sq_ptr = nullptr;
+            release();
+            return false;
+        }
+        if (single) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = ::mmap(nullptr, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) {
+                cq_ptr = nullptr;
+                release();
+                return false;
+            }
+        }
+        sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+        void *s = ::mmap(nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                         IORING_OFF_SQES);
+        if (s == MAP_FAILED) {
+            release();
+            return false;
+        }
+        sqes = static_cast<io_uring_sqe *>(s);
+
+        char *sq = static_cast<char *>(sq_ptr);
+        char *cq = static_cast<char *>(cq_ptr);
+        sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sq_mask = reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cq_mask = reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+        return entries >= depth;
+    }
+
+    // Encola y envía una lectura; iov debe seguir vivo hasta su completado
+    void submit_read(int file, const iovec *iov, uint64_t offset, uint64_t user_data) {
+        unsigned tail = *sq_tail;
+        unsigned idx = tail & *sq_mask;
+        io_uring_sqe *sqe = &sqes[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = file;
+        sqe->addr = reinterpret_cast<uint64_t>(iov);
+        sqe->len = 1;
+        sqe->off = offset;
+        sqe->user_data = user_data;
+        sq_array[idx] = idx;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        enter(1, 0);
+    }
+
+    // Saca un completado; con wait bloquea hasta que haya uno
+    bool pop(io_uring_cqe &out, bool wait) {
+        for (;;) {
+            unsigned head = *cq_head;
+            unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+            if (head != tail) {
+                out = cqes[head & *cq_mask];
+                __atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+            if (!wait) return false;
+            enter(0, 1);
+        }
+    }
+
+private:
+    void enter(unsigned to_submit, unsigned min_complete) {
+        unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+        for (;;) {
+            long r = ::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+            if (r >= 0) return;
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+            throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+        }
+    }
+
+    void release() {
+        if (sqes) ::munmap(sqes, sqes_len);
+        if (cq_ptr && cq_ptr != sq_ptr) ::munmap(cq_ptr, cq_len);
+        if (sq_ptr) ::munmap(sq_ptr, sq_len);
+        if (fd >= 0) ::close(fd);
+        sqes = nullptr;
+        sq_ptr = cq_ptr = nullptr;
+        fd = -1;
+    }
+};
+
+} // namespace detail
+
+// Archivo abierto para lecturas grandes; read() se puede llamar varias
+// veces (p.ej. un bloque de filas cada vez) y el informe se acumula
+class FileReader {
+private:
+    struct Slot {
+        size_t block = 0;         // bloque que ocupa la ranura
+        uint64_t start = 0;       // rango útil [start, end) del archivo
+        uint64_t end = 0;
+        uint64_t read_start = 0;  // rango realmente pedido (alineado con O_DIRECT)
+        bool bounce = false;      // se lee en 'buffer' y se copia al destino
+        bool done = false;
+        iovec iov{};
+        std::unique_ptr<char, detail::AlignedFree> buffer;
+    };
+
+    std::string path;
+    int fd = -1;
+    int plain_fd = -1;  // sin O_DIRECT: lecturas cortas y reintentos
+    uint64_t file_bytes = 0;
+    LoadOptions opt;
+    std::unique_ptr<detail::Ring> ring;
+    std::vector<Slot> slots;
+    LoadReport rep;
+
+public:
+    FileReader(const std::string &p, const LoadOptions &o) : path(p), opt(o) {
+        opt.depth = std::max(1u, opt.depth);
+        opt.block_bytes = std::max(detail::DIRECT_ALIGN, detail::align_down(opt.block_bytes));
+
+        plain_fd = ::open(path.c_str(), O_RDONLY);
+        if (plain_fd < 0) throw std::runtime_error("No se pudo abrir: " + path);
+        struct stat sb;
+        if (::fstat(plain_fd, &sb) != 0) {
+            ::close(plain_fd);
+            throw std::runtime_error("No se pudo obtener tamaño: " + path);
+        }
+        file_bytes = uint64_t(sb.st_size);
+
+        fd = plain_fd;
+        if (opt.direct) {
+            int dfd = ::open(path.c_str(), O_RDONLY | O_DIRECT);
+            if (dfd >= 0) fd = dfd;
+        }
+        rep.direct = fd != plain_fd;
+        if (!rep.direct) ::posix_fadvise(plain_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+        if (opt.backend != Backend::Pread) {
+            ring.reset(new detail::Ring());
+            if (!ring->init(opt.depth)) ring.reset();
+        }
+        rep.backend = ring ? Backend::Uring : Backend::Pread;
+        rep.depth = ring ? opt.depth : 1;
+        slots.resize(ring ? opt.depth : 1);
+    }
+
+    FileReader(const FileReader &) = delete;
+    FileReader &operator=(const FileReader &) = delete;
+
+    ~FileReader() {
+        ring.reset();  // cierra el anillo antes que los descriptores
+        if (fd != plain_fd && fd >= 0) ::close(fd);
+        if (plain_fd >= 0) ::close(plain_fd);
+    }
+
+    uint64_t size() const { return file_bytes; }
+    int descriptor() const { return plain_fd; }
+    const LoadReport &report() const { return rep; }
+
+    // Lee [offset, offset + bytes) del archivo en dst. progress recibe,
+    // en orden, cuántos bytes del principio de dst ya son válidos.
+    void read(void *dst, size_t bytes, uint64_t offset, const ProgressFn &progress = nullptr) {
+        if (offset + bytes > file_bytes)
+            throw std::runtime_error("Lectura fuera del archivo: " + path);
+        if (bytes == 0) return;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        char *out = static_cast<char *>(dst);
+        size_t blocks = (bytes + opt.block_bytes - 1) / opt.block_bytes;
+
+        if (!ring) {
+            // pread() bloque a bloque
+            Slot &s = slots[0];
+            for (size_t b = 0; b < blocks; b++) {
+                prepare(s, b, out, bytes, offset);
+                if (s.bounce) {
+                    ssize_t got = pread_some(s);
+                    finish(s, out, offset, got);
+                } else {
+                    detail::pread_full(plain_fd, out + (s.start - offset), s.end - s.start, s.start);
+                }
+                if (progress) progress(size_t(s.end - offset));
+            }
+        } else {
+            // Hasta 'depth' bloques en vuelo; se entregan en orden de archivo
+            // y cada ranura se reutiliza para el bloque b + depth
+            size_t depth = slots.size();
+            size_t submitted = 0;
+            size_t in_flight = 0;
+            try {
+                for (; submitted < std::min(blocks, depth); submitted++) {
+                    submit(slots[submitted], submitted, out, bytes, offset);
+                    in_flight++;
+                }
+                for (size_t next = 0; next < blocks; next++) {
+                    Slot &s = slots[next % depth];
+                    while (!s.done) {
+                        io_uring_cqe cqe;
+                        ring->pop(cqe, true);
+                        in_flight--;
+                        Slot &c = slots[cqe.user_data % depth];
+                        finish(c, out, offset, cqe.res);
+                    }
+                    if (progress) progress(size_t(s.end - offset));
+                    if (submitted < blocks) {
+                        submit(s, submitted, out, bytes, offset);
+                        submitted++;
+                        in_flight++;
+                    }
+                }
+            } catch (...) {
+                // El kernel sigue escribiendo en dst y en los buffers de las
+                // ranuras hasta completar cada lectura enviada: se recogen
+                // todas antes de que el llamador pueda liberarlos
+                drain(in_flight);
+                throw;
+            }
+        }
+        rep.bytes += bytes;
+        rep.seconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+    }
+
+private:
+    // Decide si el bloque b se lee directamente en el destino o en el
+    // buffer alineado de la ranura (O_DIRECT con destino/offset desalineado)
+    void prepare(Slot &s, size_t b, char *out, size_t bytes, uint64_t offset) {
+        s.block = b;
+        s.done = false;
+        s.start = offset + uint64_t(b) * opt.block_bytes;
+        s.end = std::min<uint64_t>(offset + bytes, s.start + opt.block_bytes);
+        char *target = out + (s.start - offset);
+        s.bounce = rep.direct && (s.start % detail::DIRECT_ALIGN != 0 ||
+                                  (s.end - s.start) % detail::DIRECT_ALIGN != 0 ||
+                                  reinterpret_cast<uintptr_t>(target) % detail::DIRECT_ALIGN != 0);
+        if (s.bounce) {
+            s.read_start = detail::align_down(s.start);
+            size_t len = size_t(detail::align_up(s.end) - s.read_start);
+            if (!s.buffer) {
+                void *raw = nullptr;
+                if (posix_memalign(&raw, detail::DIRECT_ALIGN, opt.block_bytes + 2 * detail::DIRECT_ALIGN) != 0)
+                    throw std::runtime_error("posix_memalign falló");
+                s.buffer.reset(static_cast<char *>(raw));
+            }
+            s.iov.iov_base = s.buffer.get();
+            s.iov.iov_len = len;
+        } else {
+            s.read_start = s.start;
+            s.iov.iov_base = target;
+            s.iov.iov_len = size_t(s.end - s.start);
+        }
+    }
+
+    // Espera (y descarta) los completados de las lecturas aún en vuelo
+    void drain(size_t in_flight) {
+        io_uring_cqe cqe;
+        for (; in_flight > 0; in_flight--) ring->pop(cqe, true);
+    }
+
+    void submit(Slot &s, size_t b, char *out, size_t bytes, uint64_t offset) {
+        prepare(s, b, out, bytes, offset);
+        ring->submit_read(fd, &s.iov, s.read_start, b);
+    }
+
+    ssize_t pread_some(const Slot &s) {
+        for (;;) {
+            ssize_t r = ::pread(fd, s.iov.iov_base, s.iov.iov_len, s.read_start);
+            if (r >= 0 || errno != EINTR) return r;
+        }
+    }
+
+    // Copia lo útil del buffer alineado y completa con pread() lo que
+    // falte (error del anillo, lectura corta o final del archivo)
+    void finish(Slot &s, char *out, uint64_t offset, ssize_t got) {
+        uint64_t valid_end = s.start;
+        if (got > 0) valid_end = std::min<uint64_t>(s.end, s.read_start + uint64_t(got));
+        if (s.bounce && valid_end > s.start)
+            std::memcpy(out + (s.start - offset), s.buffer.get() + (s.start - s.read_start),
+                        valid_end - s.start);
+        if (valid_end < s.end) {
+            rep.fallbacks++;
+            detail::pread_full(plain_fd, out + (valid_end - offset), s.end - valid_end, valid_end);
+        }
+        s.done = true;
+    }
+};
+
+// Archivo completo como arreglo de T (embeddings, ids, queries)
+template <typename T>
+std::vector<T> load_array(const std::string &path, const LoadOptions &opt = LoadOptions(),
+                          LoadReport *report = nullptr) {
+    FileReader file(path, opt);
+    if (file.size() % sizeof(T) != 0)
+        throw std::runtime_error("Tamaño de archivo incorrecto: " + path);
+    std::vector<T> data(file.size() / sizeof(T));
+    file.read(data.data(), file.size(), 0);
+    if (report) report->add(file.report());
+    return data;
+}
+
+// Embeddings en memoria anónima (alineada a página, así O_DIRECT lee sin
+// copias). on_rows(first, count) recibe cada tramo de filas completas en
+// cuanto llega, mientras siguen en vuelo las lecturas de los siguientes.
+inline MappedDataset load_dataset(const std::string &path, int dim, const LoadOptions &opt,
+                                  LoadReport *report = nullptr,
+                                  const std::function<void(float *, size_t, size_t)> &on_rows = nullptr) {
+    FileReader file(path, opt);
+    size_t row_bytes = sizeof(float) * dim;
+    if (file.size() % row_bytes != 0)
+        throw std::runtime_error("Tamaño de archivo incorrecto para dim=" + std::to_string(dim));
+    MappedFile memory = MappedFile::anonymous(file.size());
+    float *base = static_cast<float *>(memory.data());
+    size_t rows_done = 0;
+    file.read(memory.data(), file.size(), 0, [&](size_t done_bytes) {
+        size_t rows = done_bytes / row_bytes;
+        if (on_rows && rows > rows_done) on_rows(base, rows_done, rows - rows_done);
+        rows_done = rows;
+    });
+    if (report) report->add(file.report());
+    return MappedDataset(std::move(memory), dim);
+}
+
+inline MappedIds load_ids(const std::string &path, const LoadOptions &opt, LoadReport *report = nullptr) {
+    FileReader file(path, opt);
+    if (file.size() % sizeof(uint64_t) != 0)
+        throw std::runtime_error("Tamaño de archivo incorrecto para IDs");
+    MappedFile memory = MappedFile::anonymous(file.size());
+    file.read(memory.data(), file.size(), 0);
+    if (report) report->add(file.report());
+    return MappedIds(std::move(memory));
+}
+
+} // namespace async_io
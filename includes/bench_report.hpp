@@ -0,0 +1,345 @@
+#pragma once
+
+#include "cpu_topology.hpp"
+#include "simd_distance.hpp"
+#include <sys/utsname.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// =================== ENTORNO Y ESTADÍSTICA DE BENCHMARKS ===================
+//
+// Captura del entorno que más mueve las mediciones (modelo de CPU,
+// governor de frecuencia, transparent huge pages, kernel, nivel SIMD) y
+// resumen de ensayos repetidos con media, desviación e intervalo de
+// confianza del 95 % (t de Student). Lo usan hnsw_bench, el generador de
+// carga y las herramientas de consulta (RunReport) para que cada corrida
+// quede documentada junto a sus números.
+
+namespace bench {
+
+namespace detail {
+
+inline std::string read_first_line(const std::string &path) {
+    std::ifstream f(path);
+    std::string line;
+    if (!f || !std::getline(f, line)) return "n/a";
+    return line;
+}
+
+// "always [madvise] never" -> "madvise"
+inline std::string bracketed(const std::string &s) {
+    size_t a = s.find('['), b = s.find(']');
+    if (a == std::string::npos || b == std::string::npos || b < a) return s;
+    return s.substr(a + 1, b - a - 1);
+}
+
+inline std::string cpu_model() {
+    std::ifstream f("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.compare(0, 10, "model name") != 0) continue;
+        size_t p = line.find(':');
+        if (p == std::string::npos) break;
+        size_t s = line.find_first_not_of(' ', p + 1);
+        return s == std::string::npos ? "n/a" : line.substr(s);
+    }
+    return "n/a";
+}
+
+}  // namespace detail
+
+inline std::string iso_timestamp() {
+    std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+    std::tm tm;
+    localtime_r(&now, &tm);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &tm);
+    return buf;
+}
+
+// Escapa una cadena para JSON (comillas incluidas)
+inline std::string json_string(const std::string &s) {
+    std::string out = "\"";
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+struct Environment {
+    std::vector<std::pair<std::string, std::string>> fields;  // en orden de captura
+
+    static Environment capture() {
+        Environment env;
+        struct utsname u;
+        bool has_uname = uname(&u) == 0;
+        char host[256] = {0};
+        if (gethostname(host, sizeof(host) - 1) != 0) host[0] = '\0';
+
+        env.add("timestamp", iso_timestamp());
+        env.add("hostname", host[0] ? host : "n/a");
+        env.add("kernel", has_uname ? std::string(u.sysname) + " " + u.release : "n/a");
+        env.add("arch", has_uname ? u.machine : "n/a");
+        env.add("cpu_model", detail::cpu_model());
+        env.add("topology", CpuTopology::get().summary());
+        env.add("simd", CpuFeatures::name(CpuFeatures::detect()));
+        env.add("governor",
+                detail::read_first_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"));
+        env.add("thp", detail::bracketed(
+                           detail::read_first_line("/sys/kernel/mm/transparent_hugepage/enabled")));
+        env.add("thp_defrag", detail::bracketed(
+                                  detail::read_first_line("/sys/kernel/mm/transparent_hugepage/defrag")));
+        env.add("no_turbo", detail::read_first_line("/sys/devices/system/cpu/intel_pstate/no_turbo"));
+        env.add("compiler", __VERSION__);
+        return env;
+    }
+
+    void add(const std::string &key, const std::string &value) { fields.emplace_back(key, value); }
+
+    std::string get(const std::string &key) const {
+        for (const auto &f : fields)
+            if (f.first == key) return f.second;
+        return "n/a";
+    }
+
+    // Condiciones conocidas por añadir ruido a las mediciones
+    std::vector<std::string> warnings() const {
+        std::vector<std::string> w;
+        std::string gov = get("governor");
+        if (gov != "n/a" && gov != "performance")
+            w.push_back("governor '" + gov + "': la frecuencia varía entre ensayos (usar performance)");
+        if (get("no_turbo") == "0")
+            w.push_back("turbo activo: la frecuencia depende de la temperatura y de los núcleos ocupados");
+        return w;
+    }
+
+    void print(std::ostream &os) const {
+        for (const auto &f : fields) os << "  " << f.first << ": " << f.second << "\n";
+        for (const auto &w : warnings()) os << "  AVISO: " << w << "\n";
+    }
+
+    void write_json(std::ostream &os, const std::string &indent = "  ") const {
+        os << "{\n";
+        for (size_t i = 0; i < fields.size(); i++) {
+            os << indent << "  " << json_string(fields[i].first) << ": "
+               << json_string(fields[i].second) << (i + 1 < fields.size() ? ",\n" : "\n");
+        }
+        os << indent << "}";
+    }
+
+    void write_csv(std::ostream &os, const std::string &prefix = "env_") const {
+        for (const auto &f : fields) {
+            std::string v = f.second;
+            std::replace(v.begin(), v.end(), ',', ';');
+            os << prefix << f.first << "," << v << "\n";
+        }
+    }
+};
+
+// Valor crítico bilateral al 95 % de la t de Student con df grados de libertad
+inline double t_critical_95(size_t df) {
+    static const double table[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306,
+                                     2.262,  2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+                                     2.110,  2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064,
+                                     2.060,  2.056, 2.052, 2.048, 2.045, 2.042};
+    if (df == 0) return 0.0;
+    if (df <= 30) return table[df - 1];
+    if (df <= 60) return 2.000;
+    if (df <= 120) return 1.980;
+    return 1.960;
+}
+
+// Resumen de n ensayos de una métrica. ci95 es la semiamplitud del
+// intervalo: el valor real está en [mean - ci95, mean + ci95] con 95 % de
+// confianza si los ensayos son independientes.
+struct SampleStats {
+    size_t n = 0;
+    double mean = 0.0;
+    double stddev = 0.0;  // muestral (n - 1)
+    double ci95 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+
+    static SampleStats of(const std::vector<double> &v) {
+        SampleStats s;
+        s.n = v.size();
+        if (v.empty()) return s;
+        double sum = 0.0;
+        for (double x : v) sum += x;
+        s.mean = sum / v.size();
+        s.min = *std::min_element(v.begin(), v.end());
+        s.max = *std::max_element(v.begin(), v.end());
+        // Ensayos idénticos (p. ej. recall): sin ruido de redondeo en la desviación
+        if (v.size() > 1 && s.max > s.min) {
+            double sq = 0.0;
+            for (double x : v) sq += (x - s.mean) * (x - s.mean);
+            s.stddev = std::sqrt(sq / (v.size() - 1));
+            s.ci95 = t_critical_95(v.size() - 1) * s.stddev / std::sqrt(double(v.size()));
+        }
+        return s;
+    }
+
+    double low() const { return mean - ci95; }
+    double high() const { return mean + ci95; }
+    // Coeficiente de variación en %
+    double cv_pct() const { return mean != 0.0 ? 100.0 * stddev / std::fabs(mean) : 0.0; }
+};
+
+// Reporte de una corrida única de una herramienta de consulta. Escribe
+// <prefijo>.json (entorno, configuración, métricas y tablas) y
+// <prefijo>_summary.csv en el formato de resumen de hnsw_bench (una fila
+// por métrica con n = 1), así `hnsw_bench compare` contrasta dos corridas
+// de hnswn_query_basic o hnsw_query_optimized igual que dos escenarios.
+//
+// rows() recibe filas "clave,valor" como las de los write_csv existentes:
+// al guardar, los valores numéricos pasan a métricas y el resto a
+// configuración. config() fuerza un valor numérico a configuración (k, ef,
+// threads...) para que no aparezca como métrica comparable.
+class RunReport {
+private:
+    std::string tool_;
+    std::string scenario_;
+    std::vector<std::pair<std::string, std::string>> config_;
+    std::ostringstream rows_;
+    std::vector<std::pair<std::string, std::unique_ptr<std::ostringstream>>> tables_;
+
+    static bool parse_number(const std::string &s, double &out) {
+        if (s.empty()) return false;
+        char *end = nullptr;
+        out = std::strtod(s.c_str(), &end);
+        return end == s.c_str() + s.size() && std::isfinite(out);
+    }
+
+    static std::vector<std::string> split(const std::string &line) {
+        std::vector<std::string> out;
+        std::stringstream ss(line);
+        std::string part;
+        while (std::getline(ss, part, ',')) out.push_back(part);
+        if (!line.empty() && line.back() == ',') out.emplace_back();
+        return out;
+    }
+
+    // Celda de tabla: número tal cual, vacía como null, el resto como cadena
+    static std::string json_value(const std::string &s) {
+        double v;
+        if (s.empty()) return "null";
+        return parse_number(s, v) ? s : json_string(s);
+    }
+
+    // Reparte las filas de rows() en configuración y métricas
+    void collect(std::vector<std::pair<std::string, std::string>> &config,
+                 std::vector<std::pair<std::string, double>> &metrics) const {
+        config = config_;
+        std::istringstream in(rows_.str());
+        std::string line;
+        while (std::getline(in, line)) {
+            size_t comma = line.find(',');
+            if (comma == std::string::npos) continue;
+            std::string key = line.substr(0, comma), value = line.substr(comma + 1);
+            double v;
+            if (parse_number(value, v))
+                metrics.emplace_back(key, v);
+            else
+                config.emplace_back(key, value);
+        }
+    }
+
+public:
+    RunReport(const std::string &tool, const std::string &scenario) : tool_(tool), scenario_(scenario) {
+        if (scenario.empty() || scenario.find(',') != std::string::npos)
+            throw std::runtime_error("Nombre de escenario inválido para el reporte: '" + scenario + "'");
+        rows_ << std::setprecision(10);
+    }
+
+    std::ostream &rows() { return rows_; }
+
+    template <typename T>
+    void config(const std::string &key, const T &value) {
+        std::ostringstream ss;
+        ss << value;
+        config_.emplace_back(key, ss.str());
+    }
+
+    // Tabla CSV adjunta al JSON (p. ej. estadísticas por hilo): la primera
+    // línea escrita es la cabecera
+    std::ostream &table(const std::string &name) {
+        tables_.emplace_back(name, std::unique_ptr<std::ostringstream>(new std::ostringstream()));
+        *tables_.back().second << std::setprecision(10);
+        return *tables_.back().second;
+    }
+
+    void write(const std::string &prefix, const Environment &env) const {
+        std::vector<std::pair<std::string, std::string>> config;
+        std::vector<std::pair<std::string, double>> metrics;
+        collect(config, metrics);
+
+        std::ofstream js(prefix + ".json");
+        if (!js) throw std::runtime_error("No se pudo crear: " + prefix + ".json");
+        js << std::setprecision(10);
+        js << "{\n  \"tool\": " << json_string(tool_) << ",\n  \"scenario\": " << json_string(scenario_)
+           << ",\n  \"environment\": ";
+        env.write_json(js);
+        js << ",\n  \"config\": {";
+        for (size_t i = 0; i < config.size(); i++)
+            js << (i ? ",\n    " : "\n    ") << json_string(config[i].first) << ": "
+               << json_string(config[i].second);
+        js << "\n  },\n  \"metrics\": {";
+        for (size_t i = 0; i < metrics.size(); i++)
+            js << (i ? ",\n    " : "\n    ") << json_string(metrics[i].first) << ": " << metrics[i].second;
+        js << "\n  },\n  \"tables\": {";
+        for (size_t t = 0; t < tables_.size(); t++) {
+            std::istringstream in(tables_[t].second->str());
+            std::string line;
+            std::vector<std::string> header;
+            if (std::getline(in, line)) header = split(line);
+            js << (t ? ",\n    " : "\n    ") << json_string(tables_[t].first) << ": [";
+            bool first = true;
+            while (std::getline(in, line)) {
+                if (line.empty()) continue;
+                std::vector<std::string> cells = split(line);
+                js << (first ? "\n      {" : ",\n      {");
+                for (size_t c = 0; c < cells.size() && c < header.size(); c++)
+                    js << (c ? ", " : "") << json_string(header[c]) << ": " << json_value(cells[c]);
+                js << "}";
+                first = false;
+            }
+            js << "\n    ]";
+        }
+        js << "\n  }\n}\n";
+
+        std::ofstream csv(prefix + "_summary.csv");
+        if (!csv) throw std::runtime_error("No se pudo crear: " + prefix + "_summary.csv");
+        csv << std::setprecision(10) << "scenario,metric,mean,stddev,ci95,min,max,n\n";
+        for (const auto &m : metrics)
+            csv << scenario_ << "," << m.first << "," << m.second << ",0,0," << m.second << ","
+                << m.second << ",1\n";
+    }
+};
+
+}  // namespace bench
@@ -0,0 +1,128 @@
+#pragma once
+#include "results_io.hpp"
+#include "simd_distance.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// =================== K-NN EXACTO POR BLOQUES ===================
+//
+// Top-k exacto con la misma distancia que usa el índice (L2 al cuadrado, o
+// 1 - coseno para ip). Cada thread toma un grupo de queries y recorre la
+// base por bloques de filas: el bloque se lee de memoria una vez y se
+// reutiliza desde caché para todas las queries del grupo.
+
+class BruteForce {
+public:
+    struct Options {
+        Metric metric = Metric::L2;
+        int dim = 0;
+        size_t k = 10;
+        int num_threads = 1;
+        size_t block_rows = 4096;
+        size_t query_block = 16;
+        bool progress = false;
+        SimdLevel level = CpuFeatures::detect();
+    };
+
+    // row(i) -> const float* del vector base i; label(i) -> etiqueta.
+    // Para ip las queries deben venir normalizadas; la base no hace falta.
+    template <typename RowFn, typename LabelFn>
+    static KnnResults search(size_t N, RowFn row, LabelFn label, const float *queries, size_t nq,
+                             const Options &opt) {
+        const int dim = opt.dim;
+        const size_t k = opt.k;
+        const size_t block_rows = std::max<size_t>(1, opt.block_rows);
+        const size_t query_block = std::max<size_t>(1, opt.query_block);
+        RawDistFn raw = DistanceKernels::raw(opt.metric, opt.level);
+
+        #ifdef _OPENMP
+        omp_set_num_threads(std::max(1, opt.num_threads));
+        #endif
+
+        // ip: normas inversas de la base para obtener 1 - coseno
+        std::vector<float> inv_norm;
+        if (opt.metric == Metric::IP) {
+            inv_norm.resize(N);
+            #ifdef _OPENMP
+            #pragma omp parallel for schedule(static)
+            #endif
+            for (size_t i = 0; i < N; i++) {
+                float n2 = raw(row(i), row(i), dim);
+                inv_norm[i] = n2 > 0 ? 1.0f / std::sqrt(n2) : 0.0f;
+            }
+        }
+
+        KnnResults out(nq, k);
+        size_t num_qblocks = (nq + query_block - 1) / query_block;
+        std::atomic<size_t> blocks_done{0};
+
+        #ifdef _OPENMP
+        #pragma omp parallel
+        #endif
+        {
+            std::vector<std::vector<Candidate>> heaps(query_block);
+            for (auto &h : heaps) h.reserve(k + 1);
+
+            #ifdef _OPENMP
+            #pragma omp for schedule(dynamic, 1)
+            #endif
+            for (size_t qb = 0; qb < num_qblocks; qb++) {
+                size_t q0 = qb * query_block;
+                size_t q1 = std::min(nq, q0 + query_block);
+                for (auto &h : heaps) h.clear();
+
+                for (size_t b0 = 0; b0 < N; b0 += block_rows) {
+                    size_t b1 = std::min(N, b0 + block_rows);
+                    for (size_t q = q0; q < q1; q++) {
+                        const float *qv = queries + q * dim;
+                        std::vector<Candidate> &heap = heaps[q - q0];
+                        if (opt.metric == Metric::L2) {
+                            for (size_t i = b0; i < b1; i++)
+                                push(heap, k, raw(qv, row(i), dim), label(i));
+                        } else {
+                            for (size_t i = b0; i < b1; i++)
+                                push(heap, k, 1.0f - raw(qv, row(i), dim) * inv_norm[i], label(i));
+                        }
+                    }
+                }
+
+                for (size_t q = q0; q < q1; q++) {
+                    std::vector<Candidate> &heap = heaps[q - q0];
+                    std::sort_heap(heap.begin(), heap.end());
+                    for (size_t i = 0; i < heap.size(); i++) {
+                        out.row_ids(q)[i] = heap[i].second;
+                        out.row_dists(q)[i] = heap[i].first;
+                    }
+                }
+
+                size_t done = blocks_done.fetch_add(1) + 1;
+                if (opt.progress && done % 64 == 0)
+                    std::cout << "Progreso: " << std::min(nq, done * query_block) << "/" << nq << "\n";
+            }
+        }
+        return out;
+    }
+
+private:
+    using Candidate = std::pair<float, uint64_t>;  // max-heap por distancia
+
+    static void push(std::vector<Candidate> &heap, size_t k, float d, uint64_t label) {
+        if (heap.size() < k) {
+            heap.emplace_back(d, label);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (d < heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = Candidate(d, label);
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+};
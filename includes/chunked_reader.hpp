@@ -0,0 +1,188 @@
+#pragma once
+#include "async_loader.hpp"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// =================== LECTOR POR BLOQUES CON DOBLE BUFFER ===================
+//
+// Lee embeddings e IDs en bloques de tamaño fijo con un hilo lector que
+// rellena un buffer mientras el consumidor inserta el otro. La memoria
+// total de los dos buffers queda acotada por 'max_buffer_bytes'. Cada
+// bloque se lee con varias lecturas en vuelo (async_loader.hpp).
+
+struct Chunk {
+    const float *vectors = nullptr;
+    const uint64_t *ids = nullptr;
+    size_t first_row = 0;
+    size_t rows = 0;
+};
+
+class ChunkedReader {
+private:
+    struct Slot {
+        std::vector<float> vectors;
+        std::vector<uint64_t> ids;
+        size_t first_row = 0;
+        size_t rows = 0;
+        bool full = false;
+    };
+
+    std::unique_ptr<async_io::FileReader> emb_file;
+    std::unique_ptr<async_io::FileReader> ids_file;
+    int dim = 0;
+    size_t n = 0;
+    size_t chunk_rows = 0;
+
+    Slot slots[2];
+    int consumer_slot = -1;
+    size_t next_consume = 0;
+    bool failed = false;
+    std::string error;
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread reader;
+    bool stopping = false;
+
+    // Estadísticas
+    double read_time_s = 0.0;
+    double consumer_wait_s = 0.0;
+    size_t bytes_read = 0;
+
+public:
+    ChunkedReader(const std::string &emb_path, const std::string &ids_path,
+                  int d, size_t max_buffer_bytes,
+                  const async_io::LoadOptions &io = async_io::LoadOptions())
+        : dim(d) {
+        emb_file.reset(new async_io::FileReader(emb_path, io));
+        ids_file.reset(new async_io::FileReader(ids_path, io));
+
+        size_t emb_bytes = emb_file->size();
+        size_t ids_bytes = ids_file->size();
+        size_t row_bytes = sizeof(float) * dim;
+        if (emb_bytes % row_bytes != 0 || ids_bytes % sizeof(uint64_t) != 0)
+            throw std::runtime_error("Tamaño de archivo incorrecto para dim=" +
+                                     std::to_string(dim));
+        n = emb_bytes / row_bytes;
+        if (ids_bytes / sizeof(uint64_t) != n)
+            throw std::runtime_error("Número de embeddings e IDs no coincide");
+
+        // Dos buffers (el que se inserta y el que se está leyendo)
+        size_t per_row = row_bytes + sizeof(uint64_t);
+        chunk_rows = std::max<size_t>(1, max_buffer_bytes / (2 * per_row));
+        chunk_rows = std::min(chunk_rows, std::max<size_t>(n, 1));
+        for (auto &s : slots) {
+            s.vectors.resize(chunk_rows * dim);
+            s.ids.resize(chunk_rows);
+        }
+
+        reader = std::thread([this] { read_loop(); });
+    }
+
+    ChunkedReader(const ChunkedReader &) = delete;
+    ChunkedReader &operator=(const ChunkedReader &) = delete;
+
+    ~ChunkedReader() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        cv.notify_all();
+        if (reader.joinable()) reader.join();
+    }
+
+    size_t total_rows() const { return n; }
+    size_t rows_per_chunk() const { return chunk_rows; }
+    size_t buffer_bytes() const {
+        return 2 * chunk_rows * (sizeof(float) * dim + sizeof(uint64_t));
+    }
+    double read_seconds() const { return read_time_s; }
+    double wait_seconds() const { return consumer_wait_s; }
+    size_t total_bytes_read() const { return bytes_read; }
+
+    // Lecturas de ambos archivos (backend, GB/s); válido al terminar de consumir
+    async_io::LoadReport io_report() const {
+        async_io::LoadReport r = emb_file->report();
+        r.add(ids_file->report());
+        return r;
+    }
+
+    // Devuelve el siguiente bloque; el anterior queda liberado para el lector
+    bool next(Chunk &chunk) {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (consumer_slot >= 0) {
+            slots[consumer_slot].full = false;
+            consumer_slot = -1;
+            cv.notify_all();
+        }
+        if (next_consume * chunk_rows >= n) return false;
+
+        int s = next_consume % 2;
+        auto w0 = std::chrono::high_resolution_clock::now();
+        cv.wait(lock, [&] { return slots[s].full || failed; });
+        auto w1 = std::chrono::high_resolution_clock::now();
+        consumer_wait_s += std::chrono::duration<double>(w1 - w0).count();
+        if (failed) throw std::runtime_error(error);
+
+        consumer_slot = s;
+        next_consume++;
+        chunk.vectors = slots[s].vectors.data();
+        chunk.ids = slots[s].ids.data();
+        chunk.first_row = slots[s].first_row;
+        chunk.rows = slots[s].rows;
+        return true;
+    }
+
+private:
+    void read_loop() {
+        size_t row_bytes = sizeof(float) * dim;
+        for (size_t c = 0; c * chunk_rows < n; c++) {
+            int s = c % 2;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                cv.wait(lock, [&] { return !slots[s].full || stopping; });
+                if (stopping) return;
+            }
+
+            Slot &slot = slots[s];
+            slot.first_row = c * chunk_rows;
+            slot.rows = std::min(chunk_rows, n - slot.first_row);
+            try {
+                auto r0 = std::chrono::high_resolution_clock::now();
+                emb_file->read(slot.vectors.data(), slot.rows * row_bytes,
+                               slot.first_row * row_bytes);
+                ids_file->read(slot.ids.data(), slot.rows * sizeof(uint64_t),
+                               slot.first_row * sizeof(uint64_t));
+                auto r1 = std::chrono::high_resolution_clock::now();
+                read_time_s += std::chrono::duration<double>(r1 - r0).count();
+                bytes_read += slot.rows * (row_bytes + sizeof(uint64_t));
+
+                // Lo ya leído no vuelve a usarse: no retenerlo en la page cache
+                posix_fadvise(emb_file->descriptor(), slot.first_row * row_bytes,
+                              slot.rows * row_bytes, POSIX_FADV_DONTNEED);
+            } catch (const std::exception &e) {
+                std::lock_guard<std::mutex> lock(mtx);
+                failed = true;
+                error = e.what();
+                cv.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                slot.full = true;
+            }
+            cv.notify_all();
+        }
+    }
+};
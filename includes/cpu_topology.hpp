@@ -0,0 +1,210 @@
+#pragma once
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <cctype>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// =================== TOPOLOGÍA DE CPU (SMT / NUMA) ===================
+//
+// Lee /sys/devices/system/{cpu,node} para saber qué CPUs lógicas son
+// hermanas SMT de un mismo núcleo físico y a qué nodo NUMA pertenece cada
+// una. El orden de pinning ocupa primero un hilo por núcleo físico y solo
+// después los hermanos SMT, para que N threads no compartan núcleo
+// mientras queden núcleos libres.
+
+struct LogicalCpu {
+    int cpu = 0;
+    int core = 0;      // core_id dentro del paquete
+    int package = 0;   // socket físico
+    int node = 0;      // nodo NUMA
+    int smt_rank = 0;  // 0 = primer hilo del núcleo, 1 = hermano SMT, ...
+};
+
+enum class PinPolicy { None, Compact, Spread };
+
+inline PinPolicy parse_pin_policy(const std::string &s) {
+    if (s == "none") return PinPolicy::None;
+    if (s == "compact") return PinPolicy::Compact;
+    if (s == "spread") return PinPolicy::Spread;
+    throw std::runtime_error("Política de pinning desconocida: " + s + " (none|compact|spread)");
+}
+
+inline const char *pin_policy_name(PinPolicy p) {
+    switch (p) {
+    case PinPolicy::None: return "none";
+    case PinPolicy::Compact: return "compact";
+    default: return "spread";
+    }
+}
+
+class CpuTopology {
+private:
+    std::vector<LogicalCpu> cpus_;  // solo las CPUs permitidas al proceso
+    int num_nodes_ = 1;
+    int num_cores_ = 0;
+
+    static bool read_int(const std::string &path, int &out) {
+        std::ifstream f(path);
+        return static_cast<bool>(f >> out);
+    }
+
+public:
+    // Formato de /sys: "0-3,8-11"
+    static std::vector<int> parse_list(const std::string &s) {
+        std::vector<int> out;
+        std::stringstream ss(s);
+        std::string part;
+        while (std::getline(ss, part, ',')) {
+            if (part.empty()) continue;
+            size_t dash = part.find('-');
+            int a = std::stoi(part.substr(0, dash));
+            int b = dash == std::string::npos ? a : std::stoi(part.substr(dash + 1));
+            for (int c = a; c <= b; c++) out.push_back(c);
+        }
+        return out;
+    }
+
+    static std::string read_line(const std::string &path) {
+        std::ifstream f(path);
+        std::string s;
+        std::getline(f, s);
+        return s;
+    }
+
+    static CpuTopology detect() {
+        CpuTopology t;
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool have_mask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        // Nodo NUMA de cada CPU
+        std::vector<int> node_of(CPU_SETSIZE, 0);
+        int max_node = 0;
+        if (DIR *d = opendir("/sys/devices/system/node")) {
+            while (dirent *e = readdir(d)) {
+                std::string name = e->d_name;
+                if (name.rfind("node", 0) != 0 || name.size() < 5 ||
+                    !std::isdigit(static_cast<unsigned char>(name[4])))
+                    continue;
+                int node = std::stoi(name.substr(4));
+                max_node = std::max(max_node, node);
+                for (int c : parse_list(read_line("/sys/devices/system/node/" + name + "/cpulist")))
+                    if (c >= 0 && c < CPU_SETSIZE) node_of[c] = node;
+            }
+            closedir(d);
+        }
+        t.num_nodes_ = max_node + 1;
+
+        unsigned hc = std::max(1u, std::thread::hardware_concurrency());
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (have_mask ? !CPU_ISSET(c, &allowed) : c >= int(hc)) continue;
+            LogicalCpu lc;
+            lc.cpu = c;
+            lc.node = node_of[c];
+            std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(c) + "/topology/";
+            if (!read_int(base + "core_id", lc.core)) lc.core = c;
+            if (!read_int(base + "physical_package_id", lc.package)) lc.package = 0;
+            std::vector<int> sib = parse_list(read_line(base + "thread_siblings_list"));
+            auto it = std::find(sib.begin(), sib.end(), c);
+            lc.smt_rank = it == sib.end() ? 0 : int(it - sib.begin());
+            t.cpus_.push_back(lc);
+        }
+        for (const auto &c : t.cpus_)
+            if (c.smt_rank == 0) t.num_cores_++;
+        return t;
+    }
+
+    // Topología del proceso, detectada una sola vez
+    static const CpuTopology &get() {
+        static const CpuTopology topo = detect();
+        return topo;
+    }
+
+    size_t num_cpus() const { return cpus_.size(); }
+    int num_cores() const { return num_cores_; }
+    int num_nodes() const { return num_nodes_; }
+    const std::vector<LogicalCpu> &cpus() const { return cpus_; }
+
+    // Compact: llena un nodo NUMA antes de pasar al siguiente.
+    // Spread: reparte los threads entre nodos en round-robin.
+    // En ambos casos los hermanos SMT van al final.
+    std::vector<int> pin_order(PinPolicy policy) const {
+        std::vector<LogicalCpu> sorted = cpus_;
+        std::sort(sorted.begin(), sorted.end(), [](const LogicalCpu &a, const LogicalCpu &b) {
+            if (a.smt_rank != b.smt_rank) return a.smt_rank < b.smt_rank;
+            if (a.node != b.node) return a.node < b.node;
+            return a.cpu < b.cpu;
+        });
+        if (policy == PinPolicy::Spread && num_nodes_ > 1) {
+            // Intercalar nodos dentro de cada rango SMT
+            std::vector<LogicalCpu> out;
+            size_t i = 0;
+            while (i < sorted.size()) {
+                size_t j = i;
+                while (j < sorted.size() && sorted[j].smt_rank == sorted[i].smt_rank) j++;
+                std::vector<std::vector<LogicalCpu>> per_node(num_nodes_);
+                for (size_t x = i; x < j; x++) per_node[sorted[x].node].push_back(sorted[x]);
+                for (size_t r = 0; out.size() < j; r++)
+                    for (auto &v : per_node)
+                        if (r < v.size()) out.push_back(v[r]);
+                i = j;
+            }
+            sorted.swap(out);
+        }
+        std::vector<int> order;
+        for (const auto &c : sorted) order.push_back(c.cpu);
+        return order;
+    }
+
+    int cpu_for_thread(int tid, PinPolicy policy) const {
+        if (cpus_.empty()) return tid;
+        std::vector<int> order = pin_order(policy);
+        return order[tid % order.size()];
+    }
+
+    const LogicalCpu *find(int cpu) const {
+        for (const auto &c : cpus_)
+            if (c.cpu == cpu) return &c;
+        return nullptr;
+    }
+
+    // Fija el thread actual a la CPU del orden elegido; devuelve la CPU o -1
+    int pin_thread(int tid, PinPolicy policy = PinPolicy::Compact) const {
+        if (policy == PinPolicy::None) return -1;
+        int cpu = cpu_for_thread(tid, policy);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return -1;
+        return cpu;
+    }
+
+    // Fija el thread actual a todas las CPUs permitidas de un nodo NUMA;
+    // devuelve el nodo o -1
+    int pin_thread_to_node(int node) const {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        int n = 0;
+        for (const auto &c : cpus_)
+            if (c.node == node) {
+                CPU_SET(c.cpu, &set);
+                n++;
+            }
+        if (n == 0 || pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) return -1;
+        return node;
+    }
+
+    std::string summary() const {
+        std::ostringstream os;
+        os << cpus_.size() << " CPUs lógicas, " << num_cores_ << " núcleos físicos, "
+           << num_nodes_ << " nodo(s) NUMA";
+        return os.str();
+    }
+};
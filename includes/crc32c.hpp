@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+
+// =================== CRC32C (CASTAGNOLI) ===================
+//
+// Con SSE4.2 se usa la instrucción crc32 (8 bytes por ciclo); si no, una
+// tabla de 256 entradas. Ambas rutas dan el mismo valor, así un archivo
+// escrito en una máquina se verifica en cualquier otra.
+
+namespace crc32c {
+
+inline const uint32_t *table() {
+    static const struct Table {
+        uint32_t t[256];
+        Table() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+                t[i] = c;
+            }
+        }
+    } tab;
+    return tab.t;
+}
+
+inline uint32_t update_scalar(uint32_t crc, const void *data, size_t n) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    const uint32_t *t = table();
+    for (size_t i = 0; i < n; i++) crc = t[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+inline uint32_t update_hw(uint32_t crc, const void *data, size_t n) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    uint64_t c = crc;
+    while (n >= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+        p += 8;
+        n -= 8;
+    }
+    uint32_t c32 = uint32_t(c);
+    while (n--) c32 = _mm_crc32_u8(c32, *p++);
+    return c32;
+}
+
+// crc = valor devuelto por una llamada anterior (0 al empezar)
+inline uint32_t update(uint32_t crc, const void *data, size_t n) {
+    static const bool hw = __builtin_cpu_supports("sse4.2");
+    crc = ~crc;
+    crc = hw ? update_hw(crc, data, n) : update_scalar(crc, data, n);
+    return ~crc;
+}
+
+inline uint32_t compute(const void *data, size_t n) { return update(0, data, n); }
+
+}  // namespace crc32c
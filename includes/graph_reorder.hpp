@@ -0,0 +1,188 @@
+#pragma once
+#include "hnswlib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// =================== REORDENAMIENTO DEL GRAFO PARA LOCALIDAD DE CACHÉ ===================
+//
+// Los ids internos siguen el orden de inserción: en un recorrido del grafo
+// cada salto cae en una zona arbitraria de la capa 0 y casi siempre falla
+// en caché. Tras construir, se renumeran los ids para que los vecinos de la
+// capa 0 queden contiguos en memoria:
+//   - bfs: recorrido en anchura desde el punto de entrada, vecinos en el
+//     orden de su lista (los más cercanos primero)
+//   - rcm: Reverse Cuthill-McKee, BFS que visita primero los vecinos de menor
+//     grado (entrada + salida) empezando por el nodo de menor grado de cada
+//     componente, y se invierte al final
+// Los labels externos no cambian; solo los ids internos y las listas.
+
+enum class ReorderMethod { None, BFS, RCM };
+
+inline ReorderMethod parse_reorder_method(const std::string &s) {
+    if (s == "none") return ReorderMethod::None;
+    if (s == "bfs") return ReorderMethod::BFS;
+    if (s == "rcm") return ReorderMethod::RCM;
+    throw std::invalid_argument("Reordenamiento inválido: " + s + " (none|bfs|rcm)");
+}
+
+inline const char *reorder_method_name(ReorderMethod m) {
+    switch (m) {
+    case ReorderMethod::BFS: return "bfs";
+    case ReorderMethod::RCM: return "rcm";
+    default: return "none";
+    }
+}
+
+class GraphReorder {
+public:
+    using Index = hnswlib::HierarchicalNSW<float>;
+    using tableint = hnswlib::tableint;
+
+    // order[k] = id antiguo que pasa a ocupar la posición k
+    static std::vector<tableint> compute(const Index &index, ReorderMethod method) {
+        size_t n = index.cur_element_count;
+        std::vector<tableint> order;
+        if (method == ReorderMethod::None || n == 0) {
+            order.resize(n);
+            for (size_t i = 0; i < n; i++) order[i] = tableint(i);
+            return order;
+        }
+        order.reserve(n);
+        std::vector<char> seen(n, 0);
+
+        std::vector<uint32_t> degree;
+        if (method == ReorderMethod::RCM) degree = level0_degrees(index);
+
+        std::vector<tableint> nbrs;
+        // Raíz de cada componente: el punto de entrada primero; después, en
+        // bfs el siguiente id sin visitar y en rcm el de menor grado
+        std::vector<tableint> roots;
+        roots.push_back(tableint(index.enterpoint_node_ < n ? index.enterpoint_node_ : 0));
+        std::vector<tableint> by_degree;
+        if (method == ReorderMethod::RCM) {
+            by_degree.resize(n);
+            for (size_t i = 0; i < n; i++) by_degree[i] = tableint(i);
+            std::stable_sort(by_degree.begin(), by_degree.end(),
+                             [&](tableint a, tableint b) { return degree[a] < degree[b]; });
+            roots[0] = by_degree[0];
+        }
+        size_t next_root = 0;
+
+        while (order.size() < n) {
+            tableint root;
+            if (!roots.empty()) {
+                root = roots.back();
+                roots.pop_back();
+            } else if (method == ReorderMethod::RCM) {
+                while (seen[by_degree[next_root]]) next_root++;
+                root = by_degree[next_root];
+            } else {
+                while (seen[next_root]) next_root++;
+                root = tableint(next_root);
+            }
+            if (seen[root]) continue;
+
+            // El propio vector order hace de cola
+            size_t head = order.size();
+            seen[root] = 1;
+            order.push_back(root);
+            while (head < order.size()) {
+                tableint x = order[head++];
+                hnswlib::linklistsizeint *ll = index.get_linklist0(x);
+                size_t count = index.getListCount(ll);
+                const tableint *links = reinterpret_cast<const tableint *>(ll + 1);
+                nbrs.clear();
+                for (size_t j = 0; j < count; j++)
+                    if (links[j] < n && !seen[links[j]]) nbrs.push_back(links[j]);
+                if (method == ReorderMethod::RCM)
+                    std::stable_sort(nbrs.begin(), nbrs.end(),
+                                     [&](tableint a, tableint b) { return degree[a] < degree[b]; });
+                for (tableint y : nbrs) {
+                    if (seen[y]) continue;
+                    seen[y] = 1;
+                    order.push_back(y);
+                }
+            }
+        }
+        if (method == ReorderMethod::RCM) std::reverse(order.begin(), order.end());
+        return order;
+    }
+
+    // Aplica la permutación sobre el índice: la capa 0 se permuta en un
+    // bloque temporal y se copia de vuelta (data_level0_memory_ puede ser
+    // una región de numa_memory.hpp), listas superiores por puntero,
+    // niveles, label_lookup_ y punto de entrada.
+    static void apply(Index &index, const std::vector<tableint> &order) {
+        size_t n = index.cur_element_count;
+        if (order.size() != n) throw std::runtime_error("Permutación de tamaño incorrecto");
+        std::vector<tableint> new_id(n);
+        for (size_t k = 0; k < n; k++) new_id[order[k]] = tableint(k);
+
+        size_t stride = index.size_data_per_element_;
+        std::vector<char> level0(n * stride);
+        std::vector<char *> upper(n);
+        std::vector<int> levels(n);
+        for (size_t k = 0; k < n; k++) {
+            tableint old = order[k];
+            char *dst = level0.data() + k * stride;
+            std::memcpy(dst, index.data_level0_memory_ + size_t(old) * stride, stride);
+            remap_list(dst + index.offsetLevel0_, new_id);
+            levels[k] = index.element_levels_[old];
+            upper[k] = index.linkLists_[old];
+            for (int l = 0; l < levels[k]; l++)
+                remap_list(upper[k] + size_t(l) * index.size_links_per_element_, new_id);
+        }
+        std::memcpy(index.data_level0_memory_, level0.data(), level0.size());
+        for (size_t k = 0; k < n; k++) {
+            index.linkLists_[k] = upper[k];
+            index.element_levels_[k] = levels[k];
+        }
+        for (auto &entry : index.label_lookup_) entry.second = new_id[entry.second];
+        if (index.enterpoint_node_ < n) index.enterpoint_node_ = new_id[index.enterpoint_node_];
+    }
+
+    // Distancia media en ids entre un nodo y sus vecinos de la capa 0: una
+    // aproximación barata de la localidad (menor es mejor)
+    static double mean_neighbor_gap(const Index &index) {
+        size_t n = index.cur_element_count;
+        double sum = 0.0;
+        size_t edges = 0;
+        for (size_t x = 0; x < n; x++) {
+            hnswlib::linklistsizeint *ll = index.get_linklist0(tableint(x));
+            size_t count = index.getListCount(ll);
+            const tableint *links = reinterpret_cast<const tableint *>(ll + 1);
+            for (size_t j = 0; j < count; j++) {
+                sum += std::abs(double(links[j]) - double(x));
+                edges++;
+            }
+        }
+        return edges ? sum / edges : 0.0;
+    }
+
+private:
+    static std::vector<uint32_t> level0_degrees(const Index &index) {
+        size_t n = index.cur_element_count;
+        std::vector<uint32_t> degree(n, 0);
+        for (size_t x = 0; x < n; x++) {
+            hnswlib::linklistsizeint *ll = index.get_linklist0(tableint(x));
+            size_t count = index.getListCount(ll);
+            const tableint *links = reinterpret_cast<const tableint *>(ll + 1);
+            degree[x] += uint32_t(count);
+            for (size_t j = 0; j < count; j++)
+                if (links[j] < n) degree[links[j]]++;
+        }
+        return degree;
+    }
+
+    static void remap_list(char *list, const std::vector<tableint> &new_id) {
+        unsigned short count;
+        std::memcpy(&count, list, sizeof(count));
+        tableint *links = reinterpret_cast<tableint *>(list + sizeof(hnswlib::linklistsizeint));
+        for (unsigned short j = 0; j < count; j++) links[j] = new_id[links[j]];
+    }
+};
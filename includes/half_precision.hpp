@@ -0,0 +1,311 @@
+#pragma once
+#include "simd_distance.hpp"
+#include "hnswlib.h"
+#include <cstdint>
+#include <cstring>
+#include <immintrin.h>
+#include <stdexcept>
+#include <string>
+
+// =================== ALMACENAMIENTO EN MEDIA PRECISIÓN (FP16 / BF16) ===================
+//
+// El índice guarda cada componente en 16 bits (2 * dim bytes por vector en
+// vez de 4 * dim) y los kernels convierten a float sobre la marcha:
+//   - fp16 (IEEE binario16): F16C (vcvtph2ps) con AVX2, o AVX-512F
+//   - bf16 (los 16 bits altos del float): desplazamiento de 16 bits, y con
+//     AVX-512-BF16 el producto interno usa vdpbf16ps directamente
+// No hay parámetros entrenados: la query se convierte igual que los datos.
+// Sin soporte SIMD se usa la conversión escalar (mismo resultado).
+
+enum class HalfFormat { FP16, BF16 };
+
+inline const char *half_format_name(HalfFormat f) { return f == HalfFormat::FP16 ? "fp16" : "bf16"; }
+
+inline HalfFormat parse_half_format(const std::string &s) {
+    if (s == "fp16") return HalfFormat::FP16;
+    if (s == "bf16") return HalfFormat::BF16;
+    throw std::runtime_error("Formato de media precisión desconocido: " + s + " (fp16|bf16)");
+}
+
+// ---------- Conversión escalar (redondeo al par más cercano) ----------
+
+inline uint16_t fp32_to_fp16(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint32_t sign = (x >> 16) & 0x8000u;
+    uint32_t mant = x & 0x7fffffu;
+    int exp = int((x >> 23) & 0xff);
+    if (exp == 0xff) return uint16_t(sign | 0x7c00u | (mant ? 0x200u : 0u));  // inf / nan
+    int e = exp - 127 + 15;
+    if (e >= 0x1f) return uint16_t(sign | 0x7c00u);                          // desborde -> inf
+    if (e <= 0) {
+        // Subnormal de fp16 (o cero si es demasiado pequeño)
+        if (e < -10) return uint16_t(sign);
+        mant |= 0x800000u;
+        int shift = 14 - e;
+        uint32_t h = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t mid = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (h & 1))) h++;
+        return uint16_t(sign | h);
+    }
+    uint32_t h = sign | (uint32_t(e) << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fffu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1))) h++;  // el acarreo sube al exponente
+    return uint16_t(h);
+}
+
+inline float fp16_to_fp32(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000u) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ffu;
+    uint32_t x;
+    if (exp == 0x1f) {
+        x = sign | 0x7f800000u | (mant << 13);
+    } else if (exp) {
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    } else if (mant) {
+        int e = -1;
+        do {
+            e++;
+            mant <<= 1;
+        } while (!(mant & 0x400u));
+        x = sign | (uint32_t(112 - e) << 23) | ((mant & 0x3ffu) << 13);
+    } else {
+        x = sign;
+    }
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+inline uint16_t fp32_to_bf16(float f) {
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffffu) > 0x7f800000u) return uint16_t((x >> 16) | 0x40u);  // nan silencioso
+    x += 0x7fffu + ((x >> 16) & 1);
+    return uint16_t(x >> 16);
+}
+
+inline float bf16_to_fp32(uint16_t h) {
+    uint32_t x = uint32_t(h) << 16;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+struct HalfCodec {
+    static void encode(HalfFormat fmt, const float *x, uint16_t *out, size_t n) {
+        if (fmt == HalfFormat::FP16 && __builtin_cpu_supports("f16c")) {
+            encode_fp16_f16c(x, out, n);
+            return;
+        }
+        for (size_t i = 0; i < n; i++) out[i] = fmt == HalfFormat::FP16 ? fp32_to_fp16(x[i]) : fp32_to_bf16(x[i]);
+    }
+
+    static void decode(HalfFormat fmt, const uint16_t *in, float *x, size_t n) {
+        for (size_t i = 0; i < n; i++) x[i] = fmt == HalfFormat::FP16 ? fp16_to_fp32(in[i]) : bf16_to_fp32(in[i]);
+    }
+
+private:
+    __attribute__((target("avx,f16c")))
+    static void encode_fp16_f16c(const float *x, uint16_t *out, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(x + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), h);
+        }
+        for (; i < n; i++) out[i] = fp32_to_fp16(x[i]);
+    }
+};
+
+// =================== KERNELS SOBRE VECTORES DE 16 BITS ===================
+
+struct HalfDistParam {
+    size_t dim = 0;
+};
+
+struct HalfKernels {
+    // BF16 = false: fp16 (IEEE); true: bf16
+    template <bool BF16>
+    static inline float load1(uint16_t h) {
+        return BF16 ? bf16_to_fp32(h) : fp16_to_fp32(h);
+    }
+
+    // ---------- Escalar ----------
+    template <bool BF16>
+    static float l2_scalar(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        float s = 0.0f;
+        for (size_t i = 0; i < n; i++) {
+            float d = load1<BF16>(x[i]) - load1<BF16>(y[i]);
+            s += d * d;
+        }
+        return s;
+    }
+
+    template <bool BF16>
+    static float ip_scalar(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        float s = 0.0f;
+        for (size_t i = 0; i < n; i++) s += load1<BF16>(x[i]) * load1<BF16>(y[i]);
+        return 1.0f - s;
+    }
+
+    // ---------- AVX2: fp16 con F16C, bf16 ampliando a 32 bits ----------
+    template <bool BF16>
+    __attribute__((target("avx2,fma,f16c")))
+    static inline __m256 load8(const uint16_t *p) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        if (BF16) return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16));
+        return _mm256_cvtph_ps(h);
+    }
+
+    template <bool BF16>
+    __attribute__((target("avx2,fma,f16c")))
+    static float l2_avx2(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim, i = 0;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        __m256 acc = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            __m256 d = _mm256_sub_ps(load8<BF16>(x + i), load8<BF16>(y + i));
+            acc = _mm256_fmadd_ps(d, d, acc);
+        }
+        float s = DistanceKernels::hsum256(acc);
+        for (; i < n; i++) {
+            float d = load1<BF16>(x[i]) - load1<BF16>(y[i]);
+            s += d * d;
+        }
+        return s;
+    }
+
+    template <bool BF16>
+    __attribute__((target("avx2,fma,f16c")))
+    static float ip_avx2(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim, i = 0;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        __m256 acc = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) acc = _mm256_fmadd_ps(load8<BF16>(x + i), load8<BF16>(y + i), acc);
+        float s = DistanceKernels::hsum256(acc);
+        for (; i < n; i++) s += load1<BF16>(x[i]) * load1<BF16>(y[i]);
+        return 1.0f - s;
+    }
+
+    // ---------- AVX-512F ----------
+    template <bool BF16>
+    __attribute__((target("avx512f")))
+    static inline __m512 load16(const uint16_t *p) {
+        __m256i h = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        if (BF16) return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(h), 16));
+        return _mm512_cvtph_ps(h);
+    }
+
+    template <bool BF16>
+    __attribute__((target("avx512f")))
+    static float l2_avx512(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim, i = 0;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        __m512 acc = _mm512_setzero_ps();
+        for (; i + 16 <= n; i += 16) {
+            __m512 d = _mm512_sub_ps(load16<BF16>(x + i), load16<BF16>(y + i));
+            acc = _mm512_fmadd_ps(d, d, acc);
+        }
+        float s = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++) {
+            float d = load1<BF16>(x[i]) - load1<BF16>(y[i]);
+            s += d * d;
+        }
+        return s;
+    }
+
+    template <bool BF16>
+    __attribute__((target("avx512f")))
+    static float ip_avx512(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim, i = 0;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        __m512 acc = _mm512_setzero_ps();
+        for (; i + 16 <= n; i += 16) acc = _mm512_fmadd_ps(load16<BF16>(x + i), load16<BF16>(y + i), acc);
+        float s = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++) s += load1<BF16>(x[i]) * load1<BF16>(y[i]);
+        return 1.0f - s;
+    }
+
+    // ---------- AVX-512-BF16: producto interno sin convertir ----------
+    // vdpbf16ps suma pares de productos bf16 en acumuladores fp32
+    __attribute__((target("avx512f,avx512bf16")))
+    static float ip_avx512bf16(const void *a, const void *b, const void *param) {
+        size_t n = static_cast<const HalfDistParam *>(param)->dim, i = 0;
+        const uint16_t *x = static_cast<const uint16_t *>(a);
+        const uint16_t *y = static_cast<const uint16_t *>(b);
+        __m512 acc = _mm512_setzero_ps();
+        for (; i + 32 <= n; i += 32) {
+            __m512bh vx = (__m512bh)_mm512_loadu_si512(x + i);
+            __m512bh vy = (__m512bh)_mm512_loadu_si512(y + i);
+            acc = _mm512_dpbf16_ps(acc, vx, vy);
+        }
+        float s = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++) s += bf16_to_fp32(x[i]) * bf16_to_fp32(y[i]);
+        return 1.0f - s;
+    }
+
+    struct Selection {
+        hnswlib::DISTFUNC<float> fn;
+        const char *name;
+    };
+
+    static bool has_f16c() { return __builtin_cpu_supports("f16c"); }
+    static bool has_avx512bf16() { return __builtin_cpu_supports("avx512bf16"); }
+
+    static Selection select(HalfFormat fmt, Metric metric, SimdLevel level) {
+        bool l2 = metric == Metric::L2;
+        if (fmt == HalfFormat::FP16) {
+            if (level == SimdLevel::AVX512) return {l2 ? l2_avx512<false> : ip_avx512<false>, "avx512"};
+            if (level == SimdLevel::AVX2 && has_f16c()) return {l2 ? l2_avx2<false> : ip_avx2<false>, "avx2+f16c"};
+            return {l2 ? l2_scalar<false> : ip_scalar<false>, "scalar"};
+        }
+        if (level == SimdLevel::AVX512) {
+            if (!l2 && has_avx512bf16()) return {ip_avx512bf16, "avx512-bf16"};
+            return {l2 ? l2_avx512<true> : ip_avx512<true>, "avx512"};
+        }
+        if (level == SimdLevel::AVX2 && has_f16c()) return {l2 ? l2_avx2<true> : ip_avx2<true>, "avx2"};
+        return {l2 ? l2_scalar<true> : ip_scalar<true>, "scalar"};
+    }
+};
+
+// Espacio hnswlib sobre vectores de 16 bits: la consulta también se convierte
+class HalfSpace : public hnswlib::SpaceInterface<float> {
+private:
+    HalfDistParam param_;
+    HalfKernels::Selection kernel_;
+    Metric metric_;
+    HalfFormat format_;
+
+public:
+    HalfSpace(Metric metric, HalfFormat format, size_t dim, SimdLevel level = CpuFeatures::detect())
+        : metric_(metric), format_(format) {
+        param_.dim = dim;
+        kernel_ = HalfKernels::select(format, metric, level);
+    }
+
+    size_t get_data_size() override { return param_.dim * sizeof(uint16_t); }
+    hnswlib::DISTFUNC<float> get_dist_func() override { return kernel_.fn; }
+    void *get_dist_func_param() override { return &param_; }
+
+    HalfFormat format() const { return format_; }
+
+    void encode(const float *x, uint16_t *out) const { HalfCodec::encode(format_, x, out, param_.dim); }
+
+    std::string description() const {
+        return std::string(half_format_name(format_)) + "-" + metric_name(metric_) + "/" + kernel_.name;
+    }
+
+    ~HalfSpace() {}
+};
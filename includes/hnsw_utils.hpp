@@ -1,4 +1,5 @@
 #pragma once
+#include <cmath>
 #include <vector>
 #include <string>
 #include <fstream>
@@ -21,6 +22,20 @@ public:
         return data;
     }
     
+    // Normalizar un vector a norma 1 (src y dst pueden ser el mismo buffer)
+    static void normalize_row(const float* src, float* dst, int dim) {
+        float norm_sq = 0.0f;
+        for (int d = 0; d < dim; d++) {
+            norm_sq += src[d] * src[d];
+        }
+        float norm = sqrtf(norm_sq);
+        // Si la norma es 0, copiar tal cual
+        float inv_norm = norm > 1e-12f ? 1.0f / norm : 1.0f;
+        for (int d = 0; d < dim; d++) {
+            dst[d] = src[d] * inv_norm;
+        }
+    }
+    
     // Guardar embeddings en binario
     static void save_embeddings_bin(const std::string& filename, 
                                    const std::vector<float>& data) {
@@ -0,0 +1,312 @@
+#pragma once
+#include "crc32c.hpp"
+#include "mapped_index.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <libgen.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// =================== GUARDADO PARALELO Y CARGA VERIFICADA ===================
+//
+// save(): escribe el formato de mapped_index.hpp con varios hilos haciendo
+// pwrite() de bloques grandes (opcionalmente con O_DIRECT), calcula el
+// CRC32C de cada sección y publica el archivo con rename() atómico: un
+// proceso que muere a mitad de guardado solo deja un <out>.tmp.
+//
+// load(): reconstruye un HierarchicalNSW a partir de cualquiera de los dos
+// formatos (mapeable o saveIndex) verificando los checksums si existen.
+
+namespace index_io {
+
+struct SaveOptions {
+    int threads = 4;
+    bool direct = false;              // O_DIRECT (cae a escritura normal si el FS no lo admite)
+    size_t chunk_bytes = 8u << 20;    // tamaño de cada pwrite
+};
+
+struct SaveReport {
+    uint64_t bytes = 0;
+    double checksum_s = 0.0;
+    double write_s = 0.0;
+    double sync_s = 0.0;
+    double total_s = 0.0;
+    int threads = 0;
+    bool direct = false;
+
+    double mb_per_s() const { return total_s > 0 ? bytes / 1048576.0 / total_s : 0.0; }
+};
+
+namespace detail {
+
+// Trozo contiguo del archivo final y de dónde salen sus bytes
+struct Segment {
+    uint64_t offset;
+    const char *data;
+    uint64_t bytes;
+};
+
+constexpr size_t DIRECT_ALIGN = 4096;
+
+inline void pwrite_full(int fd, const char *p, size_t n, uint64_t off) {
+    while (n > 0) {
+        ssize_t w = ::pwrite(fd, p, n, off);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("pwrite: ") + std::strerror(errno));
+        }
+        p += w;
+        n -= size_t(w);
+        off += uint64_t(w);
+    }
+}
+
+// Reparte 'count' tareas entre hilos; la primera excepción se relanza
+template <typename Task>
+inline void run_parallel(size_t count, int threads, Task task) {
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    auto worker = [&]() {
+        while (!failed) {
+            size_t i = next.fetch_add(1);
+            if (i >= count) break;
+            try {
+                task(i);
+            } catch (...) {
+                if (!failed.exchange(true)) error = std::current_exception();
+            }
+        }
+    };
+    int t = std::max(1, std::min<int>(threads, int(count)));
+    std::vector<std::thread> pool;
+    for (int i = 1; i < t; i++) pool.emplace_back(worker);
+    worker();
+    for (auto &th : pool) th.join();
+    if (error) std::rethrow_exception(error);
+}
+
+inline void fsync_parent_dir(const std::string &path) {
+    std::vector<char> buf(path.begin(), path.end());
+    buf.push_back('\0');
+    int dfd = ::open(::dirname(buf.data()), O_RDONLY | O_DIRECTORY);
+    if (dfd >= 0) {
+        ::fsync(dfd);
+        ::close(dfd);
+    }
+}
+
+}  // namespace detail
+
+inline SaveReport save(mapped_index::IndexImage &img, const std::string &path,
+                       const SaveOptions &opt = SaveOptions()) {
+    using namespace mapped_index;
+    using clock = std::chrono::high_resolution_clock;
+    auto t0 = clock::now();
+
+    img.layout();
+    Header &h = img.header;
+
+    // Las listas superiores se compactan en un solo bloque contiguo
+    std::vector<uint64_t> offsets = img.upper_offsets();
+    std::vector<char> upper(h.sections[SEC_UPPER_LINKS].bytes);
+    for (size_t i = 0; i < h.count; i++)
+        if (img.levels[i])
+            std::memcpy(upper.data() + offsets[i], img.upper[i],
+                        uint64_t(img.levels[i]) * h.size_links_per_element);
+
+    const char *sources[SECTION_COUNT] = {
+        img.level0,
+        reinterpret_cast<const char *>(img.levels.data()),
+        reinterpret_cast<const char *>(offsets.data()),
+        upper.data(),
+        reinterpret_cast<const char *>(img.labels.data()),
+    };
+
+    // CRC por sección en paralelo (level0 domina, va primero)
+    detail::run_parallel(SECTION_COUNT, opt.threads, [&](size_t s) {
+        h.sections[s].checksum = crc32c::compute(sources[s], h.sections[s].bytes);
+        h.sections[s].flags |= SECTION_CRC32C;
+    });
+    h.header_checksum = header_crc(h);
+    auto t1 = clock::now();
+
+    std::vector<detail::Segment> segments;
+    segments.push_back({0, reinterpret_cast<const char *>(&h), sizeof(Header)});
+    for (uint32_t s = 0; s < SECTION_COUNT; s++)
+        if (h.sections[s].bytes) segments.push_back({h.sections[s].offset, sources[s], h.sections[s].bytes});
+
+    std::string tmp = path + ".tmp";
+    SaveReport report;
+    report.threads = std::max(1, opt.threads);
+    report.bytes = h.file_bytes;
+    int fd = -1;
+    if (opt.direct) {
+        fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+        report.direct = fd >= 0;
+    }
+    if (fd < 0) fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw std::runtime_error("No se pudo crear " + tmp + ": " + std::strerror(errno));
+
+    size_t chunk = std::max<size_t>(detail::DIRECT_ALIGN,
+                                    opt.chunk_bytes / detail::DIRECT_ALIGN * detail::DIRECT_ALIGN);
+    try {
+        if (report.direct) {
+            // O_DIRECT exige offset, tamaño y buffer alineados: cada hilo arma
+            // en un buffer alineado el rango [a, b) del archivo y lo escribe
+            uint64_t padded = align_up(h.file_bytes, detail::DIRECT_ALIGN);
+            size_t chunks = (padded + chunk - 1) / chunk;
+            detail::run_parallel(chunks, opt.threads, [&](size_t c) {
+                uint64_t a = uint64_t(c) * chunk;
+                uint64_t b = std::min<uint64_t>(padded, a + chunk);
+                void *raw = nullptr;
+                if (posix_memalign(&raw, detail::DIRECT_ALIGN, b - a) != 0)
+                    throw std::runtime_error("posix_memalign falló");
+                std::unique_ptr<char, decltype(&std::free)> buf(static_cast<char *>(raw), &std::free);
+                std::memset(buf.get(), 0, b - a);
+                for (const auto &seg : segments) {
+                    uint64_t lo = std::max(a, seg.offset);
+                    uint64_t hi = std::min(b, seg.offset + seg.bytes);
+                    if (lo < hi) std::memcpy(buf.get() + (lo - a), seg.data + (lo - seg.offset), hi - lo);
+                }
+                detail::pwrite_full(fd, buf.get(), b - a, a);
+            });
+        } else {
+            // Sin O_DIRECT se escribe directamente desde la memoria del índice;
+            // el relleno entre secciones queda a cero por el ftruncate
+            if (::ftruncate(fd, h.file_bytes) != 0)
+                throw std::runtime_error(std::string("ftruncate: ") + std::strerror(errno));
+            std::vector<detail::Segment> pieces;
+            for (const auto &seg : segments)
+                for (uint64_t off = 0; off < seg.bytes; off += chunk)
+                    pieces.push_back({seg.offset + off, seg.data + off, std::min<uint64_t>(chunk, seg.bytes - off)});
+            detail::run_parallel(pieces.size(), opt.threads, [&](size_t i) {
+                detail::pwrite_full(fd, pieces[i].data, pieces[i].bytes, pieces[i].offset);
+            });
+        }
+        auto t2 = clock::now();
+        if (report.direct && ::ftruncate(fd, h.file_bytes) != 0)
+            throw std::runtime_error(std::string("ftruncate: ") + std::strerror(errno));
+        if (::fdatasync(fd) != 0)
+            throw std::runtime_error(std::string("fdatasync: ") + std::strerror(errno));
+        if (::close(fd) != 0) {
+            fd = -1;
+            throw std::runtime_error(std::string("close: ") + std::strerror(errno));
+        }
+        fd = -1;
+        if (::rename(tmp.c_str(), path.c_str()) != 0)
+            throw std::runtime_error("No se pudo renombrar " + tmp + " a " + path + ": " +
+                                     std::strerror(errno));
+        detail::fsync_parent_dir(path);
+        auto t3 = clock::now();
+        report.checksum_s = std::chrono::duration<double>(t1 - t0).count();
+        report.write_s = std::chrono::duration<double>(t2 - t1).count();
+        report.sync_s = std::chrono::duration<double>(t3 - t2).count();
+        report.total_s = std::chrono::duration<double>(t3 - t0).count();
+    } catch (...) {
+        if (fd >= 0) ::close(fd);
+        ::unlink(tmp.c_str());
+        throw;
+    }
+    return report;
+}
+
+inline SaveReport save(const hnswlib::HierarchicalNSW<float> &index, const std::string &path,
+                       const SaveOptions &opt = SaveOptions()) {
+    auto img = mapped_index::IndexImage::from_index(index);
+    return save(img, path, opt);
+}
+
+// Número de elementos guardados, leyendo solo la cabecera
+inline size_t element_count(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("No se pudo abrir: " + path);
+    if (mapped_index::is_mapped_format(path)) {
+        mapped_index::Header h;
+        in.read(reinterpret_cast<char *>(&h), sizeof(h));
+        return in ? size_t(h.count) : 0;
+    }
+    // saveIndex: offsetLevel0_, max_elements_, cur_element_count, ...
+    size_t fields[3] = {};
+    in.read(reinterpret_cast<char *>(fields), sizeof(fields));
+    return in ? fields[2] : 0;
+}
+
+// Carga cualquiera de los dos formatos. max_elements > count deja capacidad
+// para seguir insertando. Con verify se comprueban los CRC de las secciones.
+inline std::unique_ptr<hnswlib::HierarchicalNSW<float>>
+load(hnswlib::SpaceInterface<float> *space, const std::string &path, size_t max_elements = 0,
+     bool verify = true) {
+    using namespace mapped_index;
+    if (!is_mapped_format(path))
+        return std::unique_ptr<hnswlib::HierarchicalNSW<float>>(
+            new hnswlib::HierarchicalNSW<float>(space, path, false, max_elements));
+
+    MappedFile file(path);
+    file.advise(MADV_SEQUENTIAL);
+    const char *base = static_cast<const char *>(file.data());
+    if (file.size() < sizeof(Header)) throw std::runtime_error("Archivo demasiado pequeño: " + path);
+    const Header &h = *reinterpret_cast<const Header *>(base);
+    check_header(h, file.size(), path);
+    if (verify) verify_sections(h, base, path);
+    if (space->get_data_size() != h.data_size)
+        throw std::runtime_error("El espacio de distancias no coincide con el índice (" +
+                                 std::to_string(space->get_data_size()) + " vs " +
+                                 std::to_string(h.data_size) + " bytes por vector)");
+
+    size_t capacity = std::max<size_t>({max_elements, h.count, 1});
+    std::unique_ptr<hnswlib::HierarchicalNSW<float>> index(
+        new hnswlib::HierarchicalNSW<float>(space, capacity, h.m, h.ef_construction));
+    if (index->size_data_per_element_ != h.size_data_per_element ||
+        index->size_links_per_element_ != h.size_links_per_element || index->maxM0_ != h.max_m0 ||
+        index->offsetData_ != h.offset_data || index->label_offset_ != h.label_offset)
+        throw std::runtime_error("Layout del índice incompatible con esta versión de hnswlib: " + path);
+
+    std::memcpy(index->data_level0_memory_, base + h.sections[SEC_LEVEL0].offset,
+                h.sections[SEC_LEVEL0].bytes);
+    const uint32_t *levels = reinterpret_cast<const uint32_t *>(base + h.sections[SEC_LEVELS].offset);
+    const uint64_t *offsets = reinterpret_cast<const uint64_t *>(base + h.sections[SEC_UPPER_OFFSETS].offset);
+    const char *upper = base + h.sections[SEC_UPPER_LINKS].offset;
+    const LabelEntry *labels = reinterpret_cast<const LabelEntry *>(base + h.sections[SEC_LABELS].offset);
+
+    for (size_t i = 0; i < h.count; i++) {
+        index->element_levels_[i] = int(levels[i]);
+        if (levels[i] == 0) {
+            index->linkLists_[i] = nullptr;
+            continue;
+        }
+        size_t bytes = size_t(levels[i]) * h.size_links_per_element;
+        if (!fits(offsets[i], bytes, h.sections[SEC_UPPER_LINKS].bytes))
+            throw std::runtime_error("Listas superiores fuera de rango: " + path);
+        index->linkLists_[i] = static_cast<char *>(std::malloc(bytes));
+        if (!index->linkLists_[i]) throw std::runtime_error("Sin memoria para las listas superiores");
+        std::memcpy(index->linkLists_[i], upper + offsets[i], bytes);
+        // Se publica en cur_element_count a medida que se copia: si algo
+        // lanza, el destructor de hnswlib libera solo lo ya reservado
+        index->cur_element_count = i + 1;
+    }
+    index->cur_element_count = h.count;
+    for (size_t i = 0; i < h.count; i++) {
+        if (labels[i].id >= h.count) throw std::runtime_error("Id interno fuera de rango en labels: " + path);
+        index->label_lookup_[labels[i].label] = hnswlib::tableint(labels[i].id);
+    }
+    for (size_t i = 0; i < h.count; i++)
+        if (index->isMarkedDeleted(hnswlib::tableint(i))) index->num_deleted_ += 1;
+    index->maxlevel_ = h.max_level;
+    index->enterpoint_node_ = h.entry_point;
+    index->mult_ = h.mult;
+    return index;
+}
+
+}  // namespace index_io
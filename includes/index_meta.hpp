@@ -0,0 +1,166 @@
+#pragma once
+#include "mapped_index.hpp"
+#include "simd_distance.hpp"
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// =================== METADATOS DEL ÍNDICE ===================
+//
+// Métrica, dimensión, normalización, formato de los vectores y parámetros
+// de construcción, para que las herramientas de consulta elijan el espacio
+// y el preprocesado correctos sin depender de la línea de comandos.
+//   - formato mapeable: en la cabecera (flag HEADER_META)
+//   - formato saveIndex: archivo <índice>.meta junto al índice (como .sq8/.pq)
+// Los índices anteriores no tienen metadatos (present = false).
+
+enum class VectorStorage : uint32_t { FP32 = 0, SQ8 = 1, PQ = 2, FP16 = 3, BF16 = 4 };
+
+inline const char *storage_name(VectorStorage s) {
+    switch (s) {
+    case VectorStorage::SQ8: return "sq8";
+    case VectorStorage::PQ: return "pq";
+    case VectorStorage::FP16: return "fp16";
+    case VectorStorage::BF16: return "bf16";
+    default: return "fp32";
+    }
+}
+
+inline VectorStorage parse_storage(const std::string &s) {
+    if (s == "fp32") return VectorStorage::FP32;
+    if (s == "sq8") return VectorStorage::SQ8;
+    if (s == "pq") return VectorStorage::PQ;
+    if (s == "fp16") return VectorStorage::FP16;
+    if (s == "bf16") return VectorStorage::BF16;
+    throw std::runtime_error("Formato de almacenamiento desconocido: " + s + " (fp32|sq8|pq|fp16|bf16)");
+}
+
+struct IndexMeta {
+    enum Flags : uint32_t {
+        NORMALIZED = 1,  // vectores guardados con norma 1 (las queries deben normalizarse)
+    };
+
+    bool present = false;
+    Metric metric = Metric::L2;
+    uint32_t dim = 0;
+    bool normalized = false;
+    VectorStorage storage = VectorStorage::FP32;
+    uint64_t m = 0;
+    uint64_t ef_construction = 0;
+
+    static IndexMeta make(Metric metric, int dim, VectorStorage storage = VectorStorage::FP32) {
+        IndexMeta meta;
+        meta.present = true;
+        meta.metric = metric;
+        meta.dim = uint32_t(dim);
+        meta.normalized = metric == Metric::IP;
+        meta.storage = storage;
+        return meta;
+    }
+
+    // Copia los metadatos a la cabecera mapeable (antes de index_io::save)
+    void stamp(mapped_index::Header &h) const {
+        h.flags |= mapped_index::HEADER_META;
+        h.metric = uint32_t(metric);
+        h.dim = dim;
+        h.storage = uint32_t(storage);
+        h.meta_flags = normalized ? uint32_t(NORMALIZED) : 0u;
+    }
+
+    static IndexMeta from_header(const mapped_index::Header &h) {
+        IndexMeta meta;
+        meta.m = h.m;
+        meta.ef_construction = h.ef_construction;
+        if (!(h.flags & mapped_index::HEADER_META)) return meta;
+        if (h.metric > uint32_t(Metric::IP) || h.storage > uint32_t(VectorStorage::BF16))
+            throw std::runtime_error("Metadatos de índice inválidos");
+        meta.present = true;
+        meta.metric = Metric(h.metric);
+        meta.dim = h.dim;
+        meta.storage = VectorStorage(h.storage);
+        meta.normalized = (h.meta_flags & NORMALIZED) != 0;
+        return meta;
+    }
+
+    // Archivo <índice>.meta (formato saveIndex)
+    static std::string path_for(const std::string &index_path) { return index_path + ".meta"; }
+
+    void save(const std::string &path) const {
+        std::ofstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo crear: " + path);
+        uint32_t fields[4] = {uint32_t(metric), dim, uint32_t(storage), normalized ? NORMALIZED : 0u};
+        uint64_t params[2] = {m, ef_construction};
+        f.write("HNSWMETA", 8);
+        f.write(reinterpret_cast<const char *>(fields), sizeof(fields));
+        f.write(reinterpret_cast<const char *>(params), sizeof(params));
+    }
+
+    static IndexMeta load(const std::string &path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+        char magic[8];
+        uint32_t fields[4];
+        uint64_t params[2];
+        f.read(magic, 8);
+        f.read(reinterpret_cast<char *>(fields), sizeof(fields));
+        f.read(reinterpret_cast<char *>(params), sizeof(params));
+        if (!f || std::string(magic, 8) != "HNSWMETA" || fields[0] > uint32_t(Metric::IP) ||
+            fields[2] > uint32_t(VectorStorage::BF16))
+            throw std::runtime_error("Archivo de metadatos inválido: " + path);
+        IndexMeta meta;
+        meta.present = true;
+        meta.metric = Metric(fields[0]);
+        meta.dim = fields[1];
+        meta.storage = VectorStorage(fields[2]);
+        meta.normalized = (fields[3] & NORMALIZED) != 0;
+        meta.m = params[0];
+        meta.ef_construction = params[1];
+        return meta;
+    }
+
+    // Metadatos de cualquiera de los dos formatos; present = false si no hay
+    static IndexMeta read(const std::string &index_path) {
+        if (mapped_index::is_mapped_format(index_path)) {
+            std::ifstream in(index_path, std::ios::binary);
+            mapped_index::Header h;
+            in.read(reinterpret_cast<char *>(&h), sizeof(h));
+            if (!in) throw std::runtime_error("Cabecera truncada: " + index_path);
+            return from_header(h);
+        }
+        std::string side = path_for(index_path);
+        if (std::ifstream(side).good()) return load(side);
+        return IndexMeta();
+    }
+
+    // Comprueba que la dimensión pedida coincide con la del índice
+    void check_dim(int d) const {
+        if (present && dim != uint32_t(d))
+            throw std::runtime_error("El índice es de dimensión " + std::to_string(dim) +
+                                     ", no " + std::to_string(d));
+    }
+
+    // Herramientas con --metric (vacío = no se dio): con metadatos manda el
+    // índice y --metric solo se contrasta; sin metadatos manda --metric (l2
+    // por defecto) y con ip se asumen vectores normalizados, como al construir
+    void resolve_metric(const std::string &flag) {
+        if (present) {
+            if (!flag.empty() && parse_metric(flag) != metric)
+                throw std::runtime_error(std::string("El índice es ") + metric_name(metric) +
+                                         ", no " + flag);
+            return;
+        }
+        metric = flag.empty() ? Metric::L2 : parse_metric(flag);
+        normalized = metric == Metric::IP;
+    }
+
+    std::string describe() const {
+        if (!present) return "sin metadatos (se asume l2 sin normalizar)";
+        std::ostringstream ss;
+        ss << metric_name(metric) << ", dim " << dim << ", " << storage_name(storage)
+           << (normalized ? ", vectores normalizados" : "");
+        if (m) ss << ", M " << m << ", efC " << ef_construction;
+        return ss.str();
+    }
+};
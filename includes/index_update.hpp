@@ -0,0 +1,201 @@
+#pragma once
+#include "mapped_index.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// =================== ACTUALIZACIÓN INCREMENTAL DEL ÍNDICE ===================
+//
+// Borrado lógico (tombstones con markDelete) y compactación: las listas de
+// los nodos vivos que apuntan a un borrado se reconstruyen con sus vecinos
+// vivos más los vecinos del borrado (poda con la heurística de hnswlib), y
+// después los borrados se eliminan físicamente renumerando los ids.
+
+struct CompactionReport {
+    size_t deleted = 0;
+    size_t repaired_lists = 0;
+    size_t live = 0;
+};
+
+class IndexMaintenance {
+public:
+    using Index = hnswlib::HierarchicalNSW<float>;
+    using tableint = hnswlib::tableint;
+
+    // Marca como borrados los labels dados; devuelve cuántos no existían
+    static size_t apply_tombstones(Index &index, const uint64_t *labels, size_t n) {
+        size_t missing = 0;
+        for (size_t i = 0; i < n; i++) {
+            auto it = index.label_lookup_.find(hnswlib::labeltype(labels[i]));
+            if (it == index.label_lookup_.end()) {
+                missing++;
+                continue;
+            }
+            if (!index.isMarkedDeleted(it->second)) index.markDeletedInternal(it->second);
+        }
+        return missing;
+    }
+
+    // Reconecta los vecinos de los nodos borrados. Cada hilo solo reescribe
+    // las listas de sus propios nodos vivos y solo lee listas de borrados,
+    // que nadie modifica: no hace falta ningún lock.
+    static CompactionReport repair_deleted(Index &index, int num_threads) {
+        CompactionReport report;
+        size_t n = index.cur_element_count;
+        for (size_t i = 0; i < n; i++)
+            if (index.isMarkedDeleted(tableint(i))) report.deleted++;
+        report.live = n - report.deleted;
+        if (report.deleted == 0) return report;
+
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> repaired{0};
+        const size_t chunk = 256;
+        auto worker = [&]() {
+            std::vector<tableint> cand;
+            size_t local = 0;
+            while (true) {
+                size_t b = next.fetch_add(chunk);
+                if (b >= n) break;
+                size_t e = std::min(n, b + chunk);
+                for (size_t x = b; x < e; x++) {
+                    if (index.isMarkedDeleted(tableint(x))) continue;
+                    for (int level = 0; level <= index.element_levels_[x]; level++)
+                        if (repair_list(index, tableint(x), level, cand)) local++;
+                }
+            }
+            repaired += local;
+        };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < std::max(1, num_threads); t++) threads.emplace_back(worker);
+        for (auto &th : threads) th.join();
+        report.repaired_lists = repaired;
+        return report;
+    }
+
+    // Imagen del índice sin los nodos borrados (ids renumerados en orden).
+    // Debe llamarse después de repair_deleted() para no perder conectividad.
+    static mapped_index::IndexImage compacted_image(const Index &index) {
+        using namespace mapped_index;
+        IndexImage img;
+        Header &h = img.header;
+        size_t n = index.cur_element_count;
+        std::vector<int64_t> remap(n, -1);
+        size_t live = 0;
+        for (size_t i = 0; i < n; i++)
+            if (!index.isMarkedDeleted(tableint(i))) remap[i] = int64_t(live++);
+
+        h.count = live;
+        h.size_data_per_element = index.size_data_per_element_;
+        h.offset_level0 = index.offsetLevel0_;
+        h.offset_data = index.offsetData_;
+        h.label_offset = index.label_offset_;
+        h.data_size = index.label_offset_ - index.offsetData_;
+        h.size_links_per_element = index.size_links_per_element_;
+        h.size_links_level0 = index.size_links_level0_;
+        h.max_m = index.maxM_;
+        h.max_m0 = index.maxM0_;
+        h.m = index.M_;
+        h.ef_construction = index.ef_construction_;
+        h.mult = index.mult_;
+
+        img.level0_storage.resize(live * h.size_data_per_element);
+        img.levels.resize(live);
+        std::vector<uint64_t> upper_offsets(live, 0);
+        for (size_t i = 0; i < n; i++) {
+            if (remap[i] < 0) continue;
+            size_t id = size_t(remap[i]);
+            char *dst = img.level0_storage.data() + id * h.size_data_per_element;
+            std::memcpy(dst, index.data_level0_memory_ + i * h.size_data_per_element, h.size_data_per_element);
+            remap_list(dst + h.offset_level0, remap);
+
+            int level = std::max(0, index.element_levels_[i]);
+            img.levels[id] = uint32_t(level);
+            upper_offsets[id] = img.upper_storage.size();
+            size_t bytes = size_t(level) * h.size_links_per_element;
+            if (bytes == 0) continue;
+            img.upper_storage.resize(img.upper_storage.size() + bytes);
+            char *up = img.upper_storage.data() + upper_offsets[id];
+            std::memcpy(up, index.linkLists_[i], bytes);
+            for (int l = 0; l < level; l++) remap_list(up + l * h.size_links_per_element, remap);
+        }
+
+        // Punto de entrada: el actual si sigue vivo, si no el vivo más alto
+        int64_t ep = index.enterpoint_node_ < n ? remap[index.enterpoint_node_] : -1;
+        if (ep < 0) {
+            for (size_t id = 0; id < live; id++)
+                if (ep < 0 || img.levels[id] > img.levels[size_t(ep)]) ep = int64_t(id);
+        }
+        h.entry_point = ep < 0 ? 0 : uint32_t(ep);
+        h.max_level = ep < 0 ? -1 : int32_t(img.levels[size_t(ep)]);
+
+        img.level0 = img.level0_storage.data();
+        img.upper.resize(live);
+        for (size_t id = 0; id < live; id++)
+            img.upper[id] = img.levels[id] ? img.upper_storage.data() + upper_offsets[id] : nullptr;
+        img.build_labels();
+        return img;
+    }
+
+private:
+    // Reescribe la lista (x, level) si contiene borrados; true si la cambió
+    static bool repair_list(Index &index, tableint x, int level, std::vector<tableint> &cand) {
+        hnswlib::linklistsizeint *ll = index.get_linklist_at_level(x, level);
+        size_t count = index.getListCount(ll);
+        tableint *links = reinterpret_cast<tableint *>(ll + 1);
+        bool dirty = false;
+        for (size_t j = 0; j < count && !dirty; j++) dirty = index.isMarkedDeleted(links[j]);
+        if (!dirty) return false;
+
+        cand.clear();
+        for (size_t j = 0; j < count; j++) {
+            tableint nb = links[j];
+            if (!index.isMarkedDeleted(nb)) {
+                cand.push_back(nb);
+                continue;
+            }
+            // Vecinos del borrado en la misma capa
+            hnswlib::linklistsizeint *dl = index.get_linklist_at_level(nb, level);
+            size_t dc = index.getListCount(dl);
+            const tableint *dlinks = reinterpret_cast<const tableint *>(dl + 1);
+            for (size_t m = 0; m < dc; m++)
+                if (dlinks[m] != x && !index.isMarkedDeleted(dlinks[m])) cand.push_back(dlinks[m]);
+        }
+        std::sort(cand.begin(), cand.end());
+        cand.erase(std::unique(cand.begin(), cand.end()), cand.end());
+
+        const void *xdata = index.getDataByInternalId(x);
+        std::priority_queue<std::pair<float, tableint>, std::vector<std::pair<float, tableint>>,
+                            Index::CompareByFirst>
+            top;
+        for (tableint c : cand)
+            top.emplace(index.fstdistfunc_(xdata, index.getDataByInternalId(c), index.dist_func_param_), c);
+        size_t cap = level == 0 ? index.maxM0_ : index.maxM_;
+        if (top.size() > cap) index.getNeighborsByHeuristic2(top, cap);
+
+        size_t k = 0;
+        while (!top.empty()) {
+            links[k++] = top.top().second;
+            top.pop();
+        }
+        index.setListCount(ll, static_cast<unsigned short>(k));
+        return true;
+    }
+
+    // Traduce ids de una lista de enlaces; los que apuntan a borrados se descartan
+    static void remap_list(char *list, const std::vector<int64_t> &remap) {
+        unsigned short count;
+        std::memcpy(&count, list, sizeof(count));
+        tableint *links = reinterpret_cast<tableint *>(list + sizeof(hnswlib::linklistsizeint));
+        unsigned short kept = 0;
+        for (unsigned short j = 0; j < count; j++) {
+            int64_t id = remap[links[j]];
+            if (id >= 0) links[kept++] = tableint(id);
+        }
+        std::memcpy(list, &kept, sizeof(kept));
+    }
+};
@@ -0,0 +1,347 @@
+#pragma once
+#include "latency_histogram.hpp"
+#include "search_engine.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// =================== BÚSQUEDA CON VARIOS THREADS POR QUERY ===================
+//
+// Para cargas de pocas QPS y ef alto, la cola de latencia la ponen las
+// queries pesadas, que el motor por lotes resuelve en un solo thread. Aquí
+// un equipo de team_size threads resuelve cada query:
+//   1. el líder baja por las capas superiores y abre unos pocos nodos de la
+//      capa 0 alrededor del punto de entrada (semillas)
+//   2. las semillas se reparten entre los miembros, y cada uno hace la
+//      búsqueda en haz desde las suyas. La lista de visitados es común y
+//      cada nodo lo reclama un solo miembro (intercambio atómico), así que
+//      los miembros exploran regiones disjuntas sin repetir distancias
+//   3. cada miembro publica la peor distancia de su top cuando ya tiene ef
+//      nodos; el mínimo de esas cotas acota el top-ef global y sirve para
+//      podar a todos
+//   4. el líder fusiona los top de los miembros y se queda con los k mejores
+// Con teams equipos se usan teams*team_size threads, el mismo número de
+// núcleos que el motor por lotes con ese número de workers.
+
+class IntraQuerySearcher {
+private:
+    struct alignas(64) Team {
+        HnswGraphView graph;            // copia de la capa 0 que usa el equipo
+        std::vector<uint16_t> visited;  // común a los miembros
+        uint16_t tag = 0;
+        std::vector<std::unique_ptr<SearchContext>> members;
+        std::vector<std::vector<std::pair<float, tableint>>> seeds;  // por miembro
+
+        // Publicación de la query en curso (la escribe el líder)
+        const void *query = nullptr;
+        size_t ef = 0;
+        alignas(64) std::atomic<uint64_t> generation{0};
+        alignas(64) std::atomic<int> pending{0};
+        alignas(64) std::atomic<float> bound{0.0f};
+        std::atomic<bool> stop{false};
+        uint64_t launched = 0;  // generación al lanzar los threads
+    };
+
+    HnswGraphView graph;
+    int team_size;
+    int num_teams;
+    std::vector<std::unique_ptr<Team>> teams;
+    std::vector<LatencyHistogram> histograms;
+    std::function<void(int)> thread_init;
+    std::function<void(int)> thread_exit;
+    NormalizeFn normalize = nullptr;
+    size_t query_dim = 0;
+    std::vector<std::vector<float>> query_buffers;  // uno por equipo
+
+    static void lower_bound_to(std::atomic<float> &b, float v) {
+        float cur = b.load(std::memory_order_relaxed);
+        while (v < cur && !b.compare_exchange_weak(cur, v, std::memory_order_relaxed)) {
+        }
+    }
+
+    // true si este miembro es el primero en visitar id
+    static bool claim(uint16_t *visited, tableint id, uint16_t tag) {
+        if (__atomic_load_n(visited + id, __ATOMIC_RELAXED) == tag) return false;
+        return __atomic_exchange_n(visited + id, tag, __ATOMIC_RELAXED) != tag;
+    }
+
+    // Descenso por las capas superiores y semillas de la capa 0, repartidas
+    // por turnos entre los miembros (la más cercana al miembro 0, etc.)
+    void seed(Team &t, const void *query, size_t ef) {
+        const HnswGraphView &g = t.graph;
+        SearchContext &lead = *t.members[0];
+        if (++t.tag == 0) {
+            std::fill(t.visited.begin(), t.visited.end(), 0);
+            t.tag = 1;
+        }
+        uint16_t *visited = t.visited.data();
+        tableint ep = GraphSearcher::greedy_upper_layers(g, query, lead);
+
+        auto &pool = lead.candidates;
+        pool.clear();
+        visited[ep] = t.tag;
+        pool.emplace_back(g.dist(query, g.data(ep), g.dist_param), ep);
+        lead.distance_computations++;
+        // Abre los nodos más cercanos hasta tener unas cuantas semillas por miembro
+        size_t want = size_t(team_size) * 4;
+        for (size_t open = 0; open < pool.size() && pool.size() < want; open++) {
+            std::partial_sort(pool.begin() + open, pool.begin() + open + 1, pool.end());
+            const linklistsizeint *ll = g.links0(pool[open].second);
+            unsigned short size = HnswGraphView::link_count(ll);
+            const tableint *nb = reinterpret_cast<const tableint *>(ll + 1);
+            lead.hops++;
+            for (unsigned short i = 0; i < size; i++) {
+                if (visited[nb[i]] == t.tag) continue;
+                visited[nb[i]] = t.tag;
+                pool.emplace_back(g.dist(query, g.data(nb[i]), g.dist_param), nb[i]);
+                lead.distance_computations++;
+            }
+        }
+        std::sort(pool.begin(), pool.end());
+
+        for (auto &s : t.seeds) s.clear();
+        for (size_t i = 0; i < pool.size(); i++) t.seeds[i % team_size].push_back(pool[i]);
+        t.query = query;
+        t.ef = ef;
+        t.bound.store(std::numeric_limits<float>::max(), std::memory_order_relaxed);
+    }
+
+    // Búsqueda en haz de un miembro desde sus semillas; deja su top en ctx.top
+    void expand(Team &t, int member) {
+        const HnswGraphView &g = t.graph;
+        SearchContext &ctx = *t.members[member];
+        const void *query = t.query;
+        const size_t ef = t.ef;
+        uint16_t *visited = t.visited.data();
+        const uint16_t tag = t.tag;
+        auto &cand = ctx.candidates;
+        auto &top = ctx.top;
+        cand.clear();
+        top.clear();
+        auto cand_cmp = [](const std::pair<float, tableint> &a, const std::pair<float, tableint> &b) {
+            return a.first > b.first;
+        };
+        auto accept = [&](tableint id) { return !g.has_deletions || !g.deleted(id); };
+        auto push_top = [&](float d, tableint id) {
+            top.emplace_back(d, id);
+            std::push_heap(top.begin(), top.end());
+            if (top.size() > ef) {
+                std::pop_heap(top.begin(), top.end());
+                top.pop_back();
+            }
+        };
+
+        for (const auto &s : t.seeds[member]) {
+            cand.emplace_back(s);
+            if (accept(s.second)) push_top(s.first, s.second);
+        }
+        std::make_heap(cand.begin(), cand.end(), cand_cmp);
+        float lower = top.size() >= ef ? top.front().first : std::numeric_limits<float>::max();
+        if (top.size() >= ef) lower_bound_to(t.bound, lower);
+
+        while (!cand.empty()) {
+            std::pair<float, tableint> cur = cand.front();
+            float shared = t.bound.load(std::memory_order_relaxed);
+            if (cur.first > shared || (cur.first > lower && top.size() >= ef)) break;
+            std::pop_heap(cand.begin(), cand.end(), cand_cmp);
+            cand.pop_back();
+
+            const linklistsizeint *ll = g.links0(cur.second);
+            unsigned short size = HnswGraphView::link_count(ll);
+            const tableint *nb = reinterpret_cast<const tableint *>(ll + 1);
+            ctx.hops++;
+            if (size > 0) __builtin_prefetch(g.data(nb[0]));
+            for (unsigned short i = 0; i < size; i++) {
+                tableint id = nb[i];
+                if (i + 1 < size) __builtin_prefetch(g.data(nb[i + 1]));
+                if (!claim(visited, id, tag)) continue;
+
+                float d = g.dist(query, g.data(id), g.dist_param);
+                ctx.distance_computations++;
+                float limit = top.size() < ef ? shared : std::min(lower, shared);
+                if (d < limit) {
+                    cand.emplace_back(d, id);
+                    std::push_heap(cand.begin(), cand.end(), cand_cmp);
+                    if (accept(id)) {
+                        push_top(d, id);
+                        if (top.size() >= ef) {
+                            lower = top.front().first;
+                            lower_bound_to(t.bound, lower);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Fusión de los top de los miembros: los k más cercanos, ordenados
+    size_t merge(Team &t, size_t k, uint64_t *out_labels, float *out_dists) {
+        auto &all = t.members[0]->candidates;  // el líder ya no la necesita
+        all.clear();
+        for (auto &m : t.members) all.insert(all.end(), m->top.begin(), m->top.end());
+        size_t found = std::min(k, all.size());
+        std::partial_sort(all.begin(), all.begin() + found, all.end());
+        for (size_t i = 0; i < found; i++) {
+            out_labels[i] = t.graph.label(all[i].second);
+            if (out_dists) out_dists[i] = all[i].first;
+        }
+        return found;
+    }
+
+    static void wait_spin(unsigned &idle) {
+        if (++idle < 256)
+            __builtin_ia32_pause();
+        else
+            std::this_thread::yield();
+    }
+
+public:
+    IntraQuerySearcher(const HnswGraphView &g, int threads_per_query, int teams_count)
+        : graph(g), team_size(std::max(1, threads_per_query)), num_teams(std::max(1, teams_count)) {
+        for (int t = 0; t < num_teams; t++) {
+            std::unique_ptr<Team> team(new Team());
+            team->graph = graph;
+            team->visited.assign(graph.count, 0);
+            for (int m = 0; m < team_size; m++) team->members.emplace_back(new SearchContext(0));
+            team->seeds.resize(team_size);
+            teams.push_back(std::move(team));
+        }
+        histograms.resize(num_teams);
+    }
+
+    int threads() const { return team_size * num_teams; }
+
+    // tid global = equipo * team_size + miembro; el miembro 0 es el líder
+    void on_thread_start(std::function<void(int)> fn) { thread_init = std::move(fn); }
+    void on_thread_exit(std::function<void(int)> fn) { thread_exit = std::move(fn); }
+
+    // Grafo del equipo team_id (p. ej. la réplica de la capa 0 del nodo de su
+    // líder); se puede llamar desde on_thread_start del líder, que lo publica
+    // a los ayudantes junto con la primera query
+    void use_graph(int team_id, const HnswGraphView &g) { teams[team_id]->graph = g; }
+
+    // Como en BatchSearcher: el líder normaliza la query antes de sembrar
+    void use_query_normalizer(NormalizeFn fn, size_t dim) {
+        normalize = fn;
+        query_dim = dim;
+        query_buffers.assign(num_teams, std::vector<float>(dim));
+    }
+
+    // Mismo contrato que BatchSearcher::searchBatchRaw; per_thread_queries
+    // cuenta las queries de cada equipo en el thread de su líder
+    BatchSearchStats searchBatchRaw(const void *queries, size_t query_bytes, size_t n, size_t k,
+                                    size_t ef, uint64_t *out_ids, float *out_dists,
+                                    double *latencies_ms = nullptr) {
+        BatchSearchStats stats;
+        stats.per_thread_queries.assign(threads(), 0);
+        std::atomic<size_t> next{0};
+        const char *qbase = static_cast<const char *>(queries);
+        ef = std::max(ef, k);
+
+        auto leader = [&](int team_id) {
+            Team &t = *teams[team_id];
+            LatencyHistogram &hist = histograms[team_id];
+            hist.reset();
+            size_t done = 0;
+            while (true) {
+                size_t q = next.fetch_add(1, std::memory_order_relaxed);
+                if (q >= n) break;
+                auto t0 = std::chrono::high_resolution_clock::now();
+                uint64_t *ids = out_ids + q * k;
+                float *dists = out_dists ? out_dists + q * k : nullptr;
+                size_t found = 0;
+                if (graph.count > 0 && k > 0) {
+                    const void *query = qbase + q * query_bytes;
+                    if (normalize) {
+                        float *buf = query_buffers[team_id].data();
+                        normalize(static_cast<const float *>(query), buf, query_dim);
+                        query = buf;
+                    }
+                    seed(t, query, ef);
+                    t.pending.store(team_size - 1, std::memory_order_relaxed);
+                    t.generation.fetch_add(1, std::memory_order_release);
+                    expand(t, 0);
+                    unsigned idle = 0;
+                    while (t.pending.load(std::memory_order_acquire) != 0) wait_spin(idle);
+                    found = merge(t, k, ids, dists);
+                }
+                for (size_t i = found; i < k; i++) {
+                    ids[i] = UINT64_MAX;
+                    if (dists) dists[i] = std::numeric_limits<float>::infinity();
+                }
+                auto t1 = std::chrono::high_resolution_clock::now();
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                hist.record(ns);
+                if (latencies_ms) latencies_ms[q] = ns / 1e6;
+                done++;
+            }
+            t.stop.store(true, std::memory_order_release);
+            stats.per_thread_queries[team_id * team_size] = done;
+        };
+
+        auto helper = [&](int team_id, int member) {
+            Team &t = *teams[team_id];
+            uint64_t seen = t.launched;
+            unsigned idle = 0;
+            while (true) {
+                uint64_t gen = t.generation.load(std::memory_order_acquire);
+                if (gen == seen) {
+                    if (t.stop.load(std::memory_order_acquire)) break;
+                    wait_spin(idle);
+                    continue;
+                }
+                seen = gen;
+                idle = 0;
+                expand(t, member);
+                t.pending.fetch_sub(1, std::memory_order_release);
+            }
+        };
+
+        auto run = [&](int tid) {
+            if (thread_init) thread_init(tid);
+            int team_id = tid / team_size, member = tid % team_size;
+            SearchContext &ctx = *teams[team_id]->members[member];
+            ctx.hops = ctx.distance_computations = 0;
+            if (member == 0)
+                leader(team_id);
+            else
+                helper(team_id, member);
+            if (thread_exit) thread_exit(tid);
+        };
+
+        // Los ayudantes parten de la generación previa al arranque: si el
+        // líder publica su primera query antes de que arranquen, no se pierde
+        for (auto &t : teams) {
+            t->stop.store(false);
+            t->launched = t->generation.load();
+        }
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int tid = 0; tid < this->threads(); tid++) threads.emplace_back(run, tid);
+        for (auto &th : threads) th.join();
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        stats.total_time_s = std::chrono::duration<double>(t1 - t0).count();
+        stats.qps = stats.total_time_s > 0 ? n / stats.total_time_s : 0.0;
+        for (auto &t : teams)
+            for (auto &m : t->members) {
+                stats.hops += m->hops;
+                stats.distance_computations += m->distance_computations;
+            }
+        for (const auto &h : histograms) stats.latency.merge(h);
+        return stats;
+    }
+
+    BatchSearchStats searchBatch(const float *queries, size_t n, int dim, size_t k, size_t ef,
+                                 uint64_t *out_ids, float *out_dists,
+                                 double *latencies_ms = nullptr) {
+        return searchBatchRaw(queries, dim * sizeof(float), n, k, ef, out_ids, out_dists,
+                              latencies_ms);
+    }
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// =================== HISTOGRAMA DE LATENCIAS LOG-LINEAL (ESTILO HDR) ===================
+//
+// Valores en nanosegundos. Por debajo de 256 ns cada valor tiene su propio
+// bucket; por encima, cada potencia de 2 se divide en 128 sub-buckets, así
+// el error relativo de cualquier percentil es < 0.8% en todo el rango
+// (hasta ~4.9 h). Memoria fija (~38 KB) reservada al construir: record()
+// no asigna, no bloquea y no ordena nada.
+//
+// Uso típico: un histograma por thread (record sin sincronización) y
+// merge() al final. ConcurrentLatencyHistogram permite además leer el
+// histograma mientras su único escritor sigue registrando.
+
+namespace latency_detail {
+
+constexpr int SUB_BITS = 8;
+constexpr uint64_t SUB_COUNT = uint64_t(1) << SUB_BITS;  // 256 buckets exactos
+constexpr uint64_t HALF = SUB_COUNT / 2;                  // 128 sub-buckets por octava
+constexpr int MAX_EXP = 43;                               // 2^44 ns ≈ 4.9 h
+constexpr size_t BUCKETS = SUB_COUNT + size_t(MAX_EXP - SUB_BITS + 1) * HALF;
+constexpr uint64_t MAX_VALUE = (uint64_t(1) << (MAX_EXP + 1)) - 1;
+
+inline size_t index_of(uint64_t ns) {
+    if (ns < SUB_COUNT) return size_t(ns);
+    if (ns > MAX_VALUE) ns = MAX_VALUE;
+    int e = 63 - __builtin_clzll(ns);
+    int shift = e - (SUB_BITS - 1);
+    uint64_t m = ns >> shift;  // en [HALF, SUB_COUNT)
+    return size_t(SUB_COUNT + uint64_t(shift - 1) * HALF + (m - HALF));
+}
+
+// Mayor valor que cae en el bucket i
+inline uint64_t highest_of(size_t i) {
+    if (i < SUB_COUNT) return i;
+    uint64_t shift = (i - SUB_COUNT) / HALF + 1;
+    uint64_t m = (i - SUB_COUNT) % HALF + HALF;
+    return ((m + 1) << shift) - 1;
+}
+
+inline uint64_t lowest_of(size_t i) {
+    if (i < SUB_COUNT) return i;
+    uint64_t shift = (i - SUB_COUNT) / HALF + 1;
+    uint64_t m = (i - SUB_COUNT) % HALF + HALF;
+    return m << shift;
+}
+
+}  // namespace latency_detail
+
+class LatencyHistogram {
+private:
+    std::unique_ptr<uint64_t[]> counts_;
+    uint64_t total_ = 0;
+    uint64_t sum_ns_ = 0;
+    uint64_t min_ns_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ns_ = 0;
+
+public:
+    static constexpr size_t BUCKETS = latency_detail::BUCKETS;
+
+    LatencyHistogram() : counts_(new uint64_t[BUCKETS]()) {}
+
+    LatencyHistogram(const LatencyHistogram &o) : LatencyHistogram() { *this = o; }
+    LatencyHistogram &operator=(const LatencyHistogram &o) {
+        if (this != &o) {
+            std::copy(o.counts_.get(), o.counts_.get() + BUCKETS, counts_.get());
+            total_ = o.total_;
+            sum_ns_ = o.sum_ns_;
+            min_ns_ = o.min_ns_;
+            max_ns_ = o.max_ns_;
+        }
+        return *this;
+    }
+    LatencyHistogram(LatencyHistogram &&) = default;
+    LatencyHistogram &operator=(LatencyHistogram &&) = default;
+
+    void record(uint64_t ns) {
+        counts_[latency_detail::index_of(ns)]++;
+        total_++;
+        sum_ns_ += ns;
+        min_ns_ = std::min(min_ns_, ns);
+        max_ns_ = std::max(max_ns_, ns);
+    }
+
+    void reset() {
+        std::fill(counts_.get(), counts_.get() + BUCKETS, 0);
+        total_ = sum_ns_ = max_ns_ = 0;
+        min_ns_ = std::numeric_limits<uint64_t>::max();
+    }
+
+    void merge(const LatencyHistogram &o) {
+        for (size_t i = 0; i < BUCKETS; i++) counts_[i] += o.counts_[i];
+        total_ += o.total_;
+        sum_ns_ += o.sum_ns_;
+        min_ns_ = std::min(min_ns_, o.min_ns_);
+        max_ns_ = std::max(max_ns_, o.max_ns_);
+    }
+
+    // Diferencia respecto a una lectura anterior del mismo histograma
+    // (intervalos en vivo). min/max pasan a ser los límites de los buckets.
+    LatencyHistogram delta_since(const LatencyHistogram &prev) const {
+        LatencyHistogram d;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            uint64_t c = counts_[i] - std::min(counts_[i], prev.counts_[i]);
+            if (!c) continue;
+            d.counts_[i] = c;
+            d.total_ += c;
+            d.min_ns_ = std::min(d.min_ns_, latency_detail::lowest_of(i));
+            d.max_ns_ = std::max(d.max_ns_, std::min(max_ns_, latency_detail::highest_of(i)));
+        }
+        d.sum_ns_ = sum_ns_ - std::min(sum_ns_, prev.sum_ns_);
+        return d;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min_ns() const { return total_ ? min_ns_ : 0; }
+    uint64_t max_ns() const { return max_ns_; }
+    double mean_ns() const { return total_ ? double(sum_ns_) / total_ : 0.0; }
+
+    // q en [0, 1]; devuelve el mayor valor equivalente del bucket que
+    // contiene el percentil, acotado por el máximo observado
+    uint64_t percentile_ns(double q) const {
+        if (total_ == 0) return 0;
+        q = std::min(1.0, std::max(0.0, q));
+        uint64_t rank = std::max<uint64_t>(1, uint64_t(q * total_ + 0.5));
+        uint64_t acc = 0;
+        for (size_t i = 0; i < BUCKETS; i++) {
+            acc += counts_[i];
+            if (acc >= rank) return std::max(min_ns(), std::min(max_ns_, latency_detail::highest_of(i)));
+        }
+        return max_ns_;
+    }
+
+    double percentile_ms(double q) const { return percentile_ns(q) / 1e6; }
+    double mean_ms() const { return mean_ns() / 1e6; }
+    double max_ms() const { return max_ns_ / 1e6; }
+    double min_ms() const { return min_ns() / 1e6; }
+
+    // Filas metric,value para los resúmenes CSV
+    void write_csv(std::ostream &os, const std::string &prefix = "") const {
+        os << prefix << "avg_latency_ms," << mean_ms() << "\n";
+        os << prefix << "min_ms," << min_ms() << "\n";
+        os << prefix << "p50_ms," << percentile_ms(0.50) << "\n";
+        os << prefix << "p90_ms," << percentile_ms(0.90) << "\n";
+        os << prefix << "p95_ms," << percentile_ms(0.95) << "\n";
+        os << prefix << "p99_ms," << percentile_ms(0.99) << "\n";
+        os << prefix << "p999_ms," << percentile_ms(0.999) << "\n";
+        os << prefix << "max_ms," << max_ms() << "\n";
+    }
+
+    void print(std::ostream &os) const {
+        os << "Latencia promedio: " << mean_ms() << " ms\n";
+        os << "P50 (mediana): " << percentile_ms(0.50) << " ms\n";
+        os << "P90: " << percentile_ms(0.90) << " ms\n";
+        os << "P95: " << percentile_ms(0.95) << " ms\n";
+        os << "P99: " << percentile_ms(0.99) << " ms\n";
+        os << "P99.9: " << percentile_ms(0.999) << " ms\n";
+        os << "Máximo: " << max_ms() << " ms\n";
+    }
+
+    friend class ConcurrentLatencyHistogram;
+};
+
+// Un solo escritor (sin RMW: load + store relajados) y lectores en
+// cualquier thread mediante snapshot()
+class ConcurrentLatencyHistogram {
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> counts_;
+    std::atomic<uint64_t> sum_ns_{0};
+    std::atomic<uint64_t> max_ns_{0};
+
+    static void bump(std::atomic<uint64_t> &a, uint64_t v) {
+        a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+public:
+    ConcurrentLatencyHistogram() : counts_(new std::atomic<uint64_t>[LatencyHistogram::BUCKETS]) {
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) counts_[i].store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t ns) {
+        bump(counts_[latency_detail::index_of(ns)], 1);
+        bump(sum_ns_, ns);
+        if (ns > max_ns_.load(std::memory_order_relaxed)) max_ns_.store(ns, std::memory_order_relaxed);
+    }
+
+    // Copia coherente salvo por registros concurrentes en curso
+    void snapshot(LatencyHistogram &out) const {
+        out.reset();
+        for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            uint64_t c = counts_[i].load(std::memory_order_relaxed);
+            if (!c) continue;
+            out.counts_[i] = c;
+            out.total_ += c;
+            out.min_ns_ = std::min(out.min_ns_, latency_detail::lowest_of(i));
+        }
+        out.sum_ns_ = sum_ns_.load(std::memory_order_relaxed);
+        out.max_ns_ = max_ns_.load(std::memory_order_relaxed);
+    }
+};
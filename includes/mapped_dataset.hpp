@@ -0,0 +1,170 @@
+#pragma once
+#include <cstdint>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// =================== VISTAS SIN COPIA SOBRE ARCHIVOS MAPEADOS ===================
+//
+// MappedDataset mantiene vivo el mmap() del archivo y entrega punteros a
+// filas directamente, sin memcpy a un std::vector. Con 'writable' el mapeo
+// es MAP_PRIVATE + PROT_WRITE: las escrituras (p.ej. normalizar in-place)
+// solo copian las páginas tocadas y nunca modifican el archivo.
+
+struct EmbeddingView {
+    const float *data = nullptr;
+    size_t n = 0;
+    int dim = 0;
+
+    const float *row(size_t i) const { return data + i * dim; }
+};
+
+class MappedFile {
+private:
+    void *addr = nullptr;
+    size_t bytes = 0;
+
+public:
+    MappedFile() = default;
+
+    // extra_flags se suma a MAP_PRIVATE (p.ej. MAP_POPULATE para precargar)
+    MappedFile(const std::string &path, bool writable = false, int extra_flags = 0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) throw std::runtime_error("No se pudo abrir: " + path);
+
+        struct stat sb;
+        if (fstat(fd, &sb) == -1) {
+            close(fd);
+            throw std::runtime_error("No se pudo obtener tamaño: " + path);
+        }
+        bytes = sb.st_size;
+
+        if (bytes > 0) {
+            int prot = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+            addr = mmap(nullptr, bytes, prot, MAP_PRIVATE | extra_flags, fd, 0);
+            if (addr == MAP_FAILED) {
+                addr = nullptr;
+                close(fd);
+                throw std::runtime_error("mmap falló: " + path);
+            }
+        }
+        // El mapeo sigue siendo válido tras cerrar el descriptor
+        close(fd);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&o) noexcept { *this = std::move(o); }
+    MappedFile &operator=(MappedFile &&o) noexcept {
+        if (this != &o) {
+            release();
+            addr = std::exchange(o.addr, nullptr);
+            bytes = std::exchange(o.bytes, 0);
+        }
+        return *this;
+    }
+
+    ~MappedFile() { release(); }
+
+    // Memoria anónima privada del tamaño de un archivo (carga con read/io_uring)
+    static MappedFile anonymous(size_t bytes) {
+        MappedFile f;
+        if (bytes > 0) {
+            f.addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (f.addr == MAP_FAILED) {
+                f.addr = nullptr;
+                throw std::runtime_error("mmap anónimo falló");
+            }
+            f.bytes = bytes;
+        }
+        return f;
+    }
+
+    void advise(int advice) const {
+        if (addr) madvise(addr, bytes, advice);
+    }
+
+    void *data() const { return addr; }
+    size_t size() const { return bytes; }
+
+private:
+    void release() {
+        if (addr) munmap(addr, bytes);
+        addr = nullptr;
+        bytes = 0;
+    }
+};
+
+class MappedDataset {
+private:
+    MappedFile file;
+    size_t n = 0;
+    int dim = 0;
+
+public:
+    MappedDataset() = default;
+
+    MappedDataset(const std::string &path, int d, bool writable = false)
+        : file(path, writable), dim(d) {
+        if (file.size() % (sizeof(float) * dim) != 0)
+            throw std::runtime_error("Tamaño de archivo incorrecto para dim=" +
+                                     std::to_string(dim));
+        n = file.size() / (sizeof(float) * dim);
+        file.advise(MADV_SEQUENTIAL);
+        file.advise(MADV_WILLNEED);
+    }
+
+    // Adopta memoria ya rellenada (async_loader.hpp); siempre escribible
+    MappedDataset(MappedFile &&memory, int d) : file(std::move(memory)), dim(d) {
+        n = file.size() / (sizeof(float) * dim);
+    }
+
+    size_t size() const { return n; }
+    int dimension() const { return dim; }
+    size_t bytes() const { return file.size(); }
+
+    const float *row(size_t i) const {
+        return static_cast<const float *>(file.data()) + i * dim;
+    }
+
+    // Solo válido si el dataset se abrió con writable = true
+    float *mutable_row(size_t i) {
+        return static_cast<float *>(file.data()) + i * dim;
+    }
+
+    EmbeddingView view() const {
+        return EmbeddingView{static_cast<const float *>(file.data()), n, dim};
+    }
+
+    // Tras la construcción se puede avisar al kernel de que ya no se leerá
+    void advise(int advice) const { file.advise(advice); }
+};
+
+class MappedIds {
+private:
+    MappedFile file;
+    size_t n = 0;
+
+public:
+    MappedIds() = default;
+
+    explicit MappedIds(const std::string &path) : file(path) {
+        if (file.size() % sizeof(uint64_t) != 0)
+            throw std::runtime_error("Tamaño de archivo incorrecto para IDs");
+        n = file.size() / sizeof(uint64_t);
+        file.advise(MADV_SEQUENTIAL);
+    }
+
+    explicit MappedIds(MappedFile &&memory) : file(std::move(memory)) {
+        n = file.size() / sizeof(uint64_t);
+    }
+
+    size_t size() const { return n; }
+    const uint64_t *data() const { return static_cast<const uint64_t *>(file.data()); }
+    uint64_t operator[](size_t i) const { return data()[i]; }
+};
@@ -0,0 +1,483 @@
+#pragma once
+#include "crc32c.hpp"
+#include "mapped_dataset.hpp"
+#include "search_engine.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// =================== FORMATO DE ÍNDICE MAPEABLE ===================
+//
+// Layout en disco (todas las secciones alineadas a 64 bytes):
+//
+//   [cabecera]       MappedIndexHeader: parámetros del grafo + tabla de secciones
+//   [LEVEL0]         count * size_data_per_element, idéntico a data_level0_memory_
+//   [LEVELS]         uint32 por elemento (nivel máximo del nodo)
+//   [UPPER_OFFSETS]  uint64 por elemento: desplazamiento de sus listas
+//                    superiores dentro de UPPER_LINKS (0 si nivel 0)
+//   [UPPER_LINKS]    listas de capas 1..nivel concatenadas, mismo formato
+//                    que linkLists_ de hnswlib
+//   [LABELS]         pares (label, id interno) ordenados por label
+//
+// El grafo se recorre directamente sobre el mmap del archivo: abrir el
+// índice no copia nada, y varios procesos comparten las mismas páginas
+// del page cache.
+//
+// Cada sección lleva su CRC32C (flag SECTION_CRC32C) y la cabecera el suyo
+// propio, calculado con header_checksum = 0. La escritura está en index_io.hpp.
+
+namespace mapped_index {
+
+constexpr char MAGIC[8] = {'H', 'N', 'S', 'W', 'M', 'A', 'P', '1'};
+// 2: cabecera con header_checksum y flags, CRC32C por sección. La versión 1
+// (sin checksums) no se lee: se regenera con hnsw_convert.
+constexpr uint32_t VERSION = 2;
+constexpr size_t SECTION_ALIGN = 64;
+
+enum SectionId : uint32_t {
+    SEC_LEVEL0 = 0,
+    SEC_LEVELS,
+    SEC_UPPER_OFFSETS,
+    SEC_UPPER_LINKS,
+    SEC_LABELS,
+    SECTION_COUNT
+};
+
+enum SectionFlags : uint32_t {
+    SECTION_CRC32C = 1,  // checksum válido
+};
+
+enum HeaderFlags : uint32_t {
+    HEADER_META = 1,  // metric/dim/storage/meta_flags válidos (ver index_meta.hpp)
+    // Borrados contados al escribir: HEADER_HAS_DELETIONS es fiable y abrir
+    // el índice no necesita recorrer la capa 0
+    HEADER_DELETIONS_KNOWN = 2,
+    HEADER_HAS_DELETIONS = 4,
+};
+
+inline const char *section_name(uint32_t id) {
+    static const char *names[] = {"level0", "levels", "upper_offsets", "upper_links", "labels"};
+    return id < SECTION_COUNT ? names[id] : "?";
+}
+
+inline uint64_t align_up(uint64_t x, uint64_t a = SECTION_ALIGN) { return (x + a - 1) / a * a; }
+
+struct Section {
+    uint64_t offset = 0;
+    uint64_t bytes = 0;
+    uint32_t checksum = 0;
+    uint32_t flags = 0;
+    uint64_t reserved = 0;
+};
+
+struct LabelEntry {
+    uint64_t label;
+    uint64_t id;
+};
+
+struct alignas(64) Header {
+    char magic[8];
+    uint32_t version = VERSION;
+    uint32_t header_bytes = 0;
+    uint64_t file_bytes = 0;
+    uint64_t count = 0;
+    uint64_t size_data_per_element = 0;
+    uint64_t offset_level0 = 0;
+    uint64_t offset_data = 0;
+    uint64_t label_offset = 0;
+    uint64_t data_size = 0;  // bytes del vector guardado por elemento
+    uint64_t size_links_per_element = 0;
+    uint64_t size_links_level0 = 0;
+    uint64_t max_m = 0;
+    uint64_t max_m0 = 0;
+    uint64_t m = 0;
+    uint64_t ef_construction = 0;
+    double mult = 0.0;
+    int32_t max_level = -1;
+    uint32_t entry_point = 0;
+    uint32_t header_checksum = 0;
+    uint32_t flags = 0;
+    Section sections[SECTION_COUNT];
+    // Metadatos de la métrica (flag HEADER_META). Ocupan el relleno final
+    // de la cabecera original, así que los archivos previos siguen valiendo.
+    uint32_t metric = 0;
+    uint32_t dim = 0;
+    uint32_t storage = 0;
+    uint32_t meta_flags = 0;
+
+    Header() { std::memcpy(magic, MAGIC, sizeof(magic)); }
+};
+
+static_assert(sizeof(Header) % SECTION_ALIGN == 0, "cabecera debe ocupar múltiplo de 64");
+static_assert(sizeof(Header) == 320, "el tamaño de la cabecera es parte del formato");
+
+inline uint32_t header_crc(const Header &h) {
+    Header copy = h;
+    copy.header_checksum = 0;
+    return crc32c::compute(&copy, sizeof(copy));
+}
+
+// [offset, offset + len) dentro de [0, limit), sin desbordar
+inline bool fits(uint64_t offset, uint64_t len, uint64_t limit) {
+    return len <= limit && offset <= limit - len;
+}
+
+// Comprueba firma, checksum de la cabecera, la geometría de cada elemento y
+// que cada sección tenga exactamente el tamaño que implican count y esa
+// geometría y quepa en el archivo. Un CRC válido no basta: un archivo
+// fabricado con tamaños incoherentes haría leer fuera del mapeo.
+inline void check_header(const Header &h, size_t file_size, const std::string &path) {
+    if (std::memcmp(h.magic, MAGIC, sizeof(MAGIC)) != 0)
+        throw std::runtime_error("Formato de índice mapeable no reconocido: " + path);
+    if (h.version != VERSION)
+        throw std::runtime_error("Versión " + std::to_string(h.version) +
+                                 " del índice mapeable no soportada (se espera " +
+                                 std::to_string(VERSION) + "); regenerarlo desde el índice hnswlib con hnsw_convert: " + path);
+    if (h.header_checksum != header_crc(h))
+        throw std::runtime_error("Checksum de cabecera incorrecto: " + path);
+    if (h.file_bytes > file_size)
+        throw std::runtime_error("Índice mapeable truncado (" + std::to_string(file_size) + " de " +
+                                 std::to_string(h.file_bytes) + " bytes): " + path);
+
+    using hnswlib::linklistsizeint;
+    using hnswlib::tableint;
+    const uint64_t elem = h.size_data_per_element;
+    bool geometry = elem > 0 && fits(h.offset_level0, h.size_links_level0, elem) &&
+                    fits(h.offset_data, h.data_size, elem) &&
+                    fits(h.label_offset, sizeof(hnswlib::labeltype), elem) &&
+                    h.max_m0 < (uint64_t(1) << 16) && h.max_m < (uint64_t(1) << 16) &&
+                    h.size_links_level0 == sizeof(linklistsizeint) + h.max_m0 * sizeof(tableint) &&
+                    h.size_links_per_element == sizeof(linklistsizeint) + h.max_m * sizeof(tableint) &&
+                    h.count <= uint64_t(UINT32_MAX) && (h.count == 0 || h.entry_point < h.count) &&
+                    h.max_level >= (h.count ? 0 : -1);
+    if (!geometry) throw std::runtime_error("Parámetros del grafo incoherentes en la cabecera: " + path);
+
+    uint64_t level0_bytes;
+    if (__builtin_mul_overflow(h.count, elem, &level0_bytes))
+        throw std::runtime_error("Tamaño de la capa 0 desbordado: " + path);
+    // count <= 2^32: los demás productos caben en 64 bits
+    const uint64_t expected[SECTION_COUNT] = {
+        level0_bytes,
+        h.count * sizeof(uint32_t),
+        h.count * sizeof(uint64_t),
+        0,  // UPPER_LINKS: depende de los niveles, múltiplo del tamaño de lista
+        h.count * sizeof(LabelEntry),
+    };
+    for (uint32_t s = 0; s < SECTION_COUNT; s++) {
+        const Section &sec = h.sections[s];
+        bool size_ok = s == SEC_UPPER_LINKS ? sec.bytes % h.size_links_per_element == 0
+                                            : sec.bytes == expected[s];
+        if (sec.offset % SECTION_ALIGN != 0 || sec.offset < sizeof(Header) || !size_ok ||
+            !fits(sec.offset, sec.bytes, file_size))
+            throw std::runtime_error(std::string("Sección inválida: ") + section_name(s) + ": " + path);
+    }
+}
+
+// Recalcula el CRC32C de cada sección (lee el archivo entero) y comprueba
+// que las listas superiores de cada elemento caen dentro de UPPER_LINKS
+inline void verify_sections(const Header &h, const char *base, const std::string &path) {
+    for (uint32_t s = 0; s < SECTION_COUNT; s++) {
+        const Section &sec = h.sections[s];
+        if (!(sec.flags & SECTION_CRC32C)) continue;
+        if (crc32c::compute(base + sec.offset, sec.bytes) != sec.checksum)
+            throw std::runtime_error(std::string("Checksum incorrecto en la sección ") +
+                                     section_name(s) + ": " + path);
+    }
+    const uint32_t *levels = reinterpret_cast<const uint32_t *>(base + h.sections[SEC_LEVELS].offset);
+    const uint64_t *offsets = reinterpret_cast<const uint64_t *>(base + h.sections[SEC_UPPER_OFFSETS].offset);
+    for (size_t i = 0; i < h.count; i++) {
+        if (levels[i] > uint32_t(std::max(h.max_level, 0)) ||
+            !fits(offsets[i], uint64_t(levels[i]) * h.size_links_per_element, h.sections[SEC_UPPER_LINKS].bytes))
+            throw std::runtime_error("Listas superiores fuera de rango: " + path);
+    }
+}
+
+// true si el archivo empieza con la firma del formato mapeable
+inline bool is_mapped_format(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    char magic[8] = {};
+    f.read(magic, sizeof(magic));
+    return f && std::memcmp(magic, MAGIC, sizeof(magic)) == 0;
+}
+
+// =================== IMAGEN EN MEMORIA (ORIGEN DE LA ESCRITURA) ===================
+//
+// Describe un índice listo para escribirse: punteros a la capa 0 y a las
+// listas superiores, sea de un HierarchicalNSW vivo o de un archivo de
+// saveIndex leído por el convertidor.
+
+struct IndexImage {
+    Header header;
+    const char *level0 = nullptr;
+    std::vector<uint32_t> levels;
+    std::vector<const char *> upper;  // nullptr para nodos de nivel 0
+    std::vector<LabelEntry> labels;
+
+    // Memoria propia cuando la imagen viene de un archivo
+    std::vector<char> level0_storage;
+    std::vector<char> upper_storage;
+
+    static IndexImage from_index(const hnswlib::HierarchicalNSW<float> &index) {
+        IndexImage img;
+        Header &h = img.header;
+        h.count = index.cur_element_count;
+        h.size_data_per_element = index.size_data_per_element_;
+        h.offset_level0 = index.offsetLevel0_;
+        h.offset_data = index.offsetData_;
+        h.label_offset = index.label_offset_;
+        h.data_size = index.label_offset_ - index.offsetData_;
+        h.size_links_per_element = index.size_links_per_element_;
+        h.size_links_level0 = index.size_links_level0_;
+        h.max_m = index.maxM_;
+        h.max_m0 = index.maxM0_;
+        h.m = index.M_;
+        h.ef_construction = index.ef_construction_;
+        h.mult = index.mult_;
+        h.max_level = index.maxlevel_;
+        h.entry_point = index.enterpoint_node_;
+
+        img.level0 = index.data_level0_memory_;
+        img.levels.resize(h.count);
+        img.upper.resize(h.count);
+        for (size_t i = 0; i < h.count; i++) {
+            img.levels[i] = uint32_t(std::max(0, int(index.element_levels_[i])));
+            img.upper[i] = img.levels[i] > 0 ? index.linkLists_[i] : nullptr;
+        }
+        img.build_labels();
+        return img;
+    }
+
+    // Lee el formato de HierarchicalNSW::saveIndex sin necesitar el espacio
+    // de distancias: el tamaño del vector se deduce de los offsets
+    static IndexImage from_legacy_file(const std::string &path) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) throw std::runtime_error("No se pudo abrir: " + path);
+        auto pod = [&](auto &v) { in.read(reinterpret_cast<char *>(&v), sizeof(v)); };
+
+        size_t offset_level0, max_elements, count, size_data, label_offset, offset_data;
+        int max_level;
+        uint32_t entry_point;
+        size_t max_m, max_m0, m, ef_c;
+        double mult;
+        pod(offset_level0);
+        pod(max_elements);
+        pod(count);
+        pod(size_data);
+        pod(label_offset);
+        pod(offset_data);
+        pod(max_level);
+        pod(entry_point);
+        pod(max_m);
+        pod(max_m0);
+        pod(m);
+        pod(mult);
+        pod(ef_c);
+        if (!in || count > max_elements || label_offset + sizeof(hnswlib::labeltype) > size_data)
+            throw std::runtime_error("Cabecera de índice hnswlib inválida: " + path);
+
+        IndexImage img;
+        Header &h = img.header;
+        h.count = count;
+        h.size_data_per_element = size_data;
+        h.offset_level0 = offset_level0;
+        h.offset_data = offset_data;
+        h.label_offset = label_offset;
+        h.data_size = label_offset - offset_data;
+        h.size_links_per_element = max_m * sizeof(hnswlib::tableint) + sizeof(hnswlib::linklistsizeint);
+        h.size_links_level0 = max_m0 * sizeof(hnswlib::tableint) + sizeof(hnswlib::linklistsizeint);
+        h.max_m = max_m;
+        h.max_m0 = max_m0;
+        h.m = m;
+        h.ef_construction = ef_c;
+        h.mult = mult;
+        h.max_level = max_level;
+        h.entry_point = entry_point;
+
+        img.level0_storage.resize(count * size_data);
+        in.read(img.level0_storage.data(), img.level0_storage.size());
+        img.level0 = img.level0_storage.data();
+
+        // Primera pasada: tamaños; las listas se guardan contiguas
+        std::vector<uint64_t> offsets(count, 0);
+        img.levels.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            uint32_t bytes = 0;
+            pod(bytes);
+            if (!in) throw std::runtime_error("Índice hnswlib truncado: " + path);
+            if (bytes % h.size_links_per_element != 0)
+                throw std::runtime_error("Lista de enlaces corrupta en " + path);
+            img.levels[i] = uint32_t(bytes / h.size_links_per_element);
+            offsets[i] = img.upper_storage.size();
+            img.upper_storage.resize(img.upper_storage.size() + bytes);
+            if (bytes) in.read(img.upper_storage.data() + offsets[i], bytes);
+        }
+        if (!in) throw std::runtime_error("Índice hnswlib truncado: " + path);
+        img.upper.resize(count);
+        for (size_t i = 0; i < count; i++)
+            img.upper[i] = img.levels[i] > 0 ? img.upper_storage.data() + offsets[i] : nullptr;
+        img.build_labels();
+        return img;
+    }
+
+    void build_labels() {
+        labels.resize(header.count);
+        for (size_t i = 0; i < header.count; i++) {
+            hnswlib::labeltype l;
+            std::memcpy(&l, level0 + i * header.size_data_per_element + header.label_offset, sizeof(l));
+            labels[i] = LabelEntry{uint64_t(l), uint64_t(i)};
+        }
+        std::sort(labels.begin(), labels.end(),
+                  [](const LabelEntry &a, const LabelEntry &b) { return a.label < b.label; });
+    }
+
+    // true si algún elemento lleva la marca de borrado de hnswlib
+    bool any_deleted() const {
+        for (size_t i = 0; i < header.count; i++)
+            if (level0[i * header.size_data_per_element + header.offset_level0 + 2] & 0x01) return true;
+        return false;
+    }
+
+    // Calcula offsets y tamaños de todas las secciones en la cabecera
+    void layout() {
+        Header &h = header;
+        h.header_bytes = sizeof(Header);
+        h.flags &= ~uint32_t(HEADER_HAS_DELETIONS);
+        h.flags |= HEADER_DELETIONS_KNOWN | (any_deleted() ? HEADER_HAS_DELETIONS : 0u);
+        uint64_t upper_bytes = 0;
+        for (uint32_t l : levels) upper_bytes += uint64_t(l) * h.size_links_per_element;
+        uint64_t sizes[SECTION_COUNT] = {
+            h.count * h.size_data_per_element,
+            h.count * sizeof(uint32_t),
+            h.count * sizeof(uint64_t),
+            upper_bytes,
+            h.count * sizeof(LabelEntry),
+        };
+        uint64_t pos = align_up(sizeof(Header));
+        for (uint32_t s = 0; s < SECTION_COUNT; s++) {
+            h.sections[s].offset = pos;
+            h.sections[s].bytes = sizes[s];
+            pos = align_up(pos + sizes[s]);
+        }
+        h.file_bytes = pos;
+    }
+
+    std::vector<uint64_t> upper_offsets() const {
+        std::vector<uint64_t> offs(header.count, 0);
+        uint64_t pos = 0;
+        for (size_t i = 0; i < header.count; i++) {
+            offs[i] = pos;
+            pos += uint64_t(levels[i]) * header.size_links_per_element;
+        }
+        return offs;
+    }
+};
+
+}  // namespace mapped_index
+
+// =================== MOTOR DE SOLO LECTURA SOBRE EL MMAP ===================
+
+struct MappedIndexOptions {
+    bool populate = false;   // MAP_POPULATE: precarga todas las páginas al abrir
+    bool hugepages = false;  // MADV_HUGEPAGE (efectivo si el kernel admite THP en page cache)
+    bool verify = false;     // CRC32C de todas las secciones al abrir (lee el archivo entero)
+};
+
+class MappedIndex {
+public:
+    using Options = MappedIndexOptions;
+
+private:
+    MappedFile file;
+    const mapped_index::Header *hdr = nullptr;
+    hnswlib::DISTFUNC<float> dist = nullptr;
+    void *dist_param = nullptr;
+    double open_s = 0.0;
+    bool has_deletions = false;
+
+    const char *section(uint32_t id) const {
+        return static_cast<const char *>(file.data()) + hdr->sections[id].offset;
+    }
+
+public:
+    MappedIndex(const std::string &path, hnswlib::SpaceInterface<float> *space,
+                const Options &opt = Options()) {
+        using namespace mapped_index;
+        auto t0 = std::chrono::steady_clock::now();
+        file = MappedFile(path, false, opt.populate ? MAP_POPULATE : 0);
+        if (file.size() < sizeof(Header))
+            throw std::runtime_error("Archivo demasiado pequeño: " + path);
+        hdr = static_cast<const Header *>(file.data());
+        check_header(*hdr, file.size(), path);
+        if (opt.verify) verify_sections(*hdr, static_cast<const char *>(file.data()), path);
+        if (space->get_data_size() != hdr->data_size)
+            throw std::runtime_error("El espacio de distancias no coincide con el índice (" +
+                                     std::to_string(space->get_data_size()) + " vs " +
+                                     std::to_string(hdr->data_size) + " bytes por vector)");
+        dist = space->get_dist_func();
+        dist_param = space->get_dist_func_param();
+
+        // Archivos escritos antes de HEADER_DELETIONS_KNOWN: un recorrido
+        // único de la capa 0 al abrir; al volver a escribirlos quedan con el flag
+        if (hdr->flags & HEADER_DELETIONS_KNOWN) {
+            has_deletions = (hdr->flags & HEADER_HAS_DELETIONS) != 0;
+        } else {
+            const char *l0 = section(SEC_LEVEL0);
+            for (size_t i = 0; i < hdr->count && !has_deletions; i++)
+                has_deletions = (l0[i * hdr->size_data_per_element + hdr->offset_level0 + 2] & 0x01) != 0;
+        }
+
+        file.advise(MADV_RANDOM);
+        if (opt.hugepages) file.advise(MADV_HUGEPAGE);
+        auto t1 = std::chrono::steady_clock::now();
+        open_s = std::chrono::duration<double>(t1 - t0).count();
+    }
+
+    const mapped_index::Header &header() const { return *hdr; }
+    size_t size() const { return hdr->count; }
+    size_t file_bytes() const { return file.size(); }
+    double open_seconds() const { return open_s; }
+
+    HnswGraphView view() const {
+        using namespace mapped_index;
+        HnswGraphView g;
+        g.level0 = section(SEC_LEVEL0);
+        g.size_data_per_element = hdr->size_data_per_element;
+        g.offset_level0 = hdr->offset_level0;
+        g.offset_data = hdr->offset_data;
+        g.label_offset = hdr->label_offset;
+        g.upper_base = reinterpret_cast<uintptr_t>(section(SEC_UPPER_LINKS));
+        g.upper_offsets = reinterpret_cast<const uint64_t *>(section(SEC_UPPER_OFFSETS));
+        g.size_links_per_element = hdr->size_links_per_element;
+        g.entry_point = hdr->entry_point;
+        g.max_level = hdr->max_level;
+        g.count = hdr->count;
+        g.has_deletions = has_deletions;
+        g.dist = dist;
+        g.dist_param = dist_param;
+        return g;
+    }
+
+    const uint32_t *levels() const {
+        return reinterpret_cast<const uint32_t *>(section(mapped_index::SEC_LEVELS));
+    }
+
+    // Búsqueda binaria en la sección LABELS; -1 si no existe
+    int64_t internal_id(uint64_t label) const {
+        using mapped_index::LabelEntry;
+        const LabelEntry *b = reinterpret_cast<const LabelEntry *>(section(mapped_index::SEC_LABELS));
+        const LabelEntry *e = b + hdr->count;
+        const LabelEntry *it = std::lower_bound(
+            b, e, label, [](const LabelEntry &x, uint64_t l) { return x.label < l; });
+        return it != e && it->label == label ? int64_t(it->id) : -1;
+    }
+
+    const char *vector_data(size_t id) const {
+        return section(mapped_index::SEC_LEVEL0) + id * hdr->size_data_per_element + hdr->offset_data;
+    }
+};
@@ -14,6 +14,12 @@
 #include <windows.h>
 #endif
 
+struct MemorySnapshot {
+  std::string phase;
+  size_t peak_rss_mb = 0;
+  size_t current_rss_mb = 0;
+};
+
 class MemoryMonitor {
 public:
   static size_t get_peak_rss_kb() {
@@ -67,4 +73,23 @@ public:
               << " MB" << std::endl;
 #endif
   }
+
+  // Imprime y devuelve el uso de memoria de una fase para reportarlo luego
+  static MemorySnapshot snapshot(const std::string &phase) {
+    print_memory_usage(phase);
+    return MemorySnapshot{phase, get_peak_rss_mb(), get_current_rss_kb() / 1024};
+  }
+
+  // Bytes que ocupan el grafo y los vectores de un HierarchicalNSW cargado
+  // (capa 0 + listas de capas superiores), independiente del RSS
+  template <typename Index>
+  static size_t index_bytes(const Index &index) {
+    size_t n = index.cur_element_count;
+    size_t bytes = n * index.size_data_per_element_;
+    for (size_t i = 0; i < n; i++) {
+      if (index.element_levels_[i] > 0)
+        bytes += index.size_links_per_element_ * index.element_levels_[i];
+    }
+    return bytes;
+  }
 };
\ No newline at end of file
@@ -1,92 +1,85 @@
 #pragma once
-#include <algorithm>
+#include "latency_histogram.hpp"
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <map>
-#include <numeric>
+#include <mutex>
 #include <string>
-#include <vector>
 
+// Latencias por nombre de operación sobre histogramas de memoria fija
+// (latency_histogram.hpp): no se guardan las muestras ni se ordenan para
+// sacar percentiles. record() es seguro entre threads; en bucles calientes
+// conviene un LatencyHistogram por thread y add_histogram() al final.
 class MetricsCollector {
 private:
-  std::map<std::string, std::vector<double>> metrics;
+  std::map<std::string, LatencyHistogram> metrics;
+  mutable std::mutex mutex;
   std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
 
 public:
   MetricsCollector() { start_time = std::chrono::high_resolution_clock::now(); }
 
+  // value en milisegundos
   void record(const std::string &metric, double value) {
-    metrics[metric].push_back(value);
+    record_ns(metric, static_cast<uint64_t>(value * 1e6));
+  }
+
+  void record_ns(const std::string &metric, uint64_t ns) {
+    std::lock_guard<std::mutex> lock(mutex);
+    metrics[metric].record(ns);
   }
 
   template <typename TimePoint>
   void record_latency(const std::string &operation, TimePoint start) {
     auto end = std::chrono::high_resolution_clock::now();
-    double ms = std::chrono::duration<double, std::milli>(end - start).count();
-    record(operation + "_latency_ms", ms);
+    record_ns(operation + "_latency_ms",
+              std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+
+  void add_histogram(const std::string &metric, const LatencyHistogram &h) {
+    std::lock_guard<std::mutex> lock(mutex);
+    metrics[metric].merge(h);
   }
 
-  void print_summary() {
+  void print_summary() const {
+    std::lock_guard<std::mutex> lock(mutex);
     std::cout << "\n=== RESUMEN DE MÉTRICAS ===\n";
-    for (const auto &[metric, values] : metrics) {
-      if (values.empty())
+    for (const auto &[metric, h] : metrics) {
+      if (h.count() == 0)
         continue;
-
-      double sum = std::accumulate(values.begin(), values.end(), 0.0);
-      double max = *std::max_element(values.begin(), values.end());
-      double min = *std::min_element(values.begin(), values.end());
-      double avg = sum / values.size();
-
-      // Calcular percentiles
-      std::vector<double> sorted = values;
-      std::sort(sorted.begin(), sorted.end());
-      double p50 = sorted[sorted.size() * 0.5];
-      double p95 = sorted[sorted.size() * 0.95];
-      double p99 = sorted[sorted.size() * 0.99];
-
-      std::cout << metric << ": " << avg << " ms (min: " << min
-                << ", max: " << max << ", p50: " << p50 << ", p95: " << p95
-                << ", p99: " << p99 << ", n: " << values.size() << ")\n";
+      std::cout << metric << ": " << h.mean_ms() << " ms (min: " << h.min_ms()
+                << ", max: " << h.max_ms() << ", p50: " << h.percentile_ms(0.50)
+                << ", p90: " << h.percentile_ms(0.90) << ", p99: " << h.percentile_ms(0.99)
+                << ", p99.9: " << h.percentile_ms(0.999) << ", n: " << h.count() << ")\n";
     }
   }
 
-  void save_to_csv(const std::string &filename) {
+  // Una fila por métrica con su resumen
+  void save_to_csv(const std::string &filename) const {
     std::ofstream file(filename);
     if (!file.is_open()) {
       std::cerr << "Error abriendo archivo: " << filename << "\n";
       return;
     }
 
-    // Encabezados
-    file << "timestamp";
-    for (const auto &[metric, _] : metrics) {
-      file << "," << metric;
-    }
-    file << "\n";
-
-    // Datos
-    size_t max_points = 0;
-    for (const auto &[_, values] : metrics) {
-      if (values.size() > max_points)
-        max_points = values.size();
-    }
-
-    for (size_t i = 0; i < max_points; ++i) {
-      file << i;
-      for (const auto &[metric, values] : metrics) {
-        file << "," << (i < values.size() ? values[i] : 0.0);
-      }
-      file << "\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    file << "metric,count,avg_ms,min_ms,p50_ms,p90_ms,p95_ms,p99_ms,p999_ms,max_ms\n";
+    for (const auto &[metric, h] : metrics) {
+      file << metric << "," << h.count() << "," << h.mean_ms() << "," << h.min_ms() << ","
+           << h.percentile_ms(0.50) << "," << h.percentile_ms(0.90) << ","
+           << h.percentile_ms(0.95) << "," << h.percentile_ms(0.99) << ","
+           << h.percentile_ms(0.999) << "," << h.max_ms() << "\n";
     }
 
     std::cout << "Métricas guardadas en: " << filename << "\n";
   }
 
-  std::vector<double> get_metric(const std::string &metric) const {
+  LatencyHistogram get_metric(const std::string &metric) const {
+    std::lock_guard<std::mutex> lock(mutex);
     auto it = metrics.find(metric);
     if (it != metrics.end())
       return it->second;
     return {};
   }
-};
\ No newline at end of file
+};
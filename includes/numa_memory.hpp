@@ -0,0 +1,278 @@
+#pragma once
+#include "cpu_topology.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// =================== MEMORIA DEL ÍNDICE: HUGE PAGES Y NUMA ===================
+//
+// La capa 0 del índice (vectores + listas, el bloque que recorre cada
+// búsqueda) se copia a una región anónima propia en vez del malloc de
+// hnswlib:
+//   - páginas: thp (madvise MADV_HUGEPAGE) o hugetlb (MAP_HUGETLB, necesita
+//     vm.nr_hugepages; si no hay páginas reservadas se vuelve a thp)
+//   - NUMA: interleave reparte las páginas entre todos los nodos con
+//     memoria; replicate hace una copia ligada (MPOL_BIND) a cada nodo y
+//     cada worker usa la de su nodo
+// mbind se llama por syscall antes de tocar la región, sin depender de
+// libnuma. Con un solo nodo NUMA la política se ignora.
+
+enum class HugePageMode { None, THP, HugeTLB };
+enum class NumaPlacement { Default, Interleave, Replicate };
+
+inline HugePageMode parse_huge_page_mode(const std::string &s) {
+    if (s == "none") return HugePageMode::None;
+    if (s == "thp") return HugePageMode::THP;
+    if (s == "hugetlb") return HugePageMode::HugeTLB;
+    throw std::runtime_error("Modo de páginas inválido: " + s + " (none|thp|hugetlb)");
+}
+
+inline NumaPlacement parse_numa_placement(const std::string &s) {
+    if (s == "default") return NumaPlacement::Default;
+    if (s == "interleave") return NumaPlacement::Interleave;
+    if (s == "replicate") return NumaPlacement::Replicate;
+    throw std::runtime_error("Colocación NUMA inválida: " + s + " (default|interleave|replicate)");
+}
+
+struct IndexMemoryOptions {
+    HugePageMode pages = HugePageMode::None;
+    NumaPlacement numa = NumaPlacement::Default;
+
+    bool active() const { return pages != HugePageMode::None || numa != NumaPlacement::Default; }
+
+    std::string describe() const {
+        static const char *p[] = {"4k", "thp", "hugetlb"};
+        static const char *n[] = {"default", "interleave", "replicate"};
+        return std::string(p[int(pages)]) + "+" + n[int(numa)];
+    }
+};
+
+namespace numa_detail {
+
+constexpr size_t HUGE_PAGE = size_t(2) << 20;
+
+// Nodos con memoria (/sys/devices/system/node/has_memory)
+inline const std::vector<int> &memory_nodes() {
+    static const std::vector<int> nodes = [] {
+        std::vector<int> v =
+            CpuTopology::parse_list(CpuTopology::read_line("/sys/devices/system/node/has_memory"));
+        if (v.empty()) v.push_back(0);
+        return v;
+    }();
+    return nodes;
+}
+
+inline long mbind(void *addr, size_t len, int mode, const std::vector<int> &nodes) {
+    const size_t bits = 8 * sizeof(unsigned long);
+    int max_node = 0;
+    for (int n : nodes) max_node = std::max(max_node, n);
+    std::vector<unsigned long> mask(size_t(max_node) / bits + 1, 0);
+    for (int n : nodes) mask[size_t(n) / bits] |= 1UL << (size_t(n) % bits);
+    return syscall(SYS_mbind, addr, len, mode, mask.data(), mask.size() * bits + 1, 0);
+}
+
+// Bytes de [base, base+len) respaldados por páginas grandes según
+// /proc/self/smaps (AnonHugePages para THP, *_Hugetlb para hugetlb)
+inline size_t huge_bytes_in(const void *base, size_t len) {
+    std::ifstream f("/proc/self/smaps");
+    uintptr_t lo = reinterpret_cast<uintptr_t>(base), hi = lo + len;
+    std::string line;
+    bool inside = false;
+    size_t kb_total = 0;
+    while (std::getline(f, line)) {
+        size_t dash = line.find('-');
+        size_t space = line.find(' ');
+        if (dash != std::string::npos && space != std::string::npos && dash < space &&
+            std::isxdigit(static_cast<unsigned char>(line[0]))) {
+            uintptr_t a = std::stoull(line.substr(0, dash), nullptr, 16);
+            uintptr_t b = std::stoull(line.substr(dash + 1, space - dash - 1), nullptr, 16);
+            inside = a < hi && b > lo;
+            continue;
+        }
+        if (!inside) continue;
+        if (line.rfind("AnonHugePages:", 0) == 0 || line.rfind("Private_Hugetlb:", 0) == 0 ||
+            line.rfind("Shared_Hugetlb:", 0) == 0) {
+            std::istringstream ss(line.substr(line.find(':') + 1));
+            size_t kb = 0;
+            ss >> kb;
+            kb_total += kb;
+        }
+    }
+    return std::min(len, kb_total * 1024);
+}
+
+}  // namespace numa_detail
+
+// Región anónima con la política de páginas y NUMA pedida. node < 0 =
+// según placement (default o interleave); node >= 0 = ligada a ese nodo.
+class NumaRegion {
+private:
+    char *base_ = nullptr;
+    size_t mapped_ = 0;
+    bool hugetlb_ = false;
+    std::string note_;
+
+public:
+    NumaRegion() = default;
+
+    NumaRegion(size_t bytes, HugePageMode pages, NumaPlacement numa, int node = -1) {
+        if (bytes == 0) bytes = 1;
+        mapped_ = (bytes + numa_detail::HUGE_PAGE - 1) / numa_detail::HUGE_PAGE * numa_detail::HUGE_PAGE;
+        void *p = MAP_FAILED;
+        if (pages == HugePageMode::HugeTLB) {
+            p = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            hugetlb_ = p != MAP_FAILED;
+            if (!hugetlb_) {
+                note_ = "sin páginas HugeTLB reservadas (vm.nr_hugepages), se usa THP";
+                pages = HugePageMode::THP;
+            }
+        }
+        if (p == MAP_FAILED)
+            p = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            throw std::runtime_error(std::string("mmap de la región del índice falló: ") +
+                                     std::strerror(errno));
+        base_ = static_cast<char *>(p);
+        if (pages == HugePageMode::THP) madvise(base_, mapped_, MADV_HUGEPAGE);
+
+        // Política NUMA antes del primer acceso (first-touch)
+        const std::vector<int> &nodes = numa_detail::memory_nodes();
+        long rc = 0;
+        if (node >= 0) {
+            rc = numa_detail::mbind(base_, mapped_, MPOL_BIND, {node});
+        } else if (numa == NumaPlacement::Interleave && nodes.size() > 1) {
+            rc = numa_detail::mbind(base_, mapped_, MPOL_INTERLEAVE, nodes);
+        }
+        if (rc != 0) {
+            if (!note_.empty()) note_ += "; ";
+            note_ += std::string("mbind falló (") + std::strerror(errno) + ")";
+        }
+    }
+
+    ~NumaRegion() {
+        if (base_) munmap(base_, mapped_);
+    }
+
+    NumaRegion(NumaRegion &&o) noexcept { *this = std::move(o); }
+    NumaRegion &operator=(NumaRegion &&o) noexcept {
+        if (this != &o) {
+            if (base_) munmap(base_, mapped_);
+            base_ = o.base_;
+            mapped_ = o.mapped_;
+            hugetlb_ = o.hugetlb_;
+            note_ = std::move(o.note_);
+            o.base_ = nullptr;
+            o.mapped_ = 0;
+        }
+        return *this;
+    }
+    NumaRegion(const NumaRegion &) = delete;
+    NumaRegion &operator=(const NumaRegion &) = delete;
+
+    char *data() const { return base_; }
+    size_t mapped_bytes() const { return mapped_; }
+    bool hugetlb() const { return hugetlb_; }
+    const std::string &note() const { return note_; }
+    size_t huge_bytes() const { return base_ ? numa_detail::huge_bytes_in(base_, mapped_) : 0; }
+};
+
+// Copia(s) de la capa 0: una región (default / interleave) o una por nodo
+// con memoria (replicate)
+class IndexMemory {
+private:
+    IndexMemoryOptions opt_;
+    std::vector<NumaRegion> regions_;
+    std::vector<int> nodes_;  // nodo de cada región (-1 si no está ligada)
+
+public:
+    // used: bytes a copiar de src; capacity: tamaño de la región (>= used)
+    IndexMemory(const char *src, size_t used, size_t capacity, const IndexMemoryOptions &opt)
+        : opt_(opt) {
+        capacity = std::max(capacity, used);
+        if (opt.numa == NumaPlacement::Replicate) {
+            for (int node : numa_detail::memory_nodes()) {
+                regions_.emplace_back(capacity, opt.pages, opt.numa, node);
+                nodes_.push_back(node);
+            }
+        } else {
+            regions_.emplace_back(capacity, opt.pages, opt.numa);
+            nodes_.push_back(-1);
+        }
+        for (auto &r : regions_)
+            if (used) std::memcpy(r.data(), src, used);
+    }
+
+    char *primary() const { return regions_[0].data(); }
+    size_t replicas() const { return regions_.size(); }
+    const std::vector<int> &nodes() const { return nodes_; }
+
+    // Copia local al nodo (la primera si el nodo no tiene réplica)
+    const char *replica_for_node(int node) const {
+        for (size_t i = 0; i < nodes_.size(); i++)
+            if (nodes_[i] == node) return regions_[i].data();
+        return regions_[0].data();
+    }
+
+    size_t huge_bytes() const {
+        size_t total = 0;
+        for (const auto &r : regions_) total += r.huge_bytes();
+        return total;
+    }
+
+    size_t mapped_bytes() const {
+        size_t total = 0;
+        for (const auto &r : regions_) total += r.mapped_bytes();
+        return total;
+    }
+
+    std::string describe() const {
+        std::ostringstream ss;
+        ss << opt_.describe();
+        if (regions_[0].hugetlb()) ss << " (hugetlb activo)";
+        if (opt_.numa == NumaPlacement::Replicate) ss << ", " << regions_.size() << " réplica(s)";
+        if (!regions_[0].note().empty()) ss << " [" << regions_[0].note() << "]";
+        return ss.str();
+    }
+};
+
+// Sustituye data_level0_memory_ de un HierarchicalNSW por una región
+// IndexMemory (capacidad max_elements). Al destruirse deja el puntero a
+// nullptr para que hnswlib no haga free() de memoria mapeada: hay que
+// declararlo después del índice (se destruye antes). El índice no debe
+// redimensionarse (resizeIndex) mientras el guard viva.
+class Level0Guard {
+private:
+    hnswlib::HierarchicalNSW<float> &index_;
+    IndexMemory memory_;
+
+public:
+    Level0Guard(hnswlib::HierarchicalNSW<float> &index, const IndexMemoryOptions &opt)
+        : index_(index),
+          memory_(index.data_level0_memory_, index.cur_element_count * index.size_data_per_element_,
+                  index.max_elements_ * index.size_data_per_element_, opt) {
+        free(index_.data_level0_memory_);
+        index_.data_level0_memory_ = memory_.primary();
+    }
+
+    ~Level0Guard() { index_.data_level0_memory_ = nullptr; }
+
+    Level0Guard(const Level0Guard &) = delete;
+    Level0Guard &operator=(const Level0Guard &) = delete;
+
+    const IndexMemory &memory() const { return memory_; }
+};
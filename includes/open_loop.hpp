@@ -0,0 +1,201 @@
+#pragma once
+
+#include "latency_histogram.hpp"
+#include "search_engine.hpp"
+#include "simd_distance.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// =================== CARGA EN LAZO ABIERTO ===================
+//
+// En lazo cerrado cada worker lanza la siguiente query apenas termina la
+// anterior: si el sistema se frena, también se frena la carga, y las
+// latencias medidas nunca incluyen la cola (omisión coordinada). Aquí las
+// llegadas siguen un calendario fijado de antemano (intervalo constante o
+// Poisson) y la latencia se mide desde el instante previsto de envío, así
+// que la espera detrás de queries lentas cuenta aunque el worker la haya
+// absorbido. Los workers reclaman la siguiente llegada del calendario con
+// fetch_add; si todos están ocupados la llegada espera, igual que en una
+// cola FCFS con num_threads servidores.
+
+enum class ArrivalProcess { Fixed, Poisson };
+
+inline ArrivalProcess parse_arrival_process(const std::string &s) {
+    if (s == "fixed") return ArrivalProcess::Fixed;
+    if (s == "poisson") return ArrivalProcess::Poisson;
+    throw std::runtime_error("Proceso de llegadas desconocido: " + s + " (fixed|poisson)");
+}
+
+inline const char *arrival_process_name(ArrivalProcess a) {
+    return a == ArrivalProcess::Fixed ? "fixed" : "poisson";
+}
+
+// Un punto de la curva latencia / throughput
+struct LoadPoint {
+    double offered_qps = 0.0;
+    double achieved_qps = 0.0;  // completadas / (última respuesta - primera llegada prevista)
+    size_t scheduled = 0;
+    size_t completed = 0;
+    size_t dropped = 0;  // llegadas no atendidas antes del límite de drenaje
+    double elapsed_s = 0.0;
+    LatencyHistogram latency;  // desde el envío previsto (corregida)
+    LatencyHistogram service;  // solo la búsqueda (lo que vería el lazo cerrado)
+    bool saturated = false;
+
+    static void csv_header(std::ostream &os) {
+        os << "offered_qps,achieved_qps,scheduled,completed,dropped,p50_ms,p90_ms,p99_ms,"
+              "p999_ms,max_ms,mean_ms,service_p50_ms,service_p99_ms,saturated\n";
+    }
+
+    void write_csv_row(std::ostream &os) const {
+        os << offered_qps << "," << achieved_qps << "," << scheduled << "," << completed << ","
+           << dropped << "," << latency.percentile_ms(0.50) << "," << latency.percentile_ms(0.90)
+           << "," << latency.percentile_ms(0.99) << "," << latency.percentile_ms(0.999) << ","
+           << latency.max_ms() << "," << latency.mean_ms() << "," << service.percentile_ms(0.50)
+           << "," << service.percentile_ms(0.99) << "," << (saturated ? 1 : 0) << "\n";
+    }
+};
+
+class OpenLoopRunner {
+private:
+    HnswGraphView graph;
+    int num_threads;
+    std::vector<HnswGraphView> thread_graphs;  // copia de la capa 0 que usa cada worker
+    std::function<void(int)> thread_init;
+    NormalizeFn normalize = nullptr;
+    size_t query_dim = 0;
+
+    using Clock = std::chrono::steady_clock;
+
+    // Dormir mientras falte mucho y girar el último tramo: sleep_until
+    // solo despierta con la granularidad del scheduler
+    static void wait_until(Clock::time_point target) {
+        while (true) {
+            auto now = Clock::now();
+            if (now >= target) return;
+            auto left = target - now;
+            if (left > std::chrono::microseconds(200))
+                std::this_thread::sleep_for(left - std::chrono::microseconds(100));
+            else
+                __builtin_ia32_pause();
+        }
+    }
+
+public:
+    // Por debajo de este cociente completadas/ofrecidas el punto está saturado
+    static constexpr double SATURATION_RATIO = 0.95;
+
+    OpenLoopRunner(const HnswGraphView &g, int threads)
+        : graph(g), num_threads(std::max(1, threads)), thread_graphs(num_threads, g) {}
+
+    // Se llama al arrancar cada worker (p. ej. para fijarlo a una CPU)
+    void on_thread_start(std::function<void(int)> fn) { thread_init = std::move(fn); }
+
+    // Como en BatchSearcher: grafo del worker tid (p. ej. la réplica de su
+    // nodo NUMA); se puede llamar desde on_thread_start
+    void use_graph(int tid, const HnswGraphView &g) { thread_graphs[tid] = g; }
+
+    void use_query_normalizer(NormalizeFn fn, size_t dim) {
+        normalize = fn;
+        query_dim = dim;
+    }
+
+    // Instantes de llegada (ns desde el inicio) para rate queries/s durante
+    // duration_s. Poisson: intervalos exponenciales de media 1/rate.
+    static std::vector<uint64_t> schedule(double rate, double duration_s, ArrivalProcess arrival,
+                                          uint64_t seed) {
+        if (rate <= 0.0 || duration_s <= 0.0)
+            throw std::runtime_error("La tasa y la duración deben ser positivas");
+        size_t n = std::max<size_t>(1, size_t(rate * duration_s));
+        std::vector<uint64_t> at(n);
+        std::mt19937_64 rng(seed);
+        std::exponential_distribution<double> gap(rate);
+        double t = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            at[i] = uint64_t(t * 1e9);
+            t += arrival == ArrivalProcess::Fixed ? 1.0 / rate : gap(rng);
+        }
+        return at;
+    }
+
+    // Ofrece rate queries/s durante duration_s recorriendo las nq queries en
+    // ciclo. Las llegadas que no empezaron antes de drain_factor * duration_s
+    // se descartan (cuentan en dropped y marcan el punto como saturado).
+    LoadPoint run(const float *queries, size_t nq, int dim, size_t k, size_t ef, double rate,
+                  double duration_s, ArrivalProcess arrival, uint64_t seed = 42,
+                  double drain_factor = 2.0) {
+        std::vector<uint64_t> at = schedule(rate, duration_s, arrival, seed);
+        size_t n = at.size();
+        LoadPoint p;
+        p.offered_qps = rate;
+        p.scheduled = n;
+
+        std::atomic<size_t> next{0};
+        std::vector<LatencyHistogram> latency(num_threads), service(num_threads);
+        std::vector<size_t> completed(num_threads, 0);
+        std::vector<Clock::time_point> last_done(num_threads);
+        Clock::time_point start;
+        Clock::time_point deadline;
+        std::atomic<int> ready{0};
+        std::atomic<bool> go{false};
+
+        auto worker = [&](int tid) {
+            if (thread_init) thread_init(tid);
+            const HnswGraphView &g = thread_graphs[tid];
+            SearchContext ctx(g.count);
+            std::vector<uint64_t> ids(k);
+            std::vector<float> dists(k);
+            std::vector<float> normalized(normalize ? query_dim : 0);
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire)) __builtin_ia32_pause();
+            while (true) {
+                size_t i = next.fetch_add(1, std::memory_order_relaxed);
+                if (i >= n) break;
+                Clock::time_point intended = start + std::chrono::nanoseconds(at[i]);
+                wait_until(intended);
+                auto t0 = Clock::now();
+                if (t0 > deadline) break;
+                const float *q = queries + (i % nq) * dim;
+                if (normalize) {
+                    normalize(q, normalized.data(), query_dim);
+                    q = normalized.data();
+                }
+                GraphSearcher::search(g, q, k, ef, ctx, ids.data(), dists.data());
+                auto t1 = Clock::now();
+                latency[tid].record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - intended).count());
+                service[tid].record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+                completed[tid]++;
+                last_done[tid] = t1;
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int t = 0; t < num_threads; t++) pool.emplace_back(worker, t);
+        while (ready.load() < num_threads) std::this_thread::yield();
+        start = Clock::now() + std::chrono::milliseconds(1);
+        deadline = start + std::chrono::nanoseconds(uint64_t(duration_s * drain_factor * 1e9));
+        go.store(true, std::memory_order_release);
+        for (auto &th : pool) th.join();
+
+        Clock::time_point end = start;
+        for (int t = 0; t < num_threads; t++) {
+            p.completed += completed[t];
+            p.latency.merge(latency[t]);
+            p.service.merge(service[t]);
+            if (completed[t] > 0) end = std::max(end, last_done[t]);
+        }
+        p.dropped = n - p.completed;
+        p.elapsed_s = std::chrono::duration<double>(end - start).count();
+        p.achieved_qps = p.elapsed_s > 0 ? p.completed / p.elapsed_s : 0.0;
+        p.saturated = p.dropped > 0 || p.achieved_qps < SATURATION_RATIO * rate;
+        return p;
+    }
+};
@@ -0,0 +1,243 @@
+#pragma once
+#include "hnsw_utils.hpp"
+#include "perf_counters.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Estadísticas de inserción por hilo (alineadas para evitar false sharing)
+struct alignas(64) BuildThreadStats {
+    size_t inserted = 0;
+    size_t batches = 0;
+    size_t steals = 0;
+    double busy_s = 0.0;
+    PerfSample perf;  // solo con Options::thread_counters
+
+    double throughput() const { return busy_s > 0 ? inserted / busy_s : 0.0; }
+};
+
+struct ParallelBuildReport {
+    size_t seed_count = 0;
+    double seed_time_s = 0.0;
+    double parallel_time_s = 0.0;
+    size_t batch_size = 0;
+    std::vector<BuildThreadStats> threads;
+
+    double seed_throughput() const {
+        return seed_time_s > 0 ? seed_count / seed_time_s : 0.0;
+    }
+
+    double parallel_throughput() const {
+        size_t total = 0;
+        for (const auto &t : threads) total += t.inserted;
+        return parallel_time_s > 0 ? total / parallel_time_s : 0.0;
+    }
+
+    // Eficiencia de escalado respecto al throughput secuencial de la fase
+    // semilla (cota inferior: la semilla inserta sobre un grafo más pequeño)
+    double scaling_efficiency() const {
+        if (threads.empty() || seed_throughput() <= 0) return 0.0;
+        return parallel_throughput() / (seed_throughput() * threads.size());
+    }
+};
+
+// =================== CONSTRUCCIÓN PARALELA ===================
+//
+// Fase 1 (semilla): inserta secuencialmente un prefijo para estabilizar
+// las capas superiores del grafo.
+// Fase 2: el resto se reparte en rangos contiguos por hilo; cada hilo toma
+// lotes de su propio rango y, al agotarlo, roba lotes de los rangos ajenos.
+
+class ParallelBuilder {
+public:
+    struct Options {
+        int num_threads = 1;
+        size_t seed_count = 10000;
+        size_t batch_size = 512;
+        size_t prefetch_distance = 10;
+        size_t progress_every = 50000;  // 0 = sin progreso por consola
+        // Normalización en streaming: cada hilo normaliza la fila en un
+        // buffer propio justo antes de insertarla (sin copia del dataset)
+        bool normalize = false;
+        int dim = 0;
+        // Codificación opcional (p.ej. SQ8): convierte la fila float al
+        // formato que guarda el índice, code_size bytes por vector
+        std::function<void(const float *, uint8_t *)> encode;
+        size_t code_size = 0;
+        // Contadores hardware por hilo de la fase paralela (perf_counters.hpp)
+        bool thread_counters = false;
+    };
+
+    // row(i) debe devolver un puntero a los dim floats del vector i
+    template <typename RowFn>
+    static ParallelBuildReport build(hnswlib::HierarchicalNSW<float> &index,
+                                     size_t N, RowFn row, const uint64_t *ids,
+                                     const Options &opt) {
+        ParallelBuildReport report;
+        int T = std::max(1, opt.num_threads);
+        size_t seed = std::min(N, T == 1 ? N : opt.seed_count);
+        size_t batch = std::max<size_t>(1, opt.batch_size);
+        report.seed_count = seed;
+        report.batch_size = batch;
+        report.threads.resize(T);
+
+        std::atomic<size_t> done{0};
+
+        struct Scratch {
+            std::vector<float> row;
+            std::vector<uint8_t> code;
+        };
+        auto prepare = [&](size_t i, Scratch &scratch) -> const void * {
+            const float *src = row(i);
+            if (opt.normalize) {
+                HNSWUtils::normalize_row(src, scratch.row.data(), opt.dim);
+                src = scratch.row.data();
+            }
+            if (!opt.encode) return src;
+            opt.encode(src, scratch.code.data());
+            return scratch.code.data();
+        };
+        auto make_scratch = [&]() {
+            Scratch s;
+            s.row.resize(opt.normalize ? opt.dim : 0);
+            s.code.resize(opt.encode ? opt.code_size : 0);
+            return s;
+        };
+
+        // ---------- Fase semilla (secuencial con prefetch) ----------
+        auto t0 = std::chrono::high_resolution_clock::now();
+        Scratch seed_scratch = make_scratch();
+        for (size_t i = 0; i < seed; i++) {
+            if (i + opt.prefetch_distance < seed)
+                __builtin_prefetch(row(i + opt.prefetch_distance), 0, 1);
+            index.addPoint(prepare(i, seed_scratch), ids[i]);
+            size_t total = ++done;
+            report_progress(total - 1, total, N, opt.progress_every);
+        }
+        auto t1 = std::chrono::high_resolution_clock::now();
+        report.seed_time_s = std::chrono::duration<double>(t1 - t0).count();
+
+        if (seed == N) {
+            report.threads[0].inserted = seed;
+            report.threads[0].busy_s = report.seed_time_s;
+            if (opt.progress_every) std::cout << std::endl;
+            return report;
+        }
+
+        // ---------- Fase paralela con robo de lotes ----------
+        struct alignas(64) Range {
+            std::atomic<size_t> next{0};
+            size_t end = 0;
+        };
+        std::vector<Range> ranges(T);
+        size_t rest = N - seed;
+        for (int t = 0; t < T; t++) {
+            ranges[t].next = seed + rest * t / T;
+            ranges[t].end = seed + rest * (t + 1) / T;
+        }
+
+        auto claim = [&](int owner, size_t &b, size_t &e) {
+            Range &r = ranges[owner];
+            if (r.next.load(std::memory_order_relaxed) >= r.end) return false;
+            b = r.next.fetch_add(batch, std::memory_order_relaxed);
+            if (b >= r.end) return false;
+            e = std::min(b + batch, r.end);
+            return true;
+        };
+
+        auto worker = [&](int tid) {
+            BuildThreadStats &st = report.threads[tid];
+            Scratch scratch = make_scratch();
+            std::unique_ptr<PerfCounters> counters;
+            if (opt.thread_counters) counters.reset(new PerfCounters());
+            PerfSample perf0 = counters ? counters->read() : PerfSample();
+            auto w0 = std::chrono::high_resolution_clock::now();
+            size_t b, e;
+            for (int k = 0; k < T; k++) {
+                int owner = (tid + k) % T;
+                while (claim(owner, b, e)) {
+                    for (size_t i = b; i < e; i++) {
+                        if (i + opt.prefetch_distance < e)
+                            __builtin_prefetch(row(i + opt.prefetch_distance), 0, 1);
+                        index.addPoint(prepare(i, scratch), ids[i]);
+                    }
+                    st.inserted += e - b;
+                    st.batches++;
+                    if (owner != tid) st.steals++;
+                    size_t prev = done.fetch_add(e - b);
+                    report_progress(prev, prev + (e - b), N, opt.progress_every);
+                }
+            }
+            auto w1 = std::chrono::high_resolution_clock::now();
+            st.busy_s = std::chrono::duration<double>(w1 - w0).count();
+            if (counters) st.perf = counters->since(perf0);
+        };
+
+        auto p0 = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < T; t++) threads.emplace_back(worker, t);
+        for (auto &th : threads) th.join();
+        auto p1 = std::chrono::high_resolution_clock::now();
+        report.parallel_time_s = std::chrono::duration<double>(p1 - p0).count();
+
+        if (opt.progress_every) std::cout << std::endl;
+        return report;
+    }
+
+    // Recall@1 sobre una muestra de vectores ya insertados: cada vector debe
+    // recuperarse a sí mismo. Permite comparar build secuencial vs paralelo.
+    template <typename RowFn>
+    static double self_recall(const hnswlib::HierarchicalNSW<float> &index,
+                              size_t N, RowFn row, const uint64_t *ids,
+                              size_t sample, int num_threads) {
+        return self_recall(index, N, row, [ids](size_t i) { return ids[i]; },
+                           sample, num_threads);
+    }
+
+    template <typename RowFn, typename LabelFn>
+    static double self_recall(const hnswlib::HierarchicalNSW<float> &index,
+                              size_t N, RowFn row, LabelFn label,
+                              size_t sample, int num_threads) {
+        if (N == 0 || sample == 0) return 0.0;
+        sample = std::min(sample, N);
+        std::vector<size_t> picks(sample);
+        std::mt19937_64 rng(1234);
+        std::uniform_int_distribution<size_t> dist(0, N - 1);
+        for (auto &p : picks) p = dist(rng);
+
+        std::atomic<size_t> next{0}, hits{0};
+        auto worker = [&]() {
+            size_t local = 0;
+            while (true) {
+                size_t s = next.fetch_add(1);
+                if (s >= sample) break;
+                auto res = index.searchKnn(row(picks[s]), 1);
+                if (!res.empty() && res.top().second == label(picks[s])) local++;
+            }
+            hits += local;
+        };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < std::max(1, num_threads); t++) threads.emplace_back(worker);
+        for (auto &th : threads) th.join();
+        return double(hits) / sample;
+    }
+
+private:
+    // Imprime solo cuando el contador cruza un múltiplo de 'every'
+    static void report_progress(size_t prev, size_t done, size_t N, size_t every) {
+        if (every == 0) return;
+        if (prev / every != done / every || done == N) {
+            double progress = 100.0 * done / N;
+            std::cout << "\rProgreso: " << done << "/" << N << " (" << progress
+                      << "%)" << std::flush;
+        }
+    }
+};
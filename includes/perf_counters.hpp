@@ -0,0 +1,317 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// =================== CONTADORES HARDWARE (perf_event_open) ===================
+//
+// Ciclos, instrucciones, fallos de LLC, fallos de dTLB y cambios de
+// contexto. Los contadores quedan habilitados desde que se abren y cada fase
+// se mide como diferencia entre dos lecturas (since()).
+//
+// Dos ámbitos:
+//   - Thread: solo el thread que construye el objeto.
+//   - Process: el thread que lo construye más los threads que se creen
+//     después (inherit), pero el kernel solo suma a los hijos cuando
+//     terminan: read() no ve lo que lleva hecho un thread todavía vivo.
+//     Sirve para fases cuyos hilos se unen (join) antes de leer; los pools
+//     persistentes (OpenMP) necesitan contadores Thread propios en cada
+//     worker sumados a la fase. Debe abrirse al principio de main.
+//
+// Sin permisos (perf_event_paranoid, contenedores) o sin PMU (muchas VMs),
+// cada evento que no se pueda abrir queda como n/a; si el kernel no deja
+// contar en modo kernel se cuenta solo espacio de usuario, y los cambios de
+// contexto se toman de getrusage(). Con multiplexación los valores se
+// escalan por tiempo habilitado / tiempo en PMU.
+
+enum PerfEvent {
+    PERF_CYCLES = 0,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_EVENT_COUNT
+};
+
+inline const char *perf_event_name(int e) {
+    static const char *names[PERF_EVENT_COUNT] = {"cycles", "instructions", "llc_misses",
+                                                  "dtlb_misses", "context_switches"};
+    return names[e];
+}
+
+struct PerfSample {
+    uint64_t value[PERF_EVENT_COUNT] = {};
+    bool valid[PERF_EVENT_COUNT] = {};
+
+    bool any() const {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            if (valid[e]) return true;
+        return false;
+    }
+
+    bool has(PerfEvent e) const { return valid[e]; }
+    uint64_t get(PerfEvent e) const { return value[e]; }
+
+    double ipc() const {
+        if (!valid[PERF_CYCLES] || !valid[PERF_INSTRUCTIONS] || value[PERF_CYCLES] == 0) return 0.0;
+        return double(value[PERF_INSTRUCTIONS]) / value[PERF_CYCLES];
+    }
+
+    // Suma de threads: un evento cuenta como válido si lo es en alguno
+    PerfSample &operator+=(const PerfSample &o) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            value[e] += o.value[e];
+            valid[e] = valid[e] || o.valid[e];
+        }
+        return *this;
+    }
+
+    PerfSample operator+(const PerfSample &o) const {
+        PerfSample r = *this;
+        return r += o;
+    }
+
+    // Diferencia entre dos lecturas del mismo PerfCounters
+    PerfSample operator-(const PerfSample &start) const {
+        PerfSample d;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            d.valid[e] = valid[e] && start.valid[e];
+            d.value[e] = value[e] >= start.value[e] ? value[e] - start.value[e] : 0;
+        }
+        return d;
+    }
+
+    // "cycles=... instructions=... IPC=..." (n/a para los eventos no disponibles)
+    std::string describe() const {
+        std::ostringstream ss;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (e) ss << ", ";
+            ss << perf_event_name(e) << "=";
+            if (valid[e]) ss << value[e];
+            else ss << "n/a";
+        }
+        if (ipc() > 0) ss << ", IPC=" << ipc();
+        return ss.str();
+    }
+
+    // Filas metric,value solo de los eventos disponibles. per > 0 añade
+    // además cada evento normalizado (p. ej. por query o por vector).
+    void write_csv(std::ostream &os, const std::string &prefix = "", size_t per = 0,
+                   const std::string &per_name = "") const {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (!valid[e]) continue;
+            os << prefix << perf_event_name(e) << "," << value[e] << "\n";
+            if (per > 0) os << prefix << perf_event_name(e) << "_per_" << per_name << ","
+                            << double(value[e]) / per << "\n";
+        }
+        if (ipc() > 0) os << prefix << "ipc," << ipc() << "\n";
+    }
+
+    // Columnas para CSV por thread (vacías si no hay dato)
+    static std::string csv_header() {
+        std::string h;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) h += std::string(",") + perf_event_name(e);
+        return h + ",ipc";
+    }
+
+    std::string csv_columns() const {
+        std::ostringstream ss;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            ss << ",";
+            if (valid[e]) ss << value[e];
+        }
+        ss << ",";
+        if (ipc() > 0) ss << ipc();
+        return ss.str();
+    }
+};
+
+// Contadores de una fase para los reportes (como MemorySnapshot)
+struct PerfPhase {
+    std::string phase;
+    PerfSample counters;
+};
+
+class PerfCounters {
+public:
+    enum class Scope { Thread, Process };
+
+private:
+    Scope scope_;
+    int fds_[PERF_EVENT_COUNT];
+    bool user_only_[PERF_EVENT_COUNT] = {};
+    bool ctx_from_rusage_ = false;
+    std::string status_;
+
+public:
+    explicit PerfCounters(Scope scope = Scope::Thread) : scope_(scope) {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) fds_[e] = -1;
+#ifdef __linux__
+        std::string missing;
+        int last_errno = 0;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            int err = open_event(e);
+            if (err == 0) continue;
+            last_errno = err;
+            if (!missing.empty()) missing += ", ";
+            missing += perf_event_name(e);
+        }
+        // Los cambios de contexto también salen de getrusage(): siempre
+        // disponibles aunque perf no lo esté o solo cuente espacio de usuario
+        if (fds_[PERF_CONTEXT_SWITCHES] < 0 || user_only_[PERF_CONTEXT_SWITCHES]) {
+            if (fds_[PERF_CONTEXT_SWITCHES] >= 0) close(fds_[PERF_CONTEXT_SWITCHES]);
+            fds_[PERF_CONTEXT_SWITCHES] = -1;
+            ctx_from_rusage_ = true;
+        }
+
+        std::ostringstream ss;
+        bool first = true;
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (fds_[e] < 0 && !(e == PERF_CONTEXT_SWITCHES && ctx_from_rusage_)) continue;
+            ss << (first ? "" : ", ") << perf_event_name(e);
+            if (e == PERF_CONTEXT_SWITCHES && ctx_from_rusage_) ss << " (getrusage)";
+            else if (user_only_[e]) ss << " (solo usuario)";
+            first = false;
+        }
+        if (!missing.empty()) ss << (first ? "" : "; ") << "sin " << missing << ": " << reason(last_errno);
+        status_ = ss.str();
+#else
+        status_ = "no disponibles fuera de Linux";
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            if (fds_[e] >= 0) close(fds_[e]);
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    // Al menos un evento de perf abierto (los cambios de contexto por
+    // getrusage no cuentan)
+    bool available() const {
+        for (int e = 0; e < PERF_EVENT_COUNT; e++)
+            if (fds_[e] >= 0) return true;
+        return false;
+    }
+
+    // Eventos activos y motivo de los que faltan, para imprimir al arrancar
+    const std::string &status() const { return status_; }
+
+    // Valores acumulados desde que se abrieron
+    PerfSample read() const {
+        PerfSample s;
+#ifdef __linux__
+        for (int e = 0; e < PERF_EVENT_COUNT; e++) {
+            if (fds_[e] < 0) continue;
+            // value, time_enabled, time_running
+            uint64_t buf[3] = {0, 0, 0};
+            if (::read(fds_[e], buf, sizeof(buf)) != ssize_t(sizeof(buf))) continue;
+            s.valid[e] = true;
+            s.value[e] = (buf[2] > 0 && buf[2] < buf[1])
+                             ? uint64_t(double(buf[0]) * double(buf[1]) / double(buf[2]))
+                             : buf[0];
+        }
+        if (ctx_from_rusage_) {
+            struct rusage ru;
+            if (getrusage(scope_ == Scope::Process ? RUSAGE_SELF : RUSAGE_THREAD, &ru) == 0) {
+                s.valid[PERF_CONTEXT_SWITCHES] = true;
+                s.value[PERF_CONTEXT_SWITCHES] = uint64_t(ru.ru_nvcsw) + uint64_t(ru.ru_nivcsw);
+            }
+        }
+#endif
+        return s;
+    }
+
+    PerfSample since(const PerfSample &start) const { return read() - start; }
+
+private:
+#ifdef __linux__
+    // Devuelve 0 o el errno del último intento
+    int open_event(int e) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.inherit = scope_ == Scope::Process ? 1 : 0;
+        attr.exclude_hv = 1;
+        switch (e) {
+        case PERF_CYCLES:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PERF_INSTRUCTIONS:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PERF_LLC_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PERF_DTLB_MISSES:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                          (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr.type = PERF_TYPE_SOFTWARE;
+            attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+            break;
+        }
+
+        // Primero usuario + kernel; con perf_event_paranoid >= 2 solo se
+        // permite espacio de usuario
+        int fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+            attr.exclude_kernel = 1;
+            fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            user_only_[e] = fd >= 0;
+        }
+        if (fd < 0) return errno;
+        fds_[e] = fd;
+        return 0;
+    }
+
+    static std::string reason(int err) {
+        switch (err) {
+        case EACCES:
+        case EPERM: {
+            std::ifstream f("/proc/sys/kernel/perf_event_paranoid");
+            int level = 0;
+            std::string lvl = (f >> level) ? " (perf_event_paranoid=" + std::to_string(level) + ")" : "";
+            return "sin permiso" + lvl;
+        }
+        case ENOENT:
+        case EOPNOTSUPP:
+            return "la CPU o el hipervisor no exponen el evento";
+        case ENOSYS:
+            return "kernel sin perf_event";
+        default:
+            return std::strerror(err);
+        }
+    }
+#endif
+};
+
+// Contadores de todo el proceso compartidos por las fases de un programa.
+// Se abren en la primera llamada: hay que llamarla al principio de main.
+inline PerfCounters &process_perf_counters() {
+    static PerfCounters counters(PerfCounters::Scope::Process);
+    return counters;
+}
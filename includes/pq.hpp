@@ -0,0 +1,322 @@
+#pragma once
+#include "simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <immintrin.h>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// =================== CUANTIZACIÓN DE PRODUCTO (PQ) ===================
+//
+// El vector se parte en m subvectores de dsub = dim / m dimensiones y cada
+// uno se sustituye por el índice (1 byte) del centroide más cercano de su
+// subespacio (256 centroides entrenados con k-means). El índice guarda m
+// bytes por vector en vez de 4 * dim.
+//
+// Distancias:
+//   - SDC (construcción): código contra código con tablas precalculadas de
+//     distancias entre centroides, m * 256 * 256 floats
+//   - ADC (consultas): la query queda en float; por query se calcula una
+//     tabla m * 256 con la distancia de cada subvector a cada centroide y
+//     la distancia a un código es la suma de m entradas de la tabla
+// Para ip los datos llegan normalizados y la distancia es 1 - <x, y>.
+
+class PQParams {
+public:
+    static constexpr int KSUB = 256;
+
+    int dim = 0;
+    int m = 0;
+    int dsub = 0;
+    std::vector<float> centroids;  // [m][KSUB][dsub]
+
+    const float *centroid(int j, int c) const {
+        return centroids.data() + (size_t(j) * KSUB + c) * dsub;
+    }
+
+    // row(i, out) escribe el vector i ya preprocesado (normalizado si es ip).
+    // Se entrena sobre una muestra de hasta 'sample' filas repartidas por el
+    // dataset; la asignación de cada iteración es paralela y usa el kernel
+    // L2 SIMD de simd_distance.hpp.
+    template <typename RowFn>
+    static PQParams train(size_t n, int dim, int m, RowFn row, int num_threads,
+                          size_t sample = 32768, int iters = 10) {
+        if (m <= 0 || dim % m != 0)
+            throw std::runtime_error("PQ: dim (" + std::to_string(dim) +
+                                     ") debe ser múltiplo de m (" + std::to_string(m) + ")");
+        if (n == 0) throw std::runtime_error("PQ: no hay vectores para entrenar");
+        PQParams p;
+        p.dim = dim;
+        p.m = m;
+        p.dsub = dim / m;
+        p.centroids.assign(size_t(m) * KSUB * p.dsub, 0.0f);
+
+        size_t ns = std::min(n, std::max<size_t>(sample, KSUB));
+        std::vector<float> data(ns * dim);
+        #ifdef _OPENMP
+        omp_set_num_threads(num_threads);
+        #pragma omp parallel for schedule(static)
+        #endif
+        for (size_t s = 0; s < ns; s++) row(s * n / ns, &data[s * dim]);
+
+        RawDistFn l2 = DistanceKernels::raw(Metric::L2, CpuFeatures::detect());
+        std::vector<float> sub(ns * p.dsub);
+        for (int j = 0; j < m; j++) {
+            for (size_t s = 0; s < ns; s++)
+                std::memcpy(&sub[s * p.dsub], &data[s * dim + size_t(j) * p.dsub], p.dsub * sizeof(float));
+            kmeans(sub.data(), ns, p.dsub, &p.centroids[size_t(j) * KSUB * p.dsub], iters, 1234 + j, l2);
+        }
+        return p;
+    }
+
+    void encode(const float *x, uint8_t *code) const {
+        RawDistFn l2 = DistanceKernels::raw(Metric::L2, CpuFeatures::detect());
+        for (int j = 0; j < m; j++) code[j] = uint8_t(nearest(x + size_t(j) * dsub, centroid(j, 0), dsub, l2));
+    }
+
+    void decode(const uint8_t *code, float *x) const {
+        for (int j = 0; j < m; j++) std::memcpy(x + size_t(j) * dsub, centroid(j, code[j]), dsub * sizeof(float));
+    }
+
+    // Tabla ADC de una query: lut[j * 256 + c]. Para l2 la distancia al
+    // cuadrado del subvector; para ip -<q_j, c> (el 1 lo suma el kernel).
+    void adc_table(const float *q, Metric metric, float *lut) const {
+        RawDistFn f = DistanceKernels::raw(metric, CpuFeatures::detect());
+        for (int j = 0; j < m; j++) {
+            const float *qj = q + size_t(j) * dsub;
+            for (int c = 0; c < KSUB; c++) {
+                float v = f(qj, centroid(j, c), dsub);
+                lut[size_t(j) * KSUB + c] = metric == Metric::L2 ? v : -v;
+            }
+        }
+    }
+
+    size_t table_floats() const { return size_t(m) * KSUB; }
+
+    void save(const std::string &path) const {
+        std::ofstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo crear: " + path);
+        f.write("PQ8P", 4);
+        f.write(reinterpret_cast<const char *>(&dim), sizeof(dim));
+        f.write(reinterpret_cast<const char *>(&m), sizeof(m));
+        f.write(reinterpret_cast<const char *>(centroids.data()), centroids.size() * sizeof(float));
+    }
+
+    static PQParams load(const std::string &path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+        char magic[4];
+        f.read(magic, 4);
+        if (std::string(magic, 4) != "PQ8P") throw std::runtime_error("Archivo PQ inválido: " + path);
+        PQParams p;
+        f.read(reinterpret_cast<char *>(&p.dim), sizeof(p.dim));
+        f.read(reinterpret_cast<char *>(&p.m), sizeof(p.m));
+        if (!f || p.m <= 0 || p.dim % p.m != 0) throw std::runtime_error("Archivo PQ inválido: " + path);
+        p.dsub = p.dim / p.m;
+        p.centroids.resize(size_t(p.m) * KSUB * p.dsub);
+        f.read(reinterpret_cast<char *>(p.centroids.data()), p.centroids.size() * sizeof(float));
+        if (!f) throw std::runtime_error("Archivo PQ truncado: " + path);
+        return p;
+    }
+
+    // Convención: codebooks junto al índice, con extensión .pq
+    static std::string path_for(const std::string &index_path) { return index_path + ".pq"; }
+
+private:
+    static int nearest(const float *x, const float *cents, int dsub, RawDistFn l2) {
+        int best = 0;
+        float best_d = std::numeric_limits<float>::max();
+        for (int c = 0; c < KSUB; c++) {
+            float d = l2(x, cents + size_t(c) * dsub, dsub);
+            if (d < best_d) {
+                best_d = d;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    // k-means de Lloyd con KSUB centroides sobre n subvectores contiguos.
+    // Un cluster vacío se reinicia partiendo el más poblado.
+    static void kmeans(const float *x, size_t n, int d, float *cents, int iters, unsigned seed,
+                       RawDistFn l2) {
+        std::mt19937 rng(seed);
+        std::vector<size_t> perm(n);
+        for (size_t i = 0; i < n; i++) perm[i] = i;
+        std::shuffle(perm.begin(), perm.end(), rng);
+        for (int c = 0; c < KSUB; c++)
+            std::memcpy(cents + size_t(c) * d, x + perm[size_t(c) % n] * d, d * sizeof(float));
+
+        std::vector<int> assign(n, 0);
+        std::vector<double> sums(size_t(KSUB) * d);
+        std::vector<size_t> counts(KSUB);
+        for (int it = 0; it < iters; it++) {
+            #ifdef _OPENMP
+            #pragma omp parallel for schedule(static)
+            #endif
+            for (size_t i = 0; i < n; i++) assign[i] = nearest(x + i * d, cents, d, l2);
+
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < n; i++) {
+                int c = assign[i];
+                counts[c]++;
+                const float *v = x + i * d;
+                double *s = &sums[size_t(c) * d];
+                for (int k = 0; k < d; k++) s[k] += v[k];
+            }
+            for (int c = 0; c < KSUB; c++) {
+                if (counts[c] == 0) continue;
+                for (int k = 0; k < d; k++) cents[size_t(c) * d + k] = float(sums[size_t(c) * d + k] / counts[c]);
+            }
+            for (int c = 0; c < KSUB; c++) {
+                if (counts[c] > 0) continue;
+                int big = int(std::max_element(counts.begin(), counts.end()) - counts.begin());
+                std::uniform_real_distribution<float> eps(-1e-4f, 1e-4f);
+                for (int k = 0; k < d; k++) {
+                    float v = cents[size_t(big) * d + k];
+                    cents[size_t(c) * d + k] = v + eps(rng) * (std::abs(v) + 1e-3f);
+                }
+                counts[big] /= 2;
+                counts[c] = counts[big];
+            }
+        }
+    }
+};
+
+// =================== KERNELS SOBRE CÓDIGOS PQ ===================
+
+struct PQDistParam {
+    size_t m = 0;
+    float bias = 0.0f;         // 1 para ip (distancia = 1 - <x, y>), 0 para l2
+    std::vector<float> sdc;    // [m][256][256] distancias entre centroides
+};
+
+struct PQKernels {
+    // SDC: código contra código
+    static float sdc(const void *a, const void *b, const void *param) {
+        const PQDistParam *p = static_cast<const PQDistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        const float *t = p->sdc.data();
+        float s = p->bias;
+        for (size_t j = 0; j < p->m; j++, t += PQParams::KSUB * PQParams::KSUB)
+            s += t[size_t(x[j]) * PQParams::KSUB + y[j]];
+        return s;
+    }
+
+    // ADC: a es la tabla de la query (adc_table), b el código
+    static float adc_scalar(const void *a, const void *b, const void *param) {
+        const PQDistParam *p = static_cast<const PQDistParam *>(param);
+        const float *lut = static_cast<const float *>(a);
+        const uint8_t *code = static_cast<const uint8_t *>(b);
+        float s = p->bias;
+        for (size_t j = 0; j < p->m; j++) s += lut[j * PQParams::KSUB + code[j]];
+        return s;
+    }
+
+    // 8 subespacios por iteración con gather: índice = j * 256 + code[j]
+    __attribute__((target("avx2,fma")))
+    static float adc_avx2(const void *a, const void *b, const void *param) {
+        const PQDistParam *p = static_cast<const PQDistParam *>(param);
+        const float *lut = static_cast<const float *>(a);
+        const uint8_t *code = static_cast<const uint8_t *>(b);
+        size_t m = p->m, j = 0;
+        __m256 acc = _mm256_setzero_ps();
+        __m256i base = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+        const __m256i step = _mm256_set1_epi32(8 * 256);
+        for (; j + 8 <= m; j += 8) {
+            __m256i c = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(code + j)));
+            acc = _mm256_add_ps(acc, _mm256_i32gather_ps(lut, _mm256_add_epi32(base, c), 4));
+            base = _mm256_add_epi32(base, step);
+        }
+        float s = p->bias + DistanceKernels::hsum256(acc);
+        for (; j < m; j++) s += lut[j * PQParams::KSUB + code[j]];
+        return s;
+    }
+
+    __attribute__((target("avx512f")))
+    static float adc_avx512(const void *a, const void *b, const void *param) {
+        const PQDistParam *p = static_cast<const PQDistParam *>(param);
+        const float *lut = static_cast<const float *>(a);
+        const uint8_t *code = static_cast<const uint8_t *>(b);
+        size_t m = p->m, j = 0;
+        __m512 acc = _mm512_setzero_ps();
+        __m512i base = _mm512_mullo_epi32(
+            _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(256));
+        const __m512i step = _mm512_set1_epi32(16 * 256);
+        for (; j + 16 <= m; j += 16) {
+            __m512i c = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(code + j)));
+            acc = _mm512_add_ps(acc, _mm512_i32gather_ps(_mm512_add_epi32(base, c), lut, 4));
+            base = _mm512_add_epi32(base, step);
+        }
+        float s = p->bias + _mm512_reduce_add_ps(acc);
+        for (; j < m; j++) s += lut[j * PQParams::KSUB + code[j]];
+        return s;
+    }
+
+    static hnswlib::DISTFUNC<float> select_adc(SimdLevel level, size_t m) {
+        if (level == SimdLevel::AVX512 && m >= 16) return adc_avx512;
+        if (level >= SimdLevel::AVX2 && m >= 8) return adc_avx2;
+        return adc_scalar;
+    }
+};
+
+// Espacio hnswlib sobre códigos PQ. Modo Sdc (construcción): la query es
+// otro código. Modo Adc (solo búsqueda): la query es su tabla ADC
+// (PQParams::adc_table), así la tabla se consulta durante el recorrido del
+// grafo sin tocar hnswlib ni el motor por lotes.
+class PQSpace : public hnswlib::SpaceInterface<float> {
+public:
+    enum class Mode { Sdc, Adc };
+
+private:
+    PQDistParam param_;
+    hnswlib::DISTFUNC<float> fstdistfunc_;
+    Metric metric_;
+    Mode mode_;
+    SimdLevel level_;
+
+public:
+    PQSpace(Metric metric, const PQParams &params, Mode mode, SimdLevel level = CpuFeatures::detect())
+        : metric_(metric), mode_(mode), level_(level) {
+        param_.m = params.m;
+        param_.bias = metric == Metric::IP ? 1.0f : 0.0f;
+        if (mode == Mode::Sdc) {
+            const int K = PQParams::KSUB;
+            RawDistFn f = DistanceKernels::raw(metric, level);
+            param_.sdc.resize(size_t(params.m) * K * K);
+            for (int j = 0; j < params.m; j++)
+                for (int a = 0; a < K; a++)
+                    for (int b = 0; b < K; b++) {
+                        float v = f(params.centroid(j, a), params.centroid(j, b), params.dsub);
+                        param_.sdc[(size_t(j) * K + a) * K + b] = metric == Metric::L2 ? v : -v;
+                    }
+            fstdistfunc_ = PQKernels::sdc;
+        } else {
+            fstdistfunc_ = PQKernels::select_adc(level, params.m);
+        }
+    }
+
+    size_t get_data_size() override { return param_.m; }
+    hnswlib::DISTFUNC<float> get_dist_func() override { return fstdistfunc_; }
+    void *get_dist_func_param() override { return &param_; }
+
+    std::string description() const {
+        return std::string("pq") + std::to_string(param_.m) + "-" + metric_name(metric_) + "/" +
+               (mode_ == Mode::Sdc ? "sdc" : std::string("adc-") + CpuFeatures::name(level_));
+    }
+
+    ~PQSpace() {}
+};
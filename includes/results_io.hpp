@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <ostream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// =================== RESULTADOS K-NN EN DISCO ===================
+//
+// Formato binario (little endian):
+//   char[4]  "KNNR"
+//   uint32   versión (1)
+//   uint64   n (queries)
+//   uint64   k
+//   uint64   ids[n * k]     (UINT64_MAX = hueco)
+//   float    dists[n * k]
+// La fila q corresponde a la query q del archivo de queries y está
+// ordenada de más cercano a más lejano. El mismo formato sirve para los
+// resultados de una corrida y para el ground truth exacto.
+
+class KnnResults {
+public:
+    static constexpr uint64_t EMPTY = std::numeric_limits<uint64_t>::max();
+
+    size_t n = 0;
+    size_t k = 0;
+    std::vector<uint64_t> ids;
+    std::vector<float> dists;
+
+    KnnResults() = default;
+    KnnResults(size_t n_, size_t k_) { resize(n_, k_); }
+
+    void resize(size_t n_, size_t k_) {
+        n = n_;
+        k = k_;
+        ids.assign(n * k, EMPTY);
+        dists.assign(n * k, std::numeric_limits<float>::infinity());
+    }
+
+    uint64_t *row_ids(size_t q) { return ids.data() + q * k; }
+    float *row_dists(size_t q) { return dists.data() + q * k; }
+    const uint64_t *row_ids(size_t q) const { return ids.data() + q * k; }
+    const float *row_dists(size_t q) const { return dists.data() + q * k; }
+
+    // Vuelca la cola de searchKnn (max-heap) en la fila q, en orden ascendente
+    template <typename Queue>
+    void store(size_t q, Queue &res) {
+        while (res.size() > k) res.pop();
+        size_t sz = res.size();
+        uint64_t *out_ids = row_ids(q);
+        float *out_d = row_dists(q);
+        for (size_t i = sz; i < k; i++) {
+            out_ids[i] = EMPTY;
+            out_d[i] = std::numeric_limits<float>::infinity();
+        }
+        while (!res.empty()) {
+            --sz;
+            out_ids[sz] = res.top().second;
+            out_d[sz] = res.top().first;
+            res.pop();
+        }
+    }
+
+    void save(const std::string &path) const {
+        std::ofstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo crear: " + path);
+        uint32_t version = 1;
+        uint64_t n64 = n, k64 = k;
+        f.write("KNNR", 4);
+        f.write(reinterpret_cast<const char *>(&version), sizeof(version));
+        f.write(reinterpret_cast<const char *>(&n64), sizeof(n64));
+        f.write(reinterpret_cast<const char *>(&k64), sizeof(k64));
+        f.write(reinterpret_cast<const char *>(ids.data()), ids.size() * sizeof(uint64_t));
+        f.write(reinterpret_cast<const char *>(dists.data()), dists.size() * sizeof(float));
+        if (!f) throw std::runtime_error("Error escribiendo: " + path);
+    }
+
+    static KnnResults load(const std::string &path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+        char magic[4];
+        uint32_t version = 0;
+        uint64_t n64 = 0, k64 = 0;
+        f.read(magic, 4);
+        f.read(reinterpret_cast<char *>(&version), sizeof(version));
+        f.read(reinterpret_cast<char *>(&n64), sizeof(n64));
+        f.read(reinterpret_cast<char *>(&k64), sizeof(k64));
+        if (!f || std::memcmp(magic, "KNNR", 4) != 0 || version != 1)
+            throw std::runtime_error("Archivo de resultados inválido: " + path);
+        KnnResults r(n64, k64);
+        f.read(reinterpret_cast<char *>(r.ids.data()), r.ids.size() * sizeof(uint64_t));
+        f.read(reinterpret_cast<char *>(r.dists.data()), r.dists.size() * sizeof(float));
+        if (!f) throw std::runtime_error("Archivo de resultados truncado: " + path);
+        return r;
+    }
+};
+
+// recall@at: fracción de los 'at' vecinos exactos que aparecen entre los
+// primeros 'at' encontrados, promediada sobre las queries. Devuelve -1 si
+// alguno de los dos conjuntos tiene menos de 'at' columnas.
+inline double recall_at(const KnnResults &found, const KnnResults &truth, size_t at) {
+    if (at == 0 || found.k < at || truth.k < at) return -1.0;
+    size_t nq = std::min(found.n, truth.n);
+    if (nq == 0) return -1.0;
+    size_t hits = 0;
+    std::vector<uint64_t> t;
+    for (size_t q = 0; q < nq; q++) {
+        t.assign(truth.row_ids(q), truth.row_ids(q) + at);
+        std::sort(t.begin(), t.end());
+        const uint64_t *f = found.row_ids(q);
+        for (size_t i = 0; i < at; i++) {
+            if (f[i] == KnnResults::EMPTY) continue;
+            if (std::binary_search(t.begin(), t.end(), f[i])) hits++;
+        }
+    }
+    return double(hits) / double(nq * at);
+}
+
+struct RecallReport {
+    double at1 = -1.0;
+    double at10 = -1.0;
+    double atk = -1.0;
+    size_t k = 0;
+
+    static RecallReport compute(const KnnResults &found, const KnnResults &truth, size_t k) {
+        RecallReport r;
+        r.k = k;
+        r.at1 = recall_at(found, truth, 1);
+        r.at10 = recall_at(found, truth, 10);
+        r.atk = recall_at(found, truth, k);
+        return r;
+    }
+
+    // Filas metric,value para los CSV de resumen (omite las no calculables)
+    void write_csv(std::ostream &os) const {
+        if (at1 >= 0) os << "recall_at_1," << at1 << "\n";
+        if (at10 >= 0) os << "recall_at_10," << at10 << "\n";
+        if (atk >= 0 && k != 1 && k != 10) os << "recall_at_" << k << "," << atk << "\n";
+    }
+
+    void print(std::ostream &os) const {
+        if (at1 >= 0) os << "Recall@1: " << at1 << "\n";
+        if (at10 >= 0) os << "Recall@10: " << at10 << "\n";
+        if (atk >= 0 && k != 1 && k != 10) os << "Recall@" << k << ": " << atk << "\n";
+    }
+};
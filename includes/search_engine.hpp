@@ -0,0 +1,447 @@
+#pragma once
+#include "latency_histogram.hpp"
+#include "simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// =================== MOTOR DE BÚSQUEDA PROPIO SOBRE EL GRAFO HNSW ===================
+//
+// Recorre directamente la memoria del índice de hnswlib (capa 0, listas
+// de capas superiores) pero con estado por worker: lista de visitados y
+// heaps propios y reutilizables. Así no se toma el mutex del
+// VisitedListPool ni se reserva una priority_queue nueva por consulta.
+
+using hnswlib::labeltype;
+using hnswlib::linklistsizeint;
+using hnswlib::tableint;
+
+// Vista de solo lectura del grafo. Las listas de capas superiores se
+// localizan como upper_base + upper_offsets[id]; para un índice de hnswlib
+// en memoria upper_base es 0 y upper_offsets son los propios punteros.
+struct HnswGraphView {
+    const char *level0 = nullptr;
+    size_t size_data_per_element = 0;
+    size_t offset_level0 = 0;
+    size_t offset_data = 0;
+    size_t label_offset = 0;
+    uintptr_t upper_base = 0;
+    const uint64_t *upper_offsets = nullptr;
+    size_t size_links_per_element = 0;
+    tableint entry_point = 0;
+    int max_level = -1;
+    size_t count = 0;
+    bool has_deletions = false;
+    hnswlib::DISTFUNC<float> dist = nullptr;
+    void *dist_param = nullptr;
+
+    static HnswGraphView from(const hnswlib::HierarchicalNSW<float> &index) {
+        static_assert(sizeof(char *) == sizeof(uint64_t), "se asume puntero de 64 bits");
+        HnswGraphView g;
+        g.level0 = index.data_level0_memory_;
+        g.size_data_per_element = index.size_data_per_element_;
+        g.offset_level0 = index.offsetLevel0_;
+        g.offset_data = index.offsetData_;
+        g.label_offset = index.label_offset_;
+        g.upper_base = 0;
+        g.upper_offsets = reinterpret_cast<const uint64_t *>(index.linkLists_);
+        g.size_links_per_element = index.size_links_per_element_;
+        g.entry_point = index.enterpoint_node_;
+        g.max_level = index.maxlevel_;
+        g.count = index.cur_element_count;
+        g.has_deletions = index.num_deleted_ > 0;
+        g.dist = index.fstdistfunc_;
+        g.dist_param = index.dist_func_param_;
+        return g;
+    }
+
+    const char *element(tableint id) const { return level0 + id * size_data_per_element; }
+    const char *data(tableint id) const { return element(id) + offset_data; }
+
+    const linklistsizeint *links0(tableint id) const {
+        return reinterpret_cast<const linklistsizeint *>(element(id) + offset_level0);
+    }
+
+    const linklistsizeint *links(tableint id, int level) const {
+        return reinterpret_cast<const linklistsizeint *>(
+            upper_base + upper_offsets[id] + (level - 1) * size_links_per_element);
+    }
+
+    static unsigned short link_count(const linklistsizeint *ll) {
+        return *reinterpret_cast<const unsigned short *>(ll);
+    }
+
+    labeltype label(tableint id) const {
+        labeltype l;
+        memcpy(&l, element(id) + label_offset, sizeof(labeltype));
+        return l;
+    }
+
+    // Mismo bit de borrado lógico que usa hnswlib (byte 2 de la lista de capa 0)
+    bool deleted(tableint id) const {
+        return *(reinterpret_cast<const unsigned char *>(links0(id)) + 2) & 0x01;
+    }
+};
+
+// Filtro por defecto: acepta todo
+struct AcceptAll {
+    bool operator()(tableint) const { return true; }
+};
+
+// Filtro por bitmap de ids internos (un bit por nodo, ver search_filter.hpp)
+struct IdBitmapFilter {
+    const uint64_t *words = nullptr;
+    bool operator()(tableint id) const { return (words[id >> 6] >> (id & 63)) & 1; }
+};
+
+// Estado reutilizable de un worker (alineado para no compartir líneas)
+struct alignas(64) SearchContext {
+    std::vector<uint16_t> visited;
+    uint16_t tag = 0;
+    std::vector<std::pair<float, tableint>> candidates;  // min-heap por distancia
+    std::vector<std::pair<float, tableint>> top;         // max-heap por distancia
+    size_t hops = 0;
+    size_t distance_computations = 0;
+
+    explicit SearchContext(size_t n = 0) : visited(n, 0) {}
+
+    void prepare(size_t n, size_t ef) {
+        if (visited.size() < n) {
+            visited.assign(n, 0);
+            tag = 0;
+        }
+        if (++tag == 0) {
+            std::fill(visited.begin(), visited.end(), 0);
+            tag = 1;
+        }
+        candidates.clear();
+        top.clear();
+        if (candidates.capacity() < ef * 2) candidates.reserve(ef * 2);
+        if (top.capacity() < ef + 1) top.reserve(ef + 1);
+    }
+};
+
+class GraphSearcher {
+public:
+    // Búsqueda k-NN. Escribe hasta k resultados ordenados de más cercano a
+    // más lejano en out_labels/out_dists y devuelve cuántos encontró.
+    template <typename Filter = AcceptAll>
+    static size_t search(const HnswGraphView &g, const void *query, size_t k, size_t ef,
+                         SearchContext &ctx, uint64_t *out_labels, float *out_dists,
+                         const Filter &filter = Filter()) {
+        if (g.count == 0 || k == 0) return 0;
+
+        tableint ep = greedy_upper_layers(g, query, ctx);
+        ef = std::max(ef, k);
+        search_base_layer(g, query, ep, ef, ctx, filter);
+
+        // top es un max-heap: sort_heap lo deja en orden ascendente
+        std::sort_heap(ctx.top.begin(), ctx.top.end());
+        size_t found = std::min(k, ctx.top.size());
+        for (size_t i = 0; i < found; i++) {
+            out_labels[i] = g.label(ctx.top[i].second);
+            if (out_dists) out_dists[i] = ctx.top[i].first;
+        }
+        return found;
+    }
+
+    // Recorrido exhaustivo de una lista de ids (filtros muy selectivos,
+    // donde el grafo tendría que visitar casi todo para juntar ef nodos
+    // válidos). Resultado exacto dentro de la lista.
+    static size_t scan(const HnswGraphView &g, const void *query, const tableint *ids,
+                       size_t count, size_t k, SearchContext &ctx, uint64_t *out_labels,
+                       float *out_dists) {
+        if (k == 0) return 0;
+        auto &top = ctx.top;
+        top.clear();
+        for (size_t i = 0; i < count; i++) {
+            tableint id = ids[i];
+            if (i + 1 < count) __builtin_prefetch(g.data(ids[i + 1]));
+            if (g.has_deletions && g.deleted(id)) continue;
+            float d = g.dist(query, g.data(id), g.dist_param);
+            if (top.size() < k) {
+                top.emplace_back(d, id);
+                std::push_heap(top.begin(), top.end());
+            } else if (d < top.front().first) {
+                std::pop_heap(top.begin(), top.end());
+                top.back() = std::make_pair(d, id);
+                std::push_heap(top.begin(), top.end());
+            }
+        }
+        ctx.distance_computations += count;
+
+        std::sort_heap(top.begin(), top.end());
+        for (size_t i = 0; i < top.size(); i++) {
+            out_labels[i] = g.label(top[i].second);
+            if (out_dists) out_dists[i] = top[i].first;
+        }
+        return top.size();
+    }
+
+    // Descenso voraz por las capas superiores hasta la capa 1
+    static tableint greedy_upper_layers(const HnswGraphView &g, const void *query,
+                                        SearchContext &ctx) {
+        tableint cur = g.entry_point;
+        float cur_dist = g.dist(query, g.data(cur), g.dist_param);
+        ctx.distance_computations++;
+        for (int level = g.max_level; level > 0; level--) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                const linklistsizeint *ll = g.links(cur, level);
+                unsigned short size = HnswGraphView::link_count(ll);
+                const tableint *nb = reinterpret_cast<const tableint *>(ll + 1);
+                ctx.hops++;
+                ctx.distance_computations += size;
+                for (unsigned short i = 0; i < size; i++) {
+                    float d = g.dist(query, g.data(nb[i]), g.dist_param);
+                    if (d < cur_dist) {
+                        cur_dist = d;
+                        cur = nb[i];
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return cur;
+    }
+
+    // Búsqueda en haz sobre la capa 0; deja en ctx.top (max-heap) hasta ef nodos
+    template <typename Filter>
+    static void search_base_layer(const HnswGraphView &g, const void *query, tableint ep,
+                                  size_t ef, SearchContext &ctx, const Filter &filter) {
+        ctx.prepare(g.count, ef);
+        auto &cand = ctx.candidates;
+        auto &top = ctx.top;
+        uint16_t *visited = ctx.visited.data();
+        const uint16_t tag = ctx.tag;
+        auto cand_cmp = [](const std::pair<float, tableint> &a, const std::pair<float, tableint> &b) {
+            return a.first > b.first;
+        };
+        auto accept = [&](tableint id) {
+            return (!g.has_deletions || !g.deleted(id)) && filter(id);
+        };
+
+        float lower = std::numeric_limits<float>::max();
+        float d0 = g.dist(query, g.data(ep), g.dist_param);
+        ctx.distance_computations++;
+        if (accept(ep)) {
+            top.emplace_back(d0, ep);
+            lower = d0;
+        }
+        cand.emplace_back(d0, ep);
+        visited[ep] = tag;
+
+        while (!cand.empty()) {
+            std::pair<float, tableint> cur = cand.front();
+            if (cur.first > lower && top.size() >= ef) break;
+            std::pop_heap(cand.begin(), cand.end(), cand_cmp);
+            cand.pop_back();
+
+            const linklistsizeint *ll = g.links0(cur.second);
+            unsigned short size = HnswGraphView::link_count(ll);
+            const tableint *nb = reinterpret_cast<const tableint *>(ll + 1);
+            ctx.hops++;
+
+            if (size > 0) {
+                __builtin_prefetch(visited + nb[0]);
+                __builtin_prefetch(g.data(nb[0]));
+            }
+            for (unsigned short i = 0; i < size; i++) {
+                tableint id = nb[i];
+                if (i + 1 < size) {
+                    __builtin_prefetch(visited + nb[i + 1]);
+                    __builtin_prefetch(g.data(nb[i + 1]));
+                }
+                if (visited[id] == tag) continue;
+                visited[id] = tag;
+
+                float d = g.dist(query, g.data(id), g.dist_param);
+                ctx.distance_computations++;
+                if (top.size() < ef || d < lower) {
+                    cand.emplace_back(d, id);
+                    std::push_heap(cand.begin(), cand.end(), cand_cmp);
+                    if (accept(id)) {
+                        top.emplace_back(d, id);
+                        std::push_heap(top.begin(), top.end());
+                        if (top.size() > ef) {
+                            std::pop_heap(top.begin(), top.end());
+                            top.pop_back();
+                        }
+                    }
+                    if (!top.empty()) lower = top.front().first;
+                }
+            }
+        }
+    }
+};
+
+// =================== BÚSQUEDA POR LOTES ===================
+//
+// Cada worker reclama un bloque de 'batch_size' queries a la vez y reutiliza
+// su SearchContext. Los resultados quedan en arreglos planos n*k.
+
+struct BatchSearchStats {
+    double total_time_s = 0.0;
+    double qps = 0.0;
+    std::vector<size_t> per_thread_queries;
+    size_t hops = 0;
+    size_t distance_computations = 0;
+    LatencyHistogram latency;  // fusión de los histogramas por worker
+};
+
+// Filtro para el motor por lotes: bitmap para el recorrido del grafo y la
+// lista de ids permitidos para el recorrido exhaustivo
+struct BatchFilter {
+    IdBitmapFilter bitmap;
+    const tableint *ids = nullptr;
+    size_t count = 0;
+    bool exhaustive = false;  // true = scan() sobre ids en vez del grafo
+};
+
+class BatchSearcher {
+private:
+    HnswGraphView graph;
+    int num_threads;
+    size_t batch_size;
+    std::vector<std::unique_ptr<SearchContext>> contexts;
+    std::vector<LatencyHistogram> histograms;
+    std::vector<HnswGraphView> thread_graphs;  // copia de la capa 0 que usa cada worker
+    std::function<void(int)> thread_init;
+    std::function<void(int)> thread_exit;
+    BatchFilter filter;
+    bool filtered = false;
+    NormalizeFn normalize = nullptr;  // queries a norma 1 antes de buscar (índices ip)
+    size_t query_dim = 0;
+    std::vector<std::vector<float>> query_buffers;  // una query normalizada por worker
+
+public:
+    BatchSearcher(const HnswGraphView &g, int threads, size_t batch)
+        : graph(g), num_threads(std::max(1, threads)), batch_size(std::max<size_t>(1, batch)) {
+        for (int t = 0; t < num_threads; t++)
+            contexts.emplace_back(new SearchContext(graph.count));
+        histograms.resize(num_threads);
+        thread_graphs.assign(num_threads, graph);
+    }
+
+    size_t batch() const { return batch_size; }
+
+    // Latencias del worker tid en la última búsqueda (stats.latency es su fusión)
+    const LatencyHistogram &thread_latency(int tid) const { return histograms[tid]; }
+
+    // Se llama al arrancar cada worker (p. ej. para fijarlo a una CPU)
+    void on_thread_start(std::function<void(int)> fn) { thread_init = std::move(fn); }
+
+    // Grafo del worker tid (p. ej. la réplica de la capa 0 de su nodo NUMA);
+    // se puede llamar desde on_thread_start
+    void use_graph(int tid, const HnswGraphView &g) { thread_graphs[tid] = g; }
+
+    // Restringe todas las búsquedas a los ids del filtro (ver search_filter.hpp)
+    void use_filter(const BatchFilter &f) {
+        filter = f;
+        filtered = true;
+    }
+
+    // Se llama en cada worker justo antes de terminar (p. ej. para leer sus
+    // contadores hardware)
+    void on_thread_exit(std::function<void(int)> fn) { thread_exit = std::move(fn); }
+
+    // Normaliza cada query float (dim componentes) en un buffer del worker
+    // justo antes de buscarla: sin pasada previa sobre todo el arreglo
+    void use_query_normalizer(NormalizeFn fn, size_t dim) {
+        normalize = fn;
+        query_dim = dim;
+        query_buffers.assign(num_threads, std::vector<float>(dim));
+    }
+
+    // queries: n consultas contiguas de query_bytes bytes cada una.
+    // out_ids/out_dists: n*k; los huecos quedan en UINT64_MAX / +inf.
+    // latencies_ms / query_thread (opcionales): latencia de cada consulta y
+    // worker que la resolvió.
+    BatchSearchStats searchBatchRaw(const void *queries, size_t query_bytes, size_t n, size_t k,
+                                    size_t ef, uint64_t *out_ids, float *out_dists,
+                                    double *latencies_ms = nullptr, int *query_thread = nullptr) {
+        BatchSearchStats stats;
+        stats.per_thread_queries.assign(num_threads, 0);
+        std::atomic<size_t> next{0};
+        const char *qbase = static_cast<const char *>(queries);
+
+        auto worker = [&](int tid) {
+            if (thread_init) thread_init(tid);
+            const HnswGraphView &g = thread_graphs[tid];
+            SearchContext &ctx = *contexts[tid];
+            LatencyHistogram &hist = histograms[tid];
+            ctx.hops = ctx.distance_computations = 0;
+            hist.reset();
+            size_t done = 0;
+            while (true) {
+                size_t b = next.fetch_add(batch_size, std::memory_order_relaxed);
+                if (b >= n) break;
+                size_t e = std::min(n, b + batch_size);
+                for (size_t q = b; q < e; q++) {
+                    auto t0 = std::chrono::high_resolution_clock::now();
+                    uint64_t *ids = out_ids + q * k;
+                    float *dists = out_dists ? out_dists + q * k : nullptr;
+                    const void *query = qbase + q * query_bytes;
+                    if (normalize) {
+                        float *buf = query_buffers[tid].data();
+                        normalize(static_cast<const float *>(query), buf, query_dim);
+                        query = buf;
+                    }
+                    size_t found;
+                    if (!filtered)
+                        found = GraphSearcher::search(g, query, k, ef, ctx, ids, dists);
+                    else if (filter.exhaustive)
+                        found = GraphSearcher::scan(g, query, filter.ids, filter.count, k, ctx,
+                                                    ids, dists);
+                    else
+                        found = GraphSearcher::search(g, query, k, ef, ctx, ids, dists,
+                                                      filter.bitmap);
+                    for (size_t i = found; i < k; i++) {
+                        ids[i] = UINT64_MAX;
+                        if (dists) dists[i] = std::numeric_limits<float>::infinity();
+                    }
+                    auto t1 = std::chrono::high_resolution_clock::now();
+                    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                    hist.record(ns);
+                    if (latencies_ms) latencies_ms[q] = ns / 1e6;
+                    if (query_thread) query_thread[q] = tid;
+                }
+                done += e - b;
+            }
+            stats.per_thread_queries[tid] = done;
+            if (thread_exit) thread_exit(tid);
+        };
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; t++) threads.emplace_back(worker, t);
+        for (auto &th : threads) th.join();
+        auto t1 = std::chrono::high_resolution_clock::now();
+
+        stats.total_time_s = std::chrono::duration<double>(t1 - t0).count();
+        stats.qps = stats.total_time_s > 0 ? n / stats.total_time_s : 0.0;
+        for (auto &c : contexts) {
+            stats.hops += c->hops;
+            stats.distance_computations += c->distance_computations;
+        }
+        for (const auto &h : histograms) stats.latency.merge(h);
+        return stats;
+    }
+
+    // Atajo para queries float de dimensión dim
+    BatchSearchStats searchBatch(const float *queries, size_t n, int dim, size_t k, size_t ef,
+                                 uint64_t *out_ids, float *out_dists,
+                                 double *latencies_ms = nullptr, int *query_thread = nullptr) {
+        return searchBatchRaw(queries, dim * sizeof(float), n, k, ef, out_ids, out_dists,
+                              latencies_ms, query_thread);
+    }
+};
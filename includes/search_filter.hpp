@@ -0,0 +1,212 @@
+#pragma once
+#include "mapped_dataset.hpp"
+#include "search_engine.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// =================== BÚSQUEDA K-NN FILTRADA ===================
+//
+// Restringe la búsqueda a un subconjunto de labels (p. ej. los ids de un
+// tenant) sin pedir un k enorme y post-filtrar:
+//   - lista de labels permitidos (archivo uint64, mismo formato que ids.bin)
+//   - rango de labels [lo, hi]
+//   - predicado lo <= attr <= hi sobre un archivo de atributos int32 con
+//     una fila por fila de ids.bin
+// Los criterios se combinan con AND y se compilan una vez, al cargar, en
+// un bitmap de ids internos (un bit por nodo) que el motor consulta dentro
+// del recorrido del grafo. Si el filtro deja pasar tan pocos nodos que el
+// grafo tendría que visitar casi todo para juntar ef válidos, se recorre
+// directamente la lista de permitidos (exacto y más barato).
+
+// Conjunto de labels de 64 bits al estilo roaring: los 48 bits altos eligen
+// un contenedor y los 16 bajos van en un arreglo ordenado (hasta 4096
+// elementos) o en un bitmap de 65536 bits
+class LabelSet {
+private:
+    static constexpr size_t ARRAY_MAX = 4096;
+
+    struct Container {
+        uint64_t key = 0;
+        std::vector<uint16_t> array;  // ordenado (contenedor disperso)
+        std::vector<uint64_t> bits;   // 1024 palabras (contenedor denso)
+
+        bool contains(uint16_t low) const {
+            if (!bits.empty()) return (bits[low >> 6] >> (low & 63)) & 1;
+            return std::binary_search(array.begin(), array.end(), low);
+        }
+    };
+
+    std::vector<Container> containers;  // ordenados por key
+    size_t count = 0;
+
+public:
+    LabelSet() = default;
+
+    explicit LabelSet(std::vector<uint64_t> labels) {
+        std::sort(labels.begin(), labels.end());
+        labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+        count = labels.size();
+        for (size_t i = 0; i < labels.size();) {
+            Container c;
+            c.key = labels[i] >> 16;
+            size_t j = i;
+            while (j < labels.size() && (labels[j] >> 16) == c.key) j++;
+            if (j - i > ARRAY_MAX) {
+                c.bits.assign(1024, 0);
+                for (size_t t = i; t < j; t++) {
+                    uint16_t low = uint16_t(labels[t]);
+                    c.bits[low >> 6] |= uint64_t(1) << (low & 63);
+                }
+            } else {
+                c.array.reserve(j - i);
+                for (size_t t = i; t < j; t++) c.array.push_back(uint16_t(labels[t]));
+            }
+            containers.push_back(std::move(c));
+            i = j;
+        }
+    }
+
+    static LabelSet load(const std::string &path) {
+        MappedIds ids(path);
+        return LabelSet(std::vector<uint64_t>(ids.data(), ids.data() + ids.size()));
+    }
+
+    bool contains(uint64_t label) const {
+        uint64_t key = label >> 16;
+        auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                                   [](const Container &c, uint64_t k) { return c.key < k; });
+        return it != containers.end() && it->key == key && it->contains(uint16_t(label));
+    }
+
+    size_t size() const { return count; }
+
+    size_t bytes() const {
+        size_t b = containers.size() * sizeof(Container);
+        for (const auto &c : containers) b += c.array.size() * 2 + c.bits.size() * 8;
+        return b;
+    }
+};
+
+// Adaptador para searchKnn de hnswlib (filtra por label)
+class LabelSetFunctor : public hnswlib::BaseFilterFunctor {
+private:
+    const LabelSet &set;
+
+public:
+    explicit LabelSetFunctor(const LabelSet &s) : set(s) {}
+    bool operator()(hnswlib::labeltype label) override { return set.contains(label); }
+};
+
+enum class FilterMode { Auto, Graph, Brute };
+
+inline FilterMode parse_filter_mode(const std::string &s) {
+    if (s == "auto") return FilterMode::Auto;
+    if (s == "graph") return FilterMode::Graph;
+    if (s == "brute") return FilterMode::Brute;
+    throw std::runtime_error("Modo de filtro inválido: " + s + " (auto|graph|brute)");
+}
+
+// Criterios pedidos por línea de comandos
+struct FilterSpec {
+    std::string allow_file;
+    bool has_range = false;
+    uint64_t range_lo = 0, range_hi = 0;
+    std::string attr_file, attr_ids_file;
+    int32_t attr_lo = 0, attr_hi = 0;
+    FilterMode mode = FilterMode::Auto;
+
+    bool active() const { return !allow_file.empty() || has_range || !attr_file.empty(); }
+
+    std::string describe() const {
+        std::ostringstream ss;
+        const char *sep = "";
+        if (!allow_file.empty()) {
+            ss << "ids en " << allow_file;
+            sep = " y ";
+        }
+        if (has_range) {
+            ss << sep << "label en " << range_lo << ".." << range_hi;
+            sep = " y ";
+        }
+        if (!attr_file.empty()) ss << sep << "atributo en " << attr_lo << ".." << attr_hi;
+        return ss.str();
+    }
+};
+
+class SearchFilter {
+private:
+    std::vector<uint64_t> words;  // bitmap de ids internos
+    std::vector<tableint> ids;    // ids internos permitidos, ascendentes
+    LabelSet labels;              // los mismos nodos por label (searchKnn)
+    size_t total = 0;
+    bool exhaustive = false;
+
+public:
+    // Compila los criterios contra el grafo (índice hnswlib o mapeado); ef
+    // es el efSearch de las consultas, para decidir entre grafo y recorrido
+    static SearchFilter build(const FilterSpec &spec, const HnswGraphView &g, size_t ef) {
+        LabelSet allow;
+        if (!spec.allow_file.empty()) allow = LabelSet::load(spec.allow_file);
+
+        LabelSet attr_match;
+        if (!spec.attr_file.empty()) {
+            MappedIds row_ids(spec.attr_ids_file);
+            MappedFile attrs(spec.attr_file);
+            if (attrs.size() != row_ids.size() * sizeof(int32_t))
+                throw std::runtime_error("El archivo de atributos debe tener un int32 por fila de " +
+                                         spec.attr_ids_file);
+            const int32_t *attr = static_cast<const int32_t *>(attrs.data());
+            std::vector<uint64_t> match;
+            for (size_t i = 0; i < row_ids.size(); i++)
+                if (attr[i] >= spec.attr_lo && attr[i] <= spec.attr_hi) match.push_back(row_ids[i]);
+            attr_match = LabelSet(std::move(match));
+        }
+
+        SearchFilter f;
+        f.total = g.count;
+        f.words.assign((g.count + 63) / 64, 0);
+        std::vector<uint64_t> accepted;
+        for (size_t x = 0; x < g.count; x++) {
+            labeltype l = g.label(tableint(x));
+            if (!spec.allow_file.empty() && !allow.contains(l)) continue;
+            if (spec.has_range && (l < spec.range_lo || l > spec.range_hi)) continue;
+            if (!spec.attr_file.empty() && !attr_match.contains(l)) continue;
+            f.words[x >> 6] |= uint64_t(1) << (x & 63);
+            f.ids.push_back(tableint(x));
+            accepted.push_back(l);
+        }
+        f.labels = LabelSet(std::move(accepted));
+        f.exhaustive = spec.mode == FilterMode::Brute ||
+                       (spec.mode == FilterMode::Auto && f.ids.size() <= graph_cost(g, f.selectivity(), ef));
+        return f;
+    }
+
+    // Distancias que costaría juntar ef nodos válidos por el grafo: una
+    // búsqueda sin filtro expande del orden de ef nodos con ~M0/2 vecinos
+    // nuevos cada uno, y solo una fracción 'selectivity' de lo visitado
+    // cuenta para el resultado
+    static double graph_cost(const HnswGraphView &g, double selectivity, size_t ef) {
+        size_t max_m0 = (g.offset_data - g.offset_level0 - sizeof(linklistsizeint)) / sizeof(tableint);
+        return double(ef) * (max_m0 / 2.0) / std::max(selectivity, 1e-9);
+    }
+
+    size_t allowed() const { return ids.size(); }
+    double selectivity() const { return total ? double(ids.size()) / total : 0.0; }
+    bool use_brute_force() const { return exhaustive; }
+    const LabelSet &label_set() const { return labels; }
+    size_t bytes() const { return words.size() * 8 + ids.size() * sizeof(tableint) + labels.bytes(); }
+
+    BatchFilter batch(bool force_exhaustive = false) const {
+        BatchFilter b;
+        b.bitmap.words = words.data();
+        b.ids = ids.data();
+        b.count = ids.size();
+        b.exhaustive = force_exhaustive || exhaustive;
+        return b;
+    }
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// =================== PROTOCOLO BINARIO DEL SERVIDOR ===================
+//
+// Mensajes de tamaño fijo + carga útil, little endian, sobre un socket Unix
+// de tipo stream. Un cliente puede encadenar peticiones sin esperar
+// respuesta; cada respuesta lleva el request_id de su petición.
+//
+// Petición:  RequestHeader + nq * dim floats (solo OP_SEARCH)
+// Respuesta: ResponseHeader + nq * k uint64 (ids) + nq * k float (dists)
+//            para OP_SEARCH, o payload_bytes de texto para OP_STATS.
+//
+// El servidor responde STATUS_BAD_REQUEST (y cierra) si k > 4096,
+// nq > 65536, nq * k > 2^22 o ef > 65536.
+
+namespace proto {
+
+constexpr uint32_t REQUEST_MAGIC = 0x51534e48;   // "HNSQ"
+constexpr uint32_t RESPONSE_MAGIC = 0x52534e48;  // "HNSR"
+
+enum Op : uint16_t {
+    OP_SEARCH = 1,
+    OP_STATS = 2,
+    OP_SHUTDOWN = 3,
+};
+
+enum Status : uint16_t {
+    STATUS_OK = 0,
+    STATUS_BAD_REQUEST = 1,
+    STATUS_OVERLOADED = 2,
+};
+
+#pragma pack(push, 1)
+struct RequestHeader {
+    uint32_t magic = REQUEST_MAGIC;
+    uint16_t op = OP_SEARCH;
+    uint16_t flags = 0;
+    uint32_t request_id = 0;
+    uint32_t k = 0;
+    uint32_t ef = 0;   // 0 = ef por defecto del servidor
+    uint32_t dim = 0;
+    uint32_t nq = 0;   // queries en esta petición
+};
+
+struct ResponseHeader {
+    uint32_t magic = RESPONSE_MAGIC;
+    uint16_t op = 0;
+    uint16_t status = STATUS_OK;
+    uint32_t request_id = 0;
+    uint32_t k = 0;
+    uint32_t nq = 0;
+    uint32_t reserved = 0;  // deja la carga útil alineada a 8 bytes
+    uint64_t payload_bytes = 0;
+    uint64_t server_ns = 0;  // tiempo desde que llegó la petición hasta la respuesta
+};
+#pragma pack(pop)
+
+static_assert(sizeof(ResponseHeader) % 8 == 0, "la carga útil debe quedar alineada");
+
+// Lectura/escritura completas (reintentan lecturas cortas y EINTR).
+// read_full devuelve false si el otro extremo cerró la conexión.
+inline bool read_full(int fd, void *buf, size_t n) {
+    char *p = static_cast<char *>(buf);
+    while (n > 0) {
+        ssize_t r = ::read(fd, p, n);
+        if (r == 0) return false;
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += r;
+        n -= size_t(r);
+    }
+    return true;
+}
+
+inline bool write_full(int fd, const void *buf, size_t n) {
+    const char *p = static_cast<const char *>(buf);
+    while (n > 0) {
+        ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= size_t(w);
+    }
+    return true;
+}
+
+inline sockaddr_un make_address(const std::string &path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Ruta de socket demasiado larga: " + path);
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
+inline int connect_unix(const std::string &path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) throw std::runtime_error("socket(): " + std::string(std::strerror(errno)));
+    sockaddr_un addr = make_address(path);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+        int err = errno;
+        ::close(fd);
+        throw std::runtime_error("No se pudo conectar a " + path + ": " + std::strerror(err));
+    }
+    return fd;
+}
+
+}  // namespace proto
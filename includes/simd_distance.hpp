@@ -0,0 +1,384 @@
+#pragma once
+#include "hnswlib.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <stdexcept>
+#include <string>
+
+// =================== KERNELS DE DISTANCIA SIMD CON DESPACHO EN RUNTIME ===================
+//
+// Cada kernel se compila con su propio atributo target(), así el binario
+// no necesita -march=native: el nivel SIMD se elige al arrancar con cpuid
+// (__builtin_cpu_supports). HNSW_SIMD=scalar|avx2|avx512 fuerza un nivel.
+
+enum class Metric { L2, IP };
+enum class SimdLevel { Scalar = 0, AVX2 = 1, AVX512 = 2 };
+
+using RawDistFn = float (*)(const float *, const float *, size_t);
+using NormalizeFn = void (*)(const float *src, float *dst, size_t n);
+
+inline Metric parse_metric(const std::string &s) {
+    if (s == "l2") return Metric::L2;
+    if (s == "ip") return Metric::IP;
+    throw std::runtime_error("Métrica desconocida: " + s + " (usar l2|ip)");
+}
+
+inline const char *metric_name(Metric m) { return m == Metric::L2 ? "l2" : "ip"; }
+
+class CpuFeatures {
+public:
+    static SimdLevel detect() {
+        static const SimdLevel level = detect_uncached();
+        return level;
+    }
+
+    static bool supports(SimdLevel level) {
+        switch (level) {
+        case SimdLevel::AVX512:
+            return __builtin_cpu_supports("avx512f");
+        case SimdLevel::AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        default:
+            return true;
+        }
+    }
+
+    static const char *name(SimdLevel level) {
+        switch (level) {
+        case SimdLevel::AVX512: return "avx512";
+        case SimdLevel::AVX2: return "avx2";
+        default: return "scalar";
+        }
+    }
+
+private:
+    static SimdLevel detect_uncached() {
+        __builtin_cpu_init();
+        SimdLevel best = SimdLevel::Scalar;
+        if (supports(SimdLevel::AVX2)) best = SimdLevel::AVX2;
+        if (supports(SimdLevel::AVX512)) best = SimdLevel::AVX512;
+
+        const char *forced = std::getenv("HNSW_SIMD");
+        if (forced) {
+            SimdLevel want = best;
+            if (!strcmp(forced, "scalar")) want = SimdLevel::Scalar;
+            else if (!strcmp(forced, "avx2")) want = SimdLevel::AVX2;
+            else if (!strcmp(forced, "avx512")) want = SimdLevel::AVX512;
+            if (supports(want)) best = want;
+        }
+        return best;
+    }
+};
+
+struct DistanceKernels {
+    // ---------- Escalar ----------
+    static inline float l2_scalar(const float *a, const float *b, size_t n) {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0, n4 = n & ~size_t(3);
+        for (; i < n4; i += 4) {
+            float d0 = a[i] - b[i], d1 = a[i + 1] - b[i + 1];
+            float d2 = a[i + 2] - b[i + 2], d3 = a[i + 3] - b[i + 3];
+            s0 += d0 * d0; s1 += d1 * d1; s2 += d2 * d2; s3 += d3 * d3;
+        }
+        for (; i < n; i++) {
+            float d = a[i] - b[i];
+            s0 += d * d;
+        }
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    static inline float dot_scalar(const float *a, const float *b, size_t n) {
+        float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = 0, n4 = n & ~size_t(3);
+        for (; i < n4; i += 4) {
+            s0 += a[i] * b[i]; s1 += a[i + 1] * b[i + 1];
+            s2 += a[i + 2] * b[i + 2]; s3 += a[i + 3] * b[i + 3];
+        }
+        for (; i < n; i++) s0 += a[i] * b[i];
+        return (s0 + s1) + (s2 + s3);
+    }
+
+    // ---------- AVX2 + FMA ----------
+    __attribute__((target("avx2,fma"), always_inline))
+    static inline float hsum256(__m256 v) {
+        __m128 lo = _mm256_castps256_ps128(v);
+        __m128 hi = _mm256_extractf128_ps(v, 1);
+        lo = _mm_add_ps(lo, hi);
+        __m128 shuf = _mm_movehdup_ps(lo);
+        __m128 sums = _mm_add_ps(lo, shuf);
+        shuf = _mm_movehl_ps(shuf, sums);
+        sums = _mm_add_ss(sums, shuf);
+        return _mm_cvtss_f32(sums);
+    }
+
+    __attribute__((target("avx2,fma"), always_inline))
+    static inline float l2_avx2(const float *a, const float *b, size_t n) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm256_fmadd_ps(d1, d1, acc1);
+        }
+        for (; i + 8 <= n; i += 8) {
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+            acc0 = _mm256_fmadd_ps(d0, d0, acc0);
+        }
+        float s = hsum256(_mm256_add_ps(acc0, acc1));
+        for (; i < n; i++) {
+            float d = a[i] - b[i];
+            s += d * d;
+        }
+        return s;
+    }
+
+    __attribute__((target("avx2,fma"), always_inline))
+    static inline float dot_avx2(const float *a, const float *b, size_t n) {
+        __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        }
+        for (; i + 8 <= n; i += 8) {
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        }
+        float s = hsum256(_mm256_add_ps(acc0, acc1));
+        for (; i < n; i++) s += a[i] * b[i];
+        return s;
+    }
+
+    // ---------- AVX-512 ----------
+    __attribute__((target("avx512f"), always_inline))
+    static inline float l2_avx512(const float *a, const float *b, size_t n) {
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16));
+            acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+            acc1 = _mm512_fmadd_ps(d1, d1, acc1);
+        }
+        for (; i + 16 <= n; i += 16) {
+            __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i));
+            acc0 = _mm512_fmadd_ps(d0, d0, acc0);
+        }
+        if (i < n) {
+            __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+            __m512 d0 = _mm512_sub_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i));
+            acc1 = _mm512_fmadd_ps(d0, d0, acc1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+    }
+
+    __attribute__((target("avx512f"), always_inline))
+    static inline float dot_avx512(const float *a, const float *b, size_t n) {
+        __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32) {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+        }
+        for (; i + 16 <= n; i += 16) {
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        }
+        if (i < n) {
+            __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), acc1);
+        }
+        return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+    }
+
+    // ---------- Envoltorios no inline (punteros a función) ----------
+    static float l2_scalar_fn(const float *a, const float *b, size_t n) { return l2_scalar(a, b, n); }
+    static float dot_scalar_fn(const float *a, const float *b, size_t n) { return dot_scalar(a, b, n); }
+    __attribute__((target("avx2,fma")))
+    static float l2_avx2_fn(const float *a, const float *b, size_t n) { return l2_avx2(a, b, n); }
+    __attribute__((target("avx2,fma")))
+    static float dot_avx2_fn(const float *a, const float *b, size_t n) { return dot_avx2(a, b, n); }
+    __attribute__((target("avx512f")))
+    static float l2_avx512_fn(const float *a, const float *b, size_t n) { return l2_avx512(a, b, n); }
+    __attribute__((target("avx512f")))
+    static float dot_avx512_fn(const float *a, const float *b, size_t n) { return dot_avx512(a, b, n); }
+
+    // Producto interno crudo o L2 al cuadrado, sin la convención 1 - ip
+    static RawDistFn raw(Metric metric, SimdLevel level) {
+        switch (level) {
+        case SimdLevel::AVX512: return metric == Metric::L2 ? l2_avx512_fn : dot_avx512_fn;
+        case SimdLevel::AVX2: return metric == Metric::L2 ? l2_avx2_fn : dot_avx2_fn;
+        default: return metric == Metric::L2 ? l2_scalar_fn : dot_scalar_fn;
+        }
+    }
+
+    // ---------- Firmas DISTFUNC de hnswlib (dim en tiempo de ejecución) ----------
+    static float l2_scalar_dist(const void *a, const void *b, const void *p) {
+        return l2_scalar((const float *)a, (const float *)b, *(const size_t *)p);
+    }
+    static float ip_scalar_dist(const void *a, const void *b, const void *p) {
+        return 1.0f - dot_scalar((const float *)a, (const float *)b, *(const size_t *)p);
+    }
+    __attribute__((target("avx2,fma")))
+    static float l2_avx2_dist(const void *a, const void *b, const void *p) {
+        return l2_avx2((const float *)a, (const float *)b, *(const size_t *)p);
+    }
+    __attribute__((target("avx2,fma")))
+    static float ip_avx2_dist(const void *a, const void *b, const void *p) {
+        return 1.0f - dot_avx2((const float *)a, (const float *)b, *(const size_t *)p);
+    }
+    __attribute__((target("avx512f")))
+    static float l2_avx512_dist(const void *a, const void *b, const void *p) {
+        return l2_avx512((const float *)a, (const float *)b, *(const size_t *)p);
+    }
+    __attribute__((target("avx512f")))
+    static float ip_avx512_dist(const void *a, const void *b, const void *p) {
+        return 1.0f - dot_avx512((const float *)a, (const float *)b, *(const size_t *)p);
+    }
+
+    // ---------- Dimensión fija: el compilador desenrolla el bucle completo ----------
+    template <size_t DIM>
+    static float l2_scalar_fixed(const void *a, const void *b, const void *) {
+        return l2_scalar((const float *)a, (const float *)b, DIM);
+    }
+    template <size_t DIM>
+    static float ip_scalar_fixed(const void *a, const void *b, const void *) {
+        return 1.0f - dot_scalar((const float *)a, (const float *)b, DIM);
+    }
+    template <size_t DIM>
+    __attribute__((target("avx2,fma")))
+    static float l2_avx2_fixed(const void *a, const void *b, const void *) {
+        return l2_avx2((const float *)a, (const float *)b, DIM);
+    }
+    template <size_t DIM>
+    __attribute__((target("avx2,fma")))
+    static float ip_avx2_fixed(const void *a, const void *b, const void *) {
+        return 1.0f - dot_avx2((const float *)a, (const float *)b, DIM);
+    }
+    template <size_t DIM>
+    __attribute__((target("avx512f")))
+    static float l2_avx512_fixed(const void *a, const void *b, const void *) {
+        return l2_avx512((const float *)a, (const float *)b, DIM);
+    }
+    template <size_t DIM>
+    __attribute__((target("avx512f")))
+    static float ip_avx512_fixed(const void *a, const void *b, const void *) {
+        return 1.0f - dot_avx512((const float *)a, (const float *)b, DIM);
+    }
+
+    template <size_t DIM>
+    static hnswlib::DISTFUNC<float> fixed(Metric metric, SimdLevel level) {
+        switch (level) {
+        case SimdLevel::AVX512: return metric == Metric::L2 ? l2_avx512_fixed<DIM> : ip_avx512_fixed<DIM>;
+        case SimdLevel::AVX2: return metric == Metric::L2 ? l2_avx2_fixed<DIM> : ip_avx2_fixed<DIM>;
+        default: return metric == Metric::L2 ? l2_scalar_fixed<DIM> : ip_scalar_fixed<DIM>;
+        }
+    }
+
+    // Selecciona el kernel: especializado si la dimensión es común
+    static hnswlib::DISTFUNC<float> select(Metric metric, SimdLevel level, size_t dim) {
+        switch (dim) {
+        case 96: return fixed<96>(metric, level);
+        case 128: return fixed<128>(metric, level);
+        case 256: return fixed<256>(metric, level);
+        case 384: return fixed<384>(metric, level);
+        case 512: return fixed<512>(metric, level);
+        case 768: return fixed<768>(metric, level);
+        case 1024: return fixed<1024>(metric, level);
+        default: break;
+        }
+        switch (level) {
+        case SimdLevel::AVX512: return metric == Metric::L2 ? l2_avx512_dist : ip_avx512_dist;
+        case SimdLevel::AVX2: return metric == Metric::L2 ? l2_avx2_dist : ip_avx2_dist;
+        default: return metric == Metric::L2 ? l2_scalar_dist : ip_scalar_dist;
+        }
+    }
+
+    static bool is_fixed_dim(size_t dim) {
+        return dim == 96 || dim == 128 || dim == 256 || dim == 384 || dim == 512 ||
+               dim == 768 || dim == 1024;
+    }
+
+    // ---------- Normalización a norma 1 (src y dst pueden coincidir) ----------
+    // Norma con el mismo kernel de producto interno y escalado en registros:
+    // dos lecturas de la fila, ambas con la fila ya en L1
+    static void normalize_scalar_fn(const float *src, float *dst, size_t n) {
+        float norm = std::sqrt(dot_scalar(src, src, n));
+        float inv = norm > 1e-12f ? 1.0f / norm : 1.0f;
+        for (size_t i = 0; i < n; i++) dst[i] = src[i] * inv;
+    }
+
+    __attribute__((target("avx2,fma")))
+    static void normalize_avx2_fn(const float *src, float *dst, size_t n) {
+        float norm = std::sqrt(dot_avx2(src, src, n));
+        float inv = norm > 1e-12f ? 1.0f / norm : 1.0f;
+        __m256 v = _mm256_set1_ps(inv);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_loadu_ps(src + i), v));
+        for (; i < n; i++) dst[i] = src[i] * inv;
+    }
+
+    __attribute__((target("avx512f")))
+    static void normalize_avx512_fn(const float *src, float *dst, size_t n) {
+        float norm = std::sqrt(dot_avx512(src, src, n));
+        float inv = norm > 1e-12f ? 1.0f / norm : 1.0f;
+        __m512 v = _mm512_set1_ps(inv);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) _mm512_storeu_ps(dst + i, _mm512_mul_ps(_mm512_loadu_ps(src + i), v));
+        if (i < n) {
+            __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+            _mm512_mask_storeu_ps(dst + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, src + i), v));
+        }
+    }
+
+    static NormalizeFn normalizer(SimdLevel level) {
+        switch (level) {
+        case SimdLevel::AVX512: return normalize_avx512_fn;
+        case SimdLevel::AVX2: return normalize_avx2_fn;
+        default: return normalize_scalar_fn;
+        }
+    }
+};
+
+// =================== ESPACIO PROPIO PARA HNSWLIB ===================
+//
+// Sustituye a hnswlib::L2Space / InnerProductSpace. La distancia IP sigue
+// la convención de hnswlib (1 - <a,b>), por lo que los índices son
+// intercambiables con los construidos con los espacios de serie.
+
+class SimdSpace : public hnswlib::SpaceInterface<float> {
+private:
+    hnswlib::DISTFUNC<float> fstdistfunc_;
+    size_t data_size_;
+    size_t dim_;
+    Metric metric_;
+    SimdLevel level_;
+
+public:
+    SimdSpace(Metric metric, size_t dim, SimdLevel level = CpuFeatures::detect())
+        : dim_(dim), metric_(metric), level_(level) {
+        if (!CpuFeatures::supports(level_))
+            throw std::runtime_error(std::string("CPU sin soporte para ") + CpuFeatures::name(level_));
+        fstdistfunc_ = DistanceKernels::select(metric_, level_, dim_);
+        data_size_ = dim_ * sizeof(float);
+    }
+
+    size_t get_data_size() override { return data_size_; }
+    hnswlib::DISTFUNC<float> get_dist_func() override { return fstdistfunc_; }
+    void *get_dist_func_param() override { return &dim_; }
+
+    Metric metric() const { return metric_; }
+    SimdLevel level() const { return level_; }
+
+    // Normalización con el mismo nivel SIMD que la distancia
+    NormalizeFn normalizer() const { return DistanceKernels::normalizer(level_); }
+
+    std::string description() const {
+        return std::string(metric_name(metric_)) + "/" + CpuFeatures::name(level_) +
+               (DistanceKernels::is_fixed_dim(dim_) ? " (dim fija " + std::to_string(dim_) + ")"
+                                                    : " (dim genérica)");
+    }
+
+    ~SimdSpace() {}
+};
@@ -0,0 +1,276 @@
+#pragma once
+#include "simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <immintrin.h>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// =================== CUANTIZACIÓN ESCALAR (SQ8) ===================
+//
+// Cada dimensión se cuantiza a 8 bits con su propio rango [min, max]
+// entrenado en la construcción: x ≈ min + code * scale. El índice guarda
+// solo los códigos (dim bytes por vector en vez de 4 * dim).
+
+class SQ8Params {
+public:
+    int dim = 0;
+    std::vector<float> vmin;
+    std::vector<float> scale;
+
+    // row(i) devuelve el vector i ya preprocesado (normalizado si es ip)
+    template <typename RowFn>
+    static SQ8Params train(size_t n, int dim, RowFn row, int num_threads) {
+        SQ8Params p;
+        p.dim = dim;
+        std::vector<float> lo(dim, std::numeric_limits<float>::max());
+        std::vector<float> hi(dim, std::numeric_limits<float>::lowest());
+
+        #ifdef _OPENMP
+        omp_set_num_threads(num_threads);
+        #pragma omp parallel
+        #endif
+        {
+            std::vector<float> tlo(dim, std::numeric_limits<float>::max());
+            std::vector<float> thi(dim, std::numeric_limits<float>::lowest());
+            std::vector<float> buf(dim);
+            #ifdef _OPENMP
+            #pragma omp for schedule(static) nowait
+            #endif
+            for (size_t i = 0; i < n; i++) {
+                row(i, buf.data());
+                for (int d = 0; d < dim; d++) {
+                    tlo[d] = std::min(tlo[d], buf[d]);
+                    thi[d] = std::max(thi[d], buf[d]);
+                }
+            }
+            #ifdef _OPENMP
+            #pragma omp critical
+            #endif
+            for (int d = 0; d < dim; d++) {
+                lo[d] = std::min(lo[d], tlo[d]);
+                hi[d] = std::max(hi[d], thi[d]);
+            }
+        }
+
+        p.vmin = lo;
+        p.scale.resize(dim);
+        for (int d = 0; d < dim; d++) {
+            if (n == 0) p.vmin[d] = 0.0f;
+            float range = n ? hi[d] - lo[d] : 0.0f;
+            p.scale[d] = range > 0 ? range / 255.0f : 0.0f;
+        }
+        return p;
+    }
+
+    void encode(const float *x, uint8_t *code) const {
+        for (int d = 0; d < dim; d++) {
+            float q = scale[d] > 0 ? (x[d] - vmin[d]) / scale[d] : 0.0f;
+            q = std::min(255.0f, std::max(0.0f, std::nearbyint(q)));
+            code[d] = static_cast<uint8_t>(q);
+        }
+    }
+
+    void decode(const uint8_t *code, float *x) const {
+        for (int d = 0; d < dim; d++) x[d] = vmin[d] + code[d] * scale[d];
+    }
+
+    void save(const std::string &path) const {
+        std::ofstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo crear: " + path);
+        f.write("SQ8P", 4);
+        f.write(reinterpret_cast<const char *>(&dim), sizeof(dim));
+        f.write(reinterpret_cast<const char *>(vmin.data()), dim * sizeof(float));
+        f.write(reinterpret_cast<const char *>(scale.data()), dim * sizeof(float));
+    }
+
+    static SQ8Params load(const std::string &path) {
+        std::ifstream f(path, std::ios::binary);
+        if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+        char magic[4];
+        f.read(magic, 4);
+        if (std::string(magic, 4) != "SQ8P") throw std::runtime_error("Archivo SQ8 inválido: " + path);
+        SQ8Params p;
+        f.read(reinterpret_cast<char *>(&p.dim), sizeof(p.dim));
+        p.vmin.resize(p.dim);
+        p.scale.resize(p.dim);
+        f.read(reinterpret_cast<char *>(p.vmin.data()), p.dim * sizeof(float));
+        f.read(reinterpret_cast<char *>(p.scale.data()), p.dim * sizeof(float));
+        if (!f) throw std::runtime_error("Archivo SQ8 truncado: " + path);
+        return p;
+    }
+
+    // Convención: parámetros junto al índice, con extensión .sq8
+    static std::string path_for(const std::string &index_path) { return index_path + ".sq8"; }
+};
+
+// =================== KERNELS SOBRE CÓDIGOS UINT8 ===================
+
+struct SQ8DistParam {
+    size_t dim = 0;
+    std::vector<float> weight;  // scale^2 (L2 ponderada por dimensión)
+    std::vector<float> vmin;
+    std::vector<float> scale;
+};
+
+struct SQ8Kernels {
+    static float l2_scalar(const void *a, const void *b, const void *param) {
+        const SQ8DistParam *p = static_cast<const SQ8DistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        float s = 0.0f;
+        for (size_t d = 0; d < p->dim; d++) {
+            float diff = float(int(x[d]) - int(y[d]));
+            s += p->weight[d] * diff * diff;
+        }
+        return s;
+    }
+
+    static float ip_scalar(const void *a, const void *b, const void *param) {
+        const SQ8DistParam *p = static_cast<const SQ8DistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        float s = 0.0f;
+        for (size_t d = 0; d < p->dim; d++) {
+            float fx = p->vmin[d] + x[d] * p->scale[d];
+            float fy = p->vmin[d] + y[d] * p->scale[d];
+            s += fx * fy;
+        }
+        return 1.0f - s;
+    }
+
+    __attribute__((target("avx2,fma")))
+    static float l2_avx2(const void *a, const void *b, const void *param) {
+        const SQ8DistParam *p = static_cast<const SQ8DistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        const float *w = p->weight.data();
+        size_t n = p->dim, i = 0;
+        __m256 acc = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            __m256i vx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(x + i)));
+            __m256i vy = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + i)));
+            __m256 diff = _mm256_cvtepi32_ps(_mm256_sub_epi32(vx, vy));
+            acc = _mm256_fmadd_ps(_mm256_mul_ps(diff, diff), _mm256_loadu_ps(w + i), acc);
+        }
+        float s = DistanceKernels::hsum256(acc);
+        for (; i < n; i++) {
+            float diff = float(int(x[i]) - int(y[i]));
+            s += w[i] * diff * diff;
+        }
+        return s;
+    }
+
+    __attribute__((target("avx2,fma")))
+    static float ip_avx2(const void *a, const void *b, const void *param) {
+        const SQ8DistParam *p = static_cast<const SQ8DistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        const float *m = p->vmin.data();
+        const float *sc = p->scale.data();
+        size_t n = p->dim, i = 0;
+        __m256 acc = _mm256_setzero_ps();
+        for (; i + 8 <= n; i += 8) {
+            __m256 vs = _mm256_loadu_ps(sc + i), vm = _mm256_loadu_ps(m + i);
+            __m256 fx = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(x + i))));
+            __m256 fy = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(y + i))));
+            fx = _mm256_fmadd_ps(fx, vs, vm);
+            fy = _mm256_fmadd_ps(fy, vs, vm);
+            acc = _mm256_fmadd_ps(fx, fy, acc);
+        }
+        float s = DistanceKernels::hsum256(acc);
+        for (; i < n; i++) s += (m[i] + x[i] * sc[i]) * (m[i] + y[i] * sc[i]);
+        return 1.0f - s;
+    }
+
+    __attribute__((target("avx512f")))
+    static float l2_avx512(const void *a, const void *b, const void *param) {
+        const SQ8DistParam *p = static_cast<const SQ8DistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        const float *w = p->weight.data();
+        size_t n = p->dim, i = 0;
+        __m512 acc = _mm512_setzero_ps();
+        for (; i + 16 <= n; i += 16) {
+            __m512i vx = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(x + i)));
+            __m512i vy = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(y + i)));
+            __m512 diff = _mm512_cvtepi32_ps(_mm512_sub_epi32(vx, vy));
+            acc = _mm512_fmadd_ps(_mm512_mul_ps(diff, diff), _mm512_loadu_ps(w + i), acc);
+        }
+        float s = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++) {
+            float diff = float(int(x[i]) - int(y[i]));
+            s += w[i] * diff * diff;
+        }
+        return s;
+    }
+
+    __attribute__((target("avx512f")))
+    static float ip_avx512(const void *a, const void *b, const void *param) {
+        const SQ8DistParam *p = static_cast<const SQ8DistParam *>(param);
+        const uint8_t *x = static_cast<const uint8_t *>(a);
+        const uint8_t *y = static_cast<const uint8_t *>(b);
+        const float *m = p->vmin.data();
+        const float *sc = p->scale.data();
+        size_t n = p->dim, i = 0;
+        __m512 acc = _mm512_setzero_ps();
+        for (; i + 16 <= n; i += 16) {
+            __m512 vs = _mm512_loadu_ps(sc + i), vm = _mm512_loadu_ps(m + i);
+            __m512 fx = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(x + i))));
+            __m512 fy = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i *)(y + i))));
+            fx = _mm512_fmadd_ps(fx, vs, vm);
+            fy = _mm512_fmadd_ps(fy, vs, vm);
+            acc = _mm512_fmadd_ps(fx, fy, acc);
+        }
+        float s = _mm512_reduce_add_ps(acc);
+        for (; i < n; i++) s += (m[i] + x[i] * sc[i]) * (m[i] + y[i] * sc[i]);
+        return 1.0f - s;
+    }
+
+    static hnswlib::DISTFUNC<float> select(Metric metric, SimdLevel level) {
+        switch (level) {
+        case SimdLevel::AVX512: return metric == Metric::L2 ? l2_avx512 : ip_avx512;
+        case SimdLevel::AVX2: return metric == Metric::L2 ? l2_avx2 : ip_avx2;
+        default: return metric == Metric::L2 ? l2_scalar : ip_scalar;
+        }
+    }
+};
+
+// Espacio hnswlib sobre códigos SQ8: la consulta también se codifica
+class SQ8Space : public hnswlib::SpaceInterface<float> {
+private:
+    SQ8DistParam param_;
+    hnswlib::DISTFUNC<float> fstdistfunc_;
+    Metric metric_;
+    SimdLevel level_;
+
+public:
+    SQ8Space(Metric metric, const SQ8Params &params, SimdLevel level = CpuFeatures::detect())
+        : metric_(metric), level_(level) {
+        param_.dim = params.dim;
+        param_.vmin = params.vmin;
+        param_.scale = params.scale;
+        param_.weight.resize(params.dim);
+        for (int d = 0; d < params.dim; d++) param_.weight[d] = params.scale[d] * params.scale[d];
+        fstdistfunc_ = SQ8Kernels::select(metric_, level_);
+    }
+
+    size_t get_data_size() override { return param_.dim; }
+    hnswlib::DISTFUNC<float> get_dist_func() override { return fstdistfunc_; }
+    void *get_dist_func_param() override { return &param_; }
+
+    std::string description() const {
+        return std::string("sq8-") + metric_name(metric_) + "/" + CpuFeatures::name(level_);
+    }
+
+    ~SQ8Space() {}
+};
@@ -0,0 +1,725 @@
+#include "../includes/bench_report.hpp"
+#include "../includes/cpu_topology.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/intra_query.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/mapped_index.hpp"
+#include "../includes/parallel_build.hpp"
+#include "../includes/results_io.hpp"
+#include "../includes/search_engine.hpp"
+#include "../includes/simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// =================== BENCHMARK REPRODUCIBLE POR ESCENARIOS ===================
+//
+// Lee un archivo declarativo de escenarios (índice, queries, k, ef,
+// threads, motor...), ejecuta cada uno con calentamiento y N ensayos, y
+// resume cada métrica con media, desviación e intervalo de confianza del
+// 95 %. El entorno (CPU, governor, THP, kernel, SIMD) queda en el JSON de
+// la corrida. El modo compare contrasta dos resúmenes y marca las
+// regresiones que superan el umbral sin solaparse los intervalos.
+//
+// Formato del archivo de escenarios:
+//
+//   # comentario
+//   [global]                 valores por defecto de todos los escenarios
+//   index = idx.bin
+//   queries = q.bin
+//   gt = gt10.bin            opcional: agrega recall
+//   dim = 128
+//   [ef64]                   cada sección distinta de global es un escenario
+//   ef = 64
+//   threads = 8
+//
+// En lugar de index se puede dar el dataset y los parámetros de
+// construcción; el índice se construye en memoria con ParallelBuilder (una
+// vez por combinación) y el tiempo de construcción queda en el JSON:
+//
+//   dataset = emb.bin
+//   ids = ids.bin
+//   metric = ip              l2 (defecto) | ip
+//   M = 16
+//   efc = 200
+//   build_threads = 8        0 (defecto) = todos los hilos disponibles
+
+struct Scenario {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> config;  // claves efectivas, para el JSON
+    std::string index_path;
+    std::string dataset_path;  // alternativa a index: construir con ParallelBuilder
+    std::string ids_path;
+    Metric metric = Metric::L2;
+    size_t M = 16;
+    size_t efc = 200;
+    int build_threads = 0;
+    std::string queries_path;
+    std::string gt_path;
+    int dim = 0;
+    size_t k = 10;
+    size_t ef = 100;
+    int threads = 1;
+    size_t batch = 16;
+    std::string engine = "batch";  // batch | intra | hnswlib
+    int intra = 2;                 // threads por query con engine = intra
+    size_t warmup = 1;
+    size_t trials = 5;
+    size_t max_queries = 0;  // 0 = todas
+    PinPolicy pin = PinPolicy::Compact;
+};
+
+std::string trim(const std::string& s) {
+    size_t a = s.find_first_not_of(" \t\r");
+    if (a == std::string::npos) return "";
+    size_t b = s.find_last_not_of(" \t\r");
+    return s.substr(a, b - a + 1);
+}
+
+Scenario make_scenario(const std::string& name, const std::map<std::string, std::string>& kv) {
+    Scenario s;
+    s.name = name;
+    for (const auto& e : kv) {
+        const std::string& key = e.first;
+        const std::string& v = e.second;
+        if (key == "index") {
+            s.index_path = v;
+        } else if (key == "dataset") {
+            s.dataset_path = v;
+        } else if (key == "ids") {
+            s.ids_path = v;
+        } else if (key == "metric") {
+            s.metric = parse_metric(v);
+        } else if (key == "M") {
+            s.M = std::stoul(v);
+        } else if (key == "efc") {
+            s.efc = std::stoul(v);
+        } else if (key == "build_threads") {
+            s.build_threads = std::stoi(v);
+        } else if (key == "queries") {
+            s.queries_path = v;
+        } else if (key == "gt") {
+            s.gt_path = v;
+        } else if (key == "dim") {
+            s.dim = std::stoi(v);
+        } else if (key == "k") {
+            s.k = std::stoul(v);
+        } else if (key == "ef") {
+            s.ef = std::stoul(v);
+        } else if (key == "threads") {
+            s.threads = std::stoi(v);
+        } else if (key == "batch") {
+            s.batch = std::stoul(v);
+        } else if (key == "engine") {
+            s.engine = v;
+        } else if (key == "intra") {
+            s.intra = std::stoi(v);
+        } else if (key == "warmup") {
+            s.warmup = std::stoul(v);
+        } else if (key == "trials") {
+            s.trials = std::stoul(v);
+        } else if (key == "max_queries") {
+            s.max_queries = std::stoul(v);
+        } else if (key == "pin") {
+            s.pin = parse_pin_policy(v);
+        } else {
+            throw std::runtime_error("Clave desconocida '" + key + "' en [" + name + "]");
+        }
+        s.config.emplace_back(key, v);
+    }
+    if (s.index_path.empty() == s.dataset_path.empty() || s.queries_path.empty() || s.dim <= 0)
+        throw std::runtime_error("[" + name + "] requiere index o dataset (uno solo), queries y dim");
+    if (!s.dataset_path.empty() && (s.ids_path.empty() || s.M < 2 || s.efc < 1 || s.build_threads < 0))
+        throw std::runtime_error("[" + name + "] dataset requiere ids, M >= 2, efc >= 1 y build_threads >= 0");
+    if (s.engine != "batch" && s.engine != "intra" && s.engine != "hnswlib")
+        throw std::runtime_error("[" + name + "] engine inválido: " + s.engine);
+    if (s.threads < 1 || s.trials < 1 || s.k < 1 || s.ef < s.k)
+        throw std::runtime_error("[" + name + "] requiere threads >= 1, trials >= 1 y ef >= k");
+    if (s.engine == "intra" && (s.intra < 1 || s.threads % s.intra != 0))
+        throw std::runtime_error("[" + name + "] intra debe dividir threads");
+    return s;
+}
+
+std::vector<Scenario> parse_scenarios(const std::string& path) {
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+    std::map<std::string, std::string> global;
+    std::vector<std::pair<std::string, std::map<std::string, std::string>>> sections;
+    std::map<std::string, std::string>* current = nullptr;
+    std::string line;
+    size_t lineno = 0;
+    while (std::getline(f, line)) {
+        lineno++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+        if (line.front() == '[') {
+            if (line.back() != ']') throw std::runtime_error(path + ":" + std::to_string(lineno) + ": sección mal cerrada");
+            std::string name = trim(line.substr(1, line.size() - 2));
+            if (name == "global") {
+                current = &global;
+            } else {
+                for (const auto& s : sections)
+                    if (s.first == name) throw std::runtime_error("Escenario repetido: " + name);
+                sections.emplace_back(name, std::map<std::string, std::string>());
+                current = &sections.back().second;
+            }
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos || !current)
+            throw std::runtime_error(path + ":" + std::to_string(lineno) + ": se esperaba clave = valor dentro de una sección");
+        (*current)[trim(line.substr(0, eq))] = trim(line.substr(eq + 1));
+    }
+    if (sections.empty()) throw std::runtime_error("Sin escenarios en " + path);
+
+    std::vector<Scenario> out;
+    for (auto& s : sections) {
+        std::map<std::string, std::string> kv = global;
+        for (const auto& e : s.second) kv[e.first] = e.second;
+        out.push_back(make_scenario(s.first, kv));
+    }
+    return out;
+}
+
+// =================== RECURSOS COMPARTIDOS ENTRE ESCENARIOS ===================
+
+// Índice cargado una sola vez aunque lo usen varios escenarios. El espacio
+// se declara primero para destruirse después del índice que lo referencia.
+struct LoadedIndex {
+    IndexMeta meta;
+    std::unique_ptr<SimdSpace> space;
+    std::unique_ptr<hnswlib::HierarchicalNSW<float>> index;
+    std::unique_ptr<MappedIndex> mapped;
+    double build_s = 0.0;  // > 0 si se construyó en memoria a partir del dataset
+
+    HnswGraphView view() const { return mapped ? mapped->view() : HnswGraphView::from(*index); }
+};
+
+class ResourceCache {
+private:
+    std::map<std::string, std::unique_ptr<LoadedIndex>> indexes;
+    std::map<std::string, std::vector<float>> queries;
+    std::map<std::string, KnnResults> truths;
+
+public:
+    LoadedIndex& index(const std::string& path, int dim) {
+        auto it = indexes.find(path);
+        if (it != indexes.end()) {
+            it->second->meta.check_dim(dim);
+            return *it->second;
+        }
+        std::unique_ptr<LoadedIndex> li(new LoadedIndex());
+        li->meta = IndexMeta::read(path);
+        li->meta.check_dim(dim);
+        if (li->meta.storage != VectorStorage::FP32)
+            throw std::runtime_error("Índice " + std::string(storage_name(li->meta.storage)) + " (" +
+                                     path + "): hnsw_bench solo mide índices fp32");
+        li->space.reset(new SimdSpace(li->meta.metric, dim));
+        if (mapped_index::is_mapped_format(path))
+            li->mapped.reset(new MappedIndex(path, li->space.get()));
+        else
+            li->index = index_io::load(li->space.get(), path);
+        std::cout << "Índice " << path << ": " << li->meta.describe() << ", "
+                  << li->space->description() << "\n";
+        LoadedIndex& ref = *li;
+        indexes[path] = std::move(li);
+        return ref;
+    }
+
+    // Índice construido en memoria; se reutiliza entre escenarios que
+    // comparten dataset, métrica, M y efc
+    LoadedIndex& built(const Scenario& sc) {
+        std::string key = sc.dataset_path + "|" + sc.ids_path + "|" + metric_name(sc.metric) +
+                          "|" + std::to_string(sc.M) + "|" + std::to_string(sc.efc);
+        auto it = indexes.find(key);
+        if (it != indexes.end()) {
+            it->second->meta.check_dim(sc.dim);
+            return *it->second;
+        }
+        MappedDataset base(sc.dataset_path, sc.dim);
+        MappedIds ids(sc.ids_path);
+        if (base.size() == 0) throw std::runtime_error("Dataset vacío: " + sc.dataset_path);
+        if (ids.size() != base.size())
+            throw std::runtime_error("Cantidad de ids distinta a la de vectores en " + sc.ids_path);
+
+        std::unique_ptr<LoadedIndex> li(new LoadedIndex());
+        li->meta = IndexMeta::make(sc.metric, sc.dim);
+        li->meta.m = sc.M;
+        li->meta.ef_construction = sc.efc;
+        li->space.reset(new SimdSpace(sc.metric, sc.dim));
+        li->index.reset(new hnswlib::HierarchicalNSW<float>(li->space.get(), base.size(), sc.M, sc.efc, 100));
+
+        ParallelBuilder::Options opt;
+        opt.num_threads = sc.build_threads > 0 ? sc.build_threads
+                                               : int(std::max(1u, std::thread::hardware_concurrency()));
+        opt.seed_count = std::min<size_t>(10000, base.size());
+        opt.progress_every = 0;
+        opt.normalize = li->meta.normalized;
+        opt.dim = sc.dim;
+        auto t0 = std::chrono::steady_clock::now();
+        ParallelBuilder::build(*li->index, base.size(), [&](size_t i) { return base.row(i); },
+                               ids.data(), opt);
+        li->build_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "Índice construido desde " << sc.dataset_path << " (M=" << sc.M << ", efC="
+                  << sc.efc << ", " << opt.num_threads << " hilos): " << li->meta.describe()
+                  << ", " << li->build_s << " s\n";
+        LoadedIndex& ref = *li;
+        indexes[key] = std::move(li);
+        return ref;
+    }
+
+    const std::vector<float>& query_set(const std::string& path, int dim) {
+        auto it = queries.find(path);
+        if (it != queries.end()) {
+            if (it->second.size() % dim != 0)
+                throw std::runtime_error("Dimensión incompatible con " + path);
+            return it->second;
+        }
+        MappedDataset file(path, dim);
+        std::vector<float>& q = queries[path];
+        if (file.size() > 0) q.assign(file.row(0), file.row(0) + file.size() * dim);
+        return q;
+    }
+
+    const KnnResults& truth(const std::string& path) {
+        auto it = truths.find(path);
+        if (it != truths.end()) return it->second;
+        return truths[path] = KnnResults::load(path);
+    }
+};
+
+// =================== ENSAYOS ===================
+
+using MetricList = std::vector<std::pair<std::string, double>>;
+
+// Camino de referencia: searchKnn de hnswlib con una query por fetch_add
+BatchSearchStats run_hnswlib(hnswlib::HierarchicalNSW<float>& index, const float* queries,
+                             size_t n, int dim, size_t k, int threads, PinPolicy pin,
+                             NormalizeFn normalize, KnnResults& out) {
+    std::atomic<size_t> counter{0};
+    std::vector<LatencyHistogram> histograms(threads);
+    auto worker = [&](int tid) {
+        CpuTopology::get().pin_thread(tid, pin);
+        std::vector<float> buf(dim);
+        while (true) {
+            size_t i = counter.fetch_add(1);
+            if (i >= n) break;
+            auto t0 = std::chrono::steady_clock::now();
+            const float* q = queries + i * dim;
+            if (normalize) {
+                normalize(q, buf.data(), dim);
+                q = buf.data();
+            }
+            auto res = index.searchKnn(q, k);
+            out.store(i, res);
+            auto t1 = std::chrono::steady_clock::now();
+            histograms[tid].record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+    };
+    BatchSearchStats st;
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) pool.emplace_back(worker, t);
+    for (auto& th : pool) th.join();
+    st.total_time_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    st.qps = n / st.total_time_s;
+    for (const auto& h : histograms) st.latency.merge(h);
+    return st;
+}
+
+class ScenarioRunner {
+private:
+    const Scenario& sc;
+    LoadedIndex& li;
+    const float* queries;
+    size_t nq;
+    const KnnResults* truth;
+    HnswGraphView graph;
+    std::unique_ptr<BatchSearcher> batch;
+    std::unique_ptr<IntraQuerySearcher> intra;
+    KnnResults found;
+
+public:
+    ScenarioRunner(const Scenario& s, LoadedIndex& index, const std::vector<float>& q,
+                   const KnnResults* gt)
+        : sc(s), li(index), queries(q.data()), nq(q.size() / s.dim), truth(gt), graph(index.view()) {
+        if (sc.max_queries > 0) nq = std::min(nq, sc.max_queries);
+        if (nq == 0) throw std::runtime_error("[" + sc.name + "] sin queries");
+        found.resize(nq, sc.k);
+        NormalizeFn normalize = li.meta.normalized ? li.space->normalizer() : nullptr;
+        PinPolicy pin = sc.pin;
+        if (sc.engine == "batch") {
+            batch.reset(new BatchSearcher(graph, sc.threads, sc.batch));
+            batch->on_thread_start([pin](int tid) { CpuTopology::get().pin_thread(tid, pin); });
+            if (normalize) batch->use_query_normalizer(normalize, sc.dim);
+        } else if (sc.engine == "intra") {
+            intra.reset(new IntraQuerySearcher(graph, sc.intra, sc.threads / sc.intra));
+            intra->on_thread_start([pin](int tid) { CpuTopology::get().pin_thread(tid, pin); });
+            if (normalize) intra->use_query_normalizer(normalize, sc.dim);
+        } else if (!li.index) {
+            throw std::runtime_error("[" + sc.name + "] engine hnswlib requiere un índice en formato hnswlib");
+        }
+    }
+
+    size_t queries_per_trial() const { return nq; }
+
+    MetricList trial() {
+        BatchSearchStats st;
+        if (batch) {
+            st = batch->searchBatch(queries, nq, sc.dim, sc.k, sc.ef, found.ids.data(), found.dists.data());
+        } else if (intra) {
+            st = intra->searchBatch(queries, nq, sc.dim, sc.k, sc.ef, found.ids.data(), found.dists.data());
+        } else {
+            li.index->setEf(sc.ef);
+            NormalizeFn normalize = li.meta.normalized ? li.space->normalizer() : nullptr;
+            st = run_hnswlib(*li.index, queries, nq, sc.dim, sc.k, sc.threads, sc.pin, normalize, found);
+        }
+        MetricList m;
+        m.emplace_back("qps", st.qps);
+        m.emplace_back("p50_ms", st.latency.percentile_ms(0.50));
+        m.emplace_back("p95_ms", st.latency.percentile_ms(0.95));
+        m.emplace_back("p99_ms", st.latency.percentile_ms(0.99));
+        m.emplace_back("mean_ms", st.latency.mean_ms());
+        if (st.distance_computations > 0)
+            m.emplace_back("dist_per_query", double(st.distance_computations) / nq);
+        if (truth) m.emplace_back("recall", recall_at(found, *truth, sc.k));
+        return m;
+    }
+};
+
+struct ScenarioResult {
+    const Scenario* scenario = nullptr;
+    std::string index_desc;
+    double build_s = 0.0;
+    size_t queries = 0;
+    std::vector<MetricList> trials;
+    std::vector<std::pair<std::string, bench::SampleStats>> stats;  // en el orden de las métricas
+
+    void summarize() {
+        stats.clear();
+        if (trials.empty()) return;
+        for (size_t i = 0; i < trials[0].size(); i++) {
+            std::vector<double> v;
+            for (const auto& t : trials) v.push_back(t[i].second);
+            stats.emplace_back(trials[0][i].first, bench::SampleStats::of(v));
+        }
+    }
+};
+
+// =================== SALIDAS ===================
+
+void write_json(const std::string& path, const std::string& scenario_file,
+                const bench::Environment& env, const std::vector<ScenarioResult>& results) {
+    std::ofstream f(path);
+    if (!f) throw std::runtime_error("No se pudo crear: " + path);
+    f << std::setprecision(10);
+    f << "{\n  \"tool\": \"hnsw_bench\",\n  \"scenario_file\": " << bench::json_string(scenario_file)
+      << ",\n  \"environment\": ";
+    env.write_json(f);
+    f << ",\n  \"scenarios\": [\n";
+    for (size_t r = 0; r < results.size(); r++) {
+        const ScenarioResult& res = results[r];
+        const Scenario& sc = *res.scenario;
+        f << "    {\n      \"name\": " << bench::json_string(sc.name) << ",\n      \"config\": {";
+        for (size_t i = 0; i < sc.config.size(); i++)
+            f << (i ? ", " : "") << bench::json_string(sc.config[i].first) << ": "
+              << bench::json_string(sc.config[i].second);
+        f << "},\n      \"index\": " << bench::json_string(res.index_desc);
+        if (res.build_s > 0) f << ",\n      \"build_s\": " << res.build_s;
+        f << ",\n      \"queries\": " << res.queries << ",\n      \"trials\": [\n";
+        for (size_t t = 0; t < res.trials.size(); t++) {
+            f << "        {";
+            for (size_t i = 0; i < res.trials[t].size(); i++)
+                f << (i ? ", " : "") << bench::json_string(res.trials[t][i].first) << ": "
+                  << res.trials[t][i].second;
+            f << "}" << (t + 1 < res.trials.size() ? ",\n" : "\n");
+        }
+        f << "      ],\n      \"stats\": {\n";
+        for (size_t i = 0; i < res.stats.size(); i++) {
+            const bench::SampleStats& s = res.stats[i].second;
+            f << "        " << bench::json_string(res.stats[i].first) << ": {\"mean\": " << s.mean
+              << ", \"stddev\": " << s.stddev << ", \"ci95\": " << s.ci95 << ", \"min\": " << s.min
+              << ", \"max\": " << s.max << ", \"n\": " << s.n << "}"
+              << (i + 1 < res.stats.size() ? ",\n" : "\n");
+        }
+        f << "      }\n    }" << (r + 1 < results.size() ? ",\n" : "\n");
+    }
+    f << "  ]\n}\n";
+}
+
+void write_trials_csv(const std::string& path, const std::vector<ScenarioResult>& results) {
+    std::ofstream f(path);
+    if (!f) throw std::runtime_error("No se pudo crear: " + path);
+    f << std::setprecision(10) << "scenario,trial,metric,value\n";
+    for (const auto& res : results)
+        for (size_t t = 0; t < res.trials.size(); t++)
+            for (const auto& m : res.trials[t])
+                f << res.scenario->name << "," << t << "," << m.first << "," << m.second << "\n";
+}
+
+void write_summary_csv(const std::string& path, const std::vector<ScenarioResult>& results) {
+    std::ofstream f(path);
+    if (!f) throw std::runtime_error("No se pudo crear: " + path);
+    f << std::setprecision(10) << "scenario,metric,mean,stddev,ci95,min,max,n\n";
+    for (const auto& res : results)
+        for (const auto& e : res.stats) {
+            const bench::SampleStats& s = e.second;
+            f << res.scenario->name << "," << e.first << "," << s.mean << "," << s.stddev << ","
+              << s.ci95 << "," << s.min << "," << s.max << "," << s.n << "\n";
+        }
+}
+
+// =================== COMPARACIÓN CONTRA UNA LÍNEA BASE ===================
+
+using Summary = std::map<std::pair<std::string, std::string>, bench::SampleStats>;
+
+Summary load_summary(const std::string& path) {
+    std::ifstream f(path);
+    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+    std::string line;
+    if (!std::getline(f, line) || line.compare(0, 15, "scenario,metric") != 0)
+        throw std::runtime_error("No es un resumen de hnsw_bench: " + path);
+    Summary out;
+    while (std::getline(f, line)) {
+        if (line.empty()) continue;
+        std::vector<std::string> c;
+        std::stringstream ss(line);
+        std::string part;
+        while (std::getline(ss, part, ',')) c.push_back(part);
+        if (c.size() != 8) throw std::runtime_error("Fila inválida en " + path + ": " + line);
+        bench::SampleStats s;
+        s.mean = std::stod(c[2]);
+        s.stddev = std::stod(c[3]);
+        s.ci95 = std::stod(c[4]);
+        s.min = std::stod(c[5]);
+        s.max = std::stod(c[6]);
+        s.n = std::stoul(c[7]);
+        out[{c[0], c[1]}] = s;
+    }
+    return out;
+}
+
+// Incluye las métricas con prefijo de los reportes de hnswn_query_basic y
+// hnsw_query_optimized (recall_at_10, intra_qps, batch_speedup...)
+bool is_recall(const std::string& metric) { return metric.find("recall") != std::string::npos; }
+
+bool higher_is_better(const std::string& metric) {
+    auto ends_with = [&](const std::string& suffix) {
+        return metric.size() >= suffix.size() &&
+               metric.compare(metric.size() - suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return is_recall(metric) || ends_with("qps") || ends_with("speedup") || ends_with("ipc") ||
+           ends_with("gb_s");
+}
+
+struct CompareOptions {
+    double threshold_pct = 5.0;     // cambio relativo que se considera significativo
+    double recall_threshold = 0.005;  // el recall se compara en valor absoluto
+};
+
+// Imprime la tabla y devuelve el número de regresiones. Una métrica regresa
+// si empeora más que el umbral y los intervalos del 95 % no se solapan; si
+// se solapan el cambio se marca como ruido.
+size_t compare_summaries(const Summary& base, const Summary& cur, const CompareOptions& opt,
+                         const std::string& csv_path) {
+    std::ofstream csv;
+    if (!csv_path.empty()) {
+        csv.open(csv_path);
+        if (!csv) throw std::runtime_error("No se pudo crear: " + csv_path);
+        csv << std::setprecision(10)
+            << "scenario,metric,base_mean,base_ci95,current_mean,current_ci95,change_pct,status\n";
+    }
+    std::cout << std::left << std::setw(20) << "escenario" << std::setw(16) << "métrica"
+              << std::right << std::setw(14) << "base" << std::setw(14) << "actual" << std::setw(10)
+              << "cambio" << "  estado\n";
+    size_t regressions = 0;
+    std::string missing;  // último escenario ausente, para avisar una sola vez
+    for (const auto& e : base) {
+        const std::string& scenario = e.first.first;
+        const std::string& metric = e.first.second;
+        auto it = cur.find(e.first);
+        if (it == cur.end()) {
+            if (missing != scenario)
+                std::cout << std::left << std::setw(20) << scenario << "(sin " << metric
+                          << " u otras métricas en la corrida actual)" << std::right << "\n";
+            missing = scenario;
+            continue;
+        }
+        const bench::SampleStats& b = e.second;
+        const bench::SampleStats& c = it->second;
+        double change_pct = b.mean != 0.0 ? 100.0 * (c.mean - b.mean) / std::fabs(b.mean) : 0.0;
+        double worse = higher_is_better(metric) ? b.mean - c.mean : c.mean - b.mean;
+        bool significant = is_recall(metric) ? std::fabs(c.mean - b.mean) > opt.recall_threshold
+                                              : std::fabs(change_pct) > opt.threshold_pct;
+        bool overlap = c.low() <= b.high() && b.low() <= c.high();
+        std::string status = "=";
+        if (significant && overlap) {
+            status = "ruido";
+        } else if (significant && worse > 0) {
+            status = "REGRESIÓN";
+            regressions++;
+        } else if (significant) {
+            status = "mejora";
+        }
+        std::cout << std::left << std::setw(20) << scenario << std::setw(16) << metric << std::right
+                  << std::setw(14) << b.mean << std::setw(14) << c.mean << std::setw(9)
+                  << std::fixed << std::setprecision(1) << change_pct << "%" << std::defaultfloat
+                  << std::setprecision(6) << "  " << status << "\n";
+        if (csv)
+            csv << scenario << "," << metric << "," << b.mean << "," << b.ci95 << "," << c.mean
+                << "," << c.ci95 << "," << change_pct << "," << status << "\n";
+    }
+    std::cout << "Regresiones: " << regressions << " (umbral " << opt.threshold_pct
+              << " %, recall " << opt.recall_threshold << " absoluto)\n";
+    return regressions;
+}
+
+// =================== MAIN ===================
+
+void usage(const char* prog) {
+    std::cerr << "Uso:\n"
+              << prog << " run <escenarios.ini> [--out prefijo] [--only escenario]"
+              << " [--baseline resumen.csv] [--threshold pct] [--recall-threshold abs]\n"
+              << prog << " compare <base_summary.csv> <actual_summary.csv> [--threshold pct]"
+              << " [--recall-threshold abs] [--csv salida.csv]\n\n"
+              << "Salidas de run: <prefijo>.json (entorno, configuración, ensayos y estadísticas),\n"
+              << "<prefijo>_trials.csv y <prefijo>_summary.csv (media, desviación e IC 95 %).\n"
+              << "compare acepta también los <prefijo>_summary.csv de hnswn_query_basic y\n"
+              << "hnsw_query_optimized (--report), con el mismo --tag en ambas corridas.\n"
+              << "Código de salida 2 si la comparación encuentra regresiones.\n";
+}
+
+int run_command(int argc, char** argv) {
+    std::string scenario_file = argv[2];
+    std::string prefix = "bench";
+    std::string only, baseline;
+    CompareOptions cmp;
+    for (int a = 3; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--out" && a + 1 < argc) {
+            prefix = argv[++a];
+        } else if (flag == "--only" && a + 1 < argc) {
+            only = argv[++a];
+        } else if (flag == "--baseline" && a + 1 < argc) {
+            baseline = argv[++a];
+        } else if (flag == "--threshold" && a + 1 < argc) {
+            cmp.threshold_pct = std::stod(argv[++a]);
+        } else if (flag == "--recall-threshold" && a + 1 < argc) {
+            cmp.recall_threshold = std::stod(argv[++a]);
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+
+    std::vector<Scenario> scenarios = parse_scenarios(scenario_file);
+    if (!only.empty()) {
+        scenarios.erase(std::remove_if(scenarios.begin(), scenarios.end(),
+                                       [&](const Scenario& s) { return s.name != only; }),
+                        scenarios.end());
+        if (scenarios.empty()) throw std::runtime_error("No existe el escenario " + only);
+    }
+
+    bench::Environment env = bench::Environment::capture();
+    std::cout << "=== HNSW BENCH ===\nEntorno:\n";
+    env.print(std::cout);
+    std::cout << "Escenarios: " << scenarios.size() << "\n\n";
+
+    ResourceCache cache;
+    std::vector<ScenarioResult> results;
+    for (const Scenario& sc : scenarios) {
+        LoadedIndex& li = sc.dataset_path.empty() ? cache.index(sc.index_path, sc.dim) : cache.built(sc);
+        const std::vector<float>& q = cache.query_set(sc.queries_path, sc.dim);
+        const KnnResults* gt = sc.gt_path.empty() ? nullptr : &cache.truth(sc.gt_path);
+        ScenarioRunner runner(sc, li, q, gt);
+
+        ScenarioResult res;
+        res.scenario = &sc;
+        res.index_desc = li.meta.describe();
+        res.build_s = li.build_s;
+        res.queries = runner.queries_per_trial();
+        std::cout << "[" << sc.name << "] engine " << sc.engine << ", " << res.queries
+                  << " queries, k=" << sc.k << ", ef=" << sc.ef << ", threads=" << sc.threads
+                  << ", " << sc.warmup << " calentamiento(s) + " << sc.trials << " ensayo(s)\n";
+        for (size_t w = 0; w < sc.warmup; w++) runner.trial();
+        for (size_t t = 0; t < sc.trials; t++) res.trials.push_back(runner.trial());
+        res.summarize();
+        for (const auto& e : res.stats) {
+            const bench::SampleStats& s = e.second;
+            std::cout << "  " << std::left << std::setw(16) << e.first << std::right << s.mean
+                      << " ± " << s.ci95 << " (cv " << std::fixed << std::setprecision(1)
+                      << s.cv_pct() << "%)" << std::defaultfloat << std::setprecision(6) << "\n";
+            if (e.first == "qps" && s.n > 1 && s.cv_pct() > 5.0)
+                std::cout << "  AVISO: QPS con variación alta entre ensayos; revisar ruido del sistema\n";
+        }
+        results.push_back(std::move(res));
+    }
+
+    write_json(prefix + ".json", scenario_file, env, results);
+    write_trials_csv(prefix + "_trials.csv", results);
+    write_summary_csv(prefix + "_summary.csv", results);
+    std::cout << "\nResultados: " << prefix << ".json, " << prefix << "_trials.csv, " << prefix
+              << "_summary.csv\n";
+
+    if (baseline.empty()) return 0;
+    Summary current;
+    for (const auto& res : results)
+        for (const auto& e : res.stats) current[{res.scenario->name, e.first}] = e.second;
+    std::cout << "\n=== COMPARACIÓN CON " << baseline << " ===\n";
+    size_t regressions = compare_summaries(load_summary(baseline), current, cmp, prefix + "_compare.csv");
+    return regressions > 0 ? 2 : 0;
+}
+
+int compare_command(int argc, char** argv) {
+    if (argc < 4) {
+        usage(argv[0]);
+        return 1;
+    }
+    CompareOptions cmp;
+    std::string csv_path;
+    for (int a = 4; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--threshold" && a + 1 < argc) {
+            cmp.threshold_pct = std::stod(argv[++a]);
+        } else if (flag == "--recall-threshold" && a + 1 < argc) {
+            cmp.recall_threshold = std::stod(argv[++a]);
+        } else if (flag == "--csv" && a + 1 < argc) {
+            csv_path = argv[++a];
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    size_t regressions = compare_summaries(load_summary(argv[2]), load_summary(argv[3]), cmp, csv_path);
+    return regressions > 0 ? 2 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+    std::string command = argv[1];
+    try {
+        if (command == "run") return run_command(argc, argv);
+        if (command == "compare") return compare_command(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    usage(argv[0]);
+    return 1;
+}
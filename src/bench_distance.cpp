@@ -0,0 +1,109 @@
+#include "../includes/simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// =================== MICRO-BENCHMARK DE KERNELS DE DISTANCIA ===================
+//
+// Compara ns/distancia de cada kernel propio (escalar, AVX2, AVX-512) con
+// el kernel por defecto de hnswlib para la misma dimensión.
+
+struct KernelResult {
+    std::string name;
+    double ns_per_dist;
+    double checksum;
+};
+
+KernelResult time_kernel(const std::string& name, hnswlib::DISTFUNC<float> fn, void* param,
+                         const std::vector<float>& base, const std::vector<float>& queries,
+                         size_t dim, size_t rounds) {
+    size_t nb = base.size() / dim;
+    size_t nq = queries.size() / dim;
+    double checksum = 0.0;
+
+    // Calentamiento
+    for (size_t q = 0; q < nq; q++)
+        for (size_t i = 0; i < nb; i++)
+            checksum += fn(&queries[q * dim], &base[i * dim], param);
+
+    checksum = 0.0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (size_t r = 0; r < rounds; r++) {
+        for (size_t q = 0; q < nq; q++) {
+            float acc = 0.0f;
+            for (size_t i = 0; i < nb; i++)
+                acc += fn(&queries[q * dim], &base[i * dim], param);
+            checksum += acc;
+        }
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    return {name, ns / (double(rounds) * nq * nb), checksum / rounds};
+}
+
+int main(int argc, char** argv) {
+    size_t dim = argc > 1 ? std::stoul(argv[1]) : 768;
+    size_t rounds = argc > 2 ? std::stoul(argv[2]) : 200;
+    size_t nb = 1024;  // ~3 MB a dim=768: cabe en LLC, mide cómputo
+    size_t nq = 8;
+
+    std::cout << "=== MICRO-BENCHMARK DE DISTANCIAS ===\n";
+    std::cout << "Dimensión: " << dim << ", base: " << nb << " vectores, queries: " << nq
+              << ", rondas: " << rounds << "\n";
+    std::cout << "SIMD detectado: " << CpuFeatures::name(CpuFeatures::detect()) << "\n\n";
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+    std::vector<float> base(nb * dim), queries(nq * dim);
+    for (auto& x : base) x = u(rng);
+    for (auto& x : queries) x = u(rng);
+
+    std::vector<KernelResult> results;
+    for (Metric metric : {Metric::L2, Metric::IP}) {
+        std::string m = metric_name(metric);
+        if (metric == Metric::L2) {
+            hnswlib::L2Space ref(dim);
+            results.push_back(time_kernel("hnswlib/" + m, ref.get_dist_func(), ref.get_dist_func_param(),
+                                          base, queries, dim, rounds));
+        } else {
+            hnswlib::InnerProductSpace ref(dim);
+            results.push_back(time_kernel("hnswlib/" + m, ref.get_dist_func(), ref.get_dist_func_param(),
+                                          base, queries, dim, rounds));
+        }
+
+        for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512}) {
+            if (!CpuFeatures::supports(level)) continue;
+            SimdSpace space(metric, dim, level);
+            results.push_back(time_kernel(space.description(), space.get_dist_func(),
+                                          space.get_dist_func_param(), base, queries, dim, rounds));
+        }
+    }
+
+    std::cout << std::left << std::setw(32) << "kernel" << std::right << std::setw(14)
+              << "ns/dist" << std::setw(12) << "speedup" << std::setw(12) << "rel_err" << "\n";
+    std::cout << std::string(70, '-') << "\n";
+    const KernelResult* ref = nullptr;
+    for (const auto& r : results) {
+        if (r.name.rfind("hnswlib/", 0) == 0) ref = &r;
+        double err = std::fabs(r.checksum - ref->checksum) / std::max(1e-12, std::fabs(ref->checksum));
+        std::cout << std::left << std::setw(32) << r.name << std::right << std::setw(14)
+                  << std::fixed << std::setprecision(2) << r.ns_per_dist << std::setw(11)
+                  << (ref->ns_per_dist / r.ns_per_dist) << "x" << std::setw(12)
+                  << std::scientific << std::setprecision(1) << err << "\n"
+                  << std::defaultfloat;
+    }
+
+    std::ofstream csv("distance_bench.csv");
+    csv << "kernel,dim,ns_per_distance\n";
+    for (const auto& r : results) csv << r.name << "," << dim << "," << r.ns_per_dist << "\n";
+    std::cout << "\nResultados guardados en distance_bench.csv\n";
+    return 0;
+}
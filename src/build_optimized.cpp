@@ -1,13 +1,26 @@
+#include "../includes/async_loader.hpp"
+#include "../includes/chunked_reader.hpp"
+#include "../includes/graph_reorder.hpp"
+#include "../includes/half_precision.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/memory_utils.hpp"
+#include "../includes/numa_memory.hpp"
+#include "../includes/parallel_build.hpp"
+#include "../includes/perf_counters.hpp"
+#include "../includes/pq.hpp"
+#include "../includes/search_engine.hpp"
+#include "../includes/simd_distance.hpp"
+#include "../includes/sq8.hpp"
 #include "hnswlib.h"
 #include <chrono>
-#include <cstring>      
-#include <fcntl.h>      
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
-#include <sys/mman.h>   
-#include <sys/stat.h>   
-#include <unistd.h>     
 #include <vector>
 #include <ctime>
 #include <iomanip>
@@ -40,149 +53,146 @@ string get_current_timestamp() {
     return ss.str();
 }
 
-vector<float> load_embeddings_mmap(const string &path, size_t &n, int dim) {
-    // 1. Abrir archivo
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd == -1) {
-        throw runtime_error("No se pudo abrir: " + path);
-    }
-    // 2. Obtener tamaño del archivo
-    struct stat sb;
-    if (fstat(fd, &sb) == -1) {
-        close(fd);
-        throw runtime_error("No se pudo obtener tamaño: " + path);
-    }
-    
-    size_t file_size = sb.st_size;
-    
-    // 3. Verificar que el tamaño sea correcto
-    if (file_size % (sizeof(float) * dim) != 0) {
-        close(fd);
-        throw runtime_error("Tamaño de archivo incorrecto para dim=" + to_string(dim));
+// =================== NORMALIZACIÓN IN-PLACE SOBRE EL MAPEO ===================
+
+// Normaliza las filas [first, last) con el pool de OpenMP. Los workers del
+// pool siguen vivos al salir de la región, así que el contador heredado del
+// proceso no los ve: con worker_perf cada worker distinto del maestro abre
+// contadores propios y suma ahí lo que hizo.
+template <typename RowFn>
+void normalize_range(size_t first, size_t last, int dim, int num_threads, PerfSample* worker_perf,
+                     RowFn row) {
+    #ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+    #pragma omp parallel
+    {
+        unique_ptr<PerfCounters> counters;
+        PerfSample start;
+        if (worker_perf && omp_get_thread_num() != 0) {
+            counters.reset(new PerfCounters());
+            start = counters->read();
+        }
+        #pragma omp for schedule(static)
+        for (size_t i = first; i < last; i++) {
+            float* r = row(i);
+            HNSWUtils::normalize_row(r, r, dim);
+        }
+        if (counters) {
+            PerfSample done = counters->since(start);
+            #pragma omp critical
+            *worker_perf += done;
+        }
     }
-    n = file_size / (sizeof(float) * dim);
-    // 4. Mapear archivo a memoria 
-    void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (mapped == MAP_FAILED) {
-        close(fd);
-        throw runtime_error("mmap falló: " + path);
+    #else
+    for (size_t i = first; i < last; i++) {
+        float* r = row(i);
+        HNSWUtils::normalize_row(r, r, dim);
     }
-    
-    madvise(mapped, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
-    
-    vector<float> data(n * dim);
-    memcpy(data.data(), mapped, file_size);
+    #endif
+}
 
-    munmap(mapped, file_size);
-    close(fd);
-    
-    return data;
+// Normaliza directamente sobre el mapeo MAP_PRIVATE: solo se copian las
+// páginas escritas, nunca se materializa una segunda copia del dataset
+void normalize_embeddings_inplace(MappedDataset& dataset, int num_threads,
+                                  PerfSample* worker_perf = nullptr) {
+    normalize_range(0, dataset.size(), dataset.dimension(), num_threads, worker_perf,
+                    [&](size_t i) { return dataset.mutable_row(i); });
 }
 
-vector<uint64_t> load_ids_mmap(const string &path, size_t &n) {
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd == -1) {
-        throw runtime_error("No se pudo abrir: " + path);
-    }
-    
-    struct stat sb;
-    if (fstat(fd, &sb) == -1) {
-        close(fd);
-        throw runtime_error("No se pudo obtener tamaño: " + path);
-    }
-    
-    size_t file_size = sb.st_size;
-    
-    if (file_size % sizeof(uint64_t) != 0) {
-        close(fd);
-        throw runtime_error("Tamaño de archivo incorrecto para IDs");
-    }
-    
-    n = file_size / sizeof(uint64_t);
-    
-    void* mapped = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (mapped == MAP_FAILED) {
-        close(fd);
-        throw runtime_error("mmap falló: " + path);
-    }
-    
-    madvise(mapped, file_size, MADV_SEQUENTIAL);
-    
-    vector<uint64_t> data(n);
-    memcpy(data.data(), mapped, file_size);
-    
-    munmap(mapped, file_size);
-    close(fd);
-    
-    return data;
+// Normaliza un tramo de filas recién leído (carga con --load read): corre
+// mientras siguen en vuelo las lecturas de los bloques siguientes
+void normalize_rows(float* base, size_t first, size_t count, int dim, int num_threads,
+                    PerfSample* worker_perf = nullptr) {
+    normalize_range(first, first + count, dim, num_threads, worker_perf,
+                    [base, dim](size_t i) { return base + i * dim; });
 }
 
-// =================== NORMALIZACIÓN CON POSIX MEMALIGN (ALINEAMIENTO) ===================
+// =================== CONSTRUCCIÓN EN STREAMING (MEMORIA ACOTADA) ===================
 
-vector<float> normalize_embeddings_aligned(const vector<float>& emb, int dim, int num_threads) {
-    size_t n = emb.size() / dim;
-    vector<float> normalized(n * dim);
-    
-    // Usar memoria alineada para mejor performance de SIMD
-    #ifdef _OPENMP
-    omp_set_num_threads(num_threads);
-    #pragma omp parallel for schedule(static)
-    #endif
-    for (size_t i = 0; i < n; i++) {
-        const float* src = &emb[i * dim];
-        float* dst = &normalized[i * dim];
-        
-        // Calcular norma
-        float norm_sq = 0.0f;
-        for (int d = 0; d < dim; d++) {
-            norm_sq += src[d] * src[d];
-        }
-        
-        float norm = sqrtf(norm_sq);
-        
-        // Normalizar
-        if (norm > 1e-12f) {
-            float inv_norm = 1.0f / norm;
-            for (int d = 0; d < dim; d++) {
-                dst[d] = src[d] * inv_norm;
-            }
-        } else {
-            // Si la norma es 0, copiar tal cual
-            for (int d = 0; d < dim; d++) {
-                dst[d] = src[d];
-            }
-        }
-    }
-    
-    return normalized;
-}
+// Inserta bloque a bloque mientras el hilo lector prepara el siguiente.
+// Solo el primer bloque aporta la semilla secuencial.
+ParallelBuildReport build_streaming(hnswlib::HierarchicalNSW<float>& index,
+                                    ChunkedReader& reader,
+                                    const ParallelBuilder::Options& opt,
+                                    const string& progress_path) {
+    ParallelBuildReport total;
+    total.batch_size = opt.batch_size;
+    total.threads.resize(max(1, opt.num_threads));
 
-// =================== CONSTRUCCIÓN CON PREFETCHING ===================
+    ofstream progress(progress_path);
+    progress << "chunk,inserted,elapsed_s,chunk_throughput_vec_s,avg_throughput_vec_s,"
+             << "reader_wait_s,current_rss_mb\n";
 
-void build_with_prefetch(hnswlib::HierarchicalNSW<float>& index,
-                        const vector<float>& embeddings,
-                        const vector<uint64_t>& ids,
-                        int dim) {
-    size_t N = ids.size();
-    const size_t PREFETCH_DISTANCE = 10;  
-    
-    for (size_t i = 0; i < N; i++) {
-        if (i + PREFETCH_DISTANCE < N) {
-            __builtin_prefetch(&embeddings[(i + PREFETCH_DISTANCE) * dim], 0, 1);
-            __builtin_prefetch(&ids[i + PREFETCH_DISTANCE], 0, 1);
-        }
-        
-        // Insertar vector actual
-        index.addPoint(&embeddings[i * dim], ids[i]);
-        
-        // Mostrar progreso
-        if ((i + 1) % 50000 == 0 || (i + 1) == N) {
-            double progress = 100.0 * (i + 1) / N;
-            cout << "\rProgreso: " << (i + 1) << "/" << N 
-                 << " (" << progress << "%)" << flush;
+    size_t N = reader.total_rows();
+    size_t inserted = 0;
+    size_t chunk_no = 0;
+    auto t0 = chrono::high_resolution_clock::now();
+    
+    Chunk chunk;
+    while (reader.next(chunk)) {
+        ParallelBuilder::Options chunk_opt = opt;
+        chunk_opt.seed_count = (chunk_no == 0) ? opt.seed_count : 0;
+        chunk_opt.progress_every = 0;
+
+        const float* base = chunk.vectors;
+        int dim = opt.dim;
+        auto row = [base, dim](size_t i) { return base + i * dim; };
+
+        auto c0 = chrono::high_resolution_clock::now();
+        ParallelBuildReport r = ParallelBuilder::build(index, chunk.rows, row, chunk.ids, chunk_opt);
+        auto c1 = chrono::high_resolution_clock::now();
+
+        total.seed_count += r.seed_count;
+        total.seed_time_s += r.seed_time_s;
+        total.parallel_time_s += r.parallel_time_s;
+        for (size_t t = 0; t < r.threads.size(); t++) {
+            total.threads[t].inserted += r.threads[t].inserted;
+            total.threads[t].batches += r.threads[t].batches;
+            total.threads[t].steals += r.threads[t].steals;
+            total.threads[t].busy_s += r.threads[t].busy_s;
+            total.threads[t].perf += r.threads[t].perf;
         }
+
+        inserted += chunk.rows;
+        chunk_no++;
+        double chunk_s = chrono::duration<double>(c1 - c0).count();
+        double elapsed = chrono::duration<double>(c1 - t0).count();
+        progress << chunk_no << "," << inserted << "," << elapsed << ","
+                 << (chunk.rows / chunk_s) << "," << (inserted / elapsed) << ","
+                 << reader.wait_seconds() << ","
+                 << (MemoryMonitor::get_current_rss_kb() / 1024) << "\n";
+
+        cout << "\rProgreso: " << inserted << "/" << N << " ("
+             << (100.0 * inserted / N) << "%)" << flush;
     }
     cout << endl;
+    return total;
+}
+
+// =================== SONDEO DE BÚSQUEDA (ANTES / DESPUÉS DEL REORDENAMIENTO) ===================
+
+struct SearchProbe {
+    double qps = 0.0;
+    PerfSample counters;
+    vector<uint64_t> ids;
+};
+
+// Busca una muestra de vectores del propio índice (en su formato guardado)
+// con el motor por lotes; una pasada de calentamiento y otra medida
+SearchProbe probe_search(const hnswlib::HierarchicalNSW<float>& index, const vector<char>& queries,
+                         size_t query_bytes, size_t k, size_t ef, int num_threads,
+                         const PerfCounters& perf) {
+    SearchProbe probe;
+    size_t n = queries.size() / query_bytes;
+    probe.ids.resize(n * k);
+    BatchSearcher searcher(HnswGraphView::from(index), num_threads, 16);
+    searcher.searchBatchRaw(queries.data(), query_bytes, n, k, ef, probe.ids.data(), nullptr);
+    PerfSample mark = perf.read();
+    BatchSearchStats bs = searcher.searchBatchRaw(queries.data(), query_bytes, n, k, ef,
+                                                  probe.ids.data(), nullptr);
+    probe.counters = perf.since(mark);
+    probe.qps = bs.qps;
+    return probe;
 }
 
 // =================== MAIN CON OPTIMIZACIONES REALES ===================
@@ -190,15 +200,50 @@ void build_with_prefetch(hnswlib::HierarchicalNSW<float>& index,
 int main(int argc, char **argv) {
     if (argc < 9) {
         cout << "Uso: " << argv[0] 
-             << " <embeddings.bin> <ids.bin> <dim> <M> <efC> <ip|l2> <output> <threads>\n"
+             << " <embeddings.bin> <ids.bin> <dim> <M> <efC> <ip|l2> <output> <threads>"
+             << " [--seed N] [--batch N] [--normalize stream|inplace]"
+             << " [--stream] [--max-buffer-mb N] [--load mmap|read] [--io auto|uring|pread] [--io-direct]"
+             << " [--storage fp32|sq8|pq|fp16|bf16] [--pq-m M] [--pq-train N]"
+             << " [--format hnswm|hnswlib] [--direct] [--reorder none|bfs|rcm]"
+             << " [--pages none|thp|hugetlb] [--numa default|interleave]\n"
              << "\nOptimizaciones:\n"
-             << "  - mmap() para carga rápida\n"
+             << "  - mmap() sin copia (filas leídas directamente del mapeo)\n"
              << "  - madvise() para patrones de acceso\n"
              << "  - Prefetching manual\n"
-             << "  - Normalización paralela\n";
+             << "  - Normalización paralela\n"
+             << "  - Inserción multihilo (semilla secuencial + robo de lotes)\n"
+             << "\nOpciones:\n"
+             << "  --seed N   Vectores insertados en secuencia antes de paralelizar (10000)\n"
+             << "  --batch N  Tamaño de lote por hilo en la fase paralela (512)\n"
+             << "  --normalize stream|inplace  Normalización para ip: por fila al\n"
+             << "             insertar (stream, por defecto) o sobre el mapeo (inplace)\n"
+             << "  --stream   Lee los archivos por bloques con doble buffer (memoria acotada)\n"
+             << "  --max-buffer-mb N  Presupuesto de los buffers de lectura en --stream (256)\n"
+             << "  --load mmap|read  Embeddings mapeados (mmap, por defecto) o leídos a memoria\n"
+             << "             con lecturas en vuelo; con read y ip se normaliza cada bloque al llegar\n"
+             << "  --io auto|uring|pread  Lecturas de --load read y --stream: io_uring si el\n"
+             << "             kernel lo permite (auto) o pread() secuencial\n"
+             << "  --io-direct  Lee con O_DIRECT (sin page cache) en buffers alineados\n"
+             << "  --storage fp32|sq8|pq|fp16|bf16  Formato de los vectores en el índice (fp32).\n"
+             << "             sq8 guarda códigos de 8 bits y los parámetros en <output>.sq8; pq guarda\n"
+             << "             m bytes por vector y los codebooks en <output>.pq; fp16/bf16 guardan\n"
+             << "             2 bytes por componente (conversión F16C/AVX-512 al calcular distancias)\n"
+             << "  --pq-m M   Subespacios PQ, divisor de dim (dim/8)\n"
+             << "  --pq-train N  Vectores de la muestra de entrenamiento de k-means (32768)\n"
+             << "  --format hnswm|hnswlib  Formato del archivo (hnswm): secciones con CRC32C,\n"
+             << "             escritas en paralelo y publicadas con rename atómico; hnswlib\n"
+             << "             usa saveIndex() para herramientas externas\n"
+             << "  --direct   Escribe el índice con O_DIRECT (sin pasar por el page cache)\n"
+             << "  --reorder none|bfs|rcm  Renumera los ids internos tras construir para que\n"
+             << "             los vecinos queden contiguos en memoria (none)\n"
+             << "  --pages none|thp|hugetlb  Capa 0 del índice en páginas de 2 MB (none)\n"
+             << "  --numa default|interleave  Reparte la capa 0 entre los nodos NUMA (default)\n";
         return 1;
     }
 
+    // Antes de crear cualquier hilo: los de las fases heredan los contadores
+    PerfCounters& perf = process_perf_counters();
+
     // Parámetros
     string emb_path = argv[1];
     string ids_path = argv[2];
@@ -209,72 +254,405 @@ int main(int argc, char **argv) {
     string out_path = argv[7];
     int num_threads = stoi(argv[8]);
 
+    ParallelBuilder::Options build_opt;
+    build_opt.num_threads = num_threads;
+    build_opt.thread_counters = perf.available();
+    string normalize_mode = "stream";
+    bool streaming = false;
+    size_t max_buffer_mb = 256;
+    string storage = "fp32";
+    int pq_m = 0;
+    size_t pq_train = 32768;
+    string format = "hnswm";
+    string load_mode = "mmap";
+    async_io::LoadOptions io_opt;
+    ReorderMethod reorder = ReorderMethod::None;
+    IndexMemoryOptions mem_opt;
+    index_io::SaveOptions save_opt;
+    save_opt.threads = num_threads;
+    for (int a = 9; a < argc; a++) {
+        string flag = argv[a];
+        if (flag == "--seed" && a + 1 < argc) {
+            build_opt.seed_count = stoull(argv[++a]);
+        } else if (flag == "--batch" && a + 1 < argc) {
+            build_opt.batch_size = stoull(argv[++a]);
+        } else if (flag == "--stream") {
+            streaming = true;
+        } else if (flag == "--max-buffer-mb" && a + 1 < argc) {
+            max_buffer_mb = stoull(argv[++a]);
+        } else if (flag == "--load" && a + 1 < argc) {
+            load_mode = argv[++a];
+            if (load_mode != "mmap" && load_mode != "read") {
+                cerr << "Modo de carga inválido: " << load_mode << "\n";
+                return 1;
+            }
+        } else if (flag == "--io" && a + 1 < argc) {
+            try {
+                io_opt.backend = async_io::parse_backend(argv[++a]);
+            } catch (const invalid_argument& e) {
+                cerr << e.what() << "\n";
+                return 1;
+            }
+        } else if (flag == "--io-direct") {
+            io_opt.direct = true;
+        } else if (flag == "--storage" && a + 1 < argc) {
+            storage = argv[++a];
+            if (storage != "fp32" && storage != "sq8" && storage != "pq" && storage != "fp16" &&
+                storage != "bf16") {
+                cerr << "Formato de almacenamiento inválido: " << storage << "\n";
+                return 1;
+            }
+        } else if (flag == "--pq-m" && a + 1 < argc) {
+            pq_m = stoi(argv[++a]);
+        } else if (flag == "--pq-train" && a + 1 < argc) {
+            pq_train = stoull(argv[++a]);
+        } else if (flag == "--format" && a + 1 < argc) {
+            format = argv[++a];
+            if (format != "hnswm" && format != "hnswlib") {
+                cerr << "Formato de índice inválido: " << format << "\n";
+                return 1;
+            }
+        } else if (flag == "--direct") {
+            save_opt.direct = true;
+        } else if (flag == "--pages" && a + 1 < argc) {
+            try {
+                mem_opt.pages = parse_huge_page_mode(argv[++a]);
+            } catch (const runtime_error& e) {
+                cerr << e.what() << "\n";
+                return 1;
+            }
+        } else if (flag == "--numa" && a + 1 < argc) {
+            try {
+                mem_opt.numa = parse_numa_placement(argv[++a]);
+            } catch (const runtime_error& e) {
+                cerr << e.what() << "\n";
+                return 1;
+            }
+            if (mem_opt.numa == NumaPlacement::Replicate) {
+                cerr << "--numa replicate solo aplica al servir consultas (hnsw_query_optimized)\n";
+                return 1;
+            }
+        } else if (flag == "--reorder" && a + 1 < argc) {
+            try {
+                reorder = parse_reorder_method(argv[++a]);
+            } catch (const invalid_argument& e) {
+                cerr << e.what() << "\n";
+                return 1;
+            }
+        } else if (flag == "--normalize" && a + 1 < argc) {
+            normalize_mode = argv[++a];
+            if (normalize_mode != "stream" && normalize_mode != "inplace") {
+                cerr << "Modo de normalización inválido: " << normalize_mode << "\n";
+                return 1;
+            }
+        } else {
+            cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+
+    // fp16/bf16 no entrenan nada: se convierten fila a fila también en --stream
+    if (streaming && (storage == "sq8" || storage == "pq")) {
+        cerr << "--storage " << storage << " necesita entrenar sobre todo el dataset;"
+             << " no es compatible con --stream\n";
+        return 1;
+    }
+
     cout << "\n=== HNSW CON OPTIMIZACIONES DE SISTEMA ===\n";
     cout << "Usando mmap() y optimizaciones de SO\n";
+    cout << "Contadores hardware: " << perf.status() << "\n";
+
+    // ---------- CARGA CON MMAP (SIN COPIA) ----------
+    vector<MemorySnapshot> memory_phases;
+    memory_phases.push_back(MemoryMonitor::snapshot("Inicio"));
+    vector<PerfPhase> perf_phases;
+    PerfSample perf_mark = perf.read();
+    // Workers del pool de OpenMP en la fase actual (ver normalize_range)
+    PerfSample pool_perf;
 
-    // ---------- CARGA CON MMAP ----------
     auto t_load = chrono::high_resolution_clock::now();
     
-    size_t n_emb, n_ids;
-    
-    cout << "Cargando embeddings con mmap()...\n";
-    auto embeddings = load_embeddings_mmap(emb_path, n_emb, dim);
-    
-    cout << "Cargando IDs con mmap()...\n";
-    auto ids = load_ids_mmap(ids_path, n_ids);
-    
-    if (n_emb != n_ids) {
-        throw runtime_error("Número de embeddings e IDs no coincide");
+    if (streaming && normalize_mode == "inplace") {
+        cout << "ADVERTENCIA: --stream usa normalización por fila (stream)\n";
+        normalize_mode = "stream";
+    }
+    if (load_mode == "read" && streaming) {
+        cout << "ADVERTENCIA: --stream ya lee por bloques, se ignora --load read\n";
+        load_mode = "mmap";
+    }
+    // Con --load read la memoria es propia: se normaliza al llegar cada bloque
+    bool normalize_on_load = (space_type == "ip" && load_mode == "read");
+    bool inplace = (space_type == "ip" && normalize_mode == "inplace" && !normalize_on_load);
+    async_io::LoadReport io_report;
+    
+    MappedDataset embeddings;
+    MappedIds ids;
+    unique_ptr<ChunkedReader> reader;
+    size_t N = 0;
+    
+    if (streaming) {
+        // Solo se abren los archivos: el hilo lector empieza a llenar buffers
+        cout << "Lectura por bloques (presupuesto " << max_buffer_mb << " MB)...\n";
+        reader.reset(new ChunkedReader(emb_path, ids_path, dim, max_buffer_mb * 1024 * 1024, io_opt));
+        N = reader->total_rows();
+        cout << "Bloques de " << reader->rows_per_chunk() << " vectores ("
+             << (reader->buffer_bytes() / (1024.0 * 1024.0)) << " MB en buffers)\n";
+    } else if (load_mode == "read") {
+        cout << "Leyendo embeddings con lecturas en vuelo"
+             << (normalize_on_load ? " (normalizando cada bloque al llegar)" : "") << "...\n";
+        std::function<void(float*, size_t, size_t)> on_rows;
+        if (normalize_on_load) {
+            PerfSample* worker_perf = perf.available() ? &pool_perf : nullptr;
+            on_rows = [dim, num_threads, worker_perf](float* base, size_t first, size_t count) {
+                normalize_rows(base, first, count, dim, num_threads, worker_perf);
+            };
+        }
+        embeddings = async_io::load_dataset(emb_path, dim, io_opt, &io_report, on_rows);
+        ids = async_io::load_ids(ids_path, io_opt, &io_report);
+        if (embeddings.size() != ids.size()) {
+            throw runtime_error("Número de embeddings e IDs no coincide");
+        }
+        N = embeddings.size();
+        cout << "Lectura: " << io_report.describe() << "\n";
+        if (io_opt.direct && !io_report.direct)
+            cout << "ADVERTENCIA: el sistema de archivos no admite O_DIRECT, lectura normal\n";
+    } else {
+        cout << "Mapeando embeddings con mmap()...\n";
+        embeddings = MappedDataset(emb_path, dim, inplace);
+        
+        cout << "Mapeando IDs con mmap()...\n";
+        ids = MappedIds(ids_path);
+        
+        if (embeddings.size() != ids.size()) {
+            throw runtime_error("Número de embeddings e IDs no coincide");
+        }
+        N = embeddings.size();
     }
     
-    size_t N = n_emb;
     auto t_load_end = chrono::high_resolution_clock::now();
     double load_time = chrono::duration<double>(t_load_end - t_load).count();
     
-    cout << "✓ Cargados " << N << " vectores en " << load_time << " segundos\n";
+    cout << "✓ Preparados " << N << " vectores en " << load_time << " segundos\n";
+    memory_phases.push_back(MemoryMonitor::snapshot("Carga"));
+    perf_phases.push_back({"Load", perf.since(perf_mark) + pool_perf});
 
     // ---------- PRE-PROCESO ----------
-    vector<float> processed_embeddings;
+    perf_mark = perf.read();
+    pool_perf = PerfSample();
     auto t_pre = chrono::high_resolution_clock::now();
     
-    if (space_type == "ip") {
-        cout << "Normalizando vectores (paralelo)...\n";
-        processed_embeddings = normalize_embeddings_aligned(embeddings, dim, num_threads);
-    } else {
-        // Para L2, usar embeddings originales
-        processed_embeddings = move(embeddings);
+    if (normalize_on_load) {
+        cout << "Vectores ya normalizados durante la lectura\n";
+    } else if (space_type == "ip" && inplace) {
+        cout << "Normalizando vectores in-place sobre el mapeo (paralelo)...\n";
+        normalize_embeddings_inplace(embeddings, num_threads, perf.available() ? &pool_perf : nullptr);
+    } else if (space_type == "ip") {
+        // Se normaliza cada fila en un buffer por hilo justo antes de insertar
+        cout << "Normalización en streaming durante la inserción\n";
+        build_opt.normalize = true;
+        build_opt.dim = dim;
     }
     
     auto t_pre_end = chrono::high_resolution_clock::now();
     double pre_time = chrono::duration<double>(t_pre_end - t_pre).count();
     cout << "✓ Pre-proceso completado en " << pre_time << " segundos\n";
+    memory_phases.push_back(MemoryMonitor::snapshot("Pre-proceso"));
+    perf_phases.push_back({"Normalize", perf.since(perf_mark) + pool_perf});
 
     // ---------- CONSTRUCCIÓN ----------
-    hnswlib::SpaceInterface<float>* space = nullptr;
-    if (space_type == "l2") {
-        space = new hnswlib::L2Space(dim);
+    Metric metric = parse_metric(space_type);
+    if (metric == Metric::L2) {
         cout << "Usando espacio L2 (distancia euclidiana)\n";
     } else {
-        space = new hnswlib::InnerProductSpace(dim);
         cout << "Usando espacio Inner Product (coseno)\n";
     }
+
+    hnswlib::SpaceInterface<float>* space = nullptr;
+    string kernel_desc;
+    SQ8Params sq8;
+    PQParams pq;
+    double train_time = 0.0;
+    if (storage == "pq") {
+        // Codebooks sobre los vectores tal como se insertarán
+        if (pq_m <= 0) pq_m = max(1, dim / 8);
+        cout << "Entrenando PQ (m=" << pq_m << ", 256 centroides por subespacio, muestra "
+             << min(N, pq_train) << ")...\n";
+        auto t_train = chrono::high_resolution_clock::now();
+        bool norm_rows = build_opt.normalize;
+        auto train_row = [&embeddings, dim, norm_rows](size_t i, float* out) {
+            if (norm_rows) {
+                HNSWUtils::normalize_row(embeddings.row(i), out, dim);
+            } else {
+                copy(embeddings.row(i), embeddings.row(i) + dim, out);
+            }
+        };
+        pq = PQParams::train(N, dim, pq_m, train_row, num_threads, pq_train);
+        train_time = chrono::duration<double>(chrono::high_resolution_clock::now() - t_train).count();
+        pq.save(PQParams::path_for(out_path));
+        cout << "✓ Codebooks entrenados en " << train_time << " s -> "
+             << PQParams::path_for(out_path) << "\n";
+
+        // La construcción compara códigos entre sí (SDC)
+        PQSpace* pq_space = new PQSpace(metric, pq, PQSpace::Mode::Sdc);
+        kernel_desc = pq_space->description();
+        space = pq_space;
+        build_opt.encode = [&pq](const float* x, uint8_t* code) { pq.encode(x, code); };
+        build_opt.code_size = size_t(pq_m);
+    } else if (storage == "sq8") {
+        // Rango por dimensión sobre los vectores tal como se insertarán
+        cout << "Entrenando cuantizador SQ8 (min/max por dimensión)...\n";
+        auto t_train = chrono::high_resolution_clock::now();
+        bool norm_rows = build_opt.normalize;
+        auto train_row = [&embeddings, dim, norm_rows](size_t i, float* out) {
+            if (norm_rows) {
+                HNSWUtils::normalize_row(embeddings.row(i), out, dim);
+            } else {
+                copy(embeddings.row(i), embeddings.row(i) + dim, out);
+            }
+        };
+        sq8 = SQ8Params::train(N, dim, train_row, num_threads);
+        train_time = chrono::duration<double>(chrono::high_resolution_clock::now() - t_train).count();
+        sq8.save(SQ8Params::path_for(out_path));
+        cout << "✓ Cuantizador entrenado en " << train_time << " s -> "
+             << SQ8Params::path_for(out_path) << "\n";
+
+        SQ8Space* sq8_space = new SQ8Space(metric, sq8);
+        kernel_desc = sq8_space->description();
+        space = sq8_space;
+        build_opt.encode = [&sq8](const float* x, uint8_t* code) { sq8.encode(x, code); };
+        build_opt.code_size = dim;
+    } else if (storage == "fp16" || storage == "bf16") {
+        HalfSpace* half_space = new HalfSpace(metric, parse_half_format(storage), dim);
+        kernel_desc = half_space->description();
+        space = half_space;
+        build_opt.encode = [half_space](const float* x, uint8_t* code) {
+            half_space->encode(x, reinterpret_cast<uint16_t*>(code));
+        };
+        build_opt.code_size = dim * sizeof(uint16_t);
+    } else {
+        SimdSpace* simd_space = new SimdSpace(metric, dim);
+        kernel_desc = simd_space->description();
+        space = simd_space;
+    }
+    cout << "Kernel de distancia: " << kernel_desc << "\n";
     
     cout << "\nConstruyendo índice HNSW...\n";
     cout << "Parámetros: M=" << M << ", efConstruction=" << efC << "\n";
+    cout << "Hilos: " << num_threads << " (semilla secuencial: "
+         << min(N, build_opt.seed_count) << ", lote: " << build_opt.batch_size << ")\n";
     
     hnswlib::HierarchicalNSW<float> index(space, N, M, efC);
+    // Antes de insertar: las páginas de la capa 0 se colocan al tocarse.
+    // Declarado después del índice para liberarse antes que él.
+    unique_ptr<Level0Guard> level0_guard;
+    if (mem_opt.active()) {
+        level0_guard.reset(new Level0Guard(index, mem_opt));
+        cout << "Memoria de la capa 0: " << level0_guard->memory().describe() << "\n";
+    }
     
+    perf_mark = perf.read();
     auto t_build = chrono::high_resolution_clock::now();
     
-    build_with_prefetch(index, processed_embeddings, ids, dim);
+    ParallelBuildReport build_report;
+    if (streaming) {
+        build_opt.dim = dim;
+        build_report = build_streaming(index, *reader, build_opt, "build_progress.csv");
+        io_report = reader->io_report();
+        cout << "Lectura por bloques: " << io_report.describe() << "\n";
+    } else {
+        EmbeddingView view = embeddings.view();
+        auto row = [view](size_t i) { return view.row(i); };
+        build_report = ParallelBuilder::build(index, N, row, ids.data(), build_opt);
+    }
     
     auto t_build_end = chrono::high_resolution_clock::now();
     double build_time = chrono::duration<double>(t_build_end - t_build).count();
+    memory_phases.push_back(MemoryMonitor::snapshot("Construcción"));
+    size_t huge_page_bytes = level0_guard ? level0_guard->memory().huge_bytes() : 0;
+    perf_phases.push_back({"Build", perf.since(perf_mark)});
+
+    // Verificación de calidad: recall@1 de los propios vectores (muestra),
+    // leídos del propio índice para no depender de los datos de entrada
+    index.setEf(max(efC, 64));
+    auto stored_row = [&index](size_t i) {
+        return static_cast<const void*>(index.getDataByInternalId(i));
+    };
+    auto stored_label = [&index](size_t i) { return index.getExternalLabel(i); };
+    double self_recall = ParallelBuilder::self_recall(index, N, stored_row, stored_label,
+                                                      1000, num_threads);
+
+    // ---------- REORDENAMIENTO ----------
+    double reorder_time = 0.0;
+    double gap_before = 0.0, gap_after = 0.0;
+    double agreement = 0.0;
+    SearchProbe probe_before, probe_after;
+    size_t probe_count = 0;
+    const size_t probe_k = 10, probe_ef = 64;
+    if (reorder != ReorderMethod::None) {
+        cout << "\nReordenando el grafo (" << reorder_method_name(reorder) << ")...\n";
+        // Muestra repartida por todo el índice, copiada antes de mover los datos
+        size_t query_bytes = index.label_offset_ - index.offsetData_;
+        probe_count = min<size_t>(N, 5000);
+        vector<char> probe_queries(probe_count * query_bytes);
+        for (size_t s = 0; s < probe_count; s++) {
+            memcpy(probe_queries.data() + s * query_bytes,
+                   index.getDataByInternalId(s * N / probe_count), query_bytes);
+        }
+        gap_before = GraphReorder::mean_neighbor_gap(index);
+        probe_before = probe_search(index, probe_queries, query_bytes, probe_k, probe_ef,
+                                    num_threads, perf);
+
+        auto t_reorder = chrono::high_resolution_clock::now();
+        GraphReorder::apply(index, GraphReorder::compute(index, reorder));
+        reorder_time = chrono::duration<double>(chrono::high_resolution_clock::now() - t_reorder).count();
+
+        gap_after = GraphReorder::mean_neighbor_gap(index);
+        probe_after = probe_search(index, probe_queries, query_bytes, probe_k, probe_ef,
+                                   num_threads, perf);
+        size_t same = 0;
+        for (size_t i = 0; i < probe_before.ids.size(); i++)
+            same += probe_before.ids[i] == probe_after.ids[i];
+        agreement = probe_before.ids.empty() ? 0.0 : double(same) / probe_before.ids.size();
+
+        cout << "✓ Reordenado en " << reorder_time << " s (salto medio entre vecinos: "
+             << gap_before << " -> " << gap_after << " ids)\n";
+        cout << "  QPS sondeo: " << probe_before.qps << " -> " << probe_after.qps << " ("
+             << (probe_after.qps / max(probe_before.qps, 1e-9)) << "x)\n";
+        if (probe_before.counters.has(PERF_LLC_MISSES)) {
+            cout << "  LLC misses/query: "
+                 << (double(probe_before.counters.get(PERF_LLC_MISSES)) / probe_count) << " -> "
+                 << (double(probe_after.counters.get(PERF_LLC_MISSES)) / probe_count) << "\n";
+        }
+        cout << "  Resultados idénticos: " << (agreement * 100.0) << "%\n";
+        memory_phases.push_back(MemoryMonitor::snapshot("Reordenamiento"));
+    }
 
     // ---------- GUARDADO ----------
-    cout << "\nGuardando índice...\n";
-    index.saveIndex(out_path);
-    cout << "✓ Índice guardado en: " << out_path << "\n";
+    cout << "\nGuardando índice (" << format << ")...\n";
+    perf_mark = perf.read();
+    index_io::SaveReport save_report;
+    // Métrica y preprocesado, para que las herramientas de consulta los lean
+    IndexMeta meta = IndexMeta::make(metric, dim, parse_storage(storage));
+    meta.m = M;
+    meta.ef_construction = efC;
+    if (format == "hnswm") {
+        auto image = mapped_index::IndexImage::from_index(index);
+        meta.stamp(image.header);
+        save_report = index_io::save(image, out_path, save_opt);
+        if (save_opt.direct && !save_report.direct)
+            cout << "ADVERTENCIA: el sistema de archivos no admite O_DIRECT, escritura normal\n";
+    } else {
+        auto t_save = chrono::high_resolution_clock::now();
+        index.saveIndex(out_path);
+        meta.save(IndexMeta::path_for(out_path));
+        save_report.total_s = chrono::duration<double>(chrono::high_resolution_clock::now() - t_save).count();
+        save_report.bytes = MemoryMonitor::index_bytes(index);
+        save_report.threads = 1;
+    }
+    cout << "✓ Índice guardado en: " << out_path << " (" << save_report.total_s << " s, "
+         << save_report.mb_per_s() << " MB/s)\n";
+    memory_phases.push_back(MemoryMonitor::snapshot("Guardado"));
+    perf_phases.push_back({"Save", perf.since(perf_mark)});
 
     // ---------- ESTADÍSTICAS ----------
     double total_time = load_time + pre_time + build_time;
@@ -286,11 +664,30 @@ int main(int argc, char **argv) {
     cout << "Vectores:           " << N << "\n";
     cout << "Dimensión:          " << dim << "\n";
     cout << "Tiempo carga:       " << load_time << " s\n";
+    if (io_report.bytes > 0) {
+        cout << "Lectura de entrada: " << io_report.gb_per_s() << " GB/s ("
+             << async_io::backend_name(io_report.backend) << ")\n";
+    }
     cout << "Tiempo pre-proceso: " << pre_time << " s\n";
     cout << "Tiempo construcción: " << build_time << " s\n";
+    cout << "Tiempo guardado:    " << save_report.total_s << " s (" << save_report.mb_per_s()
+         << " MB/s)\n";
     cout << "Tiempo total:       " << total_time << " s\n";
     cout << string(30, '-') << "\n";
     cout << "Throughput:         " << throughput << " vec/segundo\n";
+    cout << "Fase semilla:       " << build_report.seed_count << " vec en "
+         << build_report.seed_time_s << " s (" << build_report.seed_throughput() << " vec/s)\n";
+    if (build_report.parallel_time_s > 0) {
+        cout << "Fase paralela:      " << build_report.parallel_time_s << " s ("
+             << build_report.parallel_throughput() << " vec/s)\n";
+        cout << "Eficiencia escalado: " << (build_report.scaling_efficiency() * 100.0) << "%\n";
+    }
+    cout << "Self-recall@1:      " << self_recall << "\n";
+    const PerfSample& build_perf = perf_phases[2].counters;
+    if (build_perf.has(PERF_CYCLES) && build_perf.has(PERF_INSTRUCTIONS)) {
+        cout << "IPC construcción:   " << build_perf.ipc() << " ("
+             << (double(build_perf.get(PERF_CYCLES)) / N) << " ciclos/vec)\n";
+    }
     cout << "Velocidad vs original: " << (1088.6 / build_time) << "x\n";
     
     if (total_time < 1088.6) {
@@ -306,6 +703,8 @@ int main(int argc, char **argv) {
     metrics << "Vectors: " << N << "\n";
     metrics << "Dimension: " << dim << "\n";
     metrics << "Space: " << space_type << "\n";
+    metrics << "Storage: " << storage << "\n";
+    metrics << "Distance kernel: " << kernel_desc << "\n";
     metrics << "M: " << M << "\n";
     metrics << "efConstruction: " << efC << "\n";
     metrics << "Threads: " << num_threads << "\n";
@@ -314,9 +713,111 @@ int main(int argc, char **argv) {
     metrics << "  Preprocess: " << pre_time << " s\n";
     metrics << "  Build: " << build_time << " s\n";
     metrics << "  Total: " << total_time << " s\n";
+    metrics << "\nInput I/O:\n";
+    metrics << "  Mode: " << (streaming ? "stream" : load_mode) << "\n";
+    if (io_report.bytes > 0) {
+        metrics << "  Backend: " << async_io::backend_name(io_report.backend)
+                << (io_report.direct ? ", O_DIRECT" : "") << "\n";
+        metrics << "  Bytes: " << io_report.bytes << "\n";
+        metrics << "  Read time: " << io_report.seconds << " s\n";
+        metrics << "  Throughput: " << io_report.gb_per_s() << " GB/s\n";
+    }
+    metrics << "\nSave:\n";
+    metrics << "  Format: " << format << "\n";
+    metrics << "  Bytes: " << save_report.bytes << "\n";
+    metrics << "  Time: " << save_report.total_s << " s\n";
+    metrics << "  Throughput: " << save_report.mb_per_s() << " MB/s\n";
+    if (format == "hnswm") {
+        metrics << "  Checksum: " << save_report.checksum_s << " s\n";
+        metrics << "  Write: " << save_report.write_s << " s (" << save_report.threads << " threads"
+                << (save_report.direct ? ", O_DIRECT" : "") << ")\n";
+        metrics << "  Sync + rename: " << save_report.sync_s << " s\n";
+    }
     metrics << "\nPerformance:\n";
     metrics << "  Throughput: " << throughput << " vec/s\n";
     metrics << "  Speedup vs original: " << (1088.6 / build_time) << "x\n";
+    if (storage == "sq8") {
+        metrics << "  SQ8 training: " << train_time << " s\n";
+    } else if (storage == "pq") {
+        metrics << "  PQ training: " << train_time << " s (m=" << pq_m << ", sample "
+                << min(N, pq_train) << ")\n";
+        metrics << "  PQ compression: " << (4.0 * dim / pq_m) << "x (" << pq_m
+                << " bytes per vector)\n";
+    } else if (storage == "fp16" || storage == "bf16") {
+        metrics << "  Vector bytes: " << (dim * sizeof(uint16_t)) << " per vector (2x vs fp32)\n";
+    }
+    metrics << "\nParallel insertion:\n";
+    metrics << "  Seed vectors: " << build_report.seed_count << "\n";
+    metrics << "  Seed time: " << build_report.seed_time_s << " s\n";
+    metrics << "  Seed throughput: " << build_report.seed_throughput() << " vec/s\n";
+    metrics << "  Batch size: " << build_report.batch_size << "\n";
+    metrics << "  Parallel time: " << build_report.parallel_time_s << " s\n";
+    metrics << "  Parallel throughput: " << build_report.parallel_throughput() << " vec/s\n";
+    metrics << "  Scaling efficiency: " << (build_report.scaling_efficiency() * 100.0) << " %\n";
+    for (size_t t = 0; t < build_report.threads.size(); t++) {
+        const auto& st = build_report.threads[t];
+        metrics << "  Thread " << t << ": " << st.inserted << " vec, "
+                << st.throughput() << " vec/s, " << st.batches << " lotes, "
+                << st.steals << " robados\n";
+    }
+    if (streaming) {
+        metrics << "\nStreaming:\n";
+        metrics << "  Buffer budget: " << max_buffer_mb << " MB\n";
+        metrics << "  Chunk rows: " << reader->rows_per_chunk() << "\n";
+        metrics << "  Read time (reader thread): " << reader->read_seconds() << " s\n";
+        metrics << "  Insert wait on reader: " << reader->wait_seconds() << " s\n";
+        metrics << "  Read throughput: "
+                << (reader->total_bytes_read() / (1024.0 * 1024.0) / max(reader->read_seconds(), 1e-9))
+                << " MB/s\n";
+    }
+    metrics << "\nMemory (peak / current RSS):\n";
+    metrics << "  Normalization: " << (space_type == "ip" ? normalize_mode : "none") << "\n";
+    metrics << "  Index memory: " << (level0_guard ? level0_guard->memory().describe() : mem_opt.describe())
+            << "\n";
+    if (level0_guard) {
+        metrics << "  Huge pages after build: " << (huge_page_bytes / (1024 * 1024)) << " MB of "
+                << (level0_guard->memory().mapped_bytes() / (1024 * 1024)) << " MB\n";
+    }
+    if (streaming) {
+        metrics << "  Read buffers: " << (reader->buffer_bytes() / (1024.0 * 1024.0)) << " MB\n";
+    } else {
+        metrics << "  Dataset mapped: " << (embeddings.bytes() / (1024 * 1024)) << " MB\n";
+    }
+    for (const auto& m : memory_phases) {
+        metrics << "  " << m.phase << ": " << m.peak_rss_mb << " MB / "
+                << m.current_rss_mb << " MB\n";
+    }
+    if (reorder != ReorderMethod::None) {
+        auto per_query = [probe_count](const PerfSample& c, PerfEvent e) {
+            return c.has(e) ? to_string(double(c.get(e)) / probe_count) : string("n/a");
+        };
+        metrics << "\nReorder:\n";
+        metrics << "  Method: " << reorder_method_name(reorder) << "\n";
+        metrics << "  Time: " << reorder_time << " s\n";
+        metrics << "  Mean neighbor id gap: " << gap_before << " -> " << gap_after << "\n";
+        metrics << "  Probe: " << probe_count << " queries, k=" << probe_k << ", ef=" << probe_ef
+                << "\n";
+        metrics << "  QPS: " << probe_before.qps << " -> " << probe_after.qps << " ("
+                << (probe_after.qps / max(probe_before.qps, 1e-9)) << "x)\n";
+        metrics << "  LLC misses/query: " << per_query(probe_before.counters, PERF_LLC_MISSES)
+                << " -> " << per_query(probe_after.counters, PERF_LLC_MISSES) << "\n";
+        metrics << "  dTLB misses/query: " << per_query(probe_before.counters, PERF_DTLB_MISSES)
+                << " -> " << per_query(probe_after.counters, PERF_DTLB_MISSES) << "\n";
+        metrics << "  Result agreement: " << (agreement * 100.0) << " %\n";
+    }
+    metrics << "\nHardware counters:\n";
+    metrics << "  Events: " << perf.status() << "\n";
+    for (const auto& p : perf_phases) {
+        metrics << "  " << p.phase << ": " << p.counters.describe() << "\n";
+    }
+    if (build_opt.thread_counters) {
+        for (size_t t = 0; t < build_report.threads.size(); t++) {
+            metrics << "  Build thread " << t << ": " << build_report.threads[t].perf.describe()
+                    << "\n";
+        }
+    }
+    metrics << "\nQuality:\n";
+    metrics << "  Self-recall@1 (1000 muestras): " << self_recall << "\n";
     metrics.close();
     
     cout << "\n✓ Métricas guardadas en performance_metrics.txt\n";
@@ -0,0 +1,69 @@
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/mapped_index.hpp"
+#include "../includes/memory_utils.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// =================== CONVERSOR saveIndex -> FORMATO MAPEABLE ===================
+//
+// Lee el archivo de HierarchicalNSW::saveIndex en streaming (no necesita
+// la dimensión ni la métrica) y escribe el layout de mapped_index.hpp. Si
+// el índice tiene <index.bin>.meta, los metadatos pasan a la cabecera.
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Uso:\n" << argv[0] << " <index.bin> <index.hnswm> [--threads T] [--direct]\n";
+        return 1;
+    }
+    std::string in_path = argv[1];
+    std::string out_path = argv[2];
+
+    index_io::SaveOptions save_opt;
+    for (int a = 3; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--threads" && a + 1 < argc) {
+            save_opt.threads = std::stoi(argv[++a]);
+        } else if (flag == "--direct") {
+            save_opt.direct = true;
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << "=== CONVERSIÓN A ÍNDICE MAPEABLE ===\n";
+    std::cout << "Entrada: " << in_path << "\n";
+    std::cout << "Salida: " << out_path << "\n";
+
+    try {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        auto image = mapped_index::IndexImage::from_legacy_file(in_path);
+        IndexMeta meta = IndexMeta::read(in_path);
+        if (meta.present) meta.stamp(image.header);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        index_io::SaveReport saved = index_io::save(image, out_path, save_opt);
+
+        const mapped_index::Header& h = image.header;
+        std::cout << "Elementos: " << h.count << ", nivel máximo: " << h.max_level
+                  << ", M: " << h.m << ", efConstruction: " << h.ef_construction << "\n";
+        std::cout << "Bytes por vector: " << h.data_size << "\n";
+        std::cout << "Metadatos: " << meta.describe() << "\n";
+        std::cout << "\n=== SECCIONES ===\n";
+        for (uint32_t s = 0; s < mapped_index::SECTION_COUNT; s++) {
+            std::cout << mapped_index::section_name(s) << ": offset " << h.sections[s].offset
+                      << ", " << h.sections[s].bytes / 1048576.0 << " MB, crc32c " << std::hex
+                      << h.sections[s].checksum << std::dec << "\n";
+        }
+        std::cout << "\nTamaño total: " << h.file_bytes / 1048576.0 << " MB\n";
+        std::cout << "Lectura: " << std::chrono::duration<double>(t1 - t0).count() << " s\n";
+        std::cout << "Escritura: " << saved.total_s << " s (" << saved.mb_per_s() << " MB/s, "
+                  << saved.threads << " hilos" << (saved.direct ? ", O_DIRECT" : "") << ")\n";
+        MemoryMonitor::print_memory_usage("Fin");
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include "../includes/brute_force.hpp"
+#include "../includes/hnsw_utils.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/memory_utils.hpp"
+#include "../includes/simd_distance.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// =================== GROUND TRUTH EXACTO (FUERZA BRUTA) ===================
+//
+// Top-k exacto de cada query contra todo el dataset mapeado, con el kernel
+// por bloques de brute_force.hpp.
+
+int main(int argc, char** argv) {
+    if (argc < 8) {
+        std::cerr << "Uso:\n"
+                  << argv[0]
+                  << " <embeddings.bin> <ids.bin> <queries.bin> <dim> <k> <threads> <gt_out.bin>"
+                  << " [--metric l2|ip] [--block-rows R] [--query-block Q]\n";
+        return 1;
+    }
+
+    std::string emb_path = argv[1];
+    std::string ids_path = argv[2];
+    std::string queries_path = argv[3];
+    int dim = std::stoi(argv[4]);
+    size_t k = std::stoul(argv[5]);
+    int num_threads = std::stoi(argv[6]);
+    std::string out_path = argv[7];
+
+    std::string metric_str = "l2";
+    size_t block_rows = 4096;
+    size_t query_block = 16;
+    for (int a = 8; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--metric" && a + 1 < argc) {
+            metric_str = argv[++a];
+        } else if (flag == "--block-rows" && a + 1 < argc) {
+            block_rows = std::max<size_t>(1, std::stoul(argv[++a]));
+        } else if (flag == "--query-block" && a + 1 < argc) {
+            query_block = std::max<size_t>(1, std::stoul(argv[++a]));
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    Metric metric = parse_metric(metric_str);
+    SimdLevel level = CpuFeatures::detect();
+
+    std::cout << "=== GROUND TRUTH EXACTO ===\n";
+    std::cout << "Embeddings: " << emb_path << "\n";
+    std::cout << "Queries: " << queries_path << "\n";
+    std::cout << "Métrica: " << metric_str << ", k: " << k << ", threads: " << num_threads << "\n";
+    std::cout << "Kernel: " << CpuFeatures::name(level) << ", bloque: " << block_rows
+              << " filas x " << query_block << " queries\n";
+
+    MappedDataset base(emb_path, dim);
+    MappedIds ids(ids_path);
+    if (ids.size() < base.size())
+        throw std::runtime_error("Menos IDs que embeddings en " + ids_path);
+    size_t N = base.size();
+
+    MappedDataset query_file(queries_path, dim);
+    size_t nq = query_file.size();
+    std::vector<float> queries(query_file.row(0), query_file.row(0) + nq * dim);
+    std::cout << "Base: " << N << " vectores, queries: " << nq << "\n";
+
+    if (metric == Metric::IP) {
+        for (size_t q = 0; q < nq; q++)
+            HNSWUtils::normalize_row(&queries[q * dim], &queries[q * dim], dim);
+    }
+
+    BruteForce::Options bf;
+    bf.metric = metric;
+    bf.dim = dim;
+    bf.k = k;
+    bf.num_threads = num_threads;
+    bf.block_rows = block_rows;
+    bf.query_block = query_block;
+    bf.progress = true;
+    bf.level = level;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    KnnResults gt = BruteForce::search(
+        N, [&](size_t i) { return base.row(i); }, [&](size_t i) { return ids[i]; },
+        queries.data(), nq, bf);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+
+    gt.save(out_path);
+
+    double dists = double(N) * nq;
+    std::cout << "\n=== RESULTADOS ===\n";
+    std::cout << "Tiempo: " << secs << " s\n";
+    std::cout << "Distancias: " << dists << " (" << (dists / secs / 1e6) << " M/s)\n";
+    std::cout << "QPS fuerza bruta: " << (nq / secs) << "\n";
+    MemoryMonitor::print_memory_usage("Fin");
+    std::cout << "Ground truth guardado en " << out_path << "\n";
+    return 0;
+}
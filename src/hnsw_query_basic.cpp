@@ -1,5 +1,13 @@
 #include "hnswlib.h"
+#include "../includes/async_loader.hpp"
+#include "../includes/bench_report.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/latency_histogram.hpp"
 #include "../includes/memory_utils.hpp"
+#include "../includes/perf_counters.hpp"
+#include "../includes/results_io.hpp"
+#include "../includes/simd_distance.hpp"
 #include <algorithm>
 #include <chrono>
 #include <fstream>
@@ -10,30 +18,13 @@
 #include <cstdint>
 
 // -------------------- Loaders --------------------
-std::vector<float> load_fvec(const std::string &path) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
-
-    f.seekg(0, std::ios::end);
-    size_t size = f.tellg() / sizeof(float);
-    f.seekg(0, std::ios::beg);
-
-    std::vector<float> data(size);
-    f.read(reinterpret_cast<char*>(data.data()), size * sizeof(float));
-    return data;
+// Lecturas en vuelo con io_uring (pread si no está disponible), ver async_loader.hpp
+std::vector<float> load_fvec(const std::string &path, async_io::LoadReport &io) {
+    return async_io::load_array<float>(path, async_io::LoadOptions(), &io);
 }
 
-std::vector<uint64_t> load_u64vec(const std::string &path) {
-    std::ifstream f(path, std::ios::binary);
-    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
-
-    f.seekg(0, std::ios::end);
-    size_t size = f.tellg() / sizeof(uint64_t);
-    f.seekg(0, std::ios::beg);
-
-    std::vector<uint64_t> data(size);
-    f.read(reinterpret_cast<char*>(data.data()), size * sizeof(uint64_t));
-    return data;
+std::vector<uint64_t> load_u64vec(const std::string &path, async_io::LoadReport &io) {
+    return async_io::load_array<uint64_t>(path, async_io::LoadOptions(), &io);
 }
 
 // -------------------- MAIN --------------------
@@ -41,7 +32,12 @@ int main(int argc, char **argv) {
     if (argc < 7) {
         std::cerr << "Uso:\n";
         std::cerr << argv[0]
-                  << " index.bin queries.bin queries_ids.bin dim k efSearch\n";
+                  << " index.bin queries.bin queries_ids.bin dim k efSearch"
+                  << " [--results out.bin] [--gt gt.bin] [--report prefijo] [--tag nombre]\n";
+        std::cerr << "\n  --report  Prefijo de las salidas (basic_query): <prefijo>.json,\n"
+                  << "            <prefijo>_summary.csv (formato de hnsw_bench, comparable con\n"
+                  << "            hnsw_bench compare) y <prefijo>_latencies.csv\n"
+                  << "  --tag     Nombre del escenario en el resumen (query)\n";
         return 1;
     }
 
@@ -52,6 +48,26 @@ int main(int argc, char **argv) {
     int k = std::stoi(argv[5]);
     int efS = std::stoi(argv[6]);
 
+    std::string results_path, gt_path;
+    std::string report_prefix = "basic_query", tag = "query";
+    for (int a = 7; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--results" && a + 1 < argc) {
+            results_path = argv[++a];
+        } else if (flag == "--gt" && a + 1 < argc) {
+            gt_path = argv[++a];
+        } else if (flag == "--report" && a + 1 < argc) {
+            report_prefix = argv[++a];
+        } else if (flag == "--tag" && a + 1 < argc) {
+            tag = argv[++a];
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+
+    PerfCounters& perf = process_perf_counters();
+
     std::cout << "=== CONFIGURACIÓN ===\n";
     std::cout << "Índice: " << index_path << "\n";
     std::cout << "Queries: " << query_path << "\n";
@@ -59,11 +75,14 @@ int main(int argc, char **argv) {
     std::cout << "Dimensión: " << dim << "\n";
     std::cout << "k (vecinos): " << k << "\n";
     std::cout << "efSearch: " << efS << "\n";
+    std::cout << "Contadores hardware: " << perf.status() << "\n";
 
     // Cargar queries e IDs
     std::cout << "\nCargando datos...\n";
-    auto queries = load_fvec(query_path);
-    auto q_ids = load_u64vec(query_ids_path);
+    async_io::LoadReport io_report;
+    auto queries = load_fvec(query_path, io_report);
+    auto q_ids = load_u64vec(query_ids_path, io_report);
+    std::cout << "Lectura: " << io_report.describe() << "\n";
     
     std::cout << "Queries cargadas: " << queries.size() << " floats\n";
     std::cout << "IDs cargados: " << q_ids.size() << " IDs\n";
@@ -83,31 +102,53 @@ int main(int argc, char **argv) {
     }
 
     std::cout << "\nCargando índice...\n";
-    
-    hnswlib::L2Space space(dim);
-    hnswlib::HierarchicalNSW<float> index(&space, index_path);
+
+    // Métrica y normalización según los metadatos del índice
+    IndexMeta meta = IndexMeta::read(index_path);
+    std::cout << "Metadatos del índice: " << meta.describe() << "\n";
+    meta.check_dim(dim);
+    if (meta.storage != VectorStorage::FP32) {
+        std::cerr << "Índice " << storage_name(meta.storage) << ": usar hnsw_query_quantized\n";
+        return 1;
+    }
+    SimdSpace space(meta.metric, dim);
+    NormalizeFn normalize = meta.normalized ? space.normalizer() : nullptr;
+    std::vector<float> normalized(dim);
+    std::cout << "Kernel de distancia: " << space.description() << "\n";
+    PerfSample perf_mark = perf.read();
+    auto index_ptr = index_io::load(&space, index_path);
+    PerfSample load_perf = perf.since(perf_mark);
+    hnswlib::HierarchicalNSW<float>& index = *index_ptr;
     index.setEf(efS);
 
     MemoryMonitor::print_memory_usage("Inicio");
 
     std::vector<double> latencies(Q);
+    LatencyHistogram histogram;
+    KnnResults results_out(Q, k);
 
     std::cout << "\nEjecutando " << Q << " queries (SECUENCIAL)...\n";
 
+    perf_mark = perf.read();
     auto start_total = std::chrono::steady_clock::now();
 
     for (size_t i = 0; i < Q; i++) {
         const float *q = queries.data() + i * dim;
 
         auto start = std::chrono::steady_clock::now();
+        if (normalize) {
+            normalize(q, normalized.data(), dim);
+            q = normalized.data();
+        }
         auto results = index.searchKnn(q, k);
         auto end = std::chrono::steady_clock::now();
 
-        latencies[i] =
-            std::chrono::duration<double, std::milli>(end - start).count();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        histogram.record(ns);
+        latencies[i] = ns / 1e6;
 
-        // Limpiar resultados
-        while (!results.empty()) results.pop();
+        // Guardar vecinos en la fila i
+        results_out.store(i, results);
         
         // Mostrar progreso cada 10000 queries
         if (i % 10000 == 0 && i > 0) {
@@ -117,6 +158,7 @@ int main(int argc, char **argv) {
     }
 
     auto end_total = std::chrono::steady_clock::now();
+    PerfSample query_perf = perf.since(perf_mark);
 
     MemoryMonitor::print_memory_usage("Después de queries");
 
@@ -124,53 +166,56 @@ int main(int argc, char **argv) {
     double total_time =
         std::chrono::duration<double>(end_total - start_total).count();
 
-    double avg_latency =
-        std::accumulate(latencies.begin(), latencies.end(), 0.0) / Q;
-
     double qps = Q / total_time;
 
-    std::sort(latencies.begin(), latencies.end());
-    double p50 = latencies[Q * 0.50];
-    double p95 = latencies[Q * 0.95];
-    double p99 = latencies[Q * 0.99];
+    RecallReport recall;
+    if (!gt_path.empty()) recall = RecallReport::compute(results_out, KnnResults::load(gt_path), k);
 
     // -------------------- RESULTADOS --------------------
     std::cout << "\n=== RESULTADOS ===\n";
     std::cout << "Queries procesadas: " << Q << "\n";
     std::cout << "Tiempo total: " << total_time << " s\n";
     std::cout << "QPS: " << qps << "\n";
-    std::cout << "Latencia promedio: " << avg_latency << " ms\n";
-    std::cout << "P50: " << p50 << " ms\n";
-    std::cout << "P95: " << p95 << " ms\n";
-    std::cout << "P99: " << p99 << " ms\n";
+    histogram.print(std::cout);
+    recall.print(std::cout);
+    std::cout << "Contadores (queries): " << query_perf.describe() << "\n";
 
-    // -------------------- CSV --------------------
-    std::ofstream csv("basic_query_metrics.csv");
+    // -------------------- REPORTE --------------------
+    std::ofstream csv(report_prefix + "_latencies.csv");
     csv << "query_id,latency_ms\n";
     for (size_t i = 0; i < Q; i++) {
         csv << q_ids[i] << "," << latencies[i] << "\n";
     }
     csv.close();
 
-    // Guardar resumen también
-    std::ofstream summary("basic_query_summary.csv");
-    summary << "metric,value\n";
-    summary << "queries," << Q << "\n";
-    summary << "dimension," << dim << "\n";
-    summary << "k," << k << "\n";
-    summary << "efSearch," << efS << "\n";
+    bench::RunReport report("hnswn_query_basic", tag);
+    report.config("index", index_path);
+    report.config("queries", Q);
+    report.config("dimension", dim);
+    report.config("metric", metric_name(meta.metric));
+    report.config("k", k);
+    report.config("efSearch", efS);
+    report.config("threads", 1);
+    report.config("perf_available", perf.available() ? 1 : 0);
+    std::ostream &summary = report.rows();
     summary << "total_time_s," << total_time << "\n";
     summary << "qps," << qps << "\n";
-    summary << "avg_latency_ms," << avg_latency << "\n";
-    summary << "p50_ms," << p50 << "\n";
-    summary << "p95_ms," << p95 << "\n";
-    summary << "p99_ms," << p99 << "\n";
+    recall.write_csv(summary);
+    histogram.write_csv(summary);
+    io_report.write_csv(summary, "queries_io_");
+    load_perf.write_csv(summary, "load_");
+    query_perf.write_csv(summary, "query_", Q, "query");
     summary << "peak_rss_mb," << MemoryMonitor::get_peak_rss_mb() << "\n";
-    summary.close();
+    report.write(report_prefix, bench::Environment::capture());
 
     std::cout << "\nMétricas guardadas en:\n";
-    std::cout << "1. basic_query_metrics.csv\n";
-    std::cout << "2. basic_query_summary.csv\n";
+    std::cout << "1. " << report_prefix << ".json\n";
+    std::cout << "2. " << report_prefix << "_summary.csv\n";
+    std::cout << "3. " << report_prefix << "_latencies.csv\n";
+    if (!results_path.empty()) {
+        results_out.save(results_path);
+        std::cout << "4. " << results_path << "\n";
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
+#include "../includes/async_loader.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
 #include "../includes/memory_utils.hpp"
 #include "hnswlib.h"
 
+#include <algorithm>
 #include <chrono>
 #include <fstream>
 #include <iostream>
 #include <numeric>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 #include <cstdint>
 
@@ -13,34 +18,13 @@
    CARGA DE BINARIOS
    ======================= */
 
-std::vector<float> load_fvec(const std::string &path) {
-    std::ifstream f(path, std::ios::binary | std::ios::ate);
-    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
-
-    size_t size = f.tellg();
-    if (size % sizeof(float) != 0)
-        throw std::runtime_error("Archivo embeddings corrupto");
-
-    f.seekg(0, std::ios::beg);
-
-    std::vector<float> data(size / sizeof(float));
-    f.read(reinterpret_cast<char *>(data.data()), size);
-    return data;
+// Lecturas en vuelo con io_uring (pread si no está disponible), ver async_loader.hpp
+std::vector<float> load_fvec(const std::string &path, async_io::LoadReport &io) {
+    return async_io::load_array<float>(path, async_io::LoadOptions(), &io);
 }
 
-std::vector<uint64_t> load_u64(const std::string &path) {
-    std::ifstream f(path, std::ios::binary | std::ios::ate);
-    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
-
-    size_t size = f.tellg();
-    if (size % sizeof(uint64_t) != 0)
-        throw std::runtime_error("Archivo ids corrupto");
-
-    f.seekg(0, std::ios::beg);
-
-    std::vector<uint64_t> data(size / sizeof(uint64_t));
-    f.read(reinterpret_cast<char *>(data.data()), size);
-    return data;
+std::vector<uint64_t> load_u64(const std::string &path, async_io::LoadReport &io) {
+    return async_io::load_array<uint64_t>(path, async_io::LoadOptions(), &io);
 }
 
 /* =======================
@@ -68,8 +52,9 @@ int main(int argc, char **argv) {
        CARGA DE DATOS
        ======================= */
 
-    auto embeddings = load_fvec(emb_path);
-    auto ids = load_u64(ids_path);
+    async_io::LoadReport io_report;
+    auto embeddings = load_fvec(emb_path, io_report);
+    auto ids = load_u64(ids_path, io_report);
 
     if (embeddings.size() % dim != 0)
         throw std::runtime_error("El archivo embeddings no es múltiplo de dim");
@@ -84,6 +69,7 @@ int main(int argc, char **argv) {
     std::cout << "Dimensión: " << dim << "\n";
     std::cout << "M: " << M << "\n";
     std::cout << "efConstruction: " << efC << "\n";
+    std::cout << "Lectura: " << io_report.describe() << "\n";
 
     MemoryMonitor::print_memory_usage("Datos cargados");
 
@@ -120,8 +106,14 @@ int main(int argc, char **argv) {
        GUARDAR ÍNDICE
        ======================= */
 
-    index.saveIndex(out_path);
-    std::cout << "Índice guardado en: " << out_path << "\n";
+    // Formato con CRC32C por sección, escrito en paralelo (ver index_io.hpp)
+    index_io::SaveOptions save_opt;
+    save_opt.threads = std::max(1u, std::thread::hardware_concurrency());
+    auto image = mapped_index::IndexImage::from_index(index);
+    IndexMeta::make(Metric::L2, dim).stamp(image.header);
+    index_io::SaveReport saved = index_io::save(image, out_path, save_opt);
+    std::cout << "Índice guardado en: " << out_path << " (" << saved.total_s << " s, "
+              << saved.mb_per_s() << " MB/s)\n";
 
     /* =======================
        MÉTRICAS
@@ -137,6 +129,9 @@ int main(int argc, char **argv) {
     summary << "efConstruction," << efC << "\n";
     summary << "build_time_s," << build_time << "\n";
     summary << "throughput_vectors_per_s," << throughput << "\n";
+    summary << "save_time_s," << saved.total_s << "\n";
+    summary << "save_mb_per_s," << saved.mb_per_s() << "\n";
+    io_report.write_csv(summary, "input_io_");
     summary << "peak_rss_mb," << MemoryMonitor::get_peak_rss_mb() << "\n";
     summary.close();
 
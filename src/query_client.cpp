@@ -0,0 +1,237 @@
+#include "../includes/latency_histogram.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/results_io.hpp"
+#include "../includes/server_protocol.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// =================== GENERADOR DE CARGA PARA hnsw_server ===================
+//
+// Abre C conexiones al servidor; cada una envía peticiones de B queries en
+// lazo cerrado (espera la respuesta antes de la siguiente) y mide la
+// latencia extremo a extremo, separando el tiempo que reporta el servidor.
+
+struct RequestSample {
+    uint32_t request_id = 0;
+    uint32_t queries = 0;
+    double latency_ms = 0.0;
+    double server_ms = 0.0;
+    bool ok = false;
+};
+
+// Petición de control (sin carga útil); devuelve el texto de la respuesta
+std::string control_request(const std::string& socket_path, uint16_t op) {
+    int fd = proto::connect_unix(socket_path);
+    proto::RequestHeader h;
+    h.op = op;
+    std::string text;
+    proto::ResponseHeader r;
+    if (proto::write_full(fd, &h, sizeof(h)) && proto::read_full(fd, &r, sizeof(r))) {
+        text.resize(r.payload_bytes);
+        if (r.payload_bytes) proto::read_full(fd, &text[0], text.size());
+    }
+    ::close(fd);
+    return text;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 7) {
+        std::cerr << "Uso:\n"
+                  << argv[0] << " <socket_path> <queries.bin> <dim> <k> <ef> <connections>"
+                  << " [--batch B] [--requests N] [--results out.bin] [--stats] [--shutdown]\n";
+        return 1;
+    }
+
+    std::string socket_path = argv[1];
+    std::string queries_path = argv[2];
+    int dim = std::stoi(argv[3]);
+    uint32_t k = std::stoul(argv[4]);
+    uint32_t ef = std::stoul(argv[5]);
+    int connections = std::max(1, std::stoi(argv[6]));
+
+    size_t batch = 1;
+    size_t num_requests = 0;
+    std::string results_path;
+    bool fetch_stats = false;
+    bool shutdown_server = false;
+    for (int a = 7; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--batch" && a + 1 < argc) {
+            batch = std::max<size_t>(1, std::stoul(argv[++a]));
+        } else if (flag == "--requests" && a + 1 < argc) {
+            num_requests = std::stoul(argv[++a]);
+        } else if (flag == "--results" && a + 1 < argc) {
+            results_path = argv[++a];
+        } else if (flag == "--stats") {
+            fetch_stats = true;
+        } else if (flag == "--shutdown") {
+            shutdown_server = true;
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+
+    MappedDataset query_file(queries_path, dim);
+    size_t nq = query_file.size();
+    if (nq == 0) {
+        std::cerr << "El archivo de queries está vacío: " << queries_path << "\n";
+        return 1;
+    }
+    if (num_requests == 0) num_requests = (nq + batch - 1) / batch;
+
+    std::cout << "=== CLIENTE HNSW ===\n";
+    std::cout << "Socket: " << socket_path << "\n";
+    std::cout << "Queries: " << nq << ", batch: " << batch << ", peticiones: " << num_requests
+              << ", conexiones: " << connections << "\n";
+    std::cout << "k: " << k << ", efSearch: " << ef << "\n";
+
+    // La petición r cubre las queries [r*batch, r*batch + batch) módulo nq
+    std::vector<RequestSample> samples(num_requests);
+    KnnResults results(nq, k);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> failures{0};
+
+    auto worker = [&]() {
+        int fd;
+        try {
+            fd = proto::connect_unix(socket_path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
+            failures++;
+            return;
+        }
+        std::vector<float> payload(batch * dim);
+        std::vector<char> response;
+        while (true) {
+            size_t r = next.fetch_add(1);
+            if (r >= num_requests) break;
+            size_t first = (r * batch) % nq;
+            size_t count = std::min(batch, nq - first);
+            std::copy(query_file.row(first), query_file.row(first) + count * dim, payload.begin());
+
+            proto::RequestHeader h;
+            h.request_id = uint32_t(r);
+            h.k = k;
+            h.ef = ef;
+            h.dim = uint32_t(dim);
+            h.nq = uint32_t(count);
+
+            RequestSample& s = samples[r];
+            s.request_id = uint32_t(r);
+            s.queries = uint32_t(count);
+            auto t0 = std::chrono::steady_clock::now();
+            proto::ResponseHeader resp;
+            bool ok = proto::write_full(fd, &h, sizeof(h)) &&
+                      proto::write_full(fd, payload.data(), count * dim * sizeof(float)) &&
+                      proto::read_full(fd, &resp, sizeof(resp));
+            if (ok) {
+                response.resize(resp.payload_bytes);
+                ok = resp.payload_bytes == 0 || proto::read_full(fd, response.data(), response.size());
+            }
+            auto t1 = std::chrono::steady_clock::now();
+            if (!ok) {
+                failures++;
+                break;
+            }
+            s.latency_ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            s.server_ms = resp.server_ns / 1e6;
+            s.ok = resp.status == proto::STATUS_OK;
+            if (!s.ok) {
+                failures++;
+                continue;
+            }
+            // Las peticiones de la primera pasada rellenan la tabla de resultados
+            if (r * batch < nq) {
+                const uint64_t* ids = reinterpret_cast<const uint64_t*>(response.data());
+                const float* dists = reinterpret_cast<const float*>(ids + count * k);
+                std::copy(ids, ids + count * k, results.row_ids(first));
+                std::copy(dists, dists + count * k, results.row_dists(first));
+            }
+        }
+        ::close(fd);
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < connections; c++) threads.emplace_back(worker);
+    for (auto& th : threads) th.join();
+    auto t1 = std::chrono::steady_clock::now();
+    double total_time = std::chrono::duration<double>(t1 - t0).count();
+
+    // Mismo histograma que el servidor: percentiles comparables entre ambos
+    LatencyHistogram lat, server;
+    size_t queries_done = 0;
+    for (const auto& s : samples) {
+        if (!s.ok) continue;
+        lat.record(uint64_t(std::llround(s.latency_ms * 1e6)));
+        server.record(uint64_t(std::llround(s.server_ms * 1e6)));
+        queries_done += s.queries;
+    }
+    if (lat.count() == 0) {
+        std::cerr << "Ninguna petición completada (" << failures << " fallos)\n";
+        return 1;
+    }
+    double avg = lat.mean_ms();
+    double avg_server = server.mean_ms();
+    double p50 = lat.percentile_ms(0.50);
+    double p95 = lat.percentile_ms(0.95);
+    double p99 = lat.percentile_ms(0.99);
+    double qps = queries_done / total_time;
+
+    std::cout << "\n=== RESULTADOS ===\n";
+    std::cout << "Peticiones completadas: " << lat.count() << " (fallos: " << failures << ")\n";
+    std::cout << "Queries: " << queries_done << "\n";
+    std::cout << "Tiempo total: " << total_time << " s\n";
+    std::cout << "QPS: " << qps << "\n";
+    std::cout << "Latencia por petición promedio: " << avg << " ms (servidor " << avg_server
+              << " ms)\n";
+    std::cout << "P50: " << p50 << " ms\n";
+    std::cout << "P95: " << p95 << " ms\n";
+    std::cout << "P99: " << p99 << " ms\n";
+
+    std::ofstream lf("client_latency.csv");
+    lf << "request_id,queries,latency_ms,server_ms\n";
+    for (const auto& s : samples)
+        if (s.ok) lf << s.request_id << "," << s.queries << "," << s.latency_ms << "," << s.server_ms << "\n";
+    lf.close();
+
+    std::ofstream sf("client_summary_metrics.csv");
+    sf << "metric,value\n";
+    sf << "requests," << lat.count() << "\n";
+    sf << "failures," << failures << "\n";
+    sf << "queries," << queries_done << "\n";
+    sf << "connections," << connections << "\n";
+    sf << "batch," << batch << "\n";
+    sf << "k," << k << "\n";
+    sf << "efSearch," << ef << "\n";
+    sf << "total_time_s," << total_time << "\n";
+    sf << "qps," << qps << "\n";
+    sf << "avg_request_latency_ms," << avg << "\n";
+    sf << "avg_server_time_ms," << avg_server << "\n";
+    sf << "avg_transport_ms," << (avg - avg_server) << "\n";
+    sf << "p50_ms," << p50 << "\n";
+    sf << "p95_ms," << p95 << "\n";
+    sf << "p99_ms," << p99 << "\n";
+    sf.close();
+    std::cout << "\nMétricas guardadas en client_latency.csv y client_summary_metrics.csv\n";
+
+    if (!results_path.empty()) {
+        results.save(results_path);
+        std::cout << "Vecinos guardados en " << results_path << "\n";
+    }
+    if (fetch_stats) std::cout << "\n=== ESTADÍSTICAS DEL SERVIDOR ===\n" << control_request(socket_path, proto::OP_STATS);
+    if (shutdown_server) {
+        control_request(socket_path, proto::OP_SHUTDOWN);
+        std::cout << "Servidor detenido\n";
+    }
+    return 0;
+}
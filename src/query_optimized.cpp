@@ -1,59 +1,124 @@
+#include "../includes/async_loader.hpp"
+#include "../includes/bench_report.hpp"
+#include "../includes/cpu_topology.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/intra_query.hpp"
+#include "../includes/latency_histogram.hpp"
+#include "../includes/mapped_index.hpp"
 #include "../includes/memory_utils.hpp"
+#include "../includes/numa_memory.hpp"
+#include "../includes/open_loop.hpp"
+#include "../includes/perf_counters.hpp"
+#include "../includes/results_io.hpp"
+#include "../includes/search_engine.hpp"
+#include "../includes/search_filter.hpp"
+#include "../includes/simd_distance.hpp"
 #include "hnswlib.h"
 #include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <pthread.h>
+#include <sstream>
 #include <thread>
 #include <vector>
 #include <cstdint>
 
-struct ThreadStats {
+// Una línea de caché por thread: los contadores de threads vecinos no se
+// invalidan entre sí en cada query
+struct alignas(64) ThreadStats {
     size_t queries = 0;
+    int node = -1;    // nodo NUMA donde corrió (-1 si no está fijado)
+    PerfSample perf;  // contadores hardware del worker
 };
 
 class RealQueryOptimizer {
 private:
-    hnswlib::HierarchicalNSW<float>& index;
+    // nullptr cuando se sirve desde un índice mapeado (solo motor por lotes)
+    hnswlib::HierarchicalNSW<float>* index;
+    HnswGraphView graph;
     int dim;
     int num_threads;
+    PinPolicy pin_policy;
+    // Réplicas de la capa 0 por nodo NUMA (vacío = una sola copia)
+    std::vector<int> replica_nodes;
+    std::vector<HnswGraphView> replica_graphs;
+    // Filtro de ids (search_filter.hpp); nullptr = sin filtro
+    const SearchFilter* filter = nullptr;
+    // Normalización de cada query antes de buscar (índices ip); nullptr = cruda
+    NormalizeFn normalize = nullptr;
+    // Lectura de queries e ids (async_loader.hpp) y lo leído hasta ahora
+    async_io::LoadOptions io_options;
+    async_io::LoadReport io_report;
+
+    // Fija el worker y devuelve su nodo NUMA. Con réplicas y sin pinning
+    // por CPU, el worker se fija al nodo de la réplica que le toca.
+    int pin_worker(int tid, PinPolicy policy) const {
+        int cpu = pin_cpu(tid, policy);
+        if (cpu >= 0) {
+            const LogicalCpu* c = CpuTopology::get().find(cpu);
+            return c ? c->node : -1;
+        }
+        if (replica_nodes.empty()) return -1;
+        return CpuTopology::get().pin_thread_to_node(replica_nodes[tid % replica_nodes.size()]);
+    }
+
+    const HnswGraphView& graph_for_node(int node) const {
+        for (size_t i = 0; i < replica_nodes.size(); i++)
+            if (replica_nodes[i] == node) return replica_graphs[i];
+        return replica_graphs.empty() ? graph : replica_graphs[0];
+    }
 
 public:
-    RealQueryOptimizer(hnswlib::HierarchicalNSW<float>& idx, int d, int t)
-        : index(idx), dim(d), num_threads(t) {}
+    RealQueryOptimizer(hnswlib::HierarchicalNSW<float>& idx, int d, int t,
+                       PinPolicy pin = PinPolicy::Compact)
+        : index(&idx), graph(HnswGraphView::from(idx)), dim(d), num_threads(t), pin_policy(pin) {}
 
-    std::vector<float> load_queries(const std::string& file) {
-        std::ifstream f(file, std::ios::binary | std::ios::ate);
-        if (!f) throw std::runtime_error("No se puede abrir queries.bin");
+    RealQueryOptimizer(const HnswGraphView& g, int d, int t, PinPolicy pin = PinPolicy::Compact)
+        : index(nullptr), graph(g), dim(d), num_threads(t), pin_policy(pin) {}
 
-        size_t size = f.tellg();
-        f.seekg(0);
+    bool has_hnswlib_index() const { return index != nullptr; }
 
-        std::vector<float> q(size / sizeof(float));
-        f.read(reinterpret_cast<char*>(q.data()), size);
-        return q;
-    }
+    const HnswGraphView& view() const { return graph; }
 
-    std::vector<uint64_t> load_query_ids(const std::string& file) {
-        std::ifstream f(file, std::ios::binary | std::ios::ate);
-        if (!f) throw std::runtime_error("No se puede abrir query_ids.bin");
+    void set_filter(const SearchFilter* f) { filter = f; }
 
-        size_t size = f.tellg();
-        f.seekg(0);
+    void set_query_normalizer(NormalizeFn fn) { normalize = fn; }
+
+    void set_io_options(const async_io::LoadOptions& o) { io_options = o; }
+    const async_io::LoadReport& load_report() const { return io_report; }
+
+    // Sirve la capa 0 desde la memoria colocada (numa_memory.hpp); con
+    // replicate cada worker (o equipo, en --intra) usa la copia de su nodo
+    void place(const IndexMemory& memory, bool replicate) {
+        graph.level0 = memory.primary();
+        replica_nodes.clear();
+        replica_graphs.clear();
+        if (!replicate) return;
+        for (int node : memory.nodes()) {
+            HnswGraphView g = graph;
+            g.level0 = memory.replica_for_node(node);
+            replica_nodes.push_back(node);
+            replica_graphs.push_back(g);
+        }
+    }
+
+    std::vector<float> load_queries(const std::string& file) {
+        return async_io::load_array<float>(file, io_options, &io_report);
+    }
 
-        std::vector<uint64_t> ids(size / sizeof(uint64_t));
-        f.read(reinterpret_cast<char*>(ids.data()), size);
-        return ids;
+    std::vector<uint64_t> load_query_ids(const std::string& file) {
+        return async_io::load_array<uint64_t>(file, io_options, &io_report);
     }
 
-    static void pin_cpu(int id) {
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        CPU_SET(id % std::thread::hardware_concurrency(), &cpuset);
-        pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+    // Núcleos físicos primero y hermanos SMT al final (ver cpu_topology.hpp)
+    static int pin_cpu(int id, PinPolicy policy = PinPolicy::Compact) {
+        return CpuTopology::get().pin_thread(id, policy);
     }
 
     void run(
@@ -63,51 +128,237 @@ public:
         int ef,
         std::vector<double>& latencies,
         std::vector<uint64_t>& processed_ids,
-        std::vector<ThreadStats>& stats
+        std::vector<ThreadStats>& stats,
+        KnnResults& results,
+        LatencyHistogram& histogram
     ) {
-        index.setEf(ef);
+        index->setEf(ef);
         size_t n = std::min(queries.size() / dim, query_ids.size());
         latencies.resize(n);
         processed_ids.resize(n);
         stats.resize(num_threads);
+        results.resize(n, k);
 
         std::atomic<size_t> counter{0};
         std::vector<std::thread> threads;
+        // Un histograma por thread (sin sincronización), fusionados al final
+        std::vector<LatencyHistogram> per_thread(num_threads);
 
         auto worker = [&](int tid) {
-            pin_cpu(tid);
+            stats[tid].node = pin_worker(tid, pin_policy);
+            PerfCounters counters;
+            PerfSample perf0 = counters.read();
+            LatencyHistogram& hist = per_thread[tid];
+            // Con filtro, el filtrado por label propio de hnswlib
+            std::unique_ptr<LabelSetFunctor> allowed;
+            if (filter) allowed.reset(new LabelSetFunctor(filter->label_set()));
+            std::vector<float> normalized(normalize ? dim : 0);
             while (true) {
                 size_t i = counter.fetch_add(1);
                 if (i >= n) break;
 
                 auto t0 = std::chrono::high_resolution_clock::now();
-                auto res = index.searchKnn(queries.data() + i * dim, k);
-                while (!res.empty()) res.pop();
+                const float* query = queries.data() + i * dim;
+                if (normalize) {
+                    normalize(query, normalized.data(), dim);
+                    query = normalized.data();
+                }
+                auto res = index->searchKnn(query, k, allowed.get());
                 auto t1 = std::chrono::high_resolution_clock::now();
+                results.store(i, res);
 
-                latencies[i] =
-                    std::chrono::duration<double, std::milli>(t1 - t0).count();
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+                hist.record(ns);
+                latencies[i] = ns / 1e6;
                 processed_ids[i] = query_ids[i];
                 stats[tid].queries++;
             }
+            stats[tid].perf = counters.since(perf0);
         };
 
         for (int i = 0; i < num_threads; i++)
             threads.emplace_back(worker, i);
         for (auto& t : threads) t.join();
+        histogram.reset();
+        for (const auto& h : per_thread) histogram.merge(h);
+    }
+
+    // Igual que run() pero con el motor por lotes: cada worker reclama
+    // batch_size queries y reutiliza sus visitados/heaps. Los vecinos
+    // quedan en results (n*k) en vez de descartarse. exhaustive fuerza el
+    // recorrido de la lista del filtro (resultado exacto filtrado).
+    void run_batch(
+        const std::vector<float>& queries,
+        const std::vector<uint64_t>& query_ids,
+        int k,
+        int ef,
+        size_t batch_size,
+        std::vector<double>& latencies,
+        std::vector<uint64_t>& processed_ids,
+        std::vector<ThreadStats>& stats,
+        KnnResults& results,
+        LatencyHistogram& histogram,
+        bool exhaustive = false
+    ) {
+        size_t n = std::min(queries.size() / dim, query_ids.size());
+        latencies.resize(n);
+        processed_ids.assign(query_ids.begin(), query_ids.begin() + n);
+        results.resize(n, k);
+
+        BatchSearcher searcher(graph, num_threads, batch_size);
+        if (filter) searcher.use_filter(filter->batch(exhaustive));
+        if (normalize) searcher.use_query_normalizer(normalize, dim);
+        PinPolicy policy = pin_policy;
+        // Cada worker abre sus contadores al arrancar y los lee al terminar
+        std::vector<std::unique_ptr<PerfCounters>> counters(num_threads);
+        std::vector<PerfSample> perf0(num_threads);
+        stats.assign(num_threads, ThreadStats{});
+        searcher.on_thread_start([&, policy](int tid) {
+            stats[tid].node = pin_worker(tid, policy);
+            if (!replica_graphs.empty()) searcher.use_graph(tid, graph_for_node(stats[tid].node));
+            counters[tid].reset(new PerfCounters());
+            perf0[tid] = counters[tid]->read();
+        });
+        searcher.on_thread_exit([&](int tid) { stats[tid].perf = counters[tid]->since(perf0[tid]); });
+        BatchSearchStats bs = searcher.searchBatch(queries.data(), n, dim, k, ef,
+                                                   results.ids.data(), results.dists.data(),
+                                                   latencies.data());
+        for (int t = 0; t < num_threads; t++) stats[t].queries = bs.per_thread_queries[t];
+        histogram = bs.latency;
+    }
+
+    // Modo de baja latencia: equipos de threads_per_query threads, cada
+    // equipo resuelve una query a la vez (intra_query.hpp). Usa los mismos
+    // num_threads núcleos que run_batch.
+    void run_intra(
+        const std::vector<float>& queries,
+        size_t n,
+        int k,
+        int ef,
+        int threads_per_query,
+        std::vector<double>& latencies,
+        std::vector<ThreadStats>& stats,
+        KnnResults& results,
+        LatencyHistogram& histogram
+    ) {
+        n = std::min(n, queries.size() / dim);
+        latencies.resize(n);
+        results.resize(n, k);
+
+        IntraQuerySearcher searcher(graph, threads_per_query, num_threads / threads_per_query);
+        if (normalize) searcher.use_query_normalizer(normalize, dim);
+        PinPolicy policy = pin_policy;
+        std::vector<std::unique_ptr<PerfCounters>> counters(searcher.threads());
+        std::vector<PerfSample> perf0(searcher.threads());
+        stats.assign(searcher.threads(), ThreadStats{});
+        searcher.on_thread_start([&, policy, threads_per_query](int tid) {
+            stats[tid].node = pin_worker(tid, policy);
+            // Cada equipo busca en la réplica del nodo de su líder
+            if (!replica_graphs.empty() && tid % threads_per_query == 0)
+                searcher.use_graph(tid / threads_per_query, graph_for_node(stats[tid].node));
+            counters[tid].reset(new PerfCounters());
+            perf0[tid] = counters[tid]->read();
+        });
+        searcher.on_thread_exit([&](int tid) { stats[tid].perf = counters[tid]->since(perf0[tid]); });
+        BatchSearchStats bs = searcher.searchBatch(queries.data(), n, dim, k, ef,
+                                                   results.ids.data(), results.dists.data(),
+                                                   latencies.data());
+        for (int t = 0; t < searcher.threads(); t++) stats[t].queries = bs.per_thread_queries[t];
+        histogram = bs.latency;
+    }
+
+    // Barrido en lazo abierto (open_loop.hpp): un punto por tasa ofrecida,
+    // en orden, hasta el primero que satura. Latencias desde el envío previsto.
+    std::vector<LoadPoint> run_open_loop(
+        const std::vector<float>& queries,
+        size_t n,
+        int k,
+        int ef,
+        const std::vector<double>& rates,
+        double duration_s,
+        ArrivalProcess arrival
+    ) {
+        n = std::min(n, queries.size() / dim);
+        OpenLoopRunner runner(graph, num_threads);
+        if (normalize) runner.use_query_normalizer(normalize, dim);
+        PinPolicy policy = pin_policy;
+        runner.on_thread_start([this, &runner, policy](int tid) {
+            int node = pin_worker(tid, policy);
+            if (!replica_graphs.empty()) runner.use_graph(tid, graph_for_node(node));
+        });
+        std::vector<LoadPoint> curve;
+        for (size_t i = 0; i < rates.size(); i++) {
+            curve.push_back(runner.run(queries.data(), n, dim, k, ef, rates[i], duration_s, arrival, 42 + i));
+            const LoadPoint& p = curve.back();
+            std::cout << "  ofrecidas " << p.offered_qps << " QPS -> " << p.achieved_qps
+                      << " QPS, p50 " << p.latency.percentile_ms(0.50) << " ms, p99 "
+                      << p.latency.percentile_ms(0.99) << " ms (servicio p99 "
+                      << p.service.percentile_ms(0.99) << " ms)"
+                      << (p.saturated ? "  SATURADO" : "") << "\n";
+            if (p.saturated) break;
+        }
+        return curve;
     }
 };
 
+// "auto" = fracciones 0.1..1.2 de la capacidad medida en lazo cerrado;
+// si no, lista de tasas en QPS separadas por comas
+std::vector<double> parse_rates(const std::string& spec, double closed_loop_qps) {
+    std::vector<double> rates;
+    if (spec == "auto") {
+        for (int i = 1; i <= 12; i++) rates.push_back(closed_loop_qps * i / 10.0);
+        return rates;
+    }
+    std::stringstream ss(spec);
+    std::string part;
+    while (std::getline(ss, part, ','))
+        if (!part.empty()) rates.push_back(std::stod(part));
+    if (rates.empty() || !std::is_sorted(rates.begin(), rates.end()) || rates.front() <= 0.0)
+        throw std::runtime_error("--rates espera tasas positivas en orden creciente: " + spec);
+    return rates;
+}
+
 int main(int argc, char** argv) {
     if (argc < 8) {
         std::cerr << "Uso:\n"
                   << argv[0]
-                  << " <index.bin> <queries.bin> <query_ids.bin> <dim> <k> <ef> <threads>\n";
+                  << " <index.bin> <queries.bin> <query_ids.bin> <dim> <k> <ef> <threads>"
+                  << " [--batch B] [--pin compact|spread|none] [--results out.bin] [--gt gt.bin]"
+                  << " [--populate] [--hugepages] [--verify]"
+                  << " [--pages none|thp|hugetlb] [--numa default|interleave|replicate]"
+                  << " [--filter-ids allow.bin] [--filter-range LO HI]"
+                  << " [--filter-attr attrs.bin ids.bin LO HI] [--filter-mode auto|graph|brute]"
+                  << " [--intra T] [--io auto|uring|pread] [--io-direct]"
+                  << " [--open-loop fixed|poisson] [--rates auto|R1,R2,...] [--load-duration S]"
+                  << " [--report prefijo] [--tag nombre]\n";
+        std::cerr << "\n  --pages  Copia la capa 0 a una región con páginas de 2 MB (thp o hugetlb)\n"
+                  << "  --numa   interleave reparte la capa 0 entre nodos; replicate hace una\n"
+                  << "           copia por nodo y cada worker usa la de su nodo (motor por lotes)\n"
+                  << "  --filter-ids    Solo labels de la lista (uint64, formato de ids.bin)\n"
+                  << "  --filter-range  Solo labels en [LO, HI]\n"
+                  << "  --filter-attr   Solo filas con LO <= atributo <= HI (int32 por fila de ids.bin)\n"
+                  << "  --filter-mode   auto elige grafo o recorrido exhaustivo según la selectividad\n"
+                  << "  --intra T  Además del motor por lotes, resuelve cada query con T threads\n"
+                  << "             (threads/T queries a la vez) y compara la latencia de cola\n"
+                  << "  --io       Lectura de queries e ids: io_uring si está disponible (auto)\n"
+                  << "             o pread(); --io-direct lee con O_DIRECT\n"
+                  << "  --open-loop  Además, barre la carga ofrecida con llegadas a intervalo fijo o\n"
+                  << "               Poisson hasta saturar; latencia medida desde el envío previsto\n"
+                  << "  --rates      QPS ofrecidas por punto (auto = 10%..120% del lazo cerrado)\n"
+                  << "  --load-duration  Segundos de llegadas por punto (2 por defecto)\n"
+                  << "  --report   Prefijo de las salidas (improved_query): <prefijo>.json con\n"
+                  << "             entorno, configuración, métricas y tablas por hilo / lazo abierto,\n"
+                  << "             <prefijo>_summary.csv (comparable con hnsw_bench compare) y\n"
+                  << "             <prefijo>_latencies.csv\n"
+                  << "  --tag      Nombre del escenario en el resumen (query)\n";
         std::cerr << "\nEjemplo:\n"
-                  << argv[0] << " indice.bin queries.bin query_ids.bin 128 10 200 12\n";
+                  << argv[0] << " indice.bin queries.bin query_ids.bin 128 10 200 12 --batch 32\n";
         return 1;
     }
 
+    // Antes de crear cualquier hilo: los workers heredan los contadores
+    PerfCounters& perf = process_perf_counters();
+
     std::string index_file = argv[1];
     std::string queries_file = argv[2];
     std::string query_ids_file = argv[3];
@@ -116,6 +367,89 @@ int main(int argc, char** argv) {
     int ef = std::stoi(argv[6]);
     int threads = std::stoi(argv[7]);
 
+    // 0 = bucle clásico (una query por fetch_add con searchKnn)
+    size_t batch_size = 0;
+    PinPolicy pin = PinPolicy::Compact;
+    std::string results_file, gt_file;
+    MappedIndex::Options map_opt;
+    IndexMemoryOptions mem_opt;
+    FilterSpec filter_spec;
+    int intra = 0;  // threads por query en el modo de baja latencia (0 = apagado)
+    bool open_loop = false;
+    ArrivalProcess arrival = ArrivalProcess::Fixed;
+    std::string rates_spec = "auto";
+    double load_duration = 2.0;
+    async_io::LoadOptions io_opt;
+    std::string report_prefix = "improved_query", tag = "query";
+    for (int a = 8; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--batch" && a + 1 < argc) {
+            batch_size = std::stoul(argv[++a]);
+        } else if (flag == "--pin" && a + 1 < argc) {
+            pin = parse_pin_policy(argv[++a]);
+        } else if (flag == "--results" && a + 1 < argc) {
+            results_file = argv[++a];
+        } else if (flag == "--gt" && a + 1 < argc) {
+            gt_file = argv[++a];
+        } else if (flag == "--populate") {
+            map_opt.populate = true;
+        } else if (flag == "--hugepages") {
+            map_opt.hugepages = true;
+        } else if (flag == "--verify") {
+            map_opt.verify = true;
+        } else if (flag == "--pages" && a + 1 < argc) {
+            mem_opt.pages = parse_huge_page_mode(argv[++a]);
+        } else if (flag == "--numa" && a + 1 < argc) {
+            mem_opt.numa = parse_numa_placement(argv[++a]);
+        } else if (flag == "--filter-ids" && a + 1 < argc) {
+            filter_spec.allow_file = argv[++a];
+        } else if (flag == "--filter-range" && a + 2 < argc) {
+            filter_spec.has_range = true;
+            filter_spec.range_lo = std::stoull(argv[++a]);
+            filter_spec.range_hi = std::stoull(argv[++a]);
+        } else if (flag == "--filter-attr" && a + 4 < argc) {
+            filter_spec.attr_file = argv[++a];
+            filter_spec.attr_ids_file = argv[++a];
+            filter_spec.attr_lo = std::stoi(argv[++a]);
+            filter_spec.attr_hi = std::stoi(argv[++a]);
+        } else if (flag == "--filter-mode" && a + 1 < argc) {
+            filter_spec.mode = parse_filter_mode(argv[++a]);
+        } else if (flag == "--intra" && a + 1 < argc) {
+            intra = std::stoi(argv[++a]);
+        } else if (flag == "--io" && a + 1 < argc) {
+            io_opt.backend = async_io::parse_backend(argv[++a]);
+        } else if (flag == "--io-direct") {
+            io_opt.direct = true;
+        } else if (flag == "--open-loop" && a + 1 < argc) {
+            open_loop = true;
+            arrival = parse_arrival_process(argv[++a]);
+        } else if (flag == "--rates" && a + 1 < argc) {
+            rates_spec = argv[++a];
+        } else if (flag == "--load-duration" && a + 1 < argc) {
+            load_duration = std::stod(argv[++a]);
+        } else if (flag == "--report" && a + 1 < argc) {
+            report_prefix = argv[++a];
+        } else if (flag == "--tag" && a + 1 < argc) {
+            tag = argv[++a];
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    // La comparación es a igual número de núcleos: threads/intra equipos
+    if (intra > 0 && (intra > threads || threads % intra != 0)) {
+        std::cerr << "--intra debe dividir el número de threads (" << threads << ")\n";
+        return 1;
+    }
+    if (intra > 0 && filter_spec.active()) {
+        std::cerr << "--intra no admite filtros\n";
+        return 1;
+    }
+    if (open_loop && filter_spec.active()) {
+        std::cerr << "--open-loop no admite filtros\n";
+        return 1;
+    }
+
     std::cout << "=== CONFIGURACIÓN MEJORADA ===\n";
     std::cout << "Índice: " << index_file << "\n";
     std::cout << "Queries: " << queries_file << "\n";
@@ -125,21 +459,107 @@ int main(int argc, char** argv) {
     std::cout << "efSearch: " << ef << "\n";
     std::cout << "Threads: " << threads << "\n";
 
+    // El formato mapeable (hnsw_convert) solo se sirve con el motor por lotes
+    bool mapped_format = mapped_index::is_mapped_format(index_file);
+    // Igual con réplicas NUMA: searchKnn solo conoce una copia de la capa 0
+    bool replicate = mem_opt.numa == NumaPlacement::Replicate;
+    // Y con filtro: el recorrido exhaustivo solo existe en el motor por
+    // lotes; el bucle clásico queda como referencia con el filtro de hnswlib
+    bool filtered = filter_spec.active();
+    // Con --intra la línea base es el motor por lotes (un thread por query)
+    if ((mapped_format || replicate || filtered || intra > 0) && batch_size == 0) batch_size = 16;
+    if (batch_size > 0) std::cout << "Modo: lotes de " << batch_size << " queries\n";
+    std::cout << "Topología: " << CpuTopology::get().summary() << ", pinning "
+              << pin_policy_name(pin) << "\n";
+    std::cout << "Contadores hardware: " << perf.status() << "\n";
+
     MemoryMonitor::print_memory_usage("Inicio");
 
+    // Métrica y preprocesado según los metadatos del índice (index_meta.hpp)
+    IndexMeta meta = IndexMeta::read(index_file);
+    std::cout << "Metadatos del índice: " << meta.describe() << "\n";
+    meta.check_dim(dim);
+    if (meta.storage != VectorStorage::FP32) {
+        std::cerr << "Índice " << storage_name(meta.storage) << ": usar hnsw_query_quantized\n";
+        return 1;
+    }
+
     // Cargar índice
     std::cout << "\nCargando índice...\n";
-    hnswlib::L2Space space(dim);
-    hnswlib::HierarchicalNSW<float> index(&space, index_file);
+    SimdSpace space(meta.metric, dim);
+    std::cout << "Kernel de distancia: " << space.description() << "\n";
+    std::unique_ptr<hnswlib::HierarchicalNSW<float>> index;
+    std::unique_ptr<MappedIndex> mapped;
+    PerfSample perf_mark = perf.read();
+    auto tl0 = std::chrono::high_resolution_clock::now();
+    if (mapped_format) {
+        mapped.reset(new MappedIndex(index_file, &space, map_opt));
+    } else {
+        index = index_io::load(&space, index_file);
+    }
+    auto tl1 = std::chrono::high_resolution_clock::now();
+    double load_time = std::chrono::duration<double>(tl1 - tl0).count();
+    PerfSample load_perf = perf.since(perf_mark);
+    std::cout << "Índice " << (mapped_format ? "mapeado" : "cargado") << " en " << load_time
+              << " s\n";
+
+    // Capa 0 en huge pages / colocación NUMA. El guard se declara después
+    // del índice para soltar la región antes de que hnswlib lo destruya.
+    std::unique_ptr<Level0Guard> level0_guard;
+    std::unique_ptr<IndexMemory> mapped_memory;
+    const IndexMemory* index_memory = nullptr;
+    double placement_time = 0.0;
+    if (mem_opt.active()) {
+        auto tp0 = std::chrono::high_resolution_clock::now();
+        if (index) {
+            level0_guard.reset(new Level0Guard(*index, mem_opt));
+            index_memory = &level0_guard->memory();
+        } else {
+            HnswGraphView v = mapped->view();
+            size_t bytes = v.count * v.size_data_per_element;
+            mapped_memory.reset(new IndexMemory(v.level0, bytes, bytes, mem_opt));
+            index_memory = mapped_memory.get();
+        }
+        placement_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tp0).count();
+        std::cout << "Memoria de la capa 0: " << index_memory->describe() << ", "
+                  << (index_memory->huge_bytes() >> 20) << " MB en huge pages ("
+                  << placement_time << " s)\n";
+    }
 
     // Crear optimizador y cargar datos
-    RealQueryOptimizer opt(index, dim, threads);
+    RealQueryOptimizer opt = mapped ? RealQueryOptimizer(mapped->view(), dim, threads, pin)
+                                    : RealQueryOptimizer(*index, dim, threads, pin);
+    if (index_memory) opt.place(*index_memory, replicate);
+    opt.set_io_options(io_opt);
+    if (meta.normalized) {
+        opt.set_query_normalizer(space.normalizer());
+        std::cout << "Queries normalizadas al buscar (" << CpuFeatures::name(space.level()) << ")\n";
+    }
+
+    // Filtro compilado a bitmap de ids internos
+    SearchFilter filter;
+    double filter_time = 0.0;
+    if (filtered) {
+        auto tf0 = std::chrono::high_resolution_clock::now();
+        filter = SearchFilter::build(filter_spec, opt.view(), ef);
+        filter_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tf0).count();
+        opt.set_filter(&filter);
+        std::cout << "Filtro: " << filter_spec.describe() << "\n";
+        std::cout << "  " << filter.allowed() << " nodos permitidos (selectividad "
+                  << filter.selectivity() * 100.0 << "%), " << (filter.bytes() >> 10)
+                  << " KB, compilado en " << filter_time << " s\n";
+        std::cout << "  Estrategia: "
+                  << (filter.use_brute_force() ? "recorrido exhaustivo de los permitidos"
+                                               : "filtro dentro del recorrido del grafo")
+                  << "\n";
+    }
     
     std::cout << "Cargando queries...\n";
     auto queries = opt.load_queries(queries_file);
     
     std::cout << "Cargando IDs de queries...\n";
     auto query_ids = opt.load_query_ids(query_ids_file);
+    std::cout << "Lectura: " << opt.load_report().describe() << "\n";
 
     MemoryMonitor::print_memory_usage("Datos cargados");
 
@@ -167,80 +587,245 @@ int main(int argc, char** argv) {
     std::vector<uint64_t> processed_ids;
     std::vector<ThreadStats> thread_stats;
 
+    KnnResults results;
+    LatencyHistogram histogram;
+
+    PerfSample query_perf;
     auto t0 = std::chrono::high_resolution_clock::now();
-    opt.run(queries, query_ids, k, ef, latencies, processed_ids, thread_stats);
-    auto t1 = std::chrono::high_resolution_clock::now();
+    auto t1 = t0;
+    double total_time = 0.0;
+    double single_qps = 0.0;
+    if (opt.has_hnswlib_index()) {
+        perf_mark = perf.read();
+        opt.run(queries, query_ids, k, ef, latencies, processed_ids, thread_stats, results,
+                histogram);
+        t1 = std::chrono::high_resolution_clock::now();
+        total_time = std::chrono::duration<double>(t1 - t0).count();
+        single_qps = latencies.size() / total_time;
+        query_perf = perf.since(perf_mark);
+    }
 
-    double total_time = std::chrono::duration<double>(t1 - t0).count();
+    // Con --batch el bucle clásico queda como línea base y las métricas
+    // principales salen del motor por lotes
+    if (batch_size > 0) {
+        if (single_qps > 0) std::cout << "Bucle clásico: " << single_qps << " QPS\n";
+        std::cout << "Ejecutando motor por lotes (batch=" << batch_size << ")...\n";
+        perf_mark = perf.read();
+        t0 = std::chrono::high_resolution_clock::now();
+        opt.run_batch(queries, query_ids, k, ef, batch_size, latencies, processed_ids,
+                      thread_stats, results, histogram);
+        t1 = std::chrono::high_resolution_clock::now();
+        total_time = std::chrono::duration<double>(t1 - t0).count();
+        query_perf = perf.since(perf_mark);
+    }
 
-    // Métricas
-    double avg = std::accumulate(latencies.begin(), latencies.end(), 0.0) / latencies.size();
-    std::sort(latencies.begin(), latencies.end());
-    double p50 = latencies[latencies.size() * 0.50];
-    double p95 = latencies[latencies.size() * 0.95];
-    double p99 = latencies[latencies.size() * 0.99];
+    // Métricas (percentiles del histograma; latencies queda en orden de query)
     double qps = latencies.size() / total_time;
 
+    // Calidad frente al ground truth exacto (hnsw_groundtruth). Con filtro
+    // la referencia es el recorrido exhaustivo de los permitidos, que es
+    // exacto dentro del subconjunto; gt.bin no está filtrado.
+    RecallReport recall;
+    if (filtered) {
+        if (!gt_file.empty())
+            std::cout << "ADVERTENCIA: con filtro se ignora " << gt_file
+                      << "; el recall se mide contra la búsqueda exacta filtrada\n";
+        KnnResults exact;
+        std::vector<double> exact_lat;
+        std::vector<uint64_t> exact_ids;
+        std::vector<ThreadStats> exact_stats;
+        LatencyHistogram exact_hist;
+        opt.run_batch(queries, query_ids, k, ef, batch_size, exact_lat, exact_ids, exact_stats,
+                      exact, exact_hist, true);
+        recall = RecallReport::compute(results, exact, k);
+    } else if (!gt_file.empty()) {
+        KnnResults gt = KnnResults::load(gt_file);
+        if (gt.n < results.n)
+            std::cout << "ADVERTENCIA: el ground truth solo cubre " << gt.n << " queries\n";
+        recall = RecallReport::compute(results, gt, k);
+    }
+
+    // Modo de baja latencia con los mismos núcleos
+    KnnResults intra_results;
+    LatencyHistogram intra_histogram;
+    RecallReport intra_recall;
+    std::vector<ThreadStats> intra_stats;
+    double intra_time = 0.0;
+    if (intra > 0) {
+        std::cout << "Ejecutando " << intra << " threads por query (" << threads / intra
+                  << " queries a la vez)...\n";
+        std::vector<double> intra_latencies;
+        auto ti0 = std::chrono::high_resolution_clock::now();
+        opt.run_intra(queries, latencies.size(), k, ef, intra, intra_latencies, intra_stats,
+                      intra_results, intra_histogram);
+        intra_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - ti0).count();
+        if (!gt_file.empty())
+            intra_recall = RecallReport::compute(intra_results, KnnResults::load(gt_file), k);
+    }
+
+    // Curva latencia / throughput en lazo abierto con los mismos threads
+    std::vector<LoadPoint> curve;
+    if (open_loop) {
+        std::vector<double> rates = parse_rates(rates_spec, latencies.size() / total_time);
+        std::cout << "\n=== LAZO ABIERTO (" << arrival_process_name(arrival) << ", "
+                  << load_duration << " s por punto) ===\n";
+        curve = opt.run_open_loop(queries, latencies.size(), k, ef, rates, load_duration, arrival);
+    }
+
     // Resultados
     std::cout << "\n=== RESULTADOS ===\n";
     std::cout << "Queries procesadas: " << latencies.size() << "\n";
     std::cout << "Threads utilizados: " << threads << "\n";
     std::cout << "Tiempo total: " << total_time << " s\n";
     std::cout << "QPS (consultas por segundo): " << qps << "\n";
-    std::cout << "Latencia promedio: " << avg << " ms\n";
-    std::cout << "P50 (mediana): " << p50 << " ms\n";
-    std::cout << "P95: " << p95 << " ms\n";
-    std::cout << "P99: " << p99 << " ms\n";
+    histogram.print(std::cout);
+    recall.print(std::cout);
+    if (filtered)
+        std::cout << "Filtro: " << filter.allowed() << " permitidos, "
+                  << (filter.use_brute_force() ? "exhaustivo" : "grafo") << "\n";
+    std::cout << "Contadores (queries): " << query_perf.describe() << "\n";
+    if (batch_size > 0 && single_qps > 0) {
+        std::cout << "QPS bucle clásico: " << single_qps << "\n";
+        std::cout << "Speedup por lotes: " << (qps / single_qps) << "x\n";
+    }
+    if (intra > 0) {
+        double intra_qps = intra_histogram.count() / intra_time;
+        std::cout << "\n=== " << intra << " THREADS POR QUERY (" << threads << " núcleos) ===\n";
+        std::cout << "QPS: " << intra_qps << " (un thread por query: " << qps << ")\n";
+        intra_histogram.print(std::cout);
+        intra_recall.print(std::cout);
+        std::cout << "P99 un thread por query: " << histogram.percentile_ms(0.99) << " ms, "
+                  << intra << " por query: " << intra_histogram.percentile_ms(0.99) << " ms ("
+                  << histogram.percentile_ms(0.99) / intra_histogram.percentile_ms(0.99)
+                  << "x)\n";
+        std::cout << "Coincidencia con un thread por query (@" << k << "): "
+                  << recall_at(intra_results, results, k) << "\n";
+    }
     
+    // El mayor punto sin saturar es la capacidad utilizable a esa latencia
+    const LoadPoint* sustained = nullptr;
+    for (const auto& p : curve)
+        if (!p.saturated) sustained = &p;
+    if (open_loop) {
+        std::cout << "\n=== LAZO ABIERTO ===\n";
+        if (sustained)
+            std::cout << "Mayor carga sostenida: " << sustained->achieved_qps << " QPS con p99 "
+                      << sustained->latency.percentile_ms(0.99) << " ms (lazo cerrado: " << qps
+                      << " QPS, p99 " << histogram.percentile_ms(0.99) << " ms)\n";
+        else
+            std::cout << "Saturado ya en el primer punto (" << curve.front().offered_qps << " QPS)\n";
+    }
+
     // Distribución por thread
     std::cout << "\n=== DISTRIBUCIÓN POR THREAD ===\n";
     for (size_t i = 0; i < thread_stats.size(); i++) {
         std::cout << "Thread " << i << ": " << thread_stats[i].queries 
                   << " queries (" 
                   << (thread_stats[i].queries * 100.0 / latencies.size()) 
-                  << "%)\n";
+                  << "%)";
+        if (thread_stats[i].node >= 0) std::cout << ", nodo " << thread_stats[i].node;
+        if (thread_stats[i].perf.ipc() > 0) std::cout << ", IPC " << thread_stats[i].perf.ipc();
+        std::cout << "\n";
     }
 
     // Guardar resultados
     std::cout << "\n=== GUARDANDO RESULTADOS ===\n";
     
     // 1. Latencias con IDs reales
-    std::ofstream qf("improved_query_metrics.csv");
+    std::ofstream qf(report_prefix + "_latencies.csv");
     qf << "query_id,latency_ms\n";
     for (size_t i = 0; i < latencies.size(); i++) {
         qf << processed_ids[i] << "," << latencies[i] << "\n";
     }
     qf.close();
-    std::cout << "1. improved_query_metrics.csv - Latencias con IDs\n";
-    
-    // 2. Stats por hilo
-    std::ofstream tf("thread_stats.csv");
-    tf << "thread,queries,percentage\n";
-    for (size_t i = 0; i < thread_stats.size(); i++) {
-        double percentage = (thread_stats[i].queries * 100.0) / latencies.size();
-        tf << i << "," << thread_stats[i].queries << "," << percentage << "\n";
-    }
-    tf.close();
-    std::cout << "2. thread_stats.csv - Distribución por thread\n";
-
-    // 3. Resumen de métricas
-    std::ofstream sf("improved_summary_metrics.csv");
-    sf << "metric,value\n";
-    sf << "queries," << latencies.size() << "\n";
-    sf << "threads," << threads << "\n";
-    sf << "dimension," << dim << "\n";
-    sf << "k," << k << "\n";
-    sf << "efSearch," << ef << "\n";
+    std::cout << "1. " << report_prefix << "_latencies.csv - Latencias con IDs\n";
+
+    // 2. Reporte: configuración y métricas en el formato de hnsw_bench
+    bench::RunReport report("hnsw_query_optimized", tag);
+    report.config("index", index_file);
+    report.config("queries", latencies.size());
+    report.config("threads", threads);
+    report.config("dimension", dim);
+    report.config("metric", metric_name(meta.metric));
+    report.config("normalized_queries", meta.normalized ? 1 : 0);
+    report.config("k", k);
+    report.config("efSearch", ef);
+    report.config("batch_size", batch_size);
+    report.config("numa_nodes", CpuTopology::get().num_nodes());
+    report.config("perf_available", perf.available() ? 1 : 0);
+    std::ostream& sf = report.rows();
     sf << "total_time_s," << total_time << "\n";
     sf << "qps," << qps << "\n";
-    sf << "avg_latency_ms," << avg << "\n";
+    recall.write_csv(sf);
+    histogram.write_csv(sf);
     sf << "real_avg_latency_ms," << (total_time * 1000.0 / latencies.size()) << "\n";
-    sf << "p50_ms," << p50 << "\n";
-    sf << "p95_ms," << p95 << "\n";
-    sf << "p99_ms," << p99 << "\n";
+    sf << "index_format," << (mapped_format ? "mapped" : "hnswlib") << "\n";
+    sf << "index_load_s," << load_time << "\n";
+    sf << "index_memory," << mem_opt.describe() << "\n";
+    if (index_memory) {
+        report.config("index_memory_replicas", index_memory->replicas());
+        sf << "index_memory_mb," << (index_memory->mapped_bytes() >> 20) << "\n";
+        sf << "huge_page_mb," << (index_memory->huge_bytes() >> 20) << "\n";
+        sf << "placement_time_s," << placement_time << "\n";
+    }
+    if (batch_size > 0 && single_qps > 0) {
+        sf << "single_query_qps," << single_qps << "\n";
+        sf << "batch_speedup," << (qps / single_qps) << "\n";
+    }
+    if (filtered) {
+        sf << "filter," << filter_spec.describe() << "\n";
+        sf << "filter_allowed," << filter.allowed() << "\n";
+        sf << "filter_selectivity," << filter.selectivity() << "\n";
+        sf << "filter_strategy," << (filter.use_brute_force() ? "brute" : "graph") << "\n";
+        sf << "filter_build_s," << filter_time << "\n";
+        sf << "filter_memory_kb," << (filter.bytes() >> 10) << "\n";
+    }
+    if (intra > 0) {
+        report.config("intra_threads_per_query", intra);
+        report.config("intra_concurrent_queries", threads / intra);
+        sf << "intra_qps," << intra_histogram.count() / intra_time << "\n";
+        intra_histogram.write_csv(sf, "intra_");
+        if (intra_recall.at1 >= 0) sf << "intra_recall_at_1," << intra_recall.at1 << "\n";
+        if (intra_recall.atk >= 0) sf << "intra_recall_at_k," << intra_recall.atk << "\n";
+        sf << "intra_p99_speedup,"
+           << histogram.percentile_ms(0.99) / intra_histogram.percentile_ms(0.99) << "\n";
+    }
+    if (open_loop) {
+        sf << "open_loop_arrival," << arrival_process_name(arrival) << "\n";
+        report.config("open_loop_points", curve.size());
+        report.config("open_loop_point_duration_s", load_duration);
+        if (sustained) {
+            sf << "open_loop_sustained_qps," << sustained->achieved_qps << "\n";
+            sustained->latency.write_csv(sf, "open_loop_sustained_");
+        }
+    }
+    opt.load_report().write_csv(sf, "queries_io_");
+    load_perf.write_csv(sf, "load_");
+    query_perf.write_csv(sf, "query_", latencies.size(), "query");
     sf << "peak_rss_mb," << MemoryMonitor::get_peak_rss_mb() << "\n";
-    sf.close();
-    std::cout << "3. improved_summary_metrics.csv - Resumen completo\n";
+
+    // Distribución por hilo y curva del lazo abierto como tablas del JSON
+    std::ostream& tf = report.table("threads");
+    tf << "thread,queries,percentage,node" << PerfSample::csv_header() << "\n";
+    for (size_t i = 0; i < thread_stats.size(); i++) {
+        double percentage = (thread_stats[i].queries * 100.0) / latencies.size();
+        tf << i << "," << thread_stats[i].queries << "," << percentage << ","
+           << thread_stats[i].node << thread_stats[i].perf.csv_columns() << "\n";
+    }
+    if (open_loop) {
+        std::ostream& cf = report.table("open_loop_curve");
+        LoadPoint::csv_header(cf);
+        for (const auto& p : curve) p.write_csv_row(cf);
+    }
+    report.write(report_prefix, bench::Environment::capture());
+    std::cout << "2. " << report_prefix << ".json - Entorno, configuración, métricas y tablas\n";
+    std::cout << "3. " << report_prefix << "_summary.csv - Resumen comparable con hnsw_bench compare\n";
+
+    // 4. Vecinos encontrados (formato de results_io.hpp)
+    if (!results_file.empty()) {
+        results.save(results_file);
+        std::cout << "4. " << results_file << " - Vecinos y distancias (n*k)\n";
+    }
 
     MemoryMonitor::print_memory_usage("Fin");
     
@@ -0,0 +1,375 @@
+#include "../includes/half_precision.hpp"
+#include "../includes/hnsw_utils.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/memory_utils.hpp"
+#include "../includes/pq.hpp"
+#include "../includes/results_io.hpp"
+#include "../includes/simd_distance.hpp"
+#include "../includes/sq8.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// =================== CONSULTAS SOBRE ÍNDICES CUANTIZADOS ===================
+//
+// Ejecuta el mismo conjunto de queries sobre el índice fp32 y sobre el
+// índice cuantizado, con re-ranking exacto opcional de los candidatos
+// leyendo los embeddings originales mapeados, y reporta memoria, QPS y
+// recall@k del cuantizado respecto al fp32.
+//
+// sq8: la query se codifica igual que los datos. pq: la query se queda en
+// float y se convierte en su tabla ADC (m x 256), que es lo que recorre el
+// grafo; el índice se carga con PQSpace en modo Adc. fp16/bf16: la query
+// se convierte a 16 bits como los datos.
+
+struct RunResult {
+    std::vector<uint64_t> labels;  // n * k, ordenados de más cercano a más lejano
+    double total_time_s = 0.0;
+    double qps = 0.0;
+};
+
+// Ejecuta search(q, out) para cada query con un contador atómico compartido
+template <typename SearchFn>
+RunResult run_queries(size_t nq, size_t k, int num_threads, SearchFn search) {
+    RunResult r;
+    r.labels.assign(nq * k, UINT64_MAX);
+    std::atomic<size_t> counter{0};
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            while (true) {
+                size_t q = counter.fetch_add(1);
+                if (q >= nq) break;
+                search(q, &r.labels[q * k]);
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+    auto t1 = std::chrono::high_resolution_clock::now();
+
+    r.total_time_s = std::chrono::duration<double>(t1 - t0).count();
+    r.qps = nq / r.total_time_s;
+    return r;
+}
+
+double recall_at_k(const std::vector<uint64_t>& truth, const std::vector<uint64_t>& found,
+                   size_t nq, size_t k) {
+    size_t hits = 0;
+    for (size_t q = 0; q < nq; q++) {
+        const uint64_t* t = &truth[q * k];
+        const uint64_t* f = &found[q * k];
+        for (size_t i = 0; i < k; i++) {
+            if (f[i] == UINT64_MAX) continue;
+            if (std::find(t, t + k, f[i]) != t + k) hits++;
+        }
+    }
+    return double(hits) / (nq * k);
+}
+
+// Vuelca la cola de hnswlib a un arreglo ordenado de más cercano a más lejano
+void drain_sorted(std::priority_queue<std::pair<float, hnswlib::labeltype>>& res,
+                  uint64_t* out, size_t k) {
+    size_t sz = std::min(res.size(), k);
+    while (res.size() > sz) res.pop();
+    while (!res.empty()) {
+        out[--sz] = res.top().second;
+        res.pop();
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 8) {
+        std::cerr << "Uso:\n"
+                  << argv[0]
+                  << " <index_cuantizado.bin> <index_fp32.bin> <queries.bin> <dim> <k> <ef> <threads>"
+                  << " [--storage sq8|pq|fp16|bf16] [--metric l2|ip] [--rerank <embeddings.bin> <ids.bin>]"
+                  << " [--rerank-k R] [--gt gt.bin]\n"
+                  << "\n  --storage sq8|pq|fp16|bf16  Formato del índice cuantizado (parámetros en"
+                  << " <index>.sq8 o <index>.pq;\n             por defecto el de sus metadatos, o sq8)\n"
+                  << "  --metric   Métrica de índices sin metadatos; con metadatos solo se contrasta\n"
+                  << "  --gt F     Recall de ambos índices contra el ground truth exacto\n";
+        return 1;
+    }
+
+    std::string qindex_path = argv[1];
+    std::string findex_path = argv[2];
+    std::string queries_path = argv[3];
+    int dim = std::stoi(argv[4]);
+    size_t k = std::stoul(argv[5]);
+    int ef = std::stoi(argv[6]);
+    int num_threads = std::stoi(argv[7]);
+
+    std::string storage;
+    std::string metric_str;  // vacío = la de los metadatos del índice
+    std::string rerank_emb, rerank_ids, gt_path;
+    size_t rerank_k = 0;
+    for (int a = 8; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--storage" && a + 1 < argc) {
+            storage = argv[++a];
+        } else if (flag == "--metric" && a + 1 < argc) {
+            metric_str = argv[++a];
+        } else if (flag == "--rerank" && a + 2 < argc) {
+            rerank_emb = argv[++a];
+            rerank_ids = argv[++a];
+        } else if (flag == "--rerank-k" && a + 1 < argc) {
+            rerank_k = std::stoul(argv[++a]);
+        } else if (flag == "--gt" && a + 1 < argc) {
+            gt_path = argv[++a];
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    // Métrica y preprocesado según los metadatos de los dos índices
+    // (index_meta.hpp); --metric solo se contrasta con ellos
+    IndexMeta qmeta = IndexMeta::read(qindex_path);
+    qmeta.check_dim(dim);
+    qmeta.resolve_metric(metric_str);
+    IndexMeta fmeta = IndexMeta::read(findex_path);
+    fmeta.check_dim(dim);
+    fmeta.resolve_metric(metric_name(qmeta.metric));
+    if (fmeta.storage != VectorStorage::FP32) {
+        std::cerr << "El índice de referencia es " << storage_name(fmeta.storage) << ", no fp32\n";
+        return 1;
+    }
+    if (storage.empty()) {
+        bool quantized = qmeta.present && qmeta.storage != VectorStorage::FP32;
+        storage = quantized ? storage_name(qmeta.storage) : "sq8";
+    }
+    bool half = storage == "fp16" || storage == "bf16";
+    if (storage != "sq8" && storage != "pq" && !half) {
+        std::cerr << "Formato no soportado: " << storage << "\n";
+        return 1;
+    }
+    Metric metric = qmeta.metric;
+    metric_str = metric_name(metric);
+    bool rerank = !rerank_emb.empty();
+    if (rerank && rerank_k == 0) rerank_k = 4 * k;
+    size_t fetch_k = rerank ? std::max(rerank_k, k) : k;
+
+    std::cout << "=== CONSULTAS CON ÍNDICE CUANTIZADO (" << storage << ") ===\n";
+    std::cout << "Índice cuantizado: " << qindex_path << "\n";
+    std::cout << "Índice fp32: " << findex_path << "\n";
+    std::cout << "Métrica: " << metric_str << ", k: " << k << ", efSearch: " << ef
+              << ", threads: " << num_threads << "\n";
+    if (rerank) std::cout << "Re-ranking exacto de los " << fetch_k << " mejores candidatos\n";
+
+    // Queries (normalizadas si lo están los datos del índice)
+    MappedDataset query_file(queries_path, dim);
+    size_t nq = query_file.size();
+    if (nq == 0) {
+        std::cerr << "El archivo de queries está vacío: " << queries_path << "\n";
+        return 1;
+    }
+    std::vector<float> queries(query_file.row(0), query_file.row(0) + nq * dim);
+    if (qmeta.normalized) {
+        NormalizeFn normalize = DistanceKernels::normalizer(CpuFeatures::detect());
+        for (size_t q = 0; q < nq; q++) normalize(&queries[q * dim], &queries[q * dim], dim);
+    }
+    std::cout << "Queries: " << nq << "\n";
+
+    // ---------- Índice cuantizado ----------
+    SQ8Params params;
+    PQParams pq;
+    HalfSpace* half_space = nullptr;
+    std::unique_ptr<hnswlib::SpaceInterface<float>> qspace_ptr;
+    std::string qdesc;
+    size_t code_bytes = 0;
+    if (half) {
+        half_space = new HalfSpace(metric, parse_half_format(storage), dim);
+        qdesc = half_space->description();
+        qspace_ptr.reset(half_space);
+        code_bytes = dim * sizeof(uint16_t);
+    } else if (storage == "pq") {
+        pq = PQParams::load(PQParams::path_for(qindex_path));
+        if (pq.dim != dim) throw std::runtime_error("Dimensión del cuantizador no coincide");
+        PQSpace* s = new PQSpace(metric, pq, PQSpace::Mode::Adc);
+        qdesc = s->description();
+        qspace_ptr.reset(s);
+        code_bytes = size_t(pq.m);
+    } else {
+        params = SQ8Params::load(SQ8Params::path_for(qindex_path));
+        if (params.dim != dim) throw std::runtime_error("Dimensión del cuantizador no coincide");
+        SQ8Space* s = new SQ8Space(metric, params);
+        qdesc = s->description();
+        qspace_ptr.reset(s);
+        code_bytes = size_t(dim);
+    }
+    hnswlib::SpaceInterface<float>& qspace = *qspace_ptr;
+    std::cout << "\nCargando índice cuantizado (" << qdesc << ")...\n";
+    size_t rss0 = MemoryMonitor::get_current_rss_kb();
+    auto qindex_ptr = index_io::load(&qspace, qindex_path);
+    hnswlib::HierarchicalNSW<float>& qindex = *qindex_ptr;
+    size_t qindex_rss_mb = (MemoryMonitor::get_current_rss_kb() - rss0) / 1024;
+    qindex.setEf(std::max<size_t>(ef, fetch_k));
+
+    // ---------- Índice fp32 de referencia ----------
+    SimdSpace fspace(metric, dim);
+    std::cout << "Cargando índice fp32 (" << fspace.description() << ")...\n";
+    size_t rss1 = MemoryMonitor::get_current_rss_kb();
+    auto findex_ptr = index_io::load(&fspace, findex_path);
+    hnswlib::HierarchicalNSW<float>& findex = *findex_ptr;
+    size_t findex_rss_mb = (MemoryMonitor::get_current_rss_kb() - rss1) / 1024;
+    findex.setEf(ef);
+
+    size_t qbytes = MemoryMonitor::index_bytes(qindex);
+    size_t fbytes = MemoryMonitor::index_bytes(findex);
+
+    // ---------- Datos para re-ranking (mapeados, sin copia) ----------
+    MappedDataset base;
+    std::unordered_map<uint64_t, size_t> label_to_row;
+    RawDistFn exact = DistanceKernels::raw(metric, CpuFeatures::detect());
+    if (rerank) {
+        base = MappedDataset(rerank_emb, dim);
+        base.advise(MADV_RANDOM);
+        MappedIds ids(rerank_ids);
+        label_to_row.reserve(ids.size());
+        for (size_t i = 0; i < ids.size(); i++) label_to_row[ids[i]] = i;
+    }
+
+    MemoryMonitor::print_memory_usage("Índices cargados");
+
+    // ---------- Ejecución ----------
+    std::cout << "\nEjecutando queries sobre fp32...\n";
+    RunResult fres = run_queries(nq, k, num_threads, [&](size_t q, uint64_t* out) {
+        auto res = findex.searchKnn(&queries[q * dim], k);
+        drain_sorted(res, out, k);
+    });
+
+    std::cout << "Ejecutando queries sobre " << storage << "...\n";
+    RunResult qres = run_queries(nq, k, num_threads, [&](size_t q, uint64_t* out) {
+        // Código (sq8), tabla ADC (pq) o vector de 16 bits de la query,
+        // reutilizado por thread
+        thread_local std::vector<uint8_t> code;
+        thread_local std::vector<float> lut;
+        thread_local std::vector<uint16_t> half_code;
+        const float* query = &queries[q * dim];
+        const void* qdata;
+        if (half) {
+            half_code.resize(dim);
+            half_space->encode(query, half_code.data());
+            qdata = half_code.data();
+        } else if (storage == "pq") {
+            lut.resize(pq.table_floats());
+            pq.adc_table(query, metric, lut.data());
+            qdata = lut.data();
+        } else {
+            code.resize(dim);
+            params.encode(query, code.data());
+            qdata = code.data();
+        }
+        auto res = qindex.searchKnn(qdata, fetch_k);
+        if (!rerank) {
+            drain_sorted(res, out, k);
+            return;
+        }
+        // Re-ranking exacto con los vectores originales
+        std::vector<std::pair<float, uint64_t>> cand;
+        cand.reserve(res.size());
+        while (!res.empty()) {
+            uint64_t label = res.top().second;
+            res.pop();
+            auto it = label_to_row.find(label);
+            if (it == label_to_row.end()) continue;
+            const float* v = base.row(it->second);
+            float d;
+            if (metric == Metric::L2) {
+                d = exact(query, v, dim);
+            } else {
+                // Los vectores base están sin normalizar: coseno exacto
+                float norm = std::sqrt(DistanceKernels::dot_scalar(v, v, dim));
+                d = 1.0f - exact(query, v, dim) / std::max(norm, 1e-12f);
+            }
+            cand.emplace_back(d, label);
+        }
+        size_t top = std::min(k, cand.size());
+        std::partial_sort(cand.begin(), cand.begin() + top, cand.end());
+        for (size_t i = 0; i < top; i++) out[i] = cand[i].second;
+    });
+
+    double recall = recall_at_k(fres.labels, qres.labels, nq, k);
+    double code_ratio = 4.0 * dim / code_bytes;
+    double index_ratio = qbytes ? double(fbytes) / qbytes : 0.0;
+
+    // Recall absoluto contra el ground truth exacto (hnsw_groundtruth)
+    double fp32_gt_recall = -1.0, quant_gt_recall = -1.0;
+    if (!gt_path.empty()) {
+        KnnResults gt = KnnResults::load(gt_path);
+        auto as_results = [&](const RunResult& r) {
+            KnnResults out(nq, k);
+            out.ids = r.labels;
+            return out;
+        };
+        fp32_gt_recall = recall_at(as_results(fres), gt, k);
+        quant_gt_recall = recall_at(as_results(qres), gt, k);
+    }
+    double saved_mb = (double(fbytes) - double(qbytes)) / (1024.0 * 1024.0);
+    double saved_pct = fbytes ? 100.0 * (double(fbytes) - double(qbytes)) / fbytes : 0.0;
+
+    std::cout << "\n=== RESULTADOS ===\n";
+    std::cout << "Memoria índice fp32: " << (fbytes / (1024.0 * 1024.0)) << " MB (RSS +"
+              << findex_rss_mb << " MB)\n";
+    std::cout << "Memoria índice " << storage << ": " << (qbytes / (1024.0 * 1024.0))
+              << " MB (RSS +" << qindex_rss_mb << " MB)\n";
+    std::cout << "Memoria ahorrada: " << saved_mb << " MB (" << saved_pct << "%)\n";
+    std::cout << "Compresión: vectores " << code_ratio << "x (" << code_bytes
+              << " bytes/vector), índice " << index_ratio << "x\n";
+    std::cout << "QPS fp32: " << fres.qps << "\n";
+    std::cout << "QPS " << storage << (rerank ? " + re-rank" : "") << ": " << qres.qps << "\n";
+    std::cout << "Recall@" << k << " vs fp32: " << recall << "\n";
+    if (fp32_gt_recall >= 0) {
+        std::cout << "Recall@" << k << " fp32 (ground truth): " << fp32_gt_recall << "\n";
+        std::cout << "Recall@" << k << " " << storage << (rerank ? " + re-rank" : "")
+                  << " (ground truth): " << quant_gt_recall << " (delta "
+                  << (quant_gt_recall - fp32_gt_recall) << ")\n";
+    }
+
+    std::ofstream sf("quantized_summary_metrics.csv");
+    sf << "metric,value\n";
+    sf << "storage," << storage << "\n";
+    sf << "metric_space," << metric_str << "\n";
+    sf << "queries," << nq << "\n";
+    sf << "threads," << num_threads << "\n";
+    sf << "dimension," << dim << "\n";
+    sf << "k," << k << "\n";
+    sf << "efSearch," << ef << "\n";
+    sf << "rerank," << (rerank ? 1 : 0) << "\n";
+    sf << "rerank_k," << (rerank ? fetch_k : 0) << "\n";
+    sf << "fp32_index_mb," << (fbytes / (1024.0 * 1024.0)) << "\n";
+    sf << "quantized_index_mb," << (qbytes / (1024.0 * 1024.0)) << "\n";
+    sf << "fp32_index_rss_mb," << findex_rss_mb << "\n";
+    sf << "quantized_index_rss_mb," << qindex_rss_mb << "\n";
+    sf << "memory_saved_mb," << saved_mb << "\n";
+    sf << "memory_saved_pct," << saved_pct << "\n";
+    sf << "code_bytes_per_vector," << code_bytes << "\n";
+    sf << "code_compression_ratio," << code_ratio << "\n";
+    sf << "index_compression_ratio," << index_ratio << "\n";
+    sf << "fp32_qps," << fres.qps << "\n";
+    sf << "quantized_qps," << qres.qps << "\n";
+    sf << "recall_at_k_vs_fp32," << recall << "\n";
+    sf << "qps_vs_fp32," << (fres.qps > 0 ? qres.qps / fres.qps : 0.0) << "\n";
+    if (fp32_gt_recall >= 0) {
+        sf << "fp32_recall_at_k_gt," << fp32_gt_recall << "\n";
+        sf << "quantized_recall_at_k_gt," << quant_gt_recall << "\n";
+        sf << "recall_delta_gt," << (quant_gt_recall - fp32_gt_recall) << "\n";
+    }
+    sf << "peak_rss_mb," << MemoryMonitor::get_peak_rss_mb() << "\n";
+    sf.close();
+    std::cout << "\nMétricas guardadas en quantized_summary_metrics.csv\n";
+    return 0;
+}
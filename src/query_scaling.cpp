@@ -0,0 +1,217 @@
+#include "../includes/cpu_topology.hpp"
+#include "../includes/hnsw_utils.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/latency_histogram.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/search_engine.hpp"
+#include "../includes/simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// =================== ESTUDIO DE ESCALABILIDAD POR NÚCLEO ===================
+//
+// Ejecuta el mismo conjunto de queries con 1..N threads y mide QPS, speedup,
+// eficiencia y p50/p99 global y por thread. Compara el camino de hnswlib
+// (searchKnn: pool de visitados con mutex) con el motor propio sin estado
+// compartido (search_engine.hpp).
+
+struct ScalingRun {
+    std::string mode;
+    int threads = 0;
+    double total_time_s = 0.0;
+    double qps = 0.0;
+    LatencyHistogram latency;                // fusión de los histogramas por thread
+    std::vector<LatencyHistogram> per_thread;
+    std::vector<int> cpus;  // CPU de cada thread (-1 sin pinning)
+};
+
+// Camino original: una query por fetch_add y searchKnn de hnswlib
+ScalingRun run_hnswlib(hnswlib::HierarchicalNSW<float>& index, const float* queries, size_t nq,
+                       size_t total, int dim, size_t k, int threads, PinPolicy pin) {
+    ScalingRun r;
+    r.mode = "hnswlib";
+    r.threads = threads;
+    r.per_thread.resize(threads);
+    r.cpus.assign(threads, -1);
+    std::atomic<size_t> counter{0};
+
+    auto worker = [&](int tid) {
+        r.cpus[tid] = CpuTopology::get().pin_thread(tid, pin);
+        while (true) {
+            size_t i = counter.fetch_add(1);
+            if (i >= total) break;
+            auto t0 = std::chrono::high_resolution_clock::now();
+            auto res = index.searchKnn(queries + (i % nq) * dim, k);
+            while (!res.empty()) res.pop();
+            auto t1 = std::chrono::high_resolution_clock::now();
+            r.per_thread[tid].record(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        }
+    };
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> pool;
+    for (int t = 0; t < threads; t++) pool.emplace_back(worker, t);
+    for (auto& th : pool) th.join();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    r.total_time_s = std::chrono::duration<double>(t1 - t0).count();
+    r.qps = total / r.total_time_s;
+    for (const auto& h : r.per_thread) r.latency.merge(h);
+    return r;
+}
+
+// Motor propio: contextos por worker, sin locks ni contadores compartidos
+ScalingRun run_engine(const HnswGraphView& graph, const std::vector<float>& expanded, size_t total,
+                      int dim, size_t k, size_t ef, size_t batch, int threads, PinPolicy pin) {
+    ScalingRun r;
+    r.mode = "engine";
+    r.threads = threads;
+    r.cpus.assign(threads, -1);
+    std::vector<uint64_t> ids(total * k);
+    std::vector<float> dists(total * k);
+
+    BatchSearcher searcher(graph, threads, batch);
+    searcher.on_thread_start([&](int tid) { r.cpus[tid] = CpuTopology::get().pin_thread(tid, pin); });
+    BatchSearchStats st = searcher.searchBatch(expanded.data(), total, dim, k, ef, ids.data(),
+                                               dists.data());
+    r.total_time_s = st.total_time_s;
+    r.qps = st.qps;
+    r.latency = st.latency;
+    for (int t = 0; t < threads; t++) r.per_thread.push_back(searcher.thread_latency(t));
+    return r;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 7) {
+        std::cerr << "Uso:\n"
+                  << argv[0] << " <index.bin> <queries.bin> <dim> <k> <ef> <max_threads>"
+                  << " [--mode engine|hnswlib|both] [--batch B] [--pin compact|spread|none]"
+                  << " [--repeat R] [--metric l2|ip]\n";
+        return 1;
+    }
+
+    std::string index_path = argv[1];
+    std::string queries_path = argv[2];
+    int dim = std::stoi(argv[3]);
+    size_t k = std::stoul(argv[4]);
+    size_t ef = std::stoul(argv[5]);
+    int max_threads = std::stoi(argv[6]);
+
+    std::string mode = "both";
+    size_t batch = 16;
+    PinPolicy pin = PinPolicy::Compact;
+    size_t repeat = 1;
+    std::string metric_str;  // vacío = la de los metadatos del índice
+    for (int a = 7; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--mode" && a + 1 < argc) {
+            mode = argv[++a];
+        } else if (flag == "--batch" && a + 1 < argc) {
+            batch = std::stoul(argv[++a]);
+        } else if (flag == "--pin" && a + 1 < argc) {
+            pin = parse_pin_policy(argv[++a]);
+        } else if (flag == "--repeat" && a + 1 < argc) {
+            repeat = std::max<size_t>(1, std::stoul(argv[++a]));
+        } else if (flag == "--metric" && a + 1 < argc) {
+            metric_str = argv[++a];
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    if (mode != "engine" && mode != "hnswlib" && mode != "both") {
+        std::cerr << "Modo desconocido: " << mode << "\n";
+        return 1;
+    }
+    // Métrica y preprocesado según los metadatos del índice (index_meta.hpp)
+    IndexMeta meta = IndexMeta::read(index_path);
+    meta.check_dim(dim);
+    meta.resolve_metric(metric_str);
+    if (meta.storage != VectorStorage::FP32) {
+        std::cerr << "Índice " << storage_name(meta.storage) << ": usar hnsw_query_quantized\n";
+        return 1;
+    }
+
+    const CpuTopology& topo = CpuTopology::get();
+    std::cout << "=== ESTUDIO DE ESCALABILIDAD ===\n";
+    std::cout << "Topología: " << topo.summary() << "\n";
+    std::cout << "Pinning: " << pin_policy_name(pin) << " (orden:";
+    for (int c : topo.pin_order(pin)) std::cout << " " << c;
+    std::cout << ")\n";
+    if (max_threads > int(topo.num_cores()))
+        std::cout << "AVISO: más threads (" << max_threads << ") que núcleos físicos ("
+                  << topo.num_cores() << "); los threads extra comparten núcleo (SMT o sobre-suscripción)\n";
+
+    std::cout << "Metadatos del índice: " << meta.describe() << "\n";
+    SimdSpace space(meta.metric, dim);
+    auto index_ptr = index_io::load(&space, index_path);
+    hnswlib::HierarchicalNSW<float>& index = *index_ptr;
+    index.setEf(ef);
+    HnswGraphView graph = HnswGraphView::from(index);
+
+    MappedDataset query_file(queries_path, dim);
+    size_t nq = query_file.size();
+    if (nq == 0) {
+        std::cerr << "El archivo de queries está vacío: " << queries_path << "\n";
+        return 1;
+    }
+    std::vector<float> queries(query_file.row(0), query_file.row(0) + nq * dim);
+    if (meta.normalized) {
+        NormalizeFn normalize = space.normalizer();
+        for (size_t q = 0; q < nq; q++) normalize(&queries[q * dim], &queries[q * dim], dim);
+    }
+    size_t total = nq * repeat;
+    std::vector<float> expanded;
+    if (mode != "hnswlib") {
+        expanded.reserve(total * dim);
+        for (size_t r = 0; r < repeat; r++) expanded.insert(expanded.end(), queries.begin(), queries.end());
+    }
+    std::cout << "Queries por corrida: " << total << " (" << nq << " x " << repeat << ")\n";
+    std::cout << "k: " << k << ", efSearch: " << ef << ", batch: " << batch << "\n\n";
+
+    std::vector<std::string> modes;
+    if (mode != "engine") modes.push_back("hnswlib");
+    if (mode != "hnswlib") modes.push_back("engine");
+
+    std::ofstream sf("scaling_results.csv");
+    sf << "mode,threads,qps,speedup,efficiency,p50_ms,p99_ms,total_time_s\n";
+    std::ofstream tf("scaling_per_thread.csv");
+    tf << "mode,threads,thread,cpu,queries,p50_ms,p99_ms\n";
+
+    for (const auto& m : modes) {
+        double base_qps = 0.0;
+        for (int t = 1; t <= max_threads; t++) {
+            ScalingRun r = m == "hnswlib"
+                               ? run_hnswlib(index, queries.data(), nq, total, dim, k, t, pin)
+                               : run_engine(graph, expanded, total, dim, k, ef, batch, t, pin);
+            if (t == 1) base_qps = r.qps;
+            double speedup = base_qps > 0 ? r.qps / base_qps : 0.0;
+            double eff = speedup / t;
+            double p50 = r.latency.percentile_ms(0.50);
+            double p99 = r.latency.percentile_ms(0.99);
+
+            std::cout << m << " threads=" << t << " QPS=" << r.qps << " speedup=" << speedup
+                      << "x eficiencia=" << (eff * 100.0) << "% p50=" << p50 << " ms p99=" << p99
+                      << " ms\n";
+            sf << m << "," << t << "," << r.qps << "," << speedup << "," << eff << "," << p50
+               << "," << p99 << "," << r.total_time_s << "\n";
+
+            for (int i = 0; i < t; i++) {
+                const LatencyHistogram& h = r.per_thread[i];
+                tf << m << "," << t << "," << i << "," << r.cpus[i] << "," << h.count() << ","
+                   << h.percentile_ms(0.50) << "," << h.percentile_ms(0.99) << "\n";
+            }
+        }
+    }
+
+    std::cout << "\nResultados guardados en scaling_results.csv y scaling_per_thread.csv\n";
+    return 0;
+}
@@ -0,0 +1,446 @@
+#include "../includes/cpu_topology.hpp"
+#include "../includes/hnsw_utils.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/latency_histogram.hpp"
+#include "../includes/mapped_index.hpp"
+#include "../includes/memory_utils.hpp"
+#include "../includes/mpmc_queue.hpp"
+#include "../includes/search_engine.hpp"
+#include "../includes/server_protocol.hpp"
+#include "../includes/simd_distance.hpp"
+#include "hnswlib.h"
+#include <poll.h>
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// =================== SERVIDOR RESIDENTE DE CONSULTAS ===================
+//
+// Carga el índice una sola vez y atiende peticiones k-NN por un socket Unix.
+// Un thread por conexión lee peticiones y las encola en una cola MPMC sin
+// locks; un pool de workers (cada uno con su SearchContext) las resuelve y
+// responde directamente en la conexión de origen.
+
+static volatile std::sig_atomic_t g_signal_stop = 0;
+
+static void handle_signal(int) { g_signal_stop = 1; }
+
+struct Connection {
+    int fd = -1;
+    std::mutex write_mutex;  // las respuestas de distintos workers no se mezclan
+    std::atomic<bool> finished{false};
+
+    explicit Connection(int f) : fd(f) {}
+    ~Connection() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool send(const void* data, size_t n) {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        return proto::write_full(fd, data, n);
+    }
+};
+
+struct Job {
+    std::shared_ptr<Connection> conn;
+    proto::RequestHeader header;
+    std::vector<float> queries;
+    std::chrono::steady_clock::time_point arrival;
+};
+
+// Contadores en vivo por worker; cada worker es el único escritor de los
+// suyos y el hilo de estadísticas los lee sin locks
+struct alignas(64) WorkerCounters {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> queries{0};
+    std::atomic<uint64_t> busy_ns{0};
+    ConcurrentLatencyHistogram latency;
+};
+
+struct CounterSnapshot {
+    uint64_t requests = 0;
+    uint64_t queries = 0;
+    uint64_t busy_ns = 0;
+    LatencyHistogram latency;
+};
+
+class QueryServer {
+private:
+    const HnswGraphView graph;
+    const int dim;
+    const NormalizeFn normalize;  // queries a norma 1 antes de encolar; nullptr = crudas
+    const size_t default_ef;
+    const int num_workers;
+    const PinPolicy pin;
+
+    MpmcQueue<Job*> queue;
+    std::vector<std::unique_ptr<WorkerCounters>> counters;
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> rejected{0};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
+    static constexpr uint32_t MAX_K = 4096;
+    static constexpr uint32_t MAX_QUERIES_PER_REQUEST = 65536;
+    // Tope de nq * k por petición: acota la respuesta (12 bytes por entrada,
+    // ~48 MB) aunque k y nq estén cada uno dentro de su límite
+    static constexpr uint64_t MAX_RESULTS_PER_REQUEST = uint64_t(1) << 22;
+    // Tope de ef: SearchContext reserva del orden de 2 * ef entradas por
+    // worker, y un bad_alloc en un worker tumbaría el servidor entero
+    static constexpr uint32_t MAX_EF = 1u << 16;
+
+    // Consume la carga útil de una petición que no se va a atender, para
+    // que la siguiente cabecera quede alineada en el stream
+    static bool skip_payload(int fd, size_t bytes) {
+        char buf[64 * 1024];
+        while (bytes > 0) {
+            size_t n = std::min(bytes, sizeof(buf));
+            if (!proto::read_full(fd, buf, n)) return false;
+            bytes -= n;
+        }
+        return true;
+    }
+
+public:
+    QueryServer(const HnswGraphView& g, int d, NormalizeFn norm, size_t ef, int workers,
+                size_t queue_capacity, PinPolicy p)
+        : graph(g), dim(d), normalize(norm), default_ef(ef), num_workers(std::max(1, workers)), pin(p),
+          queue(queue_capacity) {
+        for (int i = 0; i < num_workers; i++) counters.emplace_back(new WorkerCounters());
+    }
+
+    bool stopping() const { return stop.load(std::memory_order_relaxed) || g_signal_stop; }
+    void request_stop() { stop = true; }
+
+    CounterSnapshot snapshot() const {
+        CounterSnapshot s;
+        LatencyHistogram worker_latency;
+        for (const auto& c : counters) {
+            s.requests += c->requests.load(std::memory_order_relaxed);
+            s.queries += c->queries.load(std::memory_order_relaxed);
+            s.busy_ns += c->busy_ns.load(std::memory_order_relaxed);
+            c->latency.snapshot(worker_latency);
+            s.latency.merge(worker_latency);
+        }
+        return s;
+    }
+
+    std::string stats_text() const {
+        CounterSnapshot s = snapshot();
+        double up = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        std::ostringstream os;
+        os << "uptime_s," << up << "\n";
+        os << "requests," << s.requests << "\n";
+        os << "queries," << s.queries << "\n";
+        os << "rejected," << rejected.load() << "\n";
+        os << "avg_qps," << (up > 0 ? s.queries / up : 0.0) << "\n";
+        os << "queue_depth," << queue.size_approx() << "\n";
+        os << "p50_ms," << s.latency.percentile_ms(0.50) << "\n";
+        os << "p90_ms," << s.latency.percentile_ms(0.90) << "\n";
+        os << "p99_ms," << s.latency.percentile_ms(0.99) << "\n";
+        os << "p999_ms," << s.latency.percentile_ms(0.999) << "\n";
+        os << "max_ms," << s.latency.max_ms() << "\n";
+        os << "worker_utilization," << (up > 0 ? s.busy_ns / 1e9 / up / num_workers : 0.0) << "\n";
+        os << "peak_rss_mb," << MemoryMonitor::get_peak_rss_mb() << "\n";
+        return os.str();
+    }
+
+    // ---------- Workers ----------
+    void worker_loop(int tid) {
+        CpuTopology::get().pin_thread(tid, pin);
+        SearchContext ctx(graph.count);
+        WorkerCounters& wc = *counters[tid];
+        std::vector<char> out;
+        unsigned idle = 0;
+        Job* job = nullptr;
+
+        while (true) {
+            if (!queue.try_pop(job)) {
+                if (stopping()) break;
+                // Espera escalonada: spin corto, yield y luego dormir
+                if (++idle < 64)
+                    __builtin_ia32_pause();
+                else if (idle < 256)
+                    std::this_thread::yield();
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            idle = 0;
+            auto t0 = std::chrono::steady_clock::now();
+
+            const proto::RequestHeader& h = job->header;
+            size_t k = h.k, nq = h.nq;
+            size_t ef = h.ef ? h.ef : default_ef;
+            size_t payload = nq * k * (sizeof(uint64_t) + sizeof(float));
+            out.resize(sizeof(proto::ResponseHeader) + payload);
+            uint64_t* ids = reinterpret_cast<uint64_t*>(out.data() + sizeof(proto::ResponseHeader));
+            float* dists = reinterpret_cast<float*>(ids + nq * k);
+
+            for (size_t q = 0; q < nq; q++) {
+                size_t found = GraphSearcher::search(graph, &job->queries[q * dim], k, ef, ctx,
+                                                     ids + q * k, dists + q * k);
+                for (size_t i = found; i < k; i++) {
+                    ids[q * k + i] = std::numeric_limits<uint64_t>::max();
+                    dists[q * k + i] = std::numeric_limits<float>::infinity();
+                }
+            }
+
+            auto t1 = std::chrono::steady_clock::now();
+            proto::ResponseHeader r;
+            r.op = proto::OP_SEARCH;
+            r.request_id = h.request_id;
+            r.k = h.k;
+            r.nq = h.nq;
+            r.payload_bytes = payload;
+            r.server_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - job->arrival).count();
+            std::memcpy(out.data(), &r, sizeof(r));
+            job->conn->send(out.data(), out.size());
+
+            wc.requests.fetch_add(1, std::memory_order_relaxed);
+            wc.queries.fetch_add(nq, std::memory_order_relaxed);
+            wc.busy_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(),
+                                 std::memory_order_relaxed);
+            wc.latency.record(r.server_ns);
+            delete job;
+        }
+    }
+
+    // ---------- Lectura de peticiones de una conexión ----------
+    void reader_loop(std::shared_ptr<Connection> conn) {
+        proto::RequestHeader h;
+        while (!stopping() && proto::read_full(conn->fd, &h, sizeof(h))) {
+            auto arrival = std::chrono::steady_clock::now();
+            proto::ResponseHeader r;
+            r.op = h.op;
+            r.request_id = h.request_id;
+
+            if (h.magic != proto::REQUEST_MAGIC) break;
+
+            if (h.op == proto::OP_STATS) {
+                std::string text = stats_text();
+                r.payload_bytes = text.size();
+                std::string msg(reinterpret_cast<const char*>(&r), sizeof(r));
+                msg += text;
+                if (!conn->send(msg.data(), msg.size())) break;
+                continue;
+            }
+            if (h.op == proto::OP_SHUTDOWN) {
+                conn->send(&r, sizeof(r));
+                request_stop();
+                break;
+            }
+
+            bool valid = h.op == proto::OP_SEARCH && h.dim == uint32_t(dim) && h.k > 0 &&
+                         h.k <= MAX_K && h.nq > 0 && h.nq <= MAX_QUERIES_PER_REQUEST &&
+                         uint64_t(h.nq) * h.k <= MAX_RESULTS_PER_REQUEST && h.ef <= MAX_EF;
+            if (!valid) {
+                // Sin una cabecera coherente no se puede saltar la carga útil
+                r.status = proto::STATUS_BAD_REQUEST;
+                conn->send(&r, sizeof(r));
+                break;
+            }
+
+            // Cola llena: se descarta la carga sin reservar el job. try_push
+            // puede fallar igual más abajo si otro lector llenó la cola.
+            if (queue.size_approx() >= queue.capacity()) {
+                if (!skip_payload(conn->fd, size_t(h.nq) * dim * sizeof(float))) break;
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                r.status = proto::STATUS_OVERLOADED;
+                if (!conn->send(&r, sizeof(r))) break;
+                continue;
+            }
+
+            Job* job = new Job();
+            job->conn = conn;
+            job->header = h;
+            job->arrival = arrival;
+            job->queries.resize(size_t(h.nq) * dim);
+            if (!proto::read_full(conn->fd, job->queries.data(), job->queries.size() * sizeof(float))) {
+                delete job;
+                break;
+            }
+            if (normalize) {
+                for (size_t q = 0; q < h.nq; q++)
+                    normalize(&job->queries[q * dim], &job->queries[q * dim], dim);
+            }
+            if (!queue.try_push(job)) {
+                delete job;
+                rejected.fetch_add(1, std::memory_order_relaxed);
+                r.status = proto::STATUS_OVERLOADED;
+                if (!conn->send(&r, sizeof(r))) break;
+            }
+        }
+        ::shutdown(conn->fd, SHUT_RDWR);
+        conn->finished = true;
+    }
+
+    // ---------- Bucle principal ----------
+    void serve(const std::string& socket_path, double stats_every_s) {
+        ::unlink(socket_path.c_str());
+        int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (lfd < 0) throw std::runtime_error("socket(): " + std::string(std::strerror(errno)));
+        sockaddr_un addr = proto::make_address(socket_path);
+        if (::bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(lfd, 128) != 0) {
+            int err = errno;
+            ::close(lfd);
+            throw std::runtime_error("No se pudo escuchar en " + socket_path + ": " + std::strerror(err));
+        }
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < num_workers; t++) workers.emplace_back(&QueryServer::worker_loop, this, t);
+
+        std::vector<std::shared_ptr<Connection>> conns;
+        std::vector<std::thread> readers;
+        std::cout << "Escuchando en " << socket_path << " (" << num_workers << " workers, cola "
+                  << queue.capacity() << ")\n";
+
+        CounterSnapshot prev = snapshot();
+        auto last_report = std::chrono::steady_clock::now();
+        while (!stopping()) {
+            pollfd pfd{lfd, POLLIN, 0};
+            int pr = ::poll(&pfd, 1, 200);
+            if (pr > 0 && (pfd.revents & POLLIN)) {
+                int cfd = ::accept(lfd, nullptr, nullptr);
+                if (cfd >= 0) {
+                    auto conn = std::make_shared<Connection>(cfd);
+                    conns.push_back(conn);
+                    readers.emplace_back(&QueryServer::reader_loop, this, conn);
+                }
+            }
+
+            // Liberar conexiones cerradas (el fd se cierra cuando ningún job la referencia)
+            for (size_t i = 0; i < conns.size();) {
+                if (conns[i]->finished) {
+                    readers[i].join();
+                    readers.erase(readers.begin() + i);
+                    conns.erase(conns.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            double dt = std::chrono::duration<double>(now - last_report).count();
+            if (stats_every_s > 0 && dt >= stats_every_s) {
+                CounterSnapshot cur = snapshot();
+                LatencyHistogram interval = cur.latency.delta_since(prev.latency);
+                std::cout << "[STATS] QPS: " << ((cur.queries - prev.queries) / dt)
+                          << ", peticiones/s: " << ((cur.requests - prev.requests) / dt)
+                          << ", p50: " << interval.percentile_ms(0.50)
+                          << " ms, p99: " << interval.percentile_ms(0.99)
+                          << " ms, cola: " << queue.size_approx() << ", total: " << cur.queries
+                          << std::endl;
+                prev = cur;
+                last_report = now;
+            }
+        }
+
+        std::cout << "\nDeteniendo servidor...\n";
+        ::close(lfd);
+        ::unlink(socket_path.c_str());
+        stop = true;
+        for (auto& c : conns) ::shutdown(c->fd, SHUT_RDWR);
+        for (auto& r : readers) r.join();
+        for (auto& w : workers) w.join();
+        Job* leftover = nullptr;
+        while (queue.try_pop(leftover)) delete leftover;
+        std::cout << stats_text();
+    }
+};
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        std::cerr << "Uso:\n"
+                  << argv[0] << " <index.bin> <dim> <socket_path> <workers>"
+                  << " [--ef E] [--metric l2|ip] [--queue N] [--stats-every S]"
+                  << " [--pin compact|spread|none] [--populate] [--hugepages] [--verify]\n";
+        return 1;
+    }
+
+    std::string index_path = argv[1];
+    int dim = std::stoi(argv[2]);
+    std::string socket_path = argv[3];
+    int workers = std::stoi(argv[4]);
+
+    size_t ef = 100;
+    std::string metric_str;  // vacío = la de los metadatos del índice
+    size_t queue_capacity = 4096;
+    double stats_every = 5.0;
+    PinPolicy pin = PinPolicy::Compact;
+    MappedIndex::Options map_opt;
+    for (int a = 5; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--ef" && a + 1 < argc) {
+            ef = std::stoul(argv[++a]);
+        } else if (flag == "--metric" && a + 1 < argc) {
+            metric_str = argv[++a];
+        } else if (flag == "--queue" && a + 1 < argc) {
+            queue_capacity = std::stoul(argv[++a]);
+        } else if (flag == "--stats-every" && a + 1 < argc) {
+            stats_every = std::stod(argv[++a]);
+        } else if (flag == "--pin" && a + 1 < argc) {
+            pin = parse_pin_policy(argv[++a]);
+        } else if (flag == "--populate") {
+            map_opt.populate = true;
+        } else if (flag == "--hugepages") {
+            map_opt.hugepages = true;
+        } else if (flag == "--verify") {
+            map_opt.verify = true;
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    // Métrica y preprocesado según los metadatos del índice (index_meta.hpp)
+    IndexMeta meta = IndexMeta::read(index_path);
+    meta.check_dim(dim);
+    meta.resolve_metric(metric_str);
+    if (meta.storage != VectorStorage::FP32) {
+        std::cerr << "Índice " << storage_name(meta.storage) << ": el servidor solo sirve fp32\n";
+        return 1;
+    }
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+
+    std::cout << "=== SERVIDOR HNSW ===\n";
+    std::cout << "Índice: " << index_path << "\n";
+    std::cout << "Metadatos del índice: " << meta.describe() << "\n";
+    std::cout << "Dimensión: " << dim << ", métrica: " << metric_name(meta.metric)
+              << ", efSearch por defecto: " << ef << "\n";
+
+    SimdSpace space(meta.metric, dim);
+    // El formato mapeable arranca sin copiar el grafo a memoria anónima
+    std::unique_ptr<hnswlib::HierarchicalNSW<float>> index;
+    std::unique_ptr<MappedIndex> mapped;
+    auto t0 = std::chrono::steady_clock::now();
+    if (mapped_index::is_mapped_format(index_path))
+        mapped.reset(new MappedIndex(index_path, &space, map_opt));
+    else
+        index = index_io::load(&space, index_path);
+    auto t1 = std::chrono::steady_clock::now();
+    HnswGraphView graph = mapped ? mapped->view() : HnswGraphView::from(*index);
+    std::cout << "Índice " << (mapped ? "mapeado" : "cargado") << " en "
+              << std::chrono::duration<double>(t1 - t0).count() << " s (" << graph.count
+              << " vectores, kernel " << space.description() << ")\n";
+    MemoryMonitor::print_memory_usage("Índice cargado");
+
+    QueryServer server(graph, dim, meta.normalized ? space.normalizer() : nullptr, ef, workers, queue_capacity, pin);
+    server.serve(socket_path, stats_every);
+    return 0;
+}
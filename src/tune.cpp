@@ -0,0 +1,332 @@
+#include "../includes/brute_force.hpp"
+#include "../includes/hnsw_utils.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/memory_utils.hpp"
+#include "../includes/parallel_build.hpp"
+#include "../includes/results_io.hpp"
+#include "../includes/search_engine.hpp"
+#include "../includes/simd_distance.hpp"
+#include "hnswlib.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// =================== AUTO-TUNING DE M / efConstruction / efSearch ===================
+//
+// Construye un índice por cada (M, efConstruction) sobre una muestra del
+// dataset, busca por bisección el menor efSearch que alcanza el recall
+// objetivo y vuelca todos los puntos medidos junto con la frontera de
+// Pareto QPS / recall / memoria.
+
+struct TunePoint {
+    int M = 0;
+    int ef_construction = 0;
+    int ef_search = 0;
+    double recall = 0.0;
+    double qps = 0.0;
+    double index_mb = 0.0;
+    double rss_mb = 0.0;
+    double build_time_s = 0.0;
+    bool pareto = false;
+};
+
+std::vector<int> parse_int_list(const std::string& s) {
+    std::vector<int> out;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, ','))
+        if (!part.empty()) out.push_back(std::stoi(part));
+    if (out.empty()) throw std::runtime_error("Lista vacía: " + s);
+    return out;
+}
+
+// Muestreo uniforme sin reemplazo de S filas en orden creciente (algoritmo S
+// de Knuth): una sola pasada, sin materializar una permutación de N
+std::vector<size_t> sample_rows(size_t N, size_t S, uint64_t seed) {
+    std::vector<size_t> rows;
+    if (S >= N) {
+        rows.resize(N);
+        for (size_t i = 0; i < N; i++) rows[i] = i;
+        return rows;
+    }
+    rows.reserve(S);
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    for (size_t i = 0; i < N && rows.size() < S; i++) {
+        if ((N - i) * u(rng) < double(S - rows.size())) rows.push_back(i);
+    }
+    return rows;
+}
+
+// a domina a b si no es peor en ningún objetivo y es mejor en alguno
+bool dominates(const TunePoint& a, const TunePoint& b) {
+    bool no_worse = a.recall >= b.recall && a.qps >= b.qps && a.index_mb <= b.index_mb;
+    bool better = a.recall > b.recall || a.qps > b.qps || a.index_mb < b.index_mb;
+    return no_worse && better;
+}
+
+void write_points(const std::string& path, const std::vector<TunePoint>& pts) {
+    std::ofstream f(path);
+    f << "M,efConstruction,efSearch,recall,qps,index_mb,rss_mb,build_time_s,pareto\n";
+    for (const auto& p : pts) {
+        f << p.M << "," << p.ef_construction << "," << p.ef_search << "," << p.recall << ","
+          << p.qps << "," << p.index_mb << "," << p.rss_mb << "," << p.build_time_s << ","
+          << (p.pareto ? 1 : 0) << "\n";
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        std::cerr << "Uso:\n"
+                  << argv[0] << " <embeddings.bin> <ids.bin> <queries.bin> <dim> <threads>"
+                  << " [--sample N] [--queries Q] [--metric l2|ip] [--M 8,16,32]"
+                  << " [--efc 100,200] [--target R] [--k K] [--ef-min E] [--ef-max E]"
+                  << " [--repeat R]\n";
+        return 1;
+    }
+
+    std::string emb_path = argv[1];
+    std::string ids_path = argv[2];
+    std::string queries_path = argv[3];
+    int dim = std::stoi(argv[4]);
+    int num_threads = std::stoi(argv[5]);
+
+    size_t sample = 100000;
+    size_t max_queries = 1000;
+    std::string metric_str = "l2";
+    std::vector<int> Ms = {8, 16, 32};
+    std::vector<int> efcs = {100, 200};
+    double target = 0.95;
+    size_t k = 10;
+    int ef_min = 10;
+    int ef_max = 1024;
+    size_t repeat = 1;
+    for (int a = 6; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--sample" && a + 1 < argc) {
+            sample = std::stoul(argv[++a]);
+        } else if (flag == "--queries" && a + 1 < argc) {
+            max_queries = std::stoul(argv[++a]);
+        } else if (flag == "--metric" && a + 1 < argc) {
+            metric_str = argv[++a];
+        } else if (flag == "--M" && a + 1 < argc) {
+            Ms = parse_int_list(argv[++a]);
+        } else if (flag == "--efc" && a + 1 < argc) {
+            efcs = parse_int_list(argv[++a]);
+        } else if (flag == "--target" && a + 1 < argc) {
+            target = std::stod(argv[++a]);
+        } else if (flag == "--k" && a + 1 < argc) {
+            k = std::stoul(argv[++a]);
+        } else if (flag == "--ef-min" && a + 1 < argc) {
+            ef_min = std::stoi(argv[++a]);
+        } else if (flag == "--ef-max" && a + 1 < argc) {
+            ef_max = std::stoi(argv[++a]);
+        } else if (flag == "--repeat" && a + 1 < argc) {
+            repeat = std::max<size_t>(1, std::stoul(argv[++a]));
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    Metric metric = parse_metric(metric_str);
+    ef_min = std::max<int>(ef_min, int(k));
+    ef_max = std::max(ef_max, ef_min);
+
+    std::cout << "=== AUTO-TUNING HNSW ===\n";
+    std::cout << "Métrica: " << metric_str << ", k: " << k << ", recall objetivo: " << target
+              << ", threads: " << num_threads << "\n";
+
+    // ---------- Muestra del dataset ----------
+    MappedDataset base(emb_path, dim);
+    MappedIds ids(ids_path);
+    std::vector<size_t> rows = sample_rows(base.size(), sample, 42);
+    size_t S = rows.size();
+    std::vector<float> data(S * dim);
+    std::vector<uint64_t> labels(S);
+    for (size_t i = 0; i < S; i++) {
+        const float* src = base.row(rows[i]);
+        if (metric == Metric::IP)
+            HNSWUtils::normalize_row(src, &data[i * dim], dim);
+        else
+            std::copy(src, src + dim, &data[i * dim]);
+        labels[i] = ids[rows[i]];
+    }
+    std::cout << "Muestra: " << S << " de " << base.size() << " vectores\n";
+
+    MappedDataset query_file(queries_path, dim);
+    size_t nq = std::min(max_queries, query_file.size());
+    if (nq == 0) {
+        std::cerr << "No hay queries que evaluar en " << queries_path << "\n";
+        return 1;
+    }
+    std::vector<float> queries(query_file.row(0), query_file.row(0) + nq * dim);
+    if (metric == Metric::IP) {
+        for (size_t q = 0; q < nq; q++)
+            HNSWUtils::normalize_row(&queries[q * dim], &queries[q * dim], dim);
+    }
+
+    // ---------- Ground truth exacto sobre la muestra ----------
+    std::cout << "Calculando ground truth sobre la muestra (" << nq << " queries)...\n";
+    BruteForce::Options bf;
+    bf.metric = metric;
+    bf.dim = dim;
+    bf.k = k;
+    bf.num_threads = num_threads;
+    KnnResults gt = BruteForce::search(
+        S, [&](size_t i) { return &data[i * dim]; }, [&](size_t i) { return labels[i]; },
+        queries.data(), nq, bf);
+
+    // ---------- Barrido ----------
+    std::vector<TunePoint> points;
+    std::vector<TunePoint> best_per_config;
+    SimdSpace space(metric, dim);
+
+    for (int M : Ms) {
+        for (int efc : efcs) {
+            std::cout << "\n--- M=" << M << ", efConstruction=" << efc << " ---\n";
+            size_t rss0 = MemoryMonitor::get_current_rss_kb();
+            auto index = std::make_unique<hnswlib::HierarchicalNSW<float>>(&space, S, M, efc, 100);
+
+            ParallelBuilder::Options opt;
+            opt.num_threads = num_threads;
+            opt.seed_count = std::min<size_t>(10000, S);
+            opt.progress_every = 0;
+            auto b0 = std::chrono::high_resolution_clock::now();
+            ParallelBuilder::build(*index, S, [&](size_t i) { return &data[i * dim]; },
+                                   labels.data(), opt);
+            auto b1 = std::chrono::high_resolution_clock::now();
+            double build_s = std::chrono::duration<double>(b1 - b0).count();
+            double index_mb = MemoryMonitor::index_bytes(*index) / (1024.0 * 1024.0);
+            double rss_mb = (double(MemoryMonitor::get_current_rss_kb()) - double(rss0)) / 1024.0;
+            std::cout << "Construcción: " << build_s << " s, índice: " << index_mb << " MB\n";
+
+            BatchSearcher searcher(HnswGraphView::from(*index), num_threads, 16);
+            KnnResults found(nq, k);
+            std::map<int, TunePoint> evaluated;
+
+            auto eval = [&](int ef) -> const TunePoint& {
+                auto it = evaluated.find(ef);
+                if (it != evaluated.end()) return it->second;
+                double best_qps = 0.0;
+                for (size_t r = 0; r < repeat; r++) {
+                    BatchSearchStats st = searcher.searchBatch(queries.data(), nq, dim, k, ef,
+                                                               found.ids.data(), found.dists.data());
+                    best_qps = std::max(best_qps, st.qps);
+                }
+                TunePoint p;
+                p.M = M;
+                p.ef_construction = efc;
+                p.ef_search = ef;
+                p.recall = recall_at(found, gt, k);
+                p.qps = best_qps;
+                p.index_mb = index_mb;
+                p.rss_mb = rss_mb;
+                p.build_time_s = build_s;
+                std::cout << "  ef=" << ef << " recall@" << k << "=" << p.recall << " QPS=" << p.qps
+                          << "\n";
+                return evaluated.emplace(ef, p).first->second;
+            };
+
+            // Crecimiento geométrico hasta alcanzar el objetivo...
+            int lo = ef_min - 1, hi = -1;
+            for (int ef = ef_min;; ef = std::min(ef * 2, ef_max)) {
+                if (eval(ef).recall >= target) {
+                    hi = ef;
+                    break;
+                }
+                lo = ef;
+                if (ef >= ef_max) break;
+            }
+            // ...y bisección entre el último ef que falla y el primero que cumple
+            if (hi > 0) {
+                while (hi - lo > std::max(1, lo / 16)) {
+                    int mid = lo + (hi - lo) / 2;
+                    if (eval(mid).recall >= target)
+                        hi = mid;
+                    else
+                        lo = mid;
+                }
+                best_per_config.push_back(evaluated.at(hi));
+                std::cout << "Menor efSearch con recall >= " << target << ": " << hi << "\n";
+            } else {
+                std::cout << "No se alcanzó el objetivo con efSearch <= " << ef_max << "\n";
+            }
+            for (const auto& kv : evaluated) points.push_back(kv.second);
+        }
+    }
+
+    // ---------- Frontera de Pareto ----------
+    std::vector<TunePoint> frontier;
+    for (auto& p : points) {
+        p.pareto = std::none_of(points.begin(), points.end(),
+                                [&](const TunePoint& o) { return dominates(o, p); });
+        if (p.pareto) frontier.push_back(p);
+    }
+    std::sort(frontier.begin(), frontier.end(),
+              [](const TunePoint& a, const TunePoint& b) { return a.recall < b.recall; });
+    write_points("tune_results.csv", points);
+    write_points("tune_pareto.csv", frontier);
+
+    // ---------- Recomendación ----------
+    std::ofstream rec("tune_recommendation.txt");
+    rec << "=== TUNING RECOMMENDATION ===\n";
+    rec << "Sample size: " << S << " of " << base.size() << "\n";
+    rec << "Queries: " << nq << "\n";
+    rec << "Metric: " << metric_str << "\n";
+    rec << "Target recall@" << k << ": " << target << "\n";
+    rec << "Points evaluated: " << points.size() << "\n";
+    rec << "Pareto points: " << frontier.size() << "\n\n";
+
+    std::cout << "\n=== RECOMENDACIÓN ===\n";
+    if (best_per_config.empty()) {
+        auto best = std::max_element(points.begin(), points.end(),
+                                     [](const TunePoint& a, const TunePoint& b) {
+                                         return a.recall < b.recall;
+                                     });
+        std::cout << "Ninguna configuración alcanza " << target << "; mejor recall: "
+                  << best->recall << " (M=" << best->M << ", efConstruction="
+                  << best->ef_construction << ", efSearch=" << best->ef_search << ")\n";
+        rec << "Target not reached. Best recall: " << best->recall << " (M=" << best->M
+            << ", efConstruction=" << best->ef_construction << ", efSearch=" << best->ef_search
+            << ")\n";
+    } else {
+        auto best = std::max_element(best_per_config.begin(), best_per_config.end(),
+                                     [](const TunePoint& a, const TunePoint& b) {
+                                         if (a.qps != b.qps) return a.qps < b.qps;
+                                         return a.index_mb > b.index_mb;
+                                     });
+        std::cout << "M=" << best->M << ", efConstruction=" << best->ef_construction
+                  << ", efSearch=" << best->ef_search << " -> recall@" << k << "="
+                  << best->recall << ", QPS=" << best->qps << ", índice " << best->index_mb
+                  << " MB (muestra)\n";
+        std::cout << "Construcción: hnsw_build_optimized <embeddings> <ids> " << dim << " "
+                  << best->M << " " << best->ef_construction << " " << metric_str
+                  << " <index.bin> <threads>\n";
+        std::cout << "Consulta: hnsw_query_optimized <index> <queries> <query_ids> " << dim << " "
+                  << k << " " << best->ef_search << " <threads>\n";
+        rec << "Recommended M: " << best->M << "\n";
+        rec << "Recommended efConstruction: " << best->ef_construction << "\n";
+        rec << "Recommended efSearch: " << best->ef_search << "\n";
+        rec << "Expected recall: " << best->recall << "\n";
+        rec << "Sample QPS: " << best->qps << "\n";
+        rec << "Sample index size: " << best->index_mb << " MB\n";
+        rec << "\nMinimum efSearch per configuration:\n";
+        for (const auto& p : best_per_config)
+            rec << "  M=" << p.M << " efConstruction=" << p.ef_construction
+                << " efSearch=" << p.ef_search << " recall=" << p.recall << " qps=" << p.qps
+                << "\n";
+    }
+    rec.close();
+
+    std::cout << "\nResultados guardados en tune_results.csv, tune_pareto.csv y "
+                 "tune_recommendation.txt\n";
+    return 0;
+}
@@ -0,0 +1,263 @@
+#include "../includes/half_precision.hpp"
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/index_update.hpp"
+#include "../includes/mapped_dataset.hpp"
+#include "../includes/memory_utils.hpp"
+#include "../includes/parallel_build.hpp"
+#include "../includes/pq.hpp"
+#include "../includes/simd_distance.hpp"
+#include "../includes/sq8.hpp"
+#include "hnswlib.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// =================== ACTUALIZACIÓN INCREMENTAL: ALTAS, BAJAS Y COMPACTACIÓN ===================
+//
+// Orden de las operaciones:
+//   1. bajas (--delete): markDelete de cada id de la lista de tombstones
+//   2. altas (--add): inserción paralela del delta; un id ya existente se
+//      actualiza en su sitio (y se reactiva si estaba borrado)
+//   3. compactación (--compact): reconecta los vecinos de los borrados y
+//      los elimina del archivo de salida
+// El formato de los vectores sale de los metadatos del índice (en índices
+// sin metadatos, de los archivos <index>.sq8 / <index>.pq que haya al
+// lado). SQ8 y PQ codifican el delta con los mismos parámetros (PQ con los
+// codebooks ya entrenados, distancias SDC) y copian el .sq8 / .pq junto a la
+// salida; fp16/bf16 convierten el delta al mismo formato.
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        std::cerr << "Uso:\n"
+                  << argv[0] << " <index_in> <dim> <ip|l2> <index_out> <threads>"
+                  << " [--add emb.bin ids.bin] [--delete tombstones.bin] [--compact] [--direct]\n"
+                  << "\nOpciones:\n"
+                  << "  --add E I      Inserta (o actualiza) los vectores de E con los ids de I\n"
+                  << "  --delete T     Marca como borrados los ids uint64 del archivo T\n"
+                  << "  --compact      Reconecta los vecinos de los borrados y los elimina\n"
+                  << "  --direct       Escribe el índice con O_DIRECT\n";
+        return 1;
+    }
+
+    std::string in_path = argv[1];
+    int dim = std::stoi(argv[2]);
+    std::string space_type = argv[3];
+    std::string out_path = argv[4];
+    int num_threads = std::max(1, std::stoi(argv[5]));
+
+    std::string add_emb, add_ids, delete_path;
+    bool compact = false;
+    index_io::SaveOptions save_opt;
+    save_opt.threads = num_threads;
+    for (int a = 6; a < argc; a++) {
+        std::string flag = argv[a];
+        if (flag == "--add" && a + 2 < argc) {
+            add_emb = argv[++a];
+            add_ids = argv[++a];
+        } else if (flag == "--delete" && a + 1 < argc) {
+            delete_path = argv[++a];
+        } else if (flag == "--compact") {
+            compact = true;
+        } else if (flag == "--direct") {
+            save_opt.direct = true;
+        } else {
+            std::cerr << "Opción desconocida: " << flag << "\n";
+            return 1;
+        }
+    }
+    Metric metric = parse_metric(space_type);
+    // Un índice con metadatos no admite otra métrica u otra dimensión
+    IndexMeta meta = IndexMeta::read(in_path);
+    meta.check_dim(dim);
+    if (meta.present && meta.metric != metric) {
+        std::cerr << "El índice es " << metric_name(meta.metric) << ", no " << space_type << "\n";
+        return 1;
+    }
+    VectorStorage storage = meta.storage;
+    if (!meta.present) {
+        if (access(SQ8Params::path_for(in_path).c_str(), R_OK) == 0)
+            storage = VectorStorage::SQ8;
+        else if (access(PQParams::path_for(in_path).c_str(), R_OK) == 0)
+            storage = VectorStorage::PQ;
+    }
+    bool half = storage == VectorStorage::FP16 || storage == VectorStorage::BF16;
+    bool sq8 = storage == VectorStorage::SQ8;
+    bool pq = storage == VectorStorage::PQ;
+
+    std::cout << "=== ACTUALIZACIÓN INCREMENTAL HNSW ===\n";
+    std::cout << "Índice: " << in_path << " -> " << out_path << "\n";
+    std::cout << "Dimensión: " << dim << ", métrica: " << space_type << ", vectores: "
+              << storage_name(storage) << ", hilos: " << num_threads << "\n";
+
+    // ---------- Delta ----------
+    MappedDataset delta;
+    MappedIds delta_ids;
+    size_t N_add = 0;
+    if (!add_emb.empty()) {
+        delta = MappedDataset(add_emb, dim);
+        delta_ids = MappedIds(add_ids);
+        if (delta.size() != delta_ids.size())
+            throw std::runtime_error("Número de embeddings e IDs del delta no coincide");
+        N_add = delta.size();
+    }
+    MappedIds tombstones;
+    if (!delete_path.empty()) tombstones = MappedIds(delete_path);
+
+    // ---------- Carga con capacidad para el delta ----------
+    std::unique_ptr<hnswlib::SpaceInterface<float>> space;
+    SQ8Params sq8_params;
+    PQParams pq_params;
+    HalfSpace* half_space = nullptr;
+    std::string kernel_desc;
+    if (half) {
+        half_space = new HalfSpace(metric, parse_half_format(storage_name(meta.storage)), dim);
+        kernel_desc = half_space->description();
+        space.reset(half_space);
+    } else if (sq8) {
+        sq8_params = SQ8Params::load(SQ8Params::path_for(in_path));
+        if (sq8_params.dim != dim) throw std::runtime_error("Dimensión del cuantizador no coincide");
+        SQ8Space* s = new SQ8Space(metric, sq8_params);
+        kernel_desc = s->description();
+        space.reset(s);
+    } else if (pq) {
+        pq_params = PQParams::load(PQParams::path_for(in_path));
+        if (pq_params.dim != dim) throw std::runtime_error("Dimensión de los codebooks PQ no coincide");
+        PQSpace* s = new PQSpace(metric, pq_params, PQSpace::Mode::Sdc);
+        kernel_desc = s->description();
+        space.reset(s);
+    } else {
+        SimdSpace* s = new SimdSpace(metric, dim);
+        kernel_desc = s->description();
+        space.reset(s);
+    }
+    std::cout << "Kernel de distancia: " << kernel_desc << "\n";
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    // La capacidad para el delta (count + N_add) se reserva al cargar, en vez
+    // de cargar y luego hacer resizeIndex (que copiaría la capa 0 otra vez)
+    size_t initial = index_io::element_count(in_path);
+    auto index = index_io::load(space.get(), in_path, initial + N_add);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    double load_time = std::chrono::duration<double>(t1 - t0).count();
+    size_t initial_deleted = index->getDeletedCount();
+    std::cout << "Índice cargado en " << load_time << " s: " << initial << " elementos ("
+              << initial_deleted << " ya borrados), capacidad " << index->max_elements_ << "\n";
+    MemoryMonitor::print_memory_usage("Índice cargado");
+
+    // ---------- 1. Bajas ----------
+    size_t missing = 0;
+    double delete_time = 0.0;
+    if (tombstones.size() > 0) {
+        auto d0 = std::chrono::high_resolution_clock::now();
+        missing = IndexMaintenance::apply_tombstones(*index, tombstones.data(), tombstones.size());
+        delete_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - d0).count();
+        std::cout << "Bajas: " << (tombstones.size() - missing) << " marcadas, " << missing
+                  << " ids inexistentes (" << delete_time << " s)\n";
+    }
+
+    // ---------- 2. Altas ----------
+    size_t updated = 0;
+    double insert_time = 0.0;
+    ParallelBuildReport insert_report;
+    if (N_add > 0) {
+        for (size_t i = 0; i < N_add; i++)
+            if (index->label_lookup_.count(hnswlib::labeltype(delta_ids[i]))) updated++;
+
+        ParallelBuilder::Options opt;
+        opt.num_threads = num_threads;
+        opt.seed_count = initial > 0 ? 0 : ParallelBuilder::Options().seed_count;
+        opt.progress_every = 0;
+        opt.normalize = metric == Metric::IP;
+        opt.dim = dim;
+        if (sq8) {
+            opt.encode = [&sq8_params](const float* x, uint8_t* code) { sq8_params.encode(x, code); };
+            opt.code_size = dim;
+        } else if (pq) {
+            opt.encode = [&pq_params](const float* x, uint8_t* code) { pq_params.encode(x, code); };
+            opt.code_size = size_t(pq_params.m);
+        } else if (half) {
+            opt.encode = [half_space](const float* x, uint8_t* code) {
+                half_space->encode(x, reinterpret_cast<uint16_t*>(code));
+            };
+            opt.code_size = dim * sizeof(uint16_t);
+        }
+        EmbeddingView view = delta.view();
+        auto row = [view](size_t i) { return view.row(i); };
+        std::cout << "Insertando " << N_add << " vectores (" << updated << " ids existentes)...\n";
+        auto i0 = std::chrono::high_resolution_clock::now();
+        insert_report = ParallelBuilder::build(*index, N_add, row, delta_ids.data(), opt);
+        insert_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - i0).count();
+        std::cout << "Altas: " << (N_add - updated) << " nuevas, " << updated << " actualizadas ("
+                  << insert_time << " s, " << (N_add / insert_time) << " vec/s)\n";
+    }
+    MemoryMonitor::print_memory_usage("Actualizado");
+
+    // ---------- 3. Compactación ----------
+    CompactionReport compaction;
+    double compact_time = 0.0;
+    mapped_index::IndexImage image;
+    if (compact) {
+        auto c0 = std::chrono::high_resolution_clock::now();
+        compaction = IndexMaintenance::repair_deleted(*index, num_threads);
+        image = IndexMaintenance::compacted_image(*index);
+        compact_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - c0).count();
+        std::cout << "Compactación: " << compaction.deleted << " borrados eliminados, "
+                  << compaction.repaired_lists << " listas reconectadas (" << compact_time << " s)\n";
+    } else {
+        image = mapped_index::IndexImage::from_index(*index);
+    }
+
+    // Recall@1 del delta contra el índice actualizado (antes de renumerar)
+    double delta_recall = 0.0;
+    if (N_add > 0) {
+        index->setEf(std::max<size_t>(index->ef_construction_, 64));
+        // El vector se busca tal como quedó guardado (normalizado/codificado)
+        auto stored = [&](size_t i) {
+            auto it = index->label_lookup_.find(hnswlib::labeltype(delta_ids[i]));
+            return static_cast<const void*>(index->getDataByInternalId(it->second));
+        };
+        auto label = [&](size_t i) { return hnswlib::labeltype(delta_ids[i]); };
+        delta_recall = ParallelBuilder::self_recall(*index, N_add, stored, label, 1000, num_threads);
+        std::cout << "Self-recall@1 del delta: " << delta_recall << "\n";
+    }
+
+    // ---------- Guardado ----------
+    if (!meta.present) meta = IndexMeta::make(metric, dim, storage);
+    meta.stamp(image.header);
+    index_io::SaveReport saved = index_io::save(image, out_path, save_opt);
+    if (sq8) sq8_params.save(SQ8Params::path_for(out_path));
+    if (pq) pq_params.save(PQParams::path_for(out_path));
+    size_t final_count = image.header.count;
+    std::cout << "✓ Índice guardado en " << out_path << ": " << final_count << " elementos ("
+              << saved.total_s << " s, " << saved.mb_per_s() << " MB/s)\n";
+
+    std::ofstream sf("update_metrics.csv");
+    sf << "metric,value\n";
+    sf << "initial_elements," << initial << "\n";
+    sf << "initial_deleted," << initial_deleted << "\n";
+    sf << "tombstones," << tombstones.size() << "\n";
+    sf << "tombstones_missing," << missing << "\n";
+    sf << "added," << (N_add - updated) << "\n";
+    sf << "updated," << updated << "\n";
+    sf << "compacted," << (compact ? 1 : 0) << "\n";
+    sf << "removed," << compaction.deleted << "\n";
+    sf << "repaired_lists," << compaction.repaired_lists << "\n";
+    sf << "final_elements," << final_count << "\n";
+    sf << "load_time_s," << load_time << "\n";
+    sf << "delete_time_s," << delete_time << "\n";
+    sf << "insert_time_s," << insert_time << "\n";
+    sf << "insert_throughput_vec_s," << (insert_time > 0 ? N_add / insert_time : 0.0) << "\n";
+    sf << "compact_time_s," << compact_time << "\n";
+    sf << "save_time_s," << saved.total_s << "\n";
+    sf << "save_mb_per_s," << saved.mb_per_s() << "\n";
+    sf << "delta_self_recall_at_1," << delta_recall << "\n";
+    sf << "peak_rss_mb," << MemoryMonitor::get_peak_rss_mb() << "\n";
+    sf.close();
+    std::cout << "Métricas guardadas en update_metrics.csv\n";
+    return 0;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// =================== SOPORTE MÍNIMO DE PRUEBAS ===================
+//
+// Cada archivo de tests/ es un ejecutable independiente que registra sus
+// casos en run_tests(); ctest lo da por bueno si devuelve 0. Los fallos
+// se reportan con std::runtime_error, igual que en el resto del proyecto,
+// y CHECK funciona también con -DNDEBUG (el build siempre es Release).
+
+#define CHECK(cond)                                                                          \
+    do {                                                                                     \
+        if (!(cond))                                                                         \
+            throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + \
+                                     ": falló " #cond);                                      \
+    } while (0)
+
+// |a - b| <= tol, con los valores en el mensaje
+#define CHECK_NEAR(a, b, tol)                                                                 \
+    do {                                                                                      \
+        double va_ = double(a), vb_ = double(b);                                              \
+        if (!(std::fabs(va_ - vb_) <= double(tol)))                                           \
+            throw std::runtime_error(std::string(__FILE__) + ":" + std::to_string(__LINE__) + \
+                                     ": " #a " = " + std::to_string(va_) + ", " #b " = " +    \
+                                     std::to_string(vb_) + " (tolerancia " +                  \
+                                     std::to_string(double(tol)) + ")");                      \
+    } while (0)
+
+namespace testing {
+
+using TestCase = std::pair<const char *, std::function<void()>>;
+
+inline int run_tests(const char *suite, const std::vector<TestCase> &cases) {
+    int failed = 0;
+    for (const auto &c : cases) {
+        try {
+            c.second();
+            std::cout << "[ OK ] " << suite << "." << c.first << "\n";
+        } catch (const std::exception &e) {
+            failed++;
+            std::cout << "[FALLO] " << suite << "." << c.first << ": " << e.what() << "\n";
+        }
+    }
+    std::cout << suite << ": " << cases.size() - failed << "/" << cases.size() << " correctos\n";
+    return failed == 0 ? 0 : 1;
+}
+
+// El cuerpo debe lanzar std::exception; devuelve el mensaje para
+// comprobar además el motivo
+inline std::string expect_throw(const std::function<void()> &body) {
+    try {
+        body();
+    } catch (const std::exception &e) {
+        return e.what();
+    }
+    throw std::runtime_error("se esperaba una excepción");
+}
+
+inline bool contains(const std::string &s, const std::string &part) {
+    return s.find(part) != std::string::npos;
+}
+
+// n vectores de dim floats en [-1, 1), reproducibles por semilla
+inline std::vector<float> random_vectors(size_t n, int dim, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> u(-1.0f, 1.0f);
+    std::vector<float> v(n * size_t(dim));
+    for (auto &x : v) x = u(rng);
+    return v;
+}
+
+inline void normalize_rows(std::vector<float> &v, int dim) {
+    for (size_t i = 0; i < v.size() / dim; i++) {
+        float *row = &v[i * dim];
+        double s = 0.0;
+        for (int d = 0; d < dim; d++) s += double(row[d]) * row[d];
+        float inv = s > 0 ? float(1.0 / std::sqrt(s)) : 0.0f;
+        for (int d = 0; d < dim; d++) row[d] *= inv;
+    }
+}
+
+// Archivo temporal en el directorio de trabajo de ctest, borrado al salir
+class TempFile {
+private:
+    std::string path_;
+
+public:
+    explicit TempFile(const std::string &name) : path_(name) { std::remove(path_.c_str()); }
+    ~TempFile() {
+        std::remove(path_.c_str());
+        std::remove((path_ + ".tmp").c_str());
+    }
+    TempFile(const TempFile &) = delete;
+    TempFile &operator=(const TempFile &) = delete;
+
+    const std::string &path() const { return path_; }
+};
+
+}  // namespace testing
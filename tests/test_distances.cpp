@@ -0,0 +1,232 @@
+#include "../includes/half_precision.hpp"
+#include "../includes/pq.hpp"
+#include "../includes/simd_distance.hpp"
+#include "../includes/sq8.hpp"
+#include "test_common.hpp"
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Kernels de distancia (fp32 SIMD, SQ8, PQ, fp16/bf16) contra referencias
+// escalares en double sobre los mismos vectores (decodificados cuando el
+// formato es cuantizado). Se prueba cada nivel SIMD que soporte la CPU.
+
+namespace {
+
+double ref_l2(const float *a, const float *b, size_t n) {
+    double s = 0.0;
+    for (size_t i = 0; i < n; i++) s += (double(a[i]) - b[i]) * (double(a[i]) - b[i]);
+    return s;
+}
+
+double ref_dot(const float *a, const float *b, size_t n) {
+    double s = 0.0;
+    for (size_t i = 0; i < n; i++) s += double(a[i]) * b[i];
+    return s;
+}
+
+double ref_dist(Metric metric, const float *a, const float *b, size_t n) {
+    return metric == Metric::L2 ? ref_l2(a, b, n) : 1.0 - ref_dot(a, b, n);
+}
+
+// Suma en float con otro orden de acumulación: error relativo ~1e-6 por término
+double tolerance(double ref, size_t n) { return 1e-5 * (1.0 + std::fabs(ref)) * (1.0 + n / 64.0); }
+
+std::vector<SimdLevel> supported_levels() {
+    std::vector<SimdLevel> out;
+    for (SimdLevel l : {SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512})
+        if (CpuFeatures::supports(l)) out.push_back(l);
+    return out;
+}
+
+const Metric METRICS[] = {Metric::L2, Metric::IP};
+
+// Dimensiones con colas que no llenan un registro y las de kernel fijo
+const size_t DIMS[] = {1, 7, 16, 31, 33, 96, 100, 128, 768};
+
+void test_raw_kernels() {
+    for (size_t dim : DIMS) {
+        auto v = testing::random_vectors(8, int(dim), 11 + unsigned(dim));
+        for (SimdLevel level : supported_levels()) {
+            RawDistFn l2 = DistanceKernels::raw(Metric::L2, level);
+            RawDistFn dot = DistanceKernels::raw(Metric::IP, level);
+            for (size_t i = 0; i + 1 < 8; i++) {
+                const float *a = &v[i * dim], *b = &v[(i + 1) * dim];
+                double r2 = ref_l2(a, b, dim), rd = ref_dot(a, b, dim);
+                CHECK_NEAR(l2(a, b, dim), r2, tolerance(r2, dim));
+                CHECK_NEAR(dot(a, b, dim), rd, tolerance(rd, dim));
+            }
+        }
+    }
+}
+
+// SimdSpace elige kernel de dimensión fija o genérico según dim
+void test_simd_space() {
+    for (size_t dim : DIMS) {
+        auto v = testing::random_vectors(6, int(dim), 23 + unsigned(dim));
+        for (Metric metric : METRICS) {
+            for (SimdLevel level : supported_levels()) {
+                SimdSpace space(metric, dim, level);
+                auto fn = space.get_dist_func();
+                for (size_t i = 0; i + 1 < 6; i++) {
+                    double ref = ref_dist(metric, &v[i * dim], &v[(i + 1) * dim], dim);
+                    CHECK_NEAR(fn(&v[i * dim], &v[(i + 1) * dim], space.get_dist_func_param()), ref,
+                               tolerance(ref, dim));
+                }
+            }
+        }
+    }
+}
+
+void test_normalizer() {
+    for (size_t dim : DIMS) {
+        auto v = testing::random_vectors(4, int(dim), 37 + unsigned(dim));
+        for (SimdLevel level : supported_levels()) {
+            NormalizeFn normalize = DistanceKernels::normalizer(level);
+            std::vector<float> out(dim);
+            for (size_t i = 0; i < 4; i++) {
+                const float *x = &v[i * dim];
+                normalize(x, out.data(), dim);
+                double norm = std::sqrt(ref_dot(x, x, dim));
+                CHECK_NEAR(ref_dot(out.data(), out.data(), dim), 1.0, 1e-5);
+                for (size_t d = 0; d < dim; d++) CHECK_NEAR(out[d], x[d] / norm, 1e-5);
+            }
+        }
+    }
+}
+
+// SQ8: la distancia sobre códigos es la de los vectores decodificados
+void test_sq8() {
+    const int dim = 45;
+    const size_t n = 300;
+    for (Metric metric : METRICS) {
+        auto data = testing::random_vectors(n, dim, 51);
+        if (metric == Metric::IP) testing::normalize_rows(data, dim);
+        SQ8Params params = SQ8Params::train(
+            n, dim, [&](size_t i, float *out) { std::memcpy(out, &data[i * dim], dim * sizeof(float)); }, 2);
+
+        std::vector<uint8_t> codes(n * dim);
+        std::vector<float> decoded(n * dim);
+        for (size_t i = 0; i < n; i++) {
+            params.encode(&data[i * dim], &codes[i * dim]);
+            params.decode(&codes[i * dim], &decoded[i * dim]);
+            // Redondeo al código más cercano: error <= scale / 2 por dimensión
+            for (int d = 0; d < dim; d++)
+                CHECK_NEAR(decoded[i * dim + d], data[i * dim + d], params.scale[d] * 0.5f + 1e-6f);
+        }
+
+        for (SimdLevel level : supported_levels()) {
+            SQ8Space space(metric, params, level);
+            auto fn = space.get_dist_func();
+            CHECK(space.get_data_size() == size_t(dim));
+            for (size_t i = 0; i + 1 < n; i += 7) {
+                double ref = ref_dist(metric, &decoded[i * dim], &decoded[(i + 1) * dim], dim);
+                CHECK_NEAR(fn(&codes[i * dim], &codes[(i + 1) * dim], space.get_dist_func_param()), ref,
+                           tolerance(ref, dim));
+            }
+        }
+    }
+}
+
+// PQ: SDC contra la distancia entre centroides, ADC contra la distancia de
+// la query en float al vector reconstruido
+void test_pq() {
+    const int dim = 32, m = 8;
+    const size_t n = 1024;
+    for (Metric metric : METRICS) {
+        auto data = testing::random_vectors(n, dim, 67);
+        if (metric == Metric::IP) testing::normalize_rows(data, dim);
+        PQParams params = PQParams::train(
+            n, dim, m, [&](size_t i, float *out) { std::memcpy(out, &data[i * dim], dim * sizeof(float)); },
+            2, n, 4);
+        CHECK(params.dsub == dim / m);
+
+        std::vector<uint8_t> codes(n * m);
+        std::vector<float> decoded(n * dim);
+        for (size_t i = 0; i < n; i++) {
+            params.encode(&data[i * dim], &codes[i * m]);
+            params.decode(&codes[i * m], &decoded[i * dim]);
+        }
+        auto queries = testing::random_vectors(16, dim, 71);
+        if (metric == Metric::IP) testing::normalize_rows(queries, dim);
+
+        PQSpace sdc(metric, params, PQSpace::Mode::Sdc);
+        for (size_t i = 0; i + 1 < n; i += 31) {
+            double ref = ref_dist(metric, &decoded[i * dim], &decoded[(i + 1) * dim], dim);
+            CHECK_NEAR(sdc.get_dist_func()(&codes[i * m], &codes[(i + 1) * m], sdc.get_dist_func_param()),
+                       ref, tolerance(ref, dim));
+        }
+
+        std::vector<float> lut(params.table_floats());
+        for (SimdLevel level : supported_levels()) {
+            PQSpace adc(metric, params, PQSpace::Mode::Adc, level);
+            auto fn = adc.get_dist_func();
+            for (size_t q = 0; q < 16; q++) {
+                params.adc_table(&queries[q * dim], metric, lut.data());
+                for (size_t i = 0; i < n; i += 53) {
+                    double ref = ref_dist(metric, &queries[q * dim], &decoded[i * dim], dim);
+                    CHECK_NEAR(fn(lut.data(), &codes[i * m], adc.get_dist_func_param()), ref,
+                               tolerance(ref, dim));
+                }
+            }
+        }
+    }
+}
+
+// Conversión escalar: ida y vuelta exacta para valores representables y
+// error relativo acotado por la mantisa de cada formato
+void test_half_conversion() {
+    for (float x : {0.0f, 1.0f, -2.5f, 0.000061035156f, 65504.0f})
+        CHECK(fp16_to_fp32(fp32_to_fp16(x)) == x);
+    for (float x : {0.0f, 1.0f, -2.5f, std::ldexp(1.0f, 100)})
+        CHECK(bf16_to_fp32(fp32_to_bf16(x)) == x);
+    auto v = testing::random_vectors(1, 4096, 79);
+    std::vector<uint16_t> simd(v.size()), scalar(v.size());
+    HalfCodec::encode(HalfFormat::FP16, v.data(), simd.data(), v.size());
+    for (size_t i = 0; i < v.size(); i++) {
+        scalar[i] = fp32_to_fp16(v[i]);
+        // F16C y la conversión escalar redondean igual (al par más cercano)
+        CHECK(simd[i] == scalar[i]);
+        CHECK_NEAR(fp16_to_fp32(scalar[i]), v[i], std::fabs(v[i]) / 2048.0 + 6e-8);
+        CHECK_NEAR(bf16_to_fp32(fp32_to_bf16(v[i])), v[i], std::fabs(v[i]) / 256.0);
+    }
+}
+
+void test_half_kernels() {
+    for (size_t dim : DIMS) {
+        auto v = testing::random_vectors(6, int(dim), 83 + unsigned(dim));
+        for (HalfFormat fmt : {HalfFormat::FP16, HalfFormat::BF16}) {
+            std::vector<uint16_t> codes(v.size());
+            std::vector<float> decoded(v.size());
+            HalfCodec::encode(fmt, v.data(), codes.data(), v.size());
+            HalfCodec::decode(fmt, codes.data(), decoded.data(), v.size());
+            for (Metric metric : METRICS) {
+                for (SimdLevel level : supported_levels()) {
+                    HalfSpace space(metric, fmt, dim, level);
+                    auto fn = space.get_dist_func();
+                    for (size_t i = 0; i + 1 < 6; i++) {
+                        double ref = ref_dist(metric, &decoded[i * dim], &decoded[(i + 1) * dim], dim);
+                        // vdpbf16ps acumula los productos de a pares: algo más de error
+                        double tol = tolerance(ref, dim) * (fmt == HalfFormat::BF16 ? 4.0 : 1.0);
+                        CHECK_NEAR(fn(&codes[i * dim], &codes[(i + 1) * dim], space.get_dist_func_param()),
+                                   ref, tol);
+                    }
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    return testing::run_tests("distances", {
+        {"raw_kernels", test_raw_kernels},
+        {"simd_space", test_simd_space},
+        {"normalizer", test_normalizer},
+        {"sq8", test_sq8},
+        {"pq", test_pq},
+        {"half_conversion", test_half_conversion},
+        {"half_kernels", test_half_kernels},
+    });
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include "../includes/simd_distance.hpp"
+#include "hnswlib.h"
+#include "test_common.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Índices pequeños y referencias exactas compartidas por las pruebas de
+// guardado y de actualización. Los labels son 1000 + fila para no
+// confundirlos con los ids internos.
+
+namespace testing {
+
+using Index = hnswlib::HierarchicalNSW<float>;
+
+inline uint64_t label_of(size_t row) { return 1000 + row; }
+
+inline std::unique_ptr<Index> build_index(SimdSpace &space, const std::vector<float> &data, int dim,
+                                          size_t capacity = 0, size_t M = 12, size_t efc = 100) {
+    size_t n = data.size() / dim;
+    std::unique_ptr<Index> index(new Index(&space, std::max(capacity, n), M, efc, 100));
+    for (size_t i = 0; i < n; i++) index->addPoint(&data[i * dim], label_of(i));
+    return index;
+}
+
+// k vecinos exactos de cada query entre las filas con live[fila] = true
+inline std::vector<std::vector<uint64_t>> exact_knn(Metric metric, const std::vector<float> &data,
+                                                    const std::vector<float> &queries, int dim,
+                                                    size_t k, const std::vector<bool> &live) {
+    size_t n = data.size() / dim, nq = queries.size() / dim;
+    std::vector<std::vector<uint64_t>> out(nq);
+    std::vector<std::pair<double, size_t>> cand;
+    for (size_t q = 0; q < nq; q++) {
+        cand.clear();
+        for (size_t i = 0; i < n; i++) {
+            if (!live[i]) continue;
+            double s = 0.0;
+            for (int d = 0; d < dim; d++) {
+                double a = queries[q * dim + d], b = data[i * dim + d];
+                s += metric == Metric::L2 ? (a - b) * (a - b) : -a * b;
+            }
+            cand.emplace_back(s, i);
+        }
+        size_t kk = std::min(k, cand.size());
+        std::partial_sort(cand.begin(), cand.begin() + kk, cand.end());
+        for (size_t j = 0; j < kk; j++) out[q].push_back(label_of(cand[j].second));
+    }
+    return out;
+}
+
+// Labels devueltos por searchKnn, del más cercano al más lejano
+inline std::vector<uint64_t> search_labels(Index &index, const float *q, size_t k) {
+    auto res = index.searchKnn(q, k);
+    std::vector<uint64_t> out(res.size());
+    for (size_t i = res.size(); i-- > 0; res.pop()) out[i] = res.top().second;
+    return out;
+}
+
+inline double recall(Index &index, const std::vector<float> &queries, int dim,
+                     const std::vector<std::vector<uint64_t>> &truth, size_t k) {
+    size_t hits = 0, total = 0;
+    for (size_t q = 0; q < truth.size(); q++) {
+        std::vector<uint64_t> found = search_labels(index, &queries[q * dim], k);
+        std::set<uint64_t> expected(truth[q].begin(), truth[q].end());
+        for (uint64_t l : found) hits += expected.count(l);
+        total += truth[q].size();
+    }
+    return total ? double(hits) / total : 0.0;
+}
+
+inline std::vector<char> read_file(const std::string &path) {
+    std::ifstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("No se pudo abrir: " + path);
+    return std::vector<char>(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+}
+
+inline void write_file(const std::string &path, const std::vector<char> &bytes) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(bytes.data(), std::streamsize(bytes.size()));
+    if (!f) throw std::runtime_error("No se pudo escribir: " + path);
+}
+
+}  // namespace testing
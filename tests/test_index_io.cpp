@@ -0,0 +1,216 @@
+#include "../includes/index_io.hpp"
+#include "../includes/index_meta.hpp"
+#include "../includes/mapped_index.hpp"
+#include "test_index.hpp"
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Guardado y carga del formato mapeable (VERSION 2, CRC32C por sección) y
+// del formato saveIndex de hnswlib: ida y vuelta exacta, y rechazo de
+// archivos corruptos o fabricados con una cabecera coherente en su CRC
+// pero incoherente con el contenido.
+
+using namespace testing;
+using mapped_index::Header;
+
+namespace {
+
+const int DIM = 16;
+const size_t N = 1500;
+
+struct Fixture {
+    std::vector<float> data = random_vectors(N, DIM, 101);
+    std::vector<float> queries = random_vectors(50, DIM, 103);
+    SimdSpace space{Metric::L2, DIM};
+    std::unique_ptr<Index> index = build_index(space, data, DIM);
+};
+
+// Mismo grafo, mismos vectores y mismos labels
+void check_same_index(const Index &a, const Index &b) {
+    CHECK(a.cur_element_count == b.cur_element_count);
+    CHECK(a.maxlevel_ == b.maxlevel_);
+    CHECK(a.enterpoint_node_ == b.enterpoint_node_);
+    CHECK(a.size_data_per_element_ == b.size_data_per_element_);
+    CHECK(a.M_ == b.M_ && a.maxM0_ == b.maxM0_ && a.ef_construction_ == b.ef_construction_);
+    size_t n = a.cur_element_count;
+    CHECK(std::memcmp(a.data_level0_memory_, b.data_level0_memory_, n * a.size_data_per_element_) == 0);
+    for (size_t i = 0; i < n; i++) {
+        CHECK(a.element_levels_[i] == b.element_levels_[i]);
+        if (a.element_levels_[i] > 0)
+            CHECK(std::memcmp(a.linkLists_[i], b.linkLists_[i],
+                              size_t(a.element_levels_[i]) * a.size_links_per_element_) == 0);
+    }
+    CHECK(a.label_lookup_.size() == b.label_lookup_.size());
+    for (const auto &e : a.label_lookup_) {
+        auto it = b.label_lookup_.find(e.first);
+        CHECK(it != b.label_lookup_.end() && it->second == e.second);
+    }
+}
+
+void check_same_results(Index &a, Index &b, const std::vector<float> &queries) {
+    a.setEf(50);
+    b.setEf(50);
+    for (size_t q = 0; q < queries.size() / DIM; q++)
+        CHECK(search_labels(a, &queries[q * DIM], 10) == search_labels(b, &queries[q * DIM], 10));
+}
+
+void test_mapped_round_trip() {
+    Fixture f;
+    TempFile file("test_index_io_round_trip.bin");
+    auto image = mapped_index::IndexImage::from_index(*f.index);
+    IndexMeta meta = IndexMeta::make(Metric::L2, DIM);
+    meta.m = f.index->M_;
+    meta.ef_construction = f.index->ef_construction_;
+    meta.stamp(image.header);
+    index_io::save(image, file.path());
+
+    CHECK(mapped_index::is_mapped_format(file.path()));
+    CHECK(index_io::element_count(file.path()) == N);
+    auto loaded = index_io::load(&f.space, file.path());
+    check_same_index(*f.index, *loaded);
+    check_same_results(*f.index, *loaded, f.queries);
+
+    IndexMeta back = IndexMeta::read(file.path());
+    CHECK(back.present && back.metric == Metric::L2 && back.dim == uint32_t(DIM));
+    CHECK(!back.normalized && back.m == meta.m && back.ef_construction == meta.ef_construction);
+
+    // El mmap sin copia ve los mismos labels e ids internos
+    MappedIndex::Options opt;
+    opt.verify = true;
+    MappedIndex mapped(file.path(), &f.space, opt);
+    CHECK(mapped.size() == N);
+    for (size_t i = 0; i < N; i += 97)
+        CHECK(mapped.internal_id(label_of(i)) == int64_t(f.index->label_lookup_.at(label_of(i))));
+    CHECK(mapped.internal_id(label_of(N)) < 0);
+}
+
+// Capacidad extra al cargar: el índice sigue aceptando inserciones
+void test_load_with_capacity() {
+    Fixture f;
+    TempFile file("test_index_io_capacity.bin");
+    index_io::save(*f.index, file.path());
+    auto loaded = index_io::load(&f.space, file.path(), N + 10);
+    CHECK(loaded->max_elements_ == N + 10);
+    auto extra = random_vectors(10, DIM, 107);
+    for (size_t i = 0; i < 10; i++) loaded->addPoint(&extra[i * DIM], label_of(N + i));
+    CHECK(search_labels(*loaded, &extra[3 * DIM], 1)[0] == label_of(N + 3));
+}
+
+// saveIndex de hnswlib: se carga directamente y se convierte al formato mapeable
+void test_legacy_format() {
+    Fixture f;
+    TempFile legacy("test_index_io_legacy.hnswlib");
+    TempFile converted("test_index_io_converted.bin");
+    f.index->saveIndex(legacy.path());
+    CHECK(!mapped_index::is_mapped_format(legacy.path()));
+    CHECK(index_io::element_count(legacy.path()) == N);
+    auto direct = index_io::load(&f.space, legacy.path());
+    check_same_index(*f.index, *direct);
+
+    auto image = mapped_index::IndexImage::from_legacy_file(legacy.path());
+    index_io::save(image, converted.path());
+    auto loaded = index_io::load(&f.space, converted.path());
+    check_same_index(*f.index, *loaded);
+    check_same_results(*f.index, *loaded, f.queries);
+}
+
+// Archivo guardado del índice de prueba, para corromperlo de varias formas
+struct SavedIndex {
+    Fixture f;
+    TempFile file{"test_index_io_corrupt.bin"};
+    std::vector<char> bytes;
+
+    SavedIndex() {
+        index_io::save(*f.index, file.path());
+        bytes = read_file(file.path());
+    }
+
+    Header &header() { return *reinterpret_cast<Header *>(bytes.data()); }
+
+    // Aplica el cambio, opcionalmente rehace el CRC de la cabecera y
+    // devuelve el error de carga (falla si la carga no lanza)
+    std::string load_error(const std::function<void(SavedIndex &)> &tamper, bool fix_header_crc,
+                           bool verify = true) {
+        std::vector<char> original = bytes;
+        tamper(*this);
+        if (fix_header_crc) header().header_checksum = mapped_index::header_crc(header());
+        write_file(file.path(), bytes);
+        bytes = original;
+        return expect_throw([&] { index_io::load(&f.space, file.path(), 0, verify); });
+    }
+};
+
+void test_rejects_corrupted_section() {
+    SavedIndex s;
+    uint64_t off = s.header().sections[mapped_index::SEC_LEVEL0].offset;
+    auto flip = [&](SavedIndex &x) { x.bytes[off + 100] ^= 0x20; };
+    std::string err = s.load_error(flip, false);
+    CHECK(contains(err, "Checksum incorrecto en la sección level0"));
+
+    // Sin verificar se carga (el grafo sigue siendo coherente)
+    std::vector<char> bad = s.bytes;
+    bad[off + 100] ^= 0x20;
+    write_file(s.file.path(), bad);
+    auto loaded = index_io::load(&s.f.space, s.file.path(), 0, false);
+    CHECK(loaded->cur_element_count == N);
+}
+
+void test_rejects_corrupted_labels() {
+    SavedIndex s;
+    uint64_t off = s.header().sections[mapped_index::SEC_LABELS].offset;
+    std::string err = s.load_error([&](SavedIndex &x) { x.bytes[off + 3] ^= 0x01; }, false);
+    CHECK(contains(err, "Checksum incorrecto en la sección labels"));
+}
+
+void test_rejects_corrupted_header() {
+    SavedIndex s;
+    std::string err = s.load_error([](SavedIndex &x) { x.header().m += 1; }, false);
+    CHECK(contains(err, "Checksum de cabecera"));
+    // Sin la firma se intenta como saveIndex de hnswlib, que también lo rechaza
+    s.load_error([](SavedIndex &x) { x.bytes[0] = 'X'; }, false);
+}
+
+void test_rejects_other_version() {
+    SavedIndex s;
+    std::string err = s.load_error([](SavedIndex &x) { x.header().version = 1; }, true);
+    CHECK(contains(err, "Versión 1"));
+}
+
+void test_rejects_truncated() {
+    SavedIndex s;
+    std::string err = s.load_error([](SavedIndex &x) { x.bytes.resize(x.bytes.size() - 64); }, false);
+    CHECK(contains(err, "truncado"));
+}
+
+// Cabeceras con CRC válido pero tamaños incoherentes: deben rechazarse
+// antes de leer fuera del mapeo
+void test_rejects_inconsistent_geometry() {
+    SavedIndex s;
+    auto sec = [](SavedIndex &x, uint32_t id) -> mapped_index::Section & { return x.header().sections[id]; };
+    CHECK(contains(s.load_error([](SavedIndex &x) { x.header().count += 1; }, true), "inválid"));
+    CHECK(contains(s.load_error([&](SavedIndex &x) { sec(x, mapped_index::SEC_LEVEL0).bytes -= 8; }, true),
+                   "Sección inválida: level0"));
+    CHECK(contains(s.load_error([&](SavedIndex &x) { sec(x, mapped_index::SEC_LABELS).offset = uint64_t(1) << 60; },
+                                true),
+                   "Sección inválida: labels"));
+    CHECK(contains(s.load_error([](SavedIndex &x) { x.header().entry_point = uint32_t(N); }, true), "incoherentes"));
+    CHECK(contains(s.load_error([](SavedIndex &x) { x.header().max_m0 = 1u << 20; }, true), "incoherentes"));
+}
+
+}  // namespace
+
+int main() {
+    return run_tests("index_io", {
+        {"mapped_round_trip", test_mapped_round_trip},
+        {"load_with_capacity", test_load_with_capacity},
+        {"legacy_format", test_legacy_format},
+        {"rejects_corrupted_section", test_rejects_corrupted_section},
+        {"rejects_corrupted_labels", test_rejects_corrupted_labels},
+        {"rejects_corrupted_header", test_rejects_corrupted_header},
+        {"rejects_other_version", test_rejects_other_version},
+        {"rejects_truncated", test_rejects_truncated},
+        {"rejects_inconsistent_geometry", test_rejects_inconsistent_geometry},
+    });
+}
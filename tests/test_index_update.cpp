@@ -0,0 +1,144 @@
+#include "../includes/index_io.hpp"
+#include "../includes/index_update.hpp"
+#include "test_index.hpp"
+#include <string>
+#include <vector>
+
+// Tombstones, reparación de vecindarios y compactación (hnsw_update): los
+// borrados desaparecen de los resultados y del archivo compactado, y el
+// recall sobre los puntos vivos no cae respecto al del índice original.
+
+using namespace testing;
+
+namespace {
+
+const int DIM = 16;
+const size_t N = 3000;
+const size_t K = 10;
+const size_t EF = 64;
+
+// Se borra una fila de cada 10 (300 de 3000, más que el refresco nocturno)
+bool deleted_row(size_t i) { return i % 10 == 3; }
+
+struct Fixture {
+    std::vector<float> data = random_vectors(N, DIM, 201);
+    std::vector<float> queries = random_vectors(200, DIM, 203);
+    SimdSpace space{Metric::L2, DIM};
+    std::unique_ptr<Index> index = build_index(space, data, DIM);
+    std::vector<uint64_t> tombstones;
+    std::vector<bool> all = std::vector<bool>(N, true);
+    std::vector<bool> live = std::vector<bool>(N, true);
+
+    Fixture() {
+        index->setEf(EF);
+        for (size_t i = 0; i < N; i++) {
+            if (!deleted_row(i)) continue;
+            tombstones.push_back(label_of(i));
+            live[i] = false;
+        }
+    }
+};
+
+bool is_tombstone(uint64_t label) { return label >= label_of(0) && deleted_row(label - label_of(0)); }
+
+void test_tombstones_hide_results() {
+    Fixture f;
+    std::vector<uint64_t> labels = f.tombstones;
+    labels.push_back(label_of(N + 5));  // no existe
+    CHECK(IndexMaintenance::apply_tombstones(*f.index, labels.data(), labels.size()) == 1);
+    CHECK(f.index->getDeletedCount() == f.tombstones.size());
+    // Aplicar otra vez no cuenta doble
+    IndexMaintenance::apply_tombstones(*f.index, f.tombstones.data(), f.tombstones.size());
+    CHECK(f.index->getDeletedCount() == f.tombstones.size());
+    for (size_t q = 0; q < f.queries.size() / DIM; q++)
+        for (uint64_t l : search_labels(*f.index, &f.queries[q * DIM], K)) CHECK(!is_tombstone(l));
+}
+
+void test_compaction_keeps_recall() {
+    Fixture f;
+    auto truth_all = exact_knn(Metric::L2, f.data, f.queries, DIM, K, f.all);
+    auto truth_live = exact_knn(Metric::L2, f.data, f.queries, DIM, K, f.live);
+    double before = recall(*f.index, f.queries, DIM, truth_all, K);
+
+    IndexMaintenance::apply_tombstones(*f.index, f.tombstones.data(), f.tombstones.size());
+    CompactionReport report = IndexMaintenance::repair_deleted(*f.index, 2);
+    CHECK(report.deleted == f.tombstones.size());
+    CHECK(report.live == N - f.tombstones.size());
+    CHECK(report.repaired_lists > 0);
+
+    TempFile file("test_index_update_compacted.bin");
+    auto image = IndexMaintenance::compacted_image(*f.index);
+    CHECK(image.header.count == report.live);
+    CHECK(!image.any_deleted());
+    index_io::save(image, file.path());
+
+    auto compacted = index_io::load(&f.space, file.path());
+    compacted->setEf(EF);
+    CHECK(compacted->cur_element_count == report.live);
+    CHECK(compacted->getDeletedCount() == 0);
+    for (size_t i = 0; i < N; i++) {
+        bool present = compacted->label_lookup_.count(label_of(i)) > 0;
+        CHECK(present == f.live[i]);
+    }
+    // Los vectores viajan con su label al renumerar
+    for (size_t i = 0; i < N; i += 101) {
+        if (!f.live[i]) continue;
+        std::vector<float> v = compacted->getDataByLabel<float>(label_of(i));
+        CHECK(std::equal(v.begin(), v.end(), f.data.begin() + i * DIM));
+    }
+
+    double after = recall(*compacted, f.queries, DIM, truth_live, K);
+    std::cout << "  recall@" << K << " antes " << before << ", compactado " << after << "\n";
+    CHECK(after >= before - 0.01);
+}
+
+// Punto de entrada borrado: la compactación elige otro nodo vivo
+void test_compaction_moves_entry_point() {
+    Fixture f;
+    uint64_t ep_label = f.index->getExternalLabel(f.index->enterpoint_node_);
+    IndexMaintenance::apply_tombstones(*f.index, &ep_label, 1);
+    IndexMaintenance::repair_deleted(*f.index, 1);
+    auto image = IndexMaintenance::compacted_image(*f.index);
+    CHECK(image.header.count == N - 1);
+    CHECK(image.header.entry_point < image.header.count);
+    CHECK(image.header.max_level == int32_t(image.levels[image.header.entry_point]));
+
+    TempFile file("test_index_update_entry.bin");
+    index_io::save(image, file.path());
+    auto compacted = index_io::load(&f.space, file.path());
+    CHECK(compacted->label_lookup_.count(ep_label) == 0);
+    compacted->setEf(EF);
+    for (size_t i = 0; i < N; i += 150) {
+        if (label_of(i) == ep_label) continue;
+        CHECK(search_labels(*compacted, &f.data[i * DIM], 1)[0] == label_of(i));
+    }
+}
+
+// Append: se carga con capacidad extra, se inserta el delta y los puntos
+// nuevos se encuentran a sí mismos
+void test_append_delta() {
+    Fixture f;
+    TempFile file("test_index_update_append.bin");
+    index_io::save(*f.index, file.path());
+    const size_t delta = 60;
+    auto extra = random_vectors(delta, DIM, 207);
+    auto grown = index_io::load(&f.space, file.path(), N + delta);
+    for (size_t i = 0; i < delta; i++) grown->addPoint(&extra[i * DIM], label_of(N + i));
+    CHECK(grown->cur_element_count == N + delta);
+    grown->setEf(EF);
+    size_t found = 0;
+    for (size_t i = 0; i < delta; i++)
+        found += search_labels(*grown, &extra[i * DIM], 1)[0] == label_of(N + i);
+    CHECK(found >= delta - 1);
+}
+
+}  // namespace
+
+int main() {
+    return run_tests("index_update", {
+        {"tombstones_hide_results", test_tombstones_hide_results},
+        {"compaction_keeps_recall", test_compaction_keeps_recall},
+        {"compaction_moves_entry_point", test_compaction_moves_entry_point},
+        {"append_delta", test_append_delta},
+    });
+}
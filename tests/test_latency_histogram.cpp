@@ -0,0 +1,125 @@
+#include "../includes/latency_histogram.hpp"
+#include "test_common.hpp"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Percentiles del histograma log-lineal contra los de la muestra ordenada:
+// el bucket de 128 sub-buckets por octava acota el error relativo en
+// 1/128 = 0.78 %.
+
+namespace {
+
+const double MAX_RELATIVE_ERROR = 1.0 / 128.0;
+const double QUANTILES[] = {0.0, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.95, 0.99, 0.999, 1.0};
+
+// Mismo criterio de rango que percentile_ns: el valor de posición
+// max(1, round(q * n)) en la muestra ordenada
+uint64_t exact_percentile(const std::vector<uint64_t> &sorted, double q) {
+    size_t rank = std::max<size_t>(1, size_t(q * sorted.size() + 0.5));
+    return sorted[std::min(rank, sorted.size()) - 1];
+}
+
+void check_against_sorted(std::vector<uint64_t> values) {
+    LatencyHistogram h;
+    for (uint64_t v : values) h.record(v);
+    std::sort(values.begin(), values.end());
+    CHECK(h.count() == values.size());
+    CHECK(h.min_ns() == values.front());
+    CHECK(h.max_ns() == values.back());
+    for (double q : QUANTILES) {
+        double exact = double(exact_percentile(values, q));
+        double got = double(h.percentile_ns(q));
+        // El histograma devuelve el extremo superior del bucket: nunca por debajo
+        CHECK(got >= exact);
+        CHECK_NEAR(got, exact, exact * MAX_RELATIVE_ERROR);
+    }
+}
+
+void test_exact_below_256ns() {
+    std::vector<uint64_t> v;
+    for (uint64_t i = 0; i < 256; i++) v.push_back(i);
+    LatencyHistogram h;
+    for (uint64_t x : v) h.record(x);
+    for (double q : QUANTILES) CHECK(h.percentile_ns(q) == exact_percentile(v, q));
+}
+
+void test_uniform() {
+    std::mt19937_64 rng(1);
+    std::uniform_int_distribution<uint64_t> u(1000, 5000000);
+    std::vector<uint64_t> v(200000);
+    for (auto &x : v) x = u(rng);
+    check_against_sorted(v);
+}
+
+// Cola larga como la de las latencias reales: lognormal de varias décadas
+void test_lognormal() {
+    std::mt19937_64 rng(2);
+    std::lognormal_distribution<double> d(12.0, 1.5);
+    std::vector<uint64_t> v(200000);
+    for (auto &x : v) x = uint64_t(d(rng));
+    check_against_sorted(v);
+}
+
+// Valores en los bordes de cada octava, donde cambia el ancho del bucket
+void test_octave_edges() {
+    std::vector<uint64_t> v;
+    for (int e = 8; e < 40; e++) {
+        uint64_t p = uint64_t(1) << e;
+        v.push_back(p - 1);
+        v.push_back(p);
+        v.push_back(p + 1);
+    }
+    check_against_sorted(v);
+}
+
+void test_merge_matches_single() {
+    std::mt19937_64 rng(3);
+    std::exponential_distribution<double> d(1.0 / 250000.0);
+    LatencyHistogram all;
+    std::vector<LatencyHistogram> parts(4);
+    for (size_t i = 0; i < 40000; i++) {
+        uint64_t x = uint64_t(d(rng));
+        all.record(x);
+        parts[i % 4].record(x);
+    }
+    LatencyHistogram merged;
+    for (const auto &p : parts) merged.merge(p);
+    CHECK(merged.count() == all.count());
+    CHECK(merged.min_ns() == all.min_ns());
+    CHECK(merged.max_ns() == all.max_ns());
+    CHECK_NEAR(merged.mean_ns(), all.mean_ns(), 1e-9 * all.mean_ns());
+    for (double q : QUANTILES) CHECK(merged.percentile_ns(q) == all.percentile_ns(q));
+}
+
+void test_delta_since() {
+    LatencyHistogram h;
+    for (uint64_t i = 1; i <= 1000; i++) h.record(i * 1000);
+    LatencyHistogram before = h;
+    for (uint64_t i = 1; i <= 500; i++) h.record(10000000 + i);
+    LatencyHistogram d = h.delta_since(before);
+    CHECK(d.count() == 500);
+    CHECK_NEAR(double(d.percentile_ns(0.5)), 10000250.0, 10000250.0 * MAX_RELATIVE_ERROR);
+}
+
+void test_empty() {
+    LatencyHistogram h;
+    CHECK(h.count() == 0);
+    CHECK(h.percentile_ns(0.99) == 0);
+    CHECK(h.mean_ms() == 0.0);
+    CHECK(h.min_ns() == 0);
+}
+
+}  // namespace
+
+int main() {
+    return testing::run_tests("latency_histogram", {
+        {"exact_below_256ns", test_exact_below_256ns},
+        {"uniform", test_uniform},
+        {"lognormal", test_lognormal},
+        {"octave_edges", test_octave_edges},
+        {"merge_matches_single", test_merge_matches_single},
+        {"delta_since", test_delta_since},
+        {"empty", test_empty},
+    });
+}
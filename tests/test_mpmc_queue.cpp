@@ -0,0 +1,82 @@
+#include "../includes/mpmc_queue.hpp"
+#include "test_common.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Cola MPMC de hnsw_server: semántica de llena/vacía con un solo hilo y,
+// con varios productores y consumidores, cada elemento se entrega
+// exactamente una vez.
+
+namespace {
+
+void test_capacity_rounds_to_power_of_two() {
+    CHECK(MpmcQueue<int>(1).capacity() == 2);
+    CHECK(MpmcQueue<int>(5).capacity() == 8);
+    CHECK(MpmcQueue<int>(64).capacity() == 64);
+}
+
+void test_full_and_empty() {
+    MpmcQueue<int> q(4);
+    int out = -1;
+    CHECK(!q.try_pop(out));
+    for (int i = 0; i < 4; i++) CHECK(q.try_push(i));
+    CHECK(!q.try_push(99));
+    CHECK(q.size_approx() == 4);
+    // FIFO, y el anillo se reutiliza al vaciarse
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 4; i++) {
+            CHECK(q.try_pop(out));
+            CHECK(out == round * 4 + i);
+        }
+        CHECK(!q.try_pop(out));
+        for (int i = 0; i < 4; i++) CHECK(q.try_push((round + 1) * 4 + i));
+    }
+}
+
+void test_each_item_delivered_once() {
+    const int producers = 4, consumers = 4;
+    const size_t per_producer = 50000;
+    const size_t total = producers * per_producer;
+    MpmcQueue<size_t> q(256);
+    std::vector<std::atomic<int>> seen(total);
+    for (auto &s : seen) s.store(0);
+    std::atomic<size_t> popped{0};
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+        threads.emplace_back([&, p] {
+            for (size_t i = 0; i < per_producer; i++) {
+                size_t v = p * per_producer + i;
+                while (!q.try_push(v)) std::this_thread::yield();
+            }
+        });
+    for (int c = 0; c < consumers; c++)
+        threads.emplace_back([&] {
+            size_t v;
+            while (popped.load() < total) {
+                if (q.try_pop(v)) {
+                    seen[v].fetch_add(1);
+                    popped.fetch_add(1);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    for (auto &t : threads) t.join();
+
+    CHECK(popped.load() == total);
+    for (size_t i = 0; i < total; i++) CHECK(seen[i].load() == 1);
+    size_t v;
+    CHECK(!q.try_pop(v));
+}
+
+}  // namespace
+
+int main() {
+    return testing::run_tests("mpmc_queue", {
+        {"capacity_rounds_to_power_of_two", test_capacity_rounds_to_power_of_two},
+        {"full_and_empty", test_full_and_empty},
+        {"each_item_delivered_once", test_each_item_delivered_once},
+    });
+}